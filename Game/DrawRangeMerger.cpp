@@ -0,0 +1,72 @@
+//
+// DrawRangeMerger.cpp
+//
+
+#include "pch.h"
+#include "DrawRangeMerger.h"
+
+DrawRangeMerger::DrawRangeMerger()
+    : m_addedCount(0)
+    , m_sorted(true)
+{
+}
+
+void DrawRangeMerger::Clear()
+{
+    // Keep the memory of the ranges for the next frame.
+    m_ranges.clear();
+    m_addedCount = 0;
+    m_sorted = true;
+}
+
+void DrawRangeMerger::Add(uint32 firstIndex, uint32 indexCount)
+{
+    if (indexCount == 0)
+        return;
+
+    m_addedCount++;
+
+    if (!m_ranges.empty())
+    {
+        Range& last = m_ranges.back();
+
+        // A range that starts where the last one ends is joined right away, the trees add their leaves in buffer order.
+        if (last.firstIndex + last.indexCount == firstIndex)
+        {
+            last.indexCount += indexCount;
+            return;
+        }
+
+        if (firstIndex < last.firstIndex + last.indexCount)
+            m_sorted = false;
+    }
+
+    m_ranges.push_back({ firstIndex, indexCount });
+}
+
+void DrawRangeMerger::Merge()
+{
+    if (m_ranges.empty())
+        return;
+
+    if (!m_sorted)
+    {
+        std::sort(m_ranges.begin(), m_ranges.end(), [](Range const& a, Range const& b) { return a.firstIndex < b.firstIndex; });
+        m_sorted = true;
+    }
+
+    // Join every range into the one before it if they touch, overlapping ranges are only drawn once.
+    size_t count = 1;
+    for (size_t i = 1; i < m_ranges.size(); ++i)
+    {
+        Range& last = m_ranges[count - 1];
+        uint32 const lastEnd = last.firstIndex + last.indexCount;
+
+        if (m_ranges[i].firstIndex <= lastEnd)
+            last.indexCount = std::max(lastEnd, m_ranges[i].firstIndex + m_ranges[i].indexCount) - last.firstIndex;
+        else
+            m_ranges[count++] = m_ranges[i];
+    }
+
+    m_ranges.resize(count);
+}
\ No newline at end of file
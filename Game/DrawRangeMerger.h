@@ -0,0 +1,34 @@
+//
+// DrawRangeMerger.h
+//
+
+#pragma once
+
+// Collects the index ranges of the visible parts of a shared index buffer and joins the ranges that follow each
+// other, so they are drawn with as few DrawIndexed calls as possible. It knows nothing about the device.
+class DrawRangeMerger
+{
+    public:
+        struct Range
+        {
+            uint32 firstIndex;
+            uint32 indexCount;
+        };
+
+    public:
+        DrawRangeMerger();
+
+        void Clear();
+        void Add(uint32 firstIndex, uint32 indexCount);
+
+        // Sorts the ranges if they weren't added in order and joins the ones that touch or overlap.
+        void Merge();
+
+        std::vector<Range> const& GetRanges() const { return m_ranges; }
+        uint32 GetAddedCount() const { return m_addedCount; }
+
+    private:
+        std::vector<Range> m_ranges;
+        uint32 m_addedCount;
+        bool m_sorted;
+};
\ No newline at end of file
@@ -169,6 +169,188 @@ bool Frustum::CheckRectangle(float minWidth, float minHeight, float minDepth, fl
     return true;
 }
 
+Frustum::Visibility Frustum::ClassifyRectangle(float minWidth, float minHeight, float minDepth, float maxWidth, float maxHeight, float maxDepth,
+    uint32& planeMask, int& testCount) const
+{
+    float positive, negative;
+
+    for (uint32 i = 0; i < TOTAL_PLANES; ++i)
+    {
+        // Skip the planes a parent box was already completely inside of.
+        if ((planeMask & (1u << i)) == 0)
+            continue;
+
+        XMFLOAT4 const& plane = m_planeNormals[i];
+        testCount++;
+
+        // Distance of the corner furthest along the plane normal, if it is behind the plane the whole box is.
+        positive = plane.w;
+        positive += plane.x * ((plane.x >= 0.0f) ? maxWidth : minWidth);
+        positive += plane.y * ((plane.y >= 0.0f) ? maxHeight : minHeight);
+        positive += plane.z * ((plane.z >= 0.0f) ? maxDepth : minDepth);
+
+        if (positive < 0.0f)
+            return Visibility::OUTSIDE;
+
+        // Distance of the opposite corner, if it is in front of the plane the whole box is.
+        negative = plane.w;
+        negative += plane.x * ((plane.x >= 0.0f) ? minWidth : maxWidth);
+        negative += plane.y * ((plane.y >= 0.0f) ? minHeight : maxHeight);
+        negative += plane.z * ((plane.z >= 0.0f) ? minDepth : maxDepth);
+
+        if (negative >= 0.0f)
+            planeMask &= ~(1u << i);
+    }
+
+    return (planeMask == 0) ? Visibility::INSIDE : Visibility::INTERSECT;
+}
+
+void Frustum::CheckRectangles(float const* minX, float const* minY, float const* minZ,
+    float const* maxX, float const* maxY, float const* maxZ, uint32 count, uint32* visibleMask)
+{
+    float const* source[6] = { minX, minY, minZ, maxX, maxY, maxZ };
+    XMFLOAT4 lanes[6];
+    uint32 positiveX[TOTAL_PLANES], positiveY[TOTAL_PLANES], positiveZ[TOTAL_PLANES];
+    XMVECTOR planeX[TOTAL_PLANES], planeY[TOTAL_PLANES], planeZ[TOTAL_PLANES], planeW[TOTAL_PLANES];
+    uint32 i, j, plane, remaining, mask;
+
+    memset(visibleMask, 0, sizeof(uint32) * ((count + 31) / 32));
+
+    for (plane = 0; plane < TOTAL_PLANES; ++plane)
+    {
+        XMFLOAT4 const& normal = m_planeNormals[plane];
+
+        // The corner of a box that is furthest along the plane normal decides if the box is on the inside of the plane,
+        // which is the same as checking all eight corners like CheckRectangle does.
+        positiveX[plane] = (normal.x >= 0.0f) ? 3 : 0;
+        positiveY[plane] = (normal.y >= 0.0f) ? 4 : 1;
+        positiveZ[plane] = (normal.z >= 0.0f) ? 5 : 2;
+
+        planeX[plane] = XMVectorReplicate(normal.x);
+        planeY[plane] = XMVectorReplicate(normal.y);
+        planeZ[plane] = XMVectorReplicate(normal.z);
+        planeW[plane] = XMVectorReplicate(normal.w);
+    }
+
+    // Test four boxes against all six planes per iteration.
+    for (i = 0; i < count; i += 4)
+    {
+        remaining = std::min(count - i, 4u);
+
+        // Copy the last boxes into a padded block so the loads don't read past the end of the arrays.
+        if (remaining < 4)
+        {
+            for (j = 0; j < 6; ++j)
+            {
+                float* lane = &lanes[j].x;
+                for (uint32 k = 0; k < 4; ++k)
+                    lane[k] = source[j][i + std::min(k, remaining - 1)];
+            }
+        }
+
+        XMVECTOR visible = XMVectorTrueInt();
+        for (plane = 0; plane < TOTAL_PLANES; ++plane)
+        {
+            XMVECTOR x, y, z;
+            if (remaining < 4)
+            {
+                x = XMLoadFloat4(&lanes[positiveX[plane]]);
+                y = XMLoadFloat4(&lanes[positiveY[plane]]);
+                z = XMLoadFloat4(&lanes[positiveZ[plane]]);
+            }
+            else
+            {
+                x = XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(source[positiveX[plane]] + i));
+                y = XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(source[positiveY[plane]] + i));
+                z = XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(source[positiveZ[plane]] + i));
+            }
+
+            XMVECTOR distance = XMVectorMultiplyAdd(planeX[plane], x, planeW[plane]);
+            distance = XMVectorMultiplyAdd(planeY[plane], y, distance);
+            distance = XMVectorMultiplyAdd(planeZ[plane], z, distance);
+
+            visible = XMVectorAndInt(visible, XMVectorGreaterOrEqual(distance, XMVectorZero()));
+        }
+
+        mask = MoveMask(visible) & ((1u << remaining) - 1u);
+        visibleMask[i / 32] |= mask << (i % 32);
+    }
+}
+
+void Frustum::CheckSpheres(float const* centerX, float const* centerY, float const* centerZ,
+    float const* radius, uint32 count, uint32* visibleMask)
+{
+    float const* source[4] = { centerX, centerY, centerZ, radius };
+    XMFLOAT4 lanes[4];
+    XMVECTOR planeX[TOTAL_PLANES], planeY[TOTAL_PLANES], planeZ[TOTAL_PLANES], planeW[TOTAL_PLANES];
+    XMVECTOR x, y, z, r;
+    uint32 i, j, plane, remaining, mask;
+
+    memset(visibleMask, 0, sizeof(uint32) * ((count + 31) / 32));
+
+    for (plane = 0; plane < TOTAL_PLANES; ++plane)
+    {
+        planeX[plane] = XMVectorReplicate(m_planeNormals[plane].x);
+        planeY[plane] = XMVectorReplicate(m_planeNormals[plane].y);
+        planeZ[plane] = XMVectorReplicate(m_planeNormals[plane].z);
+        planeW[plane] = XMVectorReplicate(m_planeNormals[plane].w);
+    }
+
+    // Test four spheres against all six planes per iteration.
+    for (i = 0; i < count; i += 4)
+    {
+        remaining = std::min(count - i, 4u);
+
+        if (remaining < 4)
+        {
+            // Copy the last spheres into a padded block so the loads don't read past the end of the arrays.
+            for (j = 0; j < 4; ++j)
+            {
+                float* lane = &lanes[j].x;
+                for (uint32 k = 0; k < 4; ++k)
+                    lane[k] = source[j][i + std::min(k, remaining - 1)];
+            }
+
+            x = XMLoadFloat4(&lanes[0]);
+            y = XMLoadFloat4(&lanes[1]);
+            z = XMLoadFloat4(&lanes[2]);
+            r = XMLoadFloat4(&lanes[3]);
+        }
+        else
+        {
+            x = XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(centerX + i));
+            y = XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(centerY + i));
+            z = XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(centerZ + i));
+            r = XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(radius + i));
+        }
+
+        XMVECTOR visible = XMVectorTrueInt();
+        for (plane = 0; plane < TOTAL_PLANES; ++plane)
+        {
+            XMVECTOR distance = XMVectorMultiplyAdd(planeX[plane], x, planeW[plane]);
+            distance = XMVectorMultiplyAdd(planeY[plane], y, distance);
+            distance = XMVectorMultiplyAdd(planeZ[plane], z, distance);
+
+            // A sphere is outside when its center is further than the radius behind the plane.
+            visible = XMVectorAndInt(visible, XMVectorGreater(distance, XMVectorNegate(r)));
+        }
+
+        mask = MoveMask(visible) & ((1u << remaining) - 1u);
+        visibleMask[i / 32] |= mask << (i % 32);
+    }
+}
+
+uint32 Frustum::MoveMask(DirectX::FXMVECTOR comparison)
+{
+#if defined(_XM_SSE_INTRINSICS_)
+    return static_cast<uint32>(_mm_movemask_ps(comparison));
+#else
+    XMUINT4 lanes;
+    XMStoreUInt4(&lanes, comparison);
+    return (lanes.x & 1u) | ((lanes.y & 1u) << 1) | ((lanes.z & 1u) << 2) | ((lanes.w & 1u) << 3);
+#endif
+}
+
 float Frustum::PlaneDotCoord(DirectX::XMFLOAT4 const& plane, DirectX::XMFLOAT3 const& point)
 {
     DirectX::XMVECTOR p = DirectX::XMLoadFloat4(&plane);
@@ -18,6 +18,16 @@ class Frustum
             TOTAL_PLANES
         };
 
+        enum class Visibility
+        {
+            OUTSIDE,
+            INTERSECT,
+            INSIDE
+        };
+
+        // Bit i of a plane mask is set while plane i still has to be tested.
+        static constexpr uint32 const ALL_PLANES = (1u << TOTAL_PLANES) - 1u;
+
         Frustum() = default;
         Frustum(Frustum const&) = delete;
         Frustum& operator=(Frustum const&) = delete;
@@ -31,6 +41,18 @@ class Frustum
 
         bool CheckRectangle(float minWidth, float minHeight, float minDepth, float maxWidth, float maxHeight, float maxDepth);
 
+        // Classifies a box against the planes in planeMask and clears the bits of the planes the box is completely inside of,
+        // children of the box only have to test the planes that are left. testCount is increased by the number of planes tested.
+        Visibility ClassifyRectangle(float minWidth, float minHeight, float minDepth, float maxWidth, float maxHeight, float maxDepth,
+            uint32& planeMask, int& testCount) const;
+
+        // Batch versions of CheckRectangle and CheckSphere, the volumes are passed as one array per component.
+        // Bit (i % 32) of visibleMask[i / 32] is set when volume i is visible, the mask needs (count + 31) / 32 words.
+        void CheckRectangles(float const* minX, float const* minY, float const* minZ,
+            float const* maxX, float const* maxY, float const* maxZ, uint32 count, uint32* visibleMask);
+        void CheckSpheres(float const* centerX, float const* centerY, float const* centerZ,
+            float const* radius, uint32 count, uint32* visibleMask);
+
 
         DirectX::XMFLOAT4 const& GetPlane(Plane id)     { return m_planeNormals[id];           }
 
@@ -43,6 +65,7 @@ class Frustum
 
     private:
         float PlaneDotCoord(DirectX::XMFLOAT4 const& plane, DirectX::XMFLOAT3 const& point);
+        static uint32 MoveMask(DirectX::FXMVECTOR comparison);
 
     private:
         DirectX::XMFLOAT4 m_planeNormals[TOTAL_PLANES];
@@ -0,0 +1,425 @@
+//
+// MD5Animator.cpp
+//
+
+#include "pch.h"
+#include "MD5Animator.h"
+
+using namespace axec;
+using namespace DirectX;
+
+namespace
+{
+    // Normalized lerp towards b on the shorter arc. Close enough to a slerp for the small angles between frames
+    // and blended poses, and it stays in the SIMD registers.
+    XMVECTOR BlendOrientation(FXMVECTOR a, FXMVECTOR b, float weight)
+    {
+        XMVECTOR const sameHemisphere = XMVectorGreaterOrEqual(XMVector4Dot(a, b), XMVectorZero());
+        XMVECTOR const target = XMVectorSelect(XMVectorNegate(b), b, sameHemisphere);
+
+        return XMQuaternionNormalize(XMVectorLerp(a, target, weight));
+    }
+}
+
+
+MD5Animator::MD5Animator()
+{
+    model = nullptr;
+    jointCount = 0;
+
+    for (Layer& layer : layers)
+    {
+        layer.current.clipCount = 0;
+        layer.current.finished = false;
+        layer.previous.clipCount = 0;
+        layer.previous.finished = false;
+        layer.fadeTime = 0.0f;
+        layer.fadeElapsed = 0.0f;
+        layer.weight = 1.0f;
+        layer.mode = LayerMode::OVERRIDE;
+        layer.masked = false;
+    }
+}
+
+void MD5Animator::Initialize(md5_model_t const& model)
+{
+    this->model = &model;
+    jointCount = static_cast<int>(model.joints.size());
+
+    parents.resize(jointCount);
+    bindPose.resize(jointCount);
+
+    // The bind pose is in model space, turn it into joint space once. It is what the first layer blends from.
+    for (int i = 0; i < jointCount; ++i)
+    {
+        Joint const& joint = model.joints[i];
+        parents[i] = joint.parentId;
+
+        XMVECTOR orientation = XMLoadFloat4(&joint.orientation);
+        XMVECTOR position = XMLoadFloat3(&joint.position);
+
+        if (joint.parentId >= 0)
+        {
+            Joint const& parent = model.joints[joint.parentId];
+            XMVECTOR const parentOrientation = XMLoadFloat4(&parent.orientation);
+
+            position = XMVector3Rotate(XMVectorSubtract(position, XMLoadFloat3(&parent.position)), parentOrientation);
+            orientation = XMQuaternionNormalize(XMQuaternionMultiply(XMQuaternionInverse(parentOrientation), orientation));
+        }
+
+        XMStoreFloat4A(&bindPose[i].orientation, orientation);
+        XMStoreFloat4A(&bindPose[i].position, position);
+    }
+
+    resultPose.resize(jointCount);
+    layerPose.resize(jointCount);
+    fadePose.resize(jointCount);
+    referencePose.resize(jointCount);
+    samplePose.resize(jointCount);
+
+    for (Layer& layer : layers)
+        layer.mask.assign(jointCount, 1.0f);
+}
+
+bool MD5Animator::Play(int layer, md5_anim_t const* clip, float fadeTime, bool loop)
+{
+    float const weight = 1.0f;
+    return PlayBlend(layer, &clip, &weight, 1, fadeTime, loop);
+}
+
+bool MD5Animator::PlayBlend(int layer, md5_anim_t const* const* clips, float const* weights, int clipCount, float fadeTime, bool loop)
+{
+    if (layer < 0 || layer >= MAX_LAYERS || clipCount <= 0 || clipCount > MAX_BLEND_CLIPS)
+        return false;
+
+    // The clips are sampled joint by joint into the pose buffers, they have to be made for this skeleton.
+    for (int i = 0; i < clipCount; ++i)
+    {
+        if (clips[i] == nullptr || clips[i]->numJoints != jointCount || clips[i]->numFrames <= 0)
+            return false;
+    }
+
+    Stop(layer, fadeTime);
+
+    BlendState& state = layers[layer].current;
+    for (int i = 0; i < clipCount; ++i)
+    {
+        state.clips[i] = clips[i];
+        state.weights[i] = weights[i];
+    }
+
+    state.clipCount = clipCount;
+    state.phase = 0.0f;
+    state.loop = loop;
+    state.finished = false;
+
+    return true;
+}
+
+void MD5Animator::SetBlendWeights(int layer, float const* weights, int clipCount)
+{
+    BlendState& state = layers[layer].current;
+
+    for (int i = 0; i < clipCount && i < state.clipCount; ++i)
+        state.weights[i] = weights[i];
+}
+
+void MD5Animator::Stop(int layer, float fadeTime)
+{
+    Layer& target = layers[layer];
+
+    if (fadeTime <= 0.0f)
+    {
+        target.previous.clipCount = 0;
+        target.fadeTime = 0.0f;
+    }
+    else if (target.current.clipCount > 0)
+    {
+        // Whatever plays now fades out, a fade that is still running is cut short.
+        target.previous = target.current;
+        target.fadeTime = fadeTime;
+        target.fadeElapsed = 0.0f;
+    }
+    else if (target.fadeTime <= 0.0f)
+    {
+        // Nothing plays, the next state fades in from the layers below.
+        target.previous.clipCount = 0;
+        target.fadeTime = fadeTime;
+        target.fadeElapsed = 0.0f;
+    }
+
+    target.current.clipCount = 0;
+    target.current.finished = false;
+}
+
+void MD5Animator::SetLayerWeight(int layer, float weight)
+{
+    layers[layer].weight = weight;
+}
+
+void MD5Animator::SetLayerMode(int layer, LayerMode mode)
+{
+    layers[layer].mode = mode;
+}
+
+void MD5Animator::SetLayerMask(int layer, float const* jointWeights)
+{
+    Layer& target = layers[layer];
+    target.masked = jointWeights != nullptr;
+
+    if (target.masked)
+        std::copy(jointWeights, jointWeights + jointCount, target.mask.begin());
+}
+
+void MD5Animator::BuildJointMask(int rootJoint, float weight, float* jointWeights) const
+{
+    // The parents come before their children, so one pass marks the whole hierarchy below the root.
+    for (int i = 0; i < jointCount; ++i)
+    {
+        bool const inHierarchy = i == rootJoint || (parents[i] >= 0 && jointWeights[parents[i]] != 0.0f);
+        jointWeights[i] = inHierarchy ? weight : 0.0f;
+    }
+}
+
+int MD5Animator::FindJoint(std::wstring const& name) const
+{
+    for (int i = 0; i < jointCount; ++i)
+    {
+        if (model->joints[i].name == name)
+            return i;
+    }
+
+    return -1;
+}
+
+void MD5Animator::Update(float deltaTime)
+{
+    for (Layer& layer : layers)
+    {
+        AdvanceState(layer.current, deltaTime);
+
+        if (layer.fadeTime <= 0.0f)
+            continue;
+
+        AdvanceState(layer.previous, deltaTime);
+
+        layer.fadeElapsed += deltaTime;
+        if (layer.fadeElapsed >= layer.fadeTime)
+        {
+            layer.previous.clipCount = 0;
+            layer.fadeTime = 0.0f;
+        }
+    }
+}
+
+void MD5Animator::Evaluate(JointPose* pose)
+{
+    std::copy(bindPose.begin(), bindPose.end(), resultPose.begin());
+
+    for (Layer const& layer : layers)
+    {
+        float const fade = layer.fadeTime > 0.0f ? std::min(layer.fadeElapsed / layer.fadeTime, 1.0f) : 1.0f;
+        float const currentWeight = layer.current.clipCount > 0 ? fade : 0.0f;
+        float const previousWeight = layer.fadeTime > 0.0f && layer.previous.clipCount > 0 ? 1.0f - fade : 0.0f;
+
+        if (layer.weight <= 0.0f || (currentWeight <= 0.0f && previousWeight <= 0.0f))
+            continue;
+
+        float const* mask = layer.masked ? layer.mask.data() : nullptr;
+
+        if (layer.mode == LayerMode::ADDITIVE)
+        {
+            // Every state adds its difference to its first frame, the fading one with what is left of the fade.
+            if (currentWeight > 0.0f)
+            {
+                EvaluateState(layer.current, false, layerPose.data());
+                EvaluateState(layer.current, true, referencePose.data());
+                AddPoses(resultPose.data(), layerPose.data(), referencePose.data(), layer.weight * currentWeight, mask, jointCount);
+            }
+
+            if (previousWeight > 0.0f)
+            {
+                EvaluateState(layer.previous, false, layerPose.data());
+                EvaluateState(layer.previous, true, referencePose.data());
+                AddPoses(resultPose.data(), layerPose.data(), referencePose.data(), layer.weight * previousWeight, mask, jointCount);
+            }
+        }
+        else if (currentWeight > 0.0f && previousWeight > 0.0f)
+        {
+            // Crossfade from the previous state to the current one, then blend the mix over the layers below.
+            EvaluateState(layer.previous, false, fadePose.data());
+            EvaluateState(layer.current, false, layerPose.data());
+            BlendPoses(fadePose.data(), layerPose.data(), currentWeight, nullptr, jointCount);
+            BlendPoses(resultPose.data(), fadePose.data(), layer.weight, mask, jointCount);
+        }
+        else
+        {
+            // Fading in from or out to the layers below.
+            BlendState const& state = currentWeight > 0.0f ? layer.current : layer.previous;
+            EvaluateState(state, false, layerPose.data());
+            BlendPoses(resultPose.data(), layerPose.data(), layer.weight * std::max(currentWeight, previousWeight), mask, jointCount);
+        }
+    }
+
+    ComposePose(pose);
+}
+
+void MD5Animator::AdvanceState(BlendState& state, float deltaTime)
+{
+    if (state.clipCount == 0 || state.finished)
+        return;
+
+    // The clips of a blend run in sync, the blend takes as long as the weighted average of the clips.
+    float duration = 0.0f;
+    float totalWeight = 0.0f;
+
+    for (int i = 0; i < state.clipCount; ++i)
+    {
+        duration += state.clips[i]->totalAnimTime * state.weights[i];
+        totalWeight += state.weights[i];
+    }
+
+    if (duration <= 0.0f || totalWeight <= 0.0f)
+        return;
+
+    state.phase += deltaTime * totalWeight / duration;
+
+    if (state.loop)
+    {
+        state.phase -= floorf(state.phase);
+    }
+    else if (state.phase >= 1.0f)
+    {
+        state.phase = 1.0f;
+        state.finished = true;
+    }
+}
+
+void MD5Animator::SampleClip(md5_anim_t const& clip, float time, bool loop, LocalJoint* pose)
+{
+    // Which frames are we between.
+    float const currentFrame = time * clip.frameRate;
+    int frame0 = static_cast<int>(floorf(currentFrame));
+    int frame1 = frame0 + 1;
+    float interpolation = currentFrame - frame0;
+
+    // A looping clip goes from its last frame back to the first one, others stop on the last frame.
+    if (frame0 >= clip.numFrames - 1)
+    {
+        frame0 = clip.numFrames - 1;
+        frame1 = loop ? 0 : frame0;
+        interpolation = loop ? std::min(interpolation, 1.0f) : 0.0f;
+    }
+
+    JointPose const* skeleton0 = &clip.localFrameSkeleton[frame0 * clip.numJoints];
+    JointPose const* skeleton1 = &clip.localFrameSkeleton[frame1 * clip.numJoints];
+
+    for (int i = 0; i < clip.numJoints; ++i)
+    {
+        XMVECTOR const position = XMVectorLerp(XMLoadFloat3(&skeleton0[i].position), XMLoadFloat3(&skeleton1[i].position), interpolation);
+        XMVECTOR const orientation = BlendOrientation(XMLoadFloat4(&skeleton0[i].orientation), XMLoadFloat4(&skeleton1[i].orientation), interpolation);
+
+        XMStoreFloat4A(&pose[i].position, position);
+        XMStoreFloat4A(&pose[i].orientation, orientation);
+    }
+}
+
+void MD5Animator::BlendPoses(LocalJoint* result, LocalJoint const* pose, float weight, float const* mask, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        float const jointWeight = mask != nullptr ? weight * mask[i] : weight;
+
+        if (jointWeight <= 0.0f)
+            continue;
+
+        if (jointWeight >= 1.0f)
+        {
+            result[i] = pose[i];
+            continue;
+        }
+
+        XMVECTOR const position = XMVectorLerp(XMLoadFloat4A(&result[i].position), XMLoadFloat4A(&pose[i].position), jointWeight);
+        XMVECTOR const orientation = BlendOrientation(XMLoadFloat4A(&result[i].orientation), XMLoadFloat4A(&pose[i].orientation), jointWeight);
+
+        XMStoreFloat4A(&result[i].position, position);
+        XMStoreFloat4A(&result[i].orientation, orientation);
+    }
+}
+
+void MD5Animator::AddPoses(LocalJoint* result, LocalJoint const* pose, LocalJoint const* reference, float weight, float const* mask, int count)
+{
+    XMVECTOR const identity = XMQuaternionIdentity();
+
+    for (int i = 0; i < count; ++i)
+    {
+        float const jointWeight = mask != nullptr ? weight * mask[i] : weight;
+
+        if (jointWeight <= 0.0f)
+            continue;
+
+        // The rotation from the reference to the pose, scaled by the weight and applied after the pose below.
+        XMVECTOR const referenceOrientation = XMLoadFloat4A(&reference[i].orientation);
+        XMVECTOR delta = XMQuaternionMultiply(XMLoadFloat4A(&pose[i].orientation), XMQuaternionInverse(referenceOrientation));
+        delta = BlendOrientation(identity, delta, jointWeight);
+
+        XMVECTOR const orientation = XMQuaternionNormalize(XMQuaternionMultiply(delta, XMLoadFloat4A(&result[i].orientation)));
+        XMVECTOR const offset = XMVectorSubtract(XMLoadFloat4A(&pose[i].position), XMLoadFloat4A(&reference[i].position));
+        XMVECTOR const position = XMVectorMultiplyAdd(offset, XMVectorReplicate(jointWeight), XMLoadFloat4A(&result[i].position));
+
+        XMStoreFloat4A(&result[i].position, position);
+        XMStoreFloat4A(&result[i].orientation, orientation);
+    }
+}
+
+void MD5Animator::EvaluateState(BlendState const& state, bool reference, LocalJoint* pose)
+{
+    float totalWeight = 0.0f;
+
+    // Mix the clips in one after another, each with its share of the weights so far.
+    for (int i = 0; i < state.clipCount; ++i)
+    {
+        if (state.weights[i] <= 0.0f)
+            continue;
+
+        md5_anim_t const& clip = *state.clips[i];
+        float const time = reference ? 0.0f : state.phase * clip.totalAnimTime;
+
+        totalWeight += state.weights[i];
+
+        if (totalWeight == state.weights[i])
+        {
+            SampleClip(clip, time, state.loop, pose);
+        }
+        else
+        {
+            SampleClip(clip, time, state.loop, samplePose.data());
+            BlendPoses(pose, samplePose.data(), state.weights[i] / totalWeight, nullptr, jointCount);
+        }
+    }
+
+    if (totalWeight <= 0.0f)
+        std::copy(bindPose.begin(), bindPose.end(), pose);
+}
+
+void MD5Animator::ComposePose(JointPose* pose) const
+{
+    // Same as the frame skeletons are built: rotate the joint into its parent's space and add the parent's position.
+    for (int i = 0; i < jointCount; ++i)
+    {
+        XMVECTOR orientation = XMLoadFloat4A(&resultPose[i].orientation);
+        XMVECTOR position = XMLoadFloat4A(&resultPose[i].position);
+
+        if (parents[i] >= 0)
+        {
+            JointPose const& parent = pose[parents[i]];
+            XMVECTOR const parentOrientation = XMLoadFloat4(&parent.orientation);
+
+            position = XMVectorAdd(XMLoadFloat3(&parent.position), XMVector3InverseRotate(position, parentOrientation));
+            orientation = XMQuaternionNormalize(XMQuaternionMultiply(parentOrientation, orientation));
+        }
+
+        XMStoreFloat3(&pose[i].position, position);
+        XMStoreFloat4(&pose[i].orientation, orientation);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+//
+// MD5Animator.h
+//
+
+#pragma once
+
+#include "MD5Loader.h"
+
+namespace axec
+{
+    // Joint of a local pose, relative to its parent. Both parts are whole vectors so they load with aligned SIMD loads.
+    struct LocalJoint
+    {
+        DirectX::XMFLOAT4A orientation;
+        DirectX::XMFLOAT4A position;
+    };
+
+    // Plays the animations of one model instance. Every layer plays a blend of clips whose phases run in sync
+    // (e.g. walk and run mixed by speed) and crossfades to the next blend when a new one is started. The layers are
+    // stacked from the first one up, each limited to the joints of its mask, and the result is one model space pose.
+    // All buffers are sized by Initialize, updating and evaluating don't allocate.
+    class MD5Animator
+    {
+        public:
+            static constexpr int MAX_LAYERS = 4;
+            static constexpr int MAX_BLEND_CLIPS = 4;
+
+            enum class LayerMode
+            {
+                OVERRIDE,   // Blends from the layers below towards the pose of the layer.
+                ADDITIVE    // Adds the difference of the clips to their first frame on top of the layers below.
+            };
+
+        public:
+            MD5Animator();
+
+            void Initialize(md5_model_t const& model);
+
+            // Starts a clip on a layer, what the layer played before fades out over fadeTime seconds.
+            bool Play(int layer, md5_anim_t const* clip, float fadeTime, bool loop = true);
+            bool PlayBlend(int layer, md5_anim_t const* const* clips, float const* weights, int clipCount, float fadeTime, bool loop = true);
+            void SetBlendWeights(int layer, float const* weights, int clipCount);
+            void Stop(int layer, float fadeTime);
+
+            void SetLayerWeight(int layer, float weight);
+            void SetLayerMode(int layer, LayerMode mode);
+
+            // Weight of every joint on a layer, nullptr plays the layer on the whole skeleton.
+            void SetLayerMask(int layer, float const* jointWeights);
+
+            // Sets the joints from rootJoint down its hierarchy to weight and all others to zero, e.g. for the upper body.
+            void BuildJointMask(int rootJoint, float weight, float* jointWeights) const;
+            int FindJoint(std::wstring const& name) const;
+            int GetJointCount() const { return jointCount; }
+
+            bool IsPlaying(int layer) const { return layers[layer].current.clipCount > 0; }
+            bool HasFinished(int layer) const { return layers[layer].current.finished; }
+
+            void Update(float deltaTime);
+            void Evaluate(JointPose* pose);
+
+        private:
+            struct BlendState
+            {
+                md5_anim_t const* clips[MAX_BLEND_CLIPS];
+                float weights[MAX_BLEND_CLIPS];
+                int clipCount;
+                float phase;
+                bool loop;
+                bool finished;
+            };
+
+            struct Layer
+            {
+                BlendState current;
+                BlendState previous;
+                float fadeTime;
+                float fadeElapsed;
+                float weight;
+                LayerMode mode;
+                bool masked;
+                std::vector<float> mask;
+            };
+
+        private:
+            static void AdvanceState(BlendState& state, float deltaTime);
+            static void SampleClip(md5_anim_t const& clip, float time, bool loop, LocalJoint* pose);
+            static void BlendPoses(LocalJoint* result, LocalJoint const* pose, float weight, float const* mask, int count);
+            static void AddPoses(LocalJoint* result, LocalJoint const* pose, LocalJoint const* reference, float weight, float const* mask, int count);
+
+            void EvaluateState(BlendState const& state, bool reference, LocalJoint* pose);
+            void ComposePose(JointPose* pose) const;
+
+        private:
+            md5_model_t const* model;
+            int jointCount;
+            std::vector<int> parents;
+            Layer layers[MAX_LAYERS];
+
+            // Scratch poses of the evaluation, one joint per model joint each.
+            std::vector<LocalJoint> bindPose;
+            std::vector<LocalJoint> resultPose;
+            std::vector<LocalJoint> layerPose;
+            std::vector<LocalJoint> fadePose;
+            std::vector<LocalJoint> referencePose;
+            std::vector<LocalJoint> samplePose;
+    };
+}
\ No newline at end of file
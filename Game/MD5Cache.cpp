@@ -0,0 +1,78 @@
+//
+// MD5Cache.cpp
+//
+
+#include "pch.h"
+#include "MD5Cache.h"
+#include "MD5Skinning.h"
+
+using namespace axec;
+
+std::unordered_map<std::wstring, std::shared_ptr<md5_model_t>> MD5Cache::meshes;
+std::unordered_map<std::wstring, std::shared_ptr<md5_anim_t>> MD5Cache::animations;
+
+std::shared_ptr<md5_model_t const> MD5Cache::ResolveMesh(ID3D11DeviceContext* deviceContext, std::wstring const& fileName, MD5SkinningMode skinningMode)
+{
+    std::shared_ptr<md5_model_t>& model = meshes[fileName];
+
+    if (!model)
+    {
+        auto loadedModel = std::make_shared<md5_model_t>();
+        if (!MD5Loader::LoadMD5Mesh(deviceContext, fileName, *loadedModel))
+        {
+            meshes.erase(fileName);
+            return nullptr;
+        }
+
+        model = std::move(loadedModel);
+    }
+
+    // The static vertices of the GPU skinning are created by the first instance that is skinned on the GPU.
+    bool const fitsPalette = model->numJoints <= MD5Skinning::MAX_PALETTE_JOINTS;
+    if (skinningMode == MD5SkinningMode::GPU && fitsPalette && !model->meshes.empty() && model->meshes[0].skinnedVertexBuffer.Get() == nullptr)
+    {
+        ID3D11Device* device = DX::GetDevice(deviceContext);
+        if (device != nullptr)
+            MD5Loader::CreateSkinnedVertexBuffers(device, *model);
+    }
+
+    return model;
+}
+
+std::shared_ptr<md5_anim_t const> MD5Cache::ResolveAnim(std::wstring const& fileName)
+{
+    std::shared_ptr<md5_anim_t>& animation = animations[fileName];
+
+    if (!animation)
+    {
+        auto loadedAnimation = std::make_shared<md5_anim_t>();
+        if (!MD5Loader::LoadMD5Anim(fileName, *loadedAnimation))
+        {
+            animations.erase(fileName);
+            return nullptr;
+        }
+
+        animation = std::move(loadedAnimation);
+    }
+
+    return animation;
+}
+
+void MD5Cache::Clear()
+{
+    for (auto iter = meshes.begin(); iter != meshes.end();)
+    {
+        if (iter->second.use_count() == 1)
+            iter = meshes.erase(iter);
+        else
+            iter++;
+    }
+
+    for (auto iter = animations.begin(); iter != animations.end();)
+    {
+        if (iter->second.use_count() == 1)
+            iter = animations.erase(iter);
+        else
+            iter++;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+//
+// MD5Cache.h
+//
+
+#pragma once
+
+#include "MD5Loader.h"
+
+namespace axec
+{
+    // Loads every MD5 mesh and animation once and shares it between all model instances that use the same file.
+    // Everything that changes per instance lives in MD5Model. The only later change to the shared data is the static
+    // vertex buffers of the GPU skinning, ResolveMesh adds them when the first instance skinned on the GPU asks for the mesh.
+    class MD5Cache
+    {
+        public:
+            static std::shared_ptr<md5_model_t const> ResolveMesh(ID3D11DeviceContext* deviceContext, std::wstring const& fileName, MD5SkinningMode skinningMode);
+            static std::shared_ptr<md5_anim_t const> ResolveAnim(std::wstring const& fileName);
+
+            // Releases the meshes and animations that no instance uses anymore.
+            static void Clear();
+
+        private:
+            static std::unordered_map<std::wstring, std::shared_ptr<md5_model_t>> meshes;
+            static std::unordered_map<std::wstring, std::shared_ptr<md5_anim_t>> animations;
+    };
+}
\ No newline at end of file
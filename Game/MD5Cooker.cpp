@@ -0,0 +1,508 @@
+//
+// MD5Cooker.cpp
+//
+
+#include "pch.h"
+#include "MD5Cooker.h"
+#include "MD5Tokenizer.h"
+#include "MappedFile.h"
+
+#include <filesystem>
+
+using namespace axec;
+
+namespace
+{
+    enum MeshSection : uint32
+    {
+        MESH_JOINTS,
+        MESH_MESHES,
+        MESH_VERTICES,
+        MESH_INDICES,
+        MESH_WEIGHTS,
+        MESH_NAMES,
+        MESH_SECTION_COUNT
+    };
+
+    enum AnimSection : uint32
+    {
+        ANIM_INFO,
+        ANIM_JOINTS,
+        ANIM_BOUNDS,
+        ANIM_BASE_FRAME,
+        ANIM_FRAME_IDS,
+        ANIM_FRAME_DATA,
+        ANIM_SKELETON,
+        ANIM_LOCAL_SKELETON,
+        ANIM_NAMES,
+        ANIM_SECTION_COUNT
+    };
+
+    // The strings of a file are stored one after another in its names section.
+    struct CookedName
+    {
+        uint32 offset;
+        uint32 length;
+    };
+
+    struct CookedJoint
+    {
+        CookedName name;
+        int32 parentId;
+        DirectX::XMFLOAT3 position;
+        DirectX::XMFLOAT4 orientation;
+    };
+
+    // A mesh addresses its ranges of the vertex, index and weight sections that all meshes share.
+    struct CookedMesh
+    {
+        CookedName shader;
+        uint32 firstVertex;
+        uint32 vertexCount;
+        uint32 firstIndex;
+        uint32 indexCount;
+        uint32 firstWeight;
+        uint32 weightCount;
+    };
+
+    struct CookedAnimInfo
+    {
+        int32 numFrames;
+        int32 numJoints;
+        int32 frameRate;
+        int32 numAnimatedComponents;
+    };
+
+    struct CookedJointInfo
+    {
+        CookedName name;
+        int32 parentId;
+        int32 flags;
+        int32 startIndex;
+    };
+
+    // Sections start on 16 byte boundaries so the arrays in the mapped file are aligned.
+    constexpr uint64 SECTION_ALIGNMENT = 16;
+
+    uint64 AlignSection(uint64 offset)
+    {
+        return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+    }
+
+    // Collects the sections of a file while it is cooked and writes them out in one go.
+    class CookedFileWriter
+    {
+        public:
+            explicit CookedFileWriter(uint32 sectionCount) : m_sections(sectionCount) {}
+
+            template<typename T>
+            void SetSection(uint32 index, T const* data, size_t count)
+            {
+                static_assert(std::is_trivially_copyable<T>::value, "The sections are copied byte by byte.");
+
+                uint8 const* bytes = reinterpret_cast<uint8 const*>(data);
+                m_sections[index].assign(bytes, bytes + sizeof(T) * count);
+            }
+
+            // The names were widened from the single byte characters of the text file, they are stored as those.
+            CookedName AddName(std::wstring const& name)
+            {
+                CookedName const cookedName = { static_cast<uint32>(m_names.size()), static_cast<uint32>(name.size()) };
+
+                for (wchar_t c : name)
+                    m_names.push_back(static_cast<char>(c));
+
+                return cookedName;
+            }
+
+            bool Save(std::wstring const& fileName, MD5Cooker::FileHeader const& header, uint32 namesSection)
+            {
+                SetSection(namesSection, m_names.data(), m_names.size());
+
+                uint32 const sectionCount = static_cast<uint32>(m_sections.size());
+                std::vector<MD5Cooker::Section> table(sectionCount);
+
+                uint64 offset = AlignSection(sizeof(MD5Cooker::FileHeader) + sizeof(MD5Cooker::Section) * sectionCount);
+                for (uint32 i = 0; i < sectionCount; ++i)
+                {
+                    table[i] = { offset, m_sections[i].size() };
+                    offset = AlignSection(offset + m_sections[i].size());
+                }
+
+                std::ofstream file(std::filesystem::path(fileName), std::ios::binary | std::ios::trunc);
+                if (!file.is_open())
+                    return false;
+
+                file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+                file.write(reinterpret_cast<char const*>(table.data()), sizeof(MD5Cooker::Section) * sectionCount);
+
+                char const padding[SECTION_ALIGNMENT] = {};
+                uint64 position = sizeof(MD5Cooker::FileHeader) + sizeof(MD5Cooker::Section) * sectionCount;
+
+                for (uint32 i = 0; i < sectionCount; ++i)
+                {
+                    file.write(padding, table[i].offset - position);
+                    file.write(reinterpret_cast<char const*>(m_sections[i].data()), m_sections[i].size());
+                    position = table[i].offset + table[i].size;
+                }
+
+                return file.good();
+            }
+
+        private:
+            std::vector<std::vector<uint8>> m_sections;
+            std::string m_names;
+    };
+
+    // Maps a cooked file and hands out its sections as arrays after the header and the section table were checked.
+    class CookedFileReader
+    {
+        public:
+            bool Open(std::wstring const& fileName, MD5Cooker::FileHeader const& expectedHeader, uint32 namesSection)
+            {
+                if (!m_file.Open(fileName.c_str()))
+                    return false;
+
+                size_t const tableEnd = sizeof(MD5Cooker::FileHeader) + sizeof(MD5Cooker::Section) * expectedHeader.sectionCount;
+                if (m_file.GetSize() < tableEnd)
+                    return false;
+
+                MD5Cooker::FileHeader header;
+                memcpy(&header, m_file.GetData(), sizeof(header));
+
+                if (header.magic != expectedHeader.magic || header.version != expectedHeader.version ||
+                    header.sourceSize != expectedHeader.sourceSize || header.sourceTime != expectedHeader.sourceTime ||
+                    header.sectionCount != expectedHeader.sectionCount)
+                    return false;
+
+                m_sections = reinterpret_cast<MD5Cooker::Section const*>(m_file.GetData() + sizeof(MD5Cooker::FileHeader));
+
+                for (uint32 i = 0; i < header.sectionCount; ++i)
+                {
+                    MD5Cooker::Section const& section = m_sections[i];
+                    if (section.offset % SECTION_ALIGNMENT != 0 || section.offset > m_file.GetSize() || section.size > m_file.GetSize() - section.offset)
+                        return false;
+                }
+
+                m_namesSection = namesSection;
+
+                return true;
+            }
+
+            template<typename T>
+            bool GetSection(uint32 index, T const*& data, size_t& count) const
+            {
+                MD5Cooker::Section const& section = m_sections[index];
+                if (section.size % sizeof(T) != 0)
+                    return false;
+
+                data = reinterpret_cast<T const*>(m_file.GetData() + section.offset);
+                count = static_cast<size_t>(section.size / sizeof(T));
+
+                return true;
+            }
+
+            bool GetName(CookedName name, std::wstring& result) const
+            {
+                MD5Cooker::Section const& section = m_sections[m_namesSection];
+                if (name.offset > section.size || name.length > section.size - name.offset)
+                    return false;
+
+                char const* names = reinterpret_cast<char const*>(m_file.GetData() + section.offset);
+                result = MD5Tokenizer::Widen(std::string_view(names + name.offset, name.length));
+
+                return true;
+            }
+
+        private:
+            MappedFile m_file;
+            MD5Cooker::Section const* m_sections = nullptr;
+            uint32 m_namesSection = 0;
+    };
+
+    // Checks that a range of count items starting at first lies inside an array of size items.
+    bool IsRangeValid(uint32 first, uint32 count, size_t size)
+    {
+        return first <= size && count <= size - first;
+    }
+
+    // Checks that every vertex, weight and index of a mesh addresses the arrays it indexes, the skinning reads them without checks.
+    bool IsMeshValid(md5_mesh_t const& mesh, size_t jointCount)
+    {
+        for (MD5Vertex const& vertex : mesh.vertices)
+        {
+            if (vertex.StartWeight < 0 || vertex.WeightCount < 0 ||
+                !IsRangeValid(static_cast<uint32>(vertex.StartWeight), static_cast<uint32>(vertex.WeightCount), mesh.weights.size()))
+                return false;
+        }
+
+        for (Weight const& weight : mesh.weights)
+        {
+            if (weight.jointId < 0 || static_cast<size_t>(weight.jointId) >= jointCount)
+                return false;
+        }
+
+        for (uint32 index : mesh.indices)
+        {
+            if (index >= mesh.vertices.size())
+                return false;
+        }
+
+        return true;
+    }
+}
+
+
+bool MD5Cooker::LoadMesh(std::wstring const& fileName, md5_model_t& model)
+{
+    FileHeader expectedHeader = { MESH_MAGIC, FILE_VERSION, 0, 0, MESH_SECTION_COUNT, 0 };
+    if (!GetSourceStamp(fileName, expectedHeader.sourceSize, expectedHeader.sourceTime))
+        return false;
+
+    CookedFileReader reader;
+    if (!reader.Open(fileName + FILE_EXTENSION, expectedHeader, MESH_NAMES))
+        return false;
+
+    CookedJoint const* joints;
+    CookedMesh const* meshes;
+    MD5Vertex const* vertices;
+    uint32 const* indices;
+    Weight const* weights;
+    size_t jointCount, meshCount, vertexCount, indexCount, weightCount;
+
+    if (!reader.GetSection(MESH_JOINTS, joints, jointCount) || !reader.GetSection(MESH_MESHES, meshes, meshCount) ||
+        !reader.GetSection(MESH_VERTICES, vertices, vertexCount) || !reader.GetSection(MESH_INDICES, indices, indexCount) ||
+        !reader.GetSection(MESH_WEIGHTS, weights, weightCount))
+        return false;
+
+    std::vector<Joint> modelJoints(jointCount);
+    for (size_t i = 0; i < jointCount; ++i)
+    {
+        if (!reader.GetName(joints[i].name, modelJoints[i].name))
+            return false;
+
+        // The joints are stored parents first, the skeleton is built in one pass in that order.
+        if (joints[i].parentId < -1 || joints[i].parentId >= static_cast<int32>(i))
+            return false;
+
+        modelJoints[i].parentId = joints[i].parentId;
+        modelJoints[i].position = joints[i].position;
+        modelJoints[i].orientation = joints[i].orientation;
+    }
+
+    std::vector<md5_mesh_t> modelMeshes(meshCount);
+    for (size_t i = 0; i < meshCount; ++i)
+    {
+        CookedMesh const& cookedMesh = meshes[i];
+        md5_mesh_t& mesh = modelMeshes[i];
+
+        if (!IsRangeValid(cookedMesh.firstVertex, cookedMesh.vertexCount, vertexCount) ||
+            !IsRangeValid(cookedMesh.firstIndex, cookedMesh.indexCount, indexCount) ||
+            !IsRangeValid(cookedMesh.firstWeight, cookedMesh.weightCount, weightCount) ||
+            !reader.GetName(cookedMesh.shader, mesh.shader))
+            return false;
+
+        // The vertices already hold the bind pose and the weights their normals, they are copied as they are.
+        mesh.vertices.assign(vertices + cookedMesh.firstVertex, vertices + cookedMesh.firstVertex + cookedMesh.vertexCount);
+        mesh.indices.assign(indices + cookedMesh.firstIndex, indices + cookedMesh.firstIndex + cookedMesh.indexCount);
+        mesh.weights.assign(weights + cookedMesh.firstWeight, weights + cookedMesh.firstWeight + cookedMesh.weightCount);
+        mesh.trianglesCount = cookedMesh.indexCount / 3;
+
+        if (!IsMeshValid(mesh, jointCount))
+            return false;
+    }
+
+    model.numJoints = static_cast<int>(jointCount);
+    model.numMeshes = static_cast<int>(meshCount);
+    model.joints = std::move(modelJoints);
+    model.meshes = std::move(modelMeshes);
+
+    return true;
+}
+
+bool MD5Cooker::SaveMesh(std::wstring const& fileName, md5_model_t const& model)
+{
+    FileHeader header = { MESH_MAGIC, FILE_VERSION, 0, 0, MESH_SECTION_COUNT, 0 };
+    if (!GetSourceStamp(fileName, header.sourceSize, header.sourceTime))
+        return false;
+
+    CookedFileWriter writer(MESH_SECTION_COUNT);
+
+    std::vector<CookedJoint> joints;
+    joints.reserve(model.joints.size());
+
+    for (Joint const& joint : model.joints)
+        joints.push_back({ writer.AddName(joint.name), joint.parentId, joint.position, joint.orientation });
+
+    std::vector<CookedMesh> meshes;
+    std::vector<MD5Vertex> vertices;
+    std::vector<uint32> indices;
+    std::vector<Weight> weights;
+
+    for (md5_mesh_t const& mesh : model.meshes)
+    {
+        CookedMesh cookedMesh;
+        cookedMesh.shader = writer.AddName(mesh.shader);
+        cookedMesh.firstVertex = static_cast<uint32>(vertices.size());
+        cookedMesh.vertexCount = static_cast<uint32>(mesh.vertices.size());
+        cookedMesh.firstIndex = static_cast<uint32>(indices.size());
+        cookedMesh.indexCount = mesh.trianglesCount * 3;
+        cookedMesh.firstWeight = static_cast<uint32>(weights.size());
+        cookedMesh.weightCount = static_cast<uint32>(mesh.weights.size());
+        meshes.push_back(cookedMesh);
+
+        vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+        indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.begin() + cookedMesh.indexCount);
+        weights.insert(weights.end(), mesh.weights.begin(), mesh.weights.end());
+    }
+
+    writer.SetSection(MESH_JOINTS, joints.data(), joints.size());
+    writer.SetSection(MESH_MESHES, meshes.data(), meshes.size());
+    writer.SetSection(MESH_VERTICES, vertices.data(), vertices.size());
+    writer.SetSection(MESH_INDICES, indices.data(), indices.size());
+    writer.SetSection(MESH_WEIGHTS, weights.data(), weights.size());
+
+    return writer.Save(fileName + FILE_EXTENSION, header, MESH_NAMES);
+}
+
+bool MD5Cooker::LoadAnim(std::wstring const& fileName, md5_anim_t& animation)
+{
+    FileHeader expectedHeader = { ANIM_MAGIC, FILE_VERSION, 0, 0, ANIM_SECTION_COUNT, 0 };
+    if (!GetSourceStamp(fileName, expectedHeader.sourceSize, expectedHeader.sourceTime))
+        return false;
+
+    CookedFileReader reader;
+    if (!reader.Open(fileName + FILE_EXTENSION, expectedHeader, ANIM_NAMES))
+        return false;
+
+    CookedAnimInfo const* info;
+    CookedJointInfo const* joints;
+    BoundingBox const* bounds;
+    JointPose const* baseFrame;
+    int32 const* frameIds;
+    float const* frameData;
+    JointPose const* skeleton;
+    JointPose const* localSkeleton;
+    size_t infoCount, jointCount, boundsCount, baseFrameCount, frameIdCount, frameDataCount, skeletonCount, localSkeletonCount;
+
+    if (!reader.GetSection(ANIM_INFO, info, infoCount) || !reader.GetSection(ANIM_JOINTS, joints, jointCount) ||
+        !reader.GetSection(ANIM_BOUNDS, bounds, boundsCount) || !reader.GetSection(ANIM_BASE_FRAME, baseFrame, baseFrameCount) ||
+        !reader.GetSection(ANIM_FRAME_IDS, frameIds, frameIdCount) || !reader.GetSection(ANIM_FRAME_DATA, frameData, frameDataCount) ||
+        !reader.GetSection(ANIM_SKELETON, skeleton, skeletonCount) || !reader.GetSection(ANIM_LOCAL_SKELETON, localSkeleton, localSkeletonCount) ||
+        infoCount != 1)
+        return false;
+
+    // Every array has to match the counts of the header, the animation code indexes them without checks.
+    size_t const numFrames = static_cast<size_t>(std::max(info->numFrames, 0));
+    size_t const numJoints = static_cast<size_t>(std::max(info->numJoints, 0));
+    size_t const numComponents = static_cast<size_t>(std::max(info->numAnimatedComponents, 0));
+
+    if (jointCount != numJoints || boundsCount != numFrames || baseFrameCount != numJoints || frameIdCount != numFrames ||
+        frameDataCount != numFrames * numComponents || skeletonCount != numFrames * numJoints || localSkeletonCount != skeletonCount)
+        return false;
+
+    md5_anim_t result;
+    result.numFrames = info->numFrames;
+    result.numJoints = info->numJoints;
+    result.frameRate = info->frameRate;
+    result.numAnimatedComponents = info->numAnimatedComponents;
+
+    result.jointInfo.resize(numJoints);
+    result.baseFrameJoints.resize(numJoints);
+
+    for (size_t i = 0; i < numJoints; ++i)
+    {
+        JointInfo& joint = result.jointInfo[i];
+        if (!reader.GetName(joints[i].name, joint.name))
+            return false;
+
+        joint.parentId = joints[i].parentId;
+        joint.flags = joints[i].flags;
+        joint.startIndex = joints[i].startIndex;
+
+        result.baseFrameJoints[i].parentId = joint.parentId;
+        result.baseFrameJoints[i].position = baseFrame[i].position;
+        result.baseFrameJoints[i].orientation = baseFrame[i].orientation;
+    }
+
+    result.frameData.resize(numFrames);
+    for (size_t i = 0; i < numFrames; ++i)
+    {
+        result.frameData[i].frameId = frameIds[i];
+        result.frameData[i].frameData.assign(frameData + i * numComponents, frameData + (i + 1) * numComponents);
+    }
+
+    // The skeletons of the frames are already built, they are copied in one block.
+    result.frameBounds.assign(bounds, bounds + boundsCount);
+    result.frameSkeleton.assign(skeleton, skeleton + skeletonCount);
+    result.localFrameSkeleton.assign(localSkeleton, localSkeleton + localSkeletonCount);
+
+    animation = std::move(result);
+
+    return true;
+}
+
+bool MD5Cooker::SaveAnim(std::wstring const& fileName, md5_anim_t const& animation)
+{
+    FileHeader header = { ANIM_MAGIC, FILE_VERSION, 0, 0, ANIM_SECTION_COUNT, 0 };
+    if (!GetSourceStamp(fileName, header.sourceSize, header.sourceTime))
+        return false;
+
+    CookedFileWriter writer(ANIM_SECTION_COUNT);
+
+    CookedAnimInfo const info = { animation.numFrames, animation.numJoints, animation.frameRate, animation.numAnimatedComponents };
+
+    std::vector<CookedJointInfo> joints;
+    joints.reserve(animation.jointInfo.size());
+
+    for (JointInfo const& joint : animation.jointInfo)
+        joints.push_back({ writer.AddName(joint.name), joint.parentId, joint.flags, joint.startIndex });
+
+    std::vector<JointPose> baseFrame;
+    baseFrame.reserve(animation.baseFrameJoints.size());
+
+    for (Joint const& joint : animation.baseFrameJoints)
+        baseFrame.push_back({ joint.position, joint.orientation });
+
+    std::vector<int32> frameIds;
+    std::vector<float> frameData;
+    frameIds.reserve(animation.frameData.size());
+    frameData.reserve(animation.frameData.size() * animation.numAnimatedComponents);
+
+    for (FrameData const& frame : animation.frameData)
+    {
+        frameIds.push_back(frame.frameId);
+        frameData.insert(frameData.end(), frame.frameData.begin(), frame.frameData.end());
+    }
+
+    writer.SetSection(ANIM_INFO, &info, 1);
+    writer.SetSection(ANIM_JOINTS, joints.data(), joints.size());
+    writer.SetSection(ANIM_BOUNDS, animation.frameBounds.data(), animation.frameBounds.size());
+    writer.SetSection(ANIM_BASE_FRAME, baseFrame.data(), baseFrame.size());
+    writer.SetSection(ANIM_FRAME_IDS, frameIds.data(), frameIds.size());
+    writer.SetSection(ANIM_FRAME_DATA, frameData.data(), frameData.size());
+    writer.SetSection(ANIM_SKELETON, animation.frameSkeleton.data(), animation.frameSkeleton.size());
+    writer.SetSection(ANIM_LOCAL_SKELETON, animation.localFrameSkeleton.data(), animation.localFrameSkeleton.size());
+
+    return writer.Save(fileName + FILE_EXTENSION, header, ANIM_NAMES);
+}
+
+bool MD5Cooker::GetSourceStamp(std::wstring const& fileName, uint64& size, int64& time)
+{
+    // Comparing the size and the write time doesn't need to read the text file, which is the point of cooking it.
+    std::error_code error;
+    std::filesystem::path const path(fileName);
+
+    std::uintmax_t const fileSize = std::filesystem::file_size(path, error);
+    if (error)
+        return false;
+
+    std::filesystem::file_time_type const writeTime = std::filesystem::last_write_time(path, error);
+    if (error)
+        return false;
+
+    size = static_cast<uint64>(fileSize);
+    time = static_cast<int64>(writeTime.time_since_epoch().count());
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+//
+// MD5Cooker.h
+//
+
+#pragma once
+
+#include "MD5Loader.h"
+
+namespace axec
+{
+    // Reads and writes the cooked MD5 files, a binary copy of a prepared mesh or animation next to its text file.
+    // Everything lives in flat sections that are copied out of the mapped file as they are, nothing is parsed.
+    class MD5Cooker
+    {
+        public:
+            // Layout of a cooked file: the header, the table of its sections and the sections themselves.
+            // The size and write time of the text file tell if the cooked file is still up to date.
+            struct FileHeader
+            {
+                uint32 magic;
+                uint32 version;
+                uint64 sourceSize;
+                int64 sourceTime;
+                uint32 sectionCount;
+                uint32 padding;
+            };
+
+            // Byte range of a section, relative to the start of the file.
+            struct Section
+            {
+                uint64 offset;
+                uint64 size;
+            };
+
+            static constexpr uint32 MESH_MAGIC = 0x4D35444D; // "MD5M"
+            static constexpr uint32 ANIM_MAGIC = 0x4135444D; // "MD5A"
+            static constexpr uint32 FILE_VERSION = 2;
+            static constexpr wchar_t const* FILE_EXTENSION = L".cooked";
+
+        public:
+            // Both take the name of the text file, the cooked file sits next to it.
+            static bool LoadMesh(std::wstring const& fileName, md5_model_t& model);
+            static bool SaveMesh(std::wstring const& fileName, md5_model_t const& model);
+
+            static bool LoadAnim(std::wstring const& fileName, md5_anim_t& animation);
+            static bool SaveAnim(std::wstring const& fileName, md5_anim_t const& animation);
+
+        private:
+            static bool GetSourceStamp(std::wstring const& fileName, uint64& size, int64& time);
+    };
+}
\ No newline at end of file
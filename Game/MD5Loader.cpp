@@ -1,5 +1,10 @@
 #include "pch.h"
 #include "MD5Loader.h"
+#include "MD5Cooker.h"
+#include "MD5Skinning.h"
+#include "MD5Tokenizer.h"
+#include "MappedFile.h"
+#include "StringHelper.h"
 
 using namespace axec;
 
@@ -10,375 +15,384 @@ bool MD5Loader::LoadMD5Mesh(ID3D11DeviceContext* deviceContext, std::wstring con
     if (device == nullptr)
         return false;
 
-    std::wifstream fileIn(fileName.c_str());
-    if (!fileIn.is_open())
+    // Use the cooked mesh while it is up to date, otherwise parse the text file and cook it for the next time.
+    if (!MD5Cooker::LoadMesh(fileName, model))
+    {
+        if (!ParseMD5Mesh(fileName, model))
+            return false;
+
+        if (!MD5Cooker::SaveMesh(fileName, model))
+            Logger::Get()->warn("Failed to write the cooked MD5 mesh of {}", StringHelper::WideToNarrow(fileName));
+    }
+
+    for (md5_mesh_t& mesh : model.meshes)
+    {
+        // Load texture.
+        DirectX::CreateWICTextureFromFile(device, mesh.shader.c_str(), nullptr, mesh.texture.ReleaseAndGetAddressOf());
+
+        // The instances skinned on the CPU copy the vertices into their own vertex buffers.
+        PrepareSkinningWeights(mesh);
+        mesh.indexBuffer.Create(device, &mesh.indices[0], mesh.trianglesCount * 3);
+    }
+
+    return true;
+}
+
+void MD5Loader::CreateSkinnedVertexBuffers(ID3D11Device* device, md5_model_t& model)
+{
+    std::vector<MD5SkinnedVertex> skinnedVertices;
+
+    // These vertices never change, the vertex shader skins them with the joint palette of each instance.
+    for (md5_mesh_t& mesh : model.meshes)
+    {
+        MD5Skinning::BuildSkinnedVertices(mesh, skinnedVertices);
+        mesh.skinnedVertexBuffer.Create(device, skinnedVertices.data(), static_cast<UINT>(skinnedVertices.size()));
+    }
+}
+
+bool MD5Loader::CookMD5Mesh(std::wstring const& fileName)
+{
+    md5_model_t model;
+    if (!ParseMD5Mesh(fileName, model))
+        return false;
+
+    return MD5Cooker::SaveMesh(fileName, model);
+}
+
+bool MD5Loader::ParseMD5Mesh(std::wstring const& fileName, md5_model_t& model)
+{
+    MappedFile file;
+    if (!file.Open(fileName.c_str()))
         return false;
 
-    std::wstring data;
+    char const* text = reinterpret_cast<char const*>(file.GetData());
+    MD5Tokenizer tokenizer(text, text + file.GetSize());
 
-    while (!fileIn.eof())
+    while (!tokenizer.IsAtEnd() && !tokenizer.HasFailed())
     {
-        fileIn >> data;
+        std::string_view data = tokenizer.NextToken();
 
-        if (data == L"MD5Version")
+        if (data == "MD5Version")
         {
-            // Check version of .md5mesh file.
-            int MD5Version = 0;
-            fileIn >> MD5Version;
-
             // MD5 Version must be 10.
-            if (MD5Version != 10)
+            if (tokenizer.NextInt() != 10)
                 return false;
         }
-        else if (data == L"commandline")
+        else if (data == "commandline")
         {
-            std::getline(fileIn, data); // Ignore the rest of this line.
+            tokenizer.SkipLine(); // Ignore the rest of this line.
         }
-        else if (data == L"numJoints")
+        else if (data == "numJoints")
         {
-            fileIn >> model.numJoints; // Store number of joints.
+            model.numJoints = tokenizer.NextInt(); // Store number of joints.
         }
-        else if (data == L"numMeshes")
+        else if (data == "numMeshes")
         {
-            fileIn >> model.numMeshes; // Store number of meshes.
+            model.numMeshes = tokenizer.NextInt(); // Store number of meshes.
         }
-        else if (data == L"joints")
+        else if (data == "joints")
         {
-            Joint joint;
-
-            fileIn >> data; // Skip the "{"
+            tokenizer.Skip("{");
+            model.joints.reserve(model.numJoints);
 
             for (int i = 0; i < model.numJoints; i++)
             {
-                fileIn >> joint.name;
-
-                // Sometimes the names might contain spaces. If that is the case, we need to continue
-                // to read the name until we get to the closing " (quatation mark).
-                if (joint.name[joint.name.size() - 1] != '"')
-                {
-                    wchar_t character;
-                    bool found = false;
-                    while (!found)
-                    {
-                        character = fileIn.get();
-
-                        if (character == '"')
-                            found = true;
-
-                        joint.name += character;
-                    }
-                }
+                Joint joint;
 
-                fileIn >> joint.parentId; // Store Parent joint Id.
-                fileIn >> data; // Skip the "("
+                // The names are quoted and might contain spaces.
+                joint.name = MD5Tokenizer::Widen(tokenizer.NextString());
+                joint.parentId = tokenizer.NextInt(); // Store Parent joint Id.
 
                 // Store position of this joint.
-                fileIn >> joint.position.x >> joint.position.z >> joint.position.y;
-                fileIn >> data >> data; // Skip the ")" and "("
+                tokenizer.Skip("(");
+                joint.position.x = tokenizer.NextFloat();
+                joint.position.z = tokenizer.NextFloat();
+                joint.position.y = tokenizer.NextFloat();
+                tokenizer.Skip(")");
 
                 // Store orientation of this joint
-                fileIn >> joint.orientation.x >> joint.orientation.z >> joint.orientation.y;
-
-                // Remove quotation marks from joints name.
-                joint.name.erase(0, 1);
-                joint.name.erase(joint.name.size() - 1, 1);
+                tokenizer.Skip("(");
+                joint.orientation.x = tokenizer.NextFloat();
+                joint.orientation.z = tokenizer.NextFloat();
+                joint.orientation.y = tokenizer.NextFloat();
 
                 // Compute the w axis of the quaternion.
                 QuaternionComputeW(joint.orientation);
 
-                std::getline(fileIn, data); // Skip rest of this lane.
+                tokenizer.SkipLine(); // Skip the ")" and the comment.
                 model.joints.push_back(joint); // Store the joint into joints vector.
             }
 
-            fileIn >> data; // Skip the "}"
+            tokenizer.Skip("}");
         }
-        else if (data == L"mesh")
+        else if (data == "mesh")
         {
             md5_mesh_t mesh;
-            int numVerts, numTris, numWeights;
 
-            fileIn >> data; // Skip the "{"
+            tokenizer.Skip("{");
 
-            fileIn >> data;
+            data = tokenizer.NextToken();
 
-            while (data != L"}") // Read until "}"
+            while (data != "}" && !tokenizer.HasFailed()) // Read until "}"
             {
-                if (data == L"shader")
+                if (data == "shader")
                 {
-                    std::wstring filePath;
-                    fileIn >> filePath;
-
-                    // Take spaces into account if file path has a space in it.
-                    if (filePath[filePath.size() - 1] != '"')
-                    {
-                        wchar_t character;
-                        bool found = false;
-
-                        while (!found)
-                        {
-                            character = fileIn.get();
-
-                            if (character == '"')
-                                found = true;
-
-                            filePath += character;
-                        }
-                    }
-
-                    // Remove the quotation marks from texture path
-                    filePath.erase(0, 1);
-                    filePath.erase(filePath.size() - 1, 1);
-
+                    // The texture path is quoted and might contain spaces.
                     mesh.shader = L"Data/";
-                    mesh.shader += filePath;
-
-                    // Load texture.
-                    DirectX::CreateWICTextureFromFile(device, mesh.shader.c_str(), nullptr, mesh.texture.ReleaseAndGetAddressOf());
-
-                    std::getline(fileIn, data); // Skip rest of this line.
+                    mesh.shader += MD5Tokenizer::Widen(tokenizer.NextString());
+                    tokenizer.SkipLine(); // Skip rest of this line.
                 }
-                else if (data == L"numverts")
+                else if (data == "numverts")
                 {
-                    fileIn >> numVerts;
-                    std::getline(fileIn, data); // Skip rest of this line.
+                    int const numVerts = tokenizer.NextInt();
+                    mesh.vertices.reserve(numVerts);
 
                     for (int i = 0; i < numVerts; i++)
                     {
                         MD5Vertex vertex;
 
-                        fileIn >> data >> data >> data; // Skip "vert # ("
-
-                                                        // Store texture coordinates
-                        fileIn >> vertex.textureCoordinate.x >> vertex.textureCoordinate.y;
+                        tokenizer.Skip("vert");
+                        tokenizer.NextInt(); // Skip the vertex number.
+                        tokenizer.Skip("(");
 
-                        fileIn >> data; // Skip ")"
-                        fileIn >> vertex.StartWeight; // Index of first weight this vert will be weighted to
-                        fileIn >> vertex.WeightCount; // Number of weights for this vertex.
+                        // Store texture coordinates
+                        vertex.textureCoordinate.x = tokenizer.NextFloat();
+                        vertex.textureCoordinate.y = tokenizer.NextFloat();
 
-                        std::getline(fileIn, data); // Skip rest of this lane.
+                        tokenizer.Skip(")");
+                        vertex.StartWeight = tokenizer.NextInt(); // Index of first weight this vert will be weighted to
+                        vertex.WeightCount = tokenizer.NextInt(); // Number of weights for this vertex.
 
                         mesh.vertices.push_back(vertex); // Push back this vertex into mesh vertices vector.
                     }
                 }
-                else if (data == L"numtris")
+                else if (data == "numtris")
                 {
-                    fileIn >> numTris;
+                    int const numTris = tokenizer.NextInt();
                     mesh.trianglesCount = numTris;
-
-                    std::getline(fileIn, data); // Skip rest of this lane.
+                    mesh.indices.reserve(numTris * 3);
 
                     for (int i = 0; i < numTris; i++)
                     {
-                        DWORD index;
-                        fileIn >> data >> data; // Skip "tri #".
+                        tokenizer.Skip("tri");
+                        tokenizer.NextInt(); // Skip the triangle number.
 
                         for (int k = 0; k < 3; k++)
-                        {
-                            fileIn >> index;
-                            mesh.indices.push_back(index);
-                        }
-
-                        std::getline(fileIn, data); // Skip rest of this lane.
+                            mesh.indices.push_back(tokenizer.NextUInt());
                     }
                 }
-                else if (data == L"numweights")
+                else if (data == "numweights")
                 {
-                    fileIn >> numWeights;
-
-                    std::getline(fileIn, data); // Skip rest of this lane.
+                    int const numWeights = tokenizer.NextInt();
+                    mesh.weights.reserve(numWeights);
 
                     for (int i = 0; i < numWeights; i++)
                     {
                         Weight weight;
-                        fileIn >> data >> data; // Skip "weight #"
 
-                        fileIn >> weight.jointId;
-                        fileIn >> weight.bias;
-                        fileIn >> data; // Skip "(".
+                        tokenizer.Skip("weight");
+                        tokenizer.NextInt(); // Skip the weight number.
 
-                        // Store weight's pos in joint's local space
-                        fileIn >> weight.position.x >> weight.position.z >> weight.position.y;
+                        weight.jointId = tokenizer.NextInt();
+                        weight.bias = tokenizer.NextFloat();
 
-                        std::getline(fileIn, data); // Skip rest of this lane.
+                        // Store weight's pos in joint's local space
+                        tokenizer.Skip("(");
+                        weight.position.x = tokenizer.NextFloat();
+                        weight.position.z = tokenizer.NextFloat();
+                        weight.position.y = tokenizer.NextFloat();
+                        tokenizer.Skip(")");
 
                         mesh.weights.push_back(weight); // Push back weight into mesh weight vector.
                     }
                 }
                 else
-                    std::getline(fileIn, data); // Skip anything else.
+                    tokenizer.SkipLine(); // Skip anything else.
 
-                fileIn >> data; // Skip "}".
+                data = tokenizer.NextToken();
             }
 
+            if (tokenizer.HasFailed())
+                break;
+
             PrepareMesh(mesh, model);
             PrepareNormals(mesh, model);
 
-            // Create vertex and index buffers for this mesh.
-            mesh.vertexBuffer.Create(device, &mesh.vertices[0], static_cast<UINT>(mesh.vertices.size()));
-            mesh.indexBuffer.Create(device, &mesh.indices[0], mesh.trianglesCount * 3);
+            model.meshes.push_back(std::move(mesh)); // Store mesh in model's meshes vector.
+        }
+    }
 
+    if (tokenizer.HasFailed())
+    {
+        Logger::Get()->error("Failed to parse the MD5 mesh {}", StringHelper::WideToNarrow(fileName));
+        return false;
+    }
 
-            model.meshes.push_back(mesh); // Store mesh in model's meshes vector.
-        }
+    return true;
+}
+
+bool MD5Loader::LoadMD5Anim(std::wstring const& fileName, md5_anim_t& animation)
+{
+    // Use the cooked animation while it is up to date, otherwise parse the text file and cook it for the next time.
+    if (!MD5Cooker::LoadAnim(fileName, animation))
+    {
+        if (!ParseMD5Anim(fileName, animation))
+            return false;
+
+        if (!MD5Cooker::SaveAnim(fileName, animation))
+            Logger::Get()->warn("Failed to write the cooked MD5 animation of {}", StringHelper::WideToNarrow(fileName));
     }
+
+    // Calculate and store some usefull animation data
+    animation.frameTime = 1.0f / animation.frameRate;
+    animation.totalAnimTime = animation.numFrames * animation.frameTime;
+
     return true;
 }
 
-bool MD5Loader::LoadMD5Anim(std::wstring const& fileName, md5_model_t& model)
+bool MD5Loader::CookMD5Anim(std::wstring const& fileName)
 {
-    std::wifstream fileIn(fileName.c_str());
-    if (!fileIn.is_open())
+    md5_anim_t animation;
+    if (!ParseMD5Anim(fileName, animation))
         return false;
 
-    std::wstring data;
-    md5_anim_t animation;
+    return MD5Cooker::SaveAnim(fileName, animation);
+}
+
+bool MD5Loader::ParseMD5Anim(std::wstring const& fileName, md5_anim_t& animation)
+{
+    MappedFile file;
+    if (!file.Open(fileName.c_str()))
+        return false;
+
+    char const* text = reinterpret_cast<char const*>(file.GetData());
+    MD5Tokenizer tokenizer(text, text + file.GetSize());
 
-    while (!fileIn.eof())
+    while (!tokenizer.IsAtEnd() && !tokenizer.HasFailed())
     {
-        fileIn >> data;
+        std::string_view data = tokenizer.NextToken();
 
-        if (data == L"MD5Version")
+        if (data == "MD5Version")
         {
-            // Check version of .md5anim file.
-            int MD5Version = 0;
-            fileIn >> MD5Version;
-
             // MD5Version must be 10.
-            if (MD5Version != 10)
+            if (tokenizer.NextInt() != 10)
                 return false;
         }
-        else if (data == L"commandline")
+        else if (data == "commandline")
         {
-            std::getline(fileIn, data); // Ignore rest of this line.
+            tokenizer.SkipLine(); // Ignore rest of this line.
         }
-        else if (data == L"numFrames")
+        else if (data == "numFrames")
         {
-            fileIn >> animation.numFrames;
+            animation.numFrames = tokenizer.NextInt();
         }
-        else if (data == L"numJoints")
+        else if (data == "numJoints")
         {
-            fileIn >> animation.numJoints;
+            animation.numJoints = tokenizer.NextInt();
         }
-        else if (data == L"frameRate")
+        else if (data == "frameRate")
         {
-            fileIn >> animation.frameRate;
+            animation.frameRate = tokenizer.NextInt();
         }
-        else if (data == L"numAnimatedComponents")
+        else if (data == "numAnimatedComponents")
         {
-            fileIn >> animation.numAnimatedComponents;
+            animation.numAnimatedComponents = tokenizer.NextInt();
         }
-        else if (data == L"hierarchy")
+        else if (data == "hierarchy")
         {
-            fileIn >> data; // Skip "{".
+            tokenizer.Skip("{");
+            animation.jointInfo.reserve(animation.numJoints);
 
             for (int i = 0; i < animation.numJoints; i++)
             {
                 JointInfo joint;
 
-                fileIn >> joint.name; // Get joint name.
-
-                if (joint.name[joint.name.size() - 1] != '"')
-                {
-                    wchar_t character;
-                    bool found = false;
-                    while (!found)
-                    {
-                        character = fileIn.get();
-
-                        if (character == '"')
-                            found = true;
-
-                        joint.name += character;
-                    }
-                }
-
-                // Remove the quotation marks from joints name.
-                joint.name.erase(0, 1);
-                joint.name.erase(joint.name.size() - 1, 1);
-
-                fileIn >> joint.parentId;
-                fileIn >> joint.flags;
-                fileIn >> joint.startIndex;
+                joint.name = MD5Tokenizer::Widen(tokenizer.NextString()); // Get joint name.
+                joint.parentId = tokenizer.NextInt();
+                joint.flags = tokenizer.NextInt();
+                joint.startIndex = tokenizer.NextInt();
 
                 // Add joint to the joint vector.
                 animation.jointInfo.push_back(joint);
 
-                std::getline(fileIn, data); // Skip the rest of this line.
+                tokenizer.SkipLine(); // Skip the rest of this line.
             }
         }
-        else if (data == L"bounds")
+        else if (data == "bounds")
         {
-            fileIn >> data; // Skip "{".
+            tokenizer.Skip("{");
+            animation.frameBounds.reserve(animation.numFrames);
 
             for (int i = 0; i < animation.numFrames; i++)
             {
                 BoundingBox bb;
 
-                fileIn >> data; // Skip "(".
-                fileIn >> bb.min.x >> bb.min.z >> bb.min.y;
-                fileIn >> data >> data; // Skip ") (".
-                fileIn >> bb.max.x >> bb.max.z >> bb.max.y;
-                fileIn >> data; // Skip ")"
+                tokenizer.Skip("(");
+                bb.min.x = tokenizer.NextFloat();
+                bb.min.z = tokenizer.NextFloat();
+                bb.min.y = tokenizer.NextFloat();
+                tokenizer.Skip(")");
+
+                tokenizer.Skip("(");
+                bb.max.x = tokenizer.NextFloat();
+                bb.max.z = tokenizer.NextFloat();
+                bb.max.y = tokenizer.NextFloat();
+                tokenizer.Skip(")");
 
                 animation.frameBounds.push_back(bb);
             }
         }
-        else if (data == L"baseframe") // Default position for the animation.
+        else if (data == "baseframe") // Default position for the animation.
         { // All frames will build their skeletons of this.
-            fileIn >> data; // Skip "{".
+            tokenizer.Skip("{");
+            animation.baseFrameJoints.reserve(animation.numJoints);
 
             for (int i = 0; i < animation.numJoints; i++)
             {
                 Joint joint;
 
-                fileIn >> data; // Skip "(".
-                fileIn >> joint.position.x >> joint.position.z >> joint.position.y;
-                fileIn >> data >> data; // Skip ") (".
-                fileIn >> joint.orientation.x >> joint.orientation.z >> joint.orientation.y;
-                fileIn >> data; // Skip ")".
+                tokenizer.Skip("(");
+                joint.position.x = tokenizer.NextFloat();
+                joint.position.z = tokenizer.NextFloat();
+                joint.position.y = tokenizer.NextFloat();
+                tokenizer.Skip(")");
+
+                tokenizer.Skip("(");
+                joint.orientation.x = tokenizer.NextFloat();
+                joint.orientation.z = tokenizer.NextFloat();
+                joint.orientation.y = tokenizer.NextFloat();
+                tokenizer.Skip(")");
 
                 animation.baseFrameJoints.push_back(joint);
             }
         }
-        else if (data == L"frame")
+        else if (data == "frame")
         {
             FrameData frame;
 
-            fileIn >> frame.frameId;
-            fileIn >> data; // Skip "{".
+            frame.frameId = tokenizer.NextInt();
+            tokenizer.Skip("{");
 
+            frame.frameData.resize(animation.numAnimatedComponents);
             for (int i = 0; i < animation.numAnimatedComponents; i++)
-            {
-                float tempData;
-                fileIn >> tempData;
-                frame.frameData.push_back(tempData);
-            }
+                frame.frameData[i] = tokenizer.NextFloat();
 
-            animation.frameData.push_back(frame);
+            tokenizer.Skip("}");
 
-            BuildFrameSkeleton(animation, frame);
+            if (tokenizer.HasFailed())
+                break;
 
-            fileIn >> data; // Skip "}".
+            BuildFrameSkeleton(animation, frame);
+            animation.frameData.push_back(std::move(frame));
         }
     }
 
-    // Calculate and store some usefull animation data
-    animation.frameTime = 1.0f / animation.frameRate;
-    animation.totalAnimTime = animation.numFrames * animation.frameTime;
-    animation.currAnimTime = 0.0f;
-
-    // Make sure the joints exists in the model, and the parentId's match up.
-    if (!CheckAnimation(model, animation))
+    if (tokenizer.HasFailed())
     {
-        if (model.animations.empty())
-            model.HasAnimations = false;
+        Logger::Get()->error("Failed to parse the MD5 animation {}", StringHelper::WideToNarrow(fileName));
         return false;
     }
 
-    model.HasAnimations = true;
-
-    // Add animation to the model.
-    model.animations.push_back(animation);
     return true;
 }
 
@@ -416,95 +430,87 @@ void MD5Loader::PrepareMesh(md5_mesh_t& mesh, md5_model_t& model)
 void MD5Loader::PrepareNormals(md5_mesh_t& mesh, md5_model_t& model)
 {
     using namespace DirectX;
-    std::vector<XMFLOAT3> tempNormal;
-
-    // normalized and unormalized normals.
-    XMFLOAT3 unnormalized = XMFLOAT3(0.0f, 0.0f, 0.0f);
-
-    // Used to get vectors (sides) from the position of the verts
-    float vecX, vecY, vecZ;
 
-    // Two edges of our triangle
-    XMVECTOR edge1 = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
-    XMVECTOR edge2 = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
+    // Sum of the unnormalized normals of the faces that use each vertex, and the number of those faces.
+    std::vector<XMFLOAT3> normalSums(mesh.vertices.size(), XMFLOAT3(0.0f, 0.0f, 0.0f));
+    std::vector<int> facesUsing(mesh.vertices.size(), 0);
 
-    // Compute face normals
+    // Compute the face normals and add them to the sums of their vertices in one pass over the triangles.
+    // The triangles are visited in order, so every sum adds up its faces in the same order as before.
     for (unsigned int i = 0; i < mesh.trianglesCount; ++i)
     {
-        // Get the vector describing one edge of our triangle (edge, 0, 2).
-        vecX = mesh.vertices[mesh.indices[(i * 3)]].position.x - mesh.vertices[mesh.indices[(i * 3) + 2]].position.x;
-        vecY = mesh.vertices[mesh.indices[(i * 3)]].position.y - mesh.vertices[mesh.indices[(i * 3) + 2]].position.y;
-        vecZ = mesh.vertices[mesh.indices[(i * 3)]].position.z - mesh.vertices[mesh.indices[(i * 3) + 2]].position.z;
-        edge1 = XMVectorSet(vecX, vecY, vecZ, 0.0f); // Create our first edge.
-
-        // Get the vector describing another edge of our triangle (edge 2, 1).
-        vecX = mesh.vertices[mesh.indices[(i * 3) + 2]].position.x - mesh.vertices[mesh.indices[(i * 3) + 1]].position.x;
-        vecY = mesh.vertices[mesh.indices[(i * 3) + 2]].position.y - mesh.vertices[mesh.indices[(i * 3) + 1]].position.y;
-        vecZ = mesh.vertices[mesh.indices[(i * 3) + 2]].position.z - mesh.vertices[mesh.indices[(i * 3) + 1]].position.z;
-        edge2 = XMVectorSet(vecX, vecY, vecZ, 0.0f); // Create our second edge.
-
-        // Cross multiply the two edge vectors to get the un-normalized face normal.
-        XMStoreFloat3(&unnormalized, XMVector3Cross(edge1, edge2));
-
-        tempNormal.push_back(unnormalized);
-    }
+        DWORD const* triangle = &mesh.indices[i * 3];
 
-    // Compute vertex normals (normal Averaging).
-    XMVECTOR normalSum = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
-    int facesUsing = 0;
-    float tX, tY, tZ; // temp axis variables.
+        XMVECTOR const position0 = XMLoadFloat3(&mesh.vertices[triangle[0]].position);
+        XMVECTOR const position1 = XMLoadFloat3(&mesh.vertices[triangle[1]].position);
+        XMVECTOR const position2 = XMLoadFloat3(&mesh.vertices[triangle[2]].position);
 
-    // Go through each vertex
-    for (unsigned int i = 0; i < mesh.vertices.size(); ++i)
-    {
-        // Check which triangles use this vertex
-        for (unsigned int j = 0; j < mesh.trianglesCount; ++j)
+        // Cross multiply the edges (0, 2) and (2, 1) to get the un-normalized face normal.
+        XMFLOAT3 unnormalized;
+        XMStoreFloat3(&unnormalized, XMVector3Cross(XMVectorSubtract(position0, position2), XMVectorSubtract(position2, position1)));
+
+        for (int k = 0; k < 3; ++k)
         {
-            if (mesh.indices[j * 3] == i || mesh.indices[(j * 3) + 1] == i || mesh.indices[(j * 3) + 2] == i)
-            {
-                tX = XMVectorGetX(normalSum) + tempNormal[j].x;
-                tY = XMVectorGetY(normalSum) + tempNormal[j].y;
-                tZ = XMVectorGetZ(normalSum) + tempNormal[j].z;
+            // A degenerate triangle that uses a vertex twice still counts once for it.
+            if ((k > 0 && triangle[k] == triangle[0]) || (k > 1 && triangle[k] == triangle[1]))
+                continue;
 
-                // If a face is using the vertex, add the unnormalized face normal to the normal Sum.
-                normalSum = XMVectorSet(tX, tY, tZ, 0.0f);
+            XMFLOAT3& normalSum = normalSums[triangle[k]];
+            normalSum.x += unnormalized.x;
+            normalSum.y += unnormalized.y;
+            normalSum.z += unnormalized.z;
 
-                facesUsing++;
-            }
+            facesUsing[triangle[k]]++;
         }
+    }
 
+    // Compute vertex normals (normal Averaging).
+    for (unsigned int i = 0; i < mesh.vertices.size(); ++i)
+    {
         // Get the actual normal by dividing the normalSum by the number of faces sharing the vertex.
-        normalSum = normalSum / static_cast<float>(facesUsing);
+        XMVECTOR normalSum = XMVectorSet(normalSums[i].x, normalSums[i].y, normalSums[i].z, 0.0f);
+        normalSum = normalSum / static_cast<float>(facesUsing[i]);
 
         // Normalize the normalSum vector
         normalSum = XMVector3Normalize(normalSum);
 
         // Store the normal in our current vertex
-        mesh.vertices[i].normal.x = -XMVectorGetX(normalSum);
-        mesh.vertices[i].normal.y = -XMVectorGetY(normalSum);
-        mesh.vertices[i].normal.z = -XMVectorGetZ(normalSum);
-
-        MD5Vertex vertex = mesh.vertices[i]; // Get the current vertex
-
-        // Create the joint space normal for easy normal calculations in animation.
-        //mesh.jointSpaceNormals.push_back(XMFLOAT3(0.0f, 0.0f, 0.0f)); // Push back a blank normal
-
-        XMVECTOR normal = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f); // Clear normal
+        MD5Vertex& vertex = mesh.vertices[i];
+        vertex.normal.x = -XMVectorGetX(normalSum);
+        vertex.normal.y = -XMVectorGetY(normalSum);
+        vertex.normal.z = -XMVectorGetZ(normalSum);
 
+        // Create the joint space normal of every weight for easy normal calculations in animation.
         for (int k = 0; k < vertex.WeightCount; k++)
         {
-            Joint joint = model.joints[mesh.weights[vertex.StartWeight + k].jointId];
-            XMVECTOR jointOrientation = XMVectorSet(joint.orientation.x, joint.orientation.y, joint.orientation.z, joint.orientation.w);
+            Weight& weight = mesh.weights[vertex.StartWeight + k];
+            XMVECTOR jointOrientation = XMLoadFloat4(&model.joints[weight.jointId].orientation);
 
             // Calculate normal based off joints orientation (turn into joint space).
-            normal = XMQuaternionMultiply(XMQuaternionMultiply(XMQuaternionInverse(jointOrientation), normalSum), jointOrientation);
+            XMVECTOR normal = XMQuaternionMultiply(XMQuaternionMultiply(XMQuaternionInverse(jointOrientation), normalSum), jointOrientation);
 
-            XMStoreFloat3(&mesh.weights[vertex.StartWeight + k].normal, XMVector3Normalize(normal));
+            XMStoreFloat3(&weight.normal, XMVector3Normalize(normal));
         }
+    }
+}
+
+void MD5Loader::PrepareSkinningWeights(md5_mesh_t& mesh)
+{
+    SkinningWeights& skinningWeights = mesh.skinningWeights;
+    size_t const weightCount = mesh.weights.size();
+
+    skinningWeights.jointIds.resize(weightCount);
+    skinningWeights.positions.resize(weightCount);
+    skinningWeights.normals.resize(weightCount);
 
-        // Clear normalSum, facesUsing for next vertex
-        normalSum = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
-        facesUsing = 0;
+    // Fold the bias into the weights so the skinning only has to add up the transformed weights.
+    for (size_t i = 0; i < weightCount; ++i)
+    {
+        Weight const& weight = mesh.weights[i];
+
+        skinningWeights.jointIds[i] = weight.jointId;
+        skinningWeights.positions[i] = DirectX::XMFLOAT4A(weight.position.x * weight.bias, weight.position.y * weight.bias, weight.position.z * weight.bias, weight.bias);
+        skinningWeights.normals[i] = DirectX::XMFLOAT4A(-weight.normal.x * weight.bias, -weight.normal.y * weight.bias, -weight.normal.z * weight.bias, 0.0f);
     }
 }
 
@@ -512,6 +518,9 @@ void MD5Loader::BuildFrameSkeleton(md5_anim_t& animation, FrameData const& frame
 {
     // Build the frame skeleton.
     std::vector<Joint> skeleton;
+    size_t const firstJoint = animation.frameSkeleton.size();
+    animation.frameSkeleton.resize(firstJoint + animation.jointInfo.size());
+    animation.localFrameSkeleton.resize(firstJoint + animation.jointInfo.size());
 
     for (int i = 0; i < animation.jointInfo.size(); i++)
     {
@@ -540,6 +549,7 @@ void MD5Loader::BuildFrameSkeleton(md5_anim_t& animation, FrameData const& frame
             joint.orientation.y = frameData.frameData[animation.jointInfo[i].startIndex + j++];
 
         QuaternionComputeW(joint.orientation);
+        animation.localFrameSkeleton[firstJoint + i] = { joint.position, joint.orientation };
 
         if (joint.parentId >= 0)
         {
@@ -572,10 +582,8 @@ void MD5Loader::BuildFrameSkeleton(md5_anim_t& animation, FrameData const& frame
 
         // Store the joint into our temporary frame skeleton.
         skeleton.push_back(joint);
+        animation.frameSkeleton[firstJoint + i] = { joint.position, joint.orientation };
     }
-
-    // Push back our newly created frame skeleton into the animation's frameSkeleton array.
-    animation.frameSkeleton.push_back(skeleton);
 }
 
 bool MD5Loader::CheckAnimation(md5_model_t const& model, md5_anim_t const& animation)
@@ -1,7 +1,7 @@
 #pragma once
 
-#include "DynamicVertexBuffer.h"
 #include "IndexBuffer.h"
+#include "VertexBuffer.h"
 #include "MD5Vertex.h"
 
 namespace axec//alibur
@@ -30,6 +30,13 @@ namespace axec//alibur
         DirectX::XMFLOAT4 orientation;
     };
 
+    // Joint of a pose without the name and parent, what the animation and the skinning work with.
+    struct JointPose
+    {
+        DirectX::XMFLOAT3 position;
+        DirectX::XMFLOAT4 orientation;
+    };
+
     struct FrameData
     {
         int frameId;
@@ -42,6 +49,15 @@ namespace axec//alibur
         DirectX::XMFLOAT3 max;
     };
 
+    // The weights of a mesh in separate arrays for the skinning. The position is multiplied by the bias and
+    // keeps the bias in w, the normal is multiplied by the negative bias.
+    struct SkinningWeights
+    {
+        std::vector<int> jointIds;
+        std::vector<DirectX::XMFLOAT4A> positions;
+        std::vector<DirectX::XMFLOAT4A> normals;
+    };
+
     struct md5_mesh_t
     {
         std::wstring shader;
@@ -52,9 +68,10 @@ namespace axec//alibur
         std::vector<DWORD> indices;
 
         std::vector<Weight> weights;
+        SkinningWeights skinningWeights;
 
         Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture;
-        DX::DynamicVertexBuffer<MD5Vertex> vertexBuffer;
+        Bind::VertexBuffer<MD5SkinnedVertex> skinnedVertexBuffer;
         Bind::IndexBuffer<DWORD> indexBuffer;
     };
 
@@ -67,13 +84,17 @@ namespace axec//alibur
 
         float frameTime;
         float totalAnimTime;
-        float currAnimTime;
 
         std::vector<JointInfo> jointInfo;
         std::vector<BoundingBox> frameBounds;
         std::vector<Joint> baseFrameJoints;
         std::vector<FrameData> frameData;
-        std::vector<std::vector<Joint>> frameSkeleton;
+
+        // The model space poses of all frames one after another, numJoints joints per frame.
+        std::vector<JointPose> frameSkeleton;
+
+        // The same poses with every joint relative to its parent, in the same layout. These are what gets blended.
+        std::vector<JointPose> localFrameSkeleton;
     };
 
     struct md5_model_t
@@ -83,22 +104,33 @@ namespace axec//alibur
 
         std::vector<Joint> joints;
         std::vector<md5_mesh_t> meshes;
-
-        bool HasAnimations;
-        std::vector<md5_anim_t> animations;
     };
 
     class MD5Loader
     {
         public:
             static bool LoadMD5Mesh(ID3D11DeviceContext* deviceContext, std::wstring const& fileName, md5_model_t& model);
-            static bool LoadMD5Anim(std::wstring const& fileName, md5_model_t& model);
+            static bool LoadMD5Anim(std::wstring const& fileName, md5_anim_t& animation);
+
+            // The vertices of the vertex shader skinning are only created for the meshes that are skinned on the GPU.
+            static void CreateSkinnedVertexBuffers(ID3D11Device* device, md5_model_t& model);
+            static bool CheckAnimation(md5_model_t const& model, md5_anim_t const& animation);
+
+            // Offline cooking of the text files, the load functions above also cook them when the cooked file is out of date.
+            static bool CookMD5Mesh(std::wstring const& fileName);
+            static bool CookMD5Anim(std::wstring const& fileName);
+
+            // Parse the text files and never the cooked ones, the tests check them against a reference.
+            static bool ParseMD5Mesh(std::wstring const& fileName, md5_model_t& model);
+            static bool ParseMD5Anim(std::wstring const& fileName, md5_anim_t& animation);
+
+            // Averages the face normals around every vertex and turns them into the joint space of each weight.
+            static void PrepareNormals(md5_mesh_t& mesh, md5_model_t& model);
 
         private:
             static void PrepareMesh(md5_mesh_t& mesh, md5_model_t& model);
-            static void PrepareNormals(md5_mesh_t& mesh, md5_model_t& model);
+            static void PrepareSkinningWeights(md5_mesh_t& mesh);
             static void BuildFrameSkeleton(md5_anim_t& animation, FrameData const& frameData);
-            static bool CheckAnimation(md5_model_t const& model, md5_anim_t const& animation);
             static void QuaternionComputeW(DirectX::XMFLOAT4& q);
     };
 }
\ No newline at end of file
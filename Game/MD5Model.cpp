@@ -4,156 +4,174 @@
 
 #include "pch.h"
 #include "MD5Model.h"
+#include "MD5Cache.h"
+#include "MD5Skinning.h"
+#include "TaskPool.h"
 
+static_assert(axec::MD5Skinning::MAX_PALETTE_JOINTS == MD5ModelShader::MAX_JOINTS, "Joint palette size mismatch");
 
 MD5Model::MD5Model()
 {
-    anim_index = 0;
+    skinningMode = MD5SkinningMode::CPU;
+    anim_index = -1;
 }
 
 MD5Model::~MD5Model()
 {
-    model.meshes.clear();
 }
 
-bool MD5Model::LoadMesh(ID3D11DeviceContext* deviceContext, std::wstring const& fileName)
+bool MD5Model::LoadMesh(ID3D11DeviceContext* deviceContext, std::wstring const& fileName, MD5SkinningMode skinningMode)
 {
-    if (!axec::MD5Loader::LoadMD5Mesh(deviceContext, fileName, model))
+    model = axec::MD5Cache::ResolveMesh(deviceContext, fileName, skinningMode);
+    if (!model)
         return false;
 
-    shader.InitializeShaders(deviceContext);
+    // The palette of the vertex shader has a fixed size, larger skeletons are skinned on the CPU.
+    this->skinningMode = skinningMode;
+    if (skinningMode == MD5SkinningMode::GPU && model->numJoints > axec::MD5Skinning::MAX_PALETTE_JOINTS)
+    {
+        Logger::Get()->warn("MD5 mesh has {} joints, more than the {} of the GPU skinning. Skinning it on the CPU.", model->numJoints, axec::MD5Skinning::MAX_PALETTE_JOINTS);
+        this->skinningMode = MD5SkinningMode::CPU;
+    }
+
+    // Start with the bind pose until an animation is played.
+    pose.resize(model->joints.size());
+    for (size_t i = 0; i < model->joints.size(); ++i)
+        pose[i] = { model->joints[i].position, model->joints[i].orientation };
+
+    animator.Initialize(*model);
+
+    jointMatrices.resize(model->joints.size());
+    axec::MD5Skinning::BuildJointMatrices(pose.data(), model->numJoints, jointMatrices.data());
+
+    if (this->skinningMode == MD5SkinningMode::GPU)
+    {
+        jointPalette = std::make_unique<MD5ModelShader::JointPaletteBufferType>();
+        axec::MD5Skinning::BuildJointPalette(jointMatrices.data(), model->numJoints, jointPalette->jointMatrices);
+    }
+    else
+    {
+        ID3D11Device* device = DX::GetDevice(deviceContext);
+        if (device == nullptr)
+            return false;
+
+        // Every instance skinned on the CPU needs its own vertices, they start as the bind pose of the mesh.
+        skinnedMeshes.resize(model->meshes.size());
+        for (size_t k = 0; k < model->meshes.size(); ++k)
+        {
+            skinnedMeshes[k].vertices = model->meshes[k].vertices;
+            skinnedMeshes[k].vertexBuffer.Create(device, skinnedMeshes[k].vertices.data(), static_cast<UINT>(skinnedMeshes[k].vertices.size()));
+        }
+
+        BuildSkinningRanges();
+    }
+
+    shader.InitializeShaders(deviceContext, this->skinningMode);
     return true;
 }
 
 bool MD5Model::LoadAnim(std::wstring const& fileName)
 {
-    if (!axec::MD5Loader::LoadMD5Anim(fileName, model))
+    if (!model)
         return false;
+
+    std::shared_ptr<axec::md5_anim_t const> animation = axec::MD5Cache::ResolveAnim(fileName);
+    if (!animation)
+        return false;
+
+    // Make sure the joints exists in the model, and the parentId's match up.
+    if (!axec::MD5Loader::CheckAnimation(*model, *animation))
+        return false;
+
+    animations.push_back(std::move(animation));
     return true;
 }
 
 void MD5Model::Update(ID3D11DeviceContext* deviceContext, float deltaTime, int index)
 {
-    if (!model.HasAnimations)
+    if (animations.empty())
         return;
 
+    // Crossfade the base layer to a new animation instead of jumping to its first frame.
     if (anim_index != index)
     {
-        // If animation is changed reset animation time.
-        model.animations[index].currAnimTime = 0.0f;
+        animator.Play(0, animations[index].get(), anim_index < 0 ? 0.0f : CROSSFADE_TIME);
+        anim_index = index;
     }
 
-    anim_index = index;
-
-    model.animations[index].currAnimTime += deltaTime;
-
-    if (model.animations[index].currAnimTime > model.animations[index].totalAnimTime)
-        model.animations[index].currAnimTime = 0.0f;
-
-    // Which frame are we on
-    float currentFrame = model.animations[index].currAnimTime * model.animations[index].frameRate;
-    int frame0 = static_cast<int>(floorf(currentFrame));
-    int frame1 = frame0 + 1;
+    // Blend all layers of the animator into the pose buffer of this model.
+    animator.Update(deltaTime);
+    animator.Evaluate(pose.data());
 
-    // Make sure we don't go over the number of frames.
-    if (frame0 == model.animations[index].numFrames - 1)
-        frame1 = 0;
+    int const numJoints = animator.GetJointCount();
 
-    float interpolation = currentFrame - frame0; // Get the remainder (in time) between frame0 and frame1 to use as interpolation factor.
+    // Build the joint matrices once, every weight of the meshes is a single matrix transform then.
+    axec::MD5Skinning::BuildJointMatrices(pose.data(), numJoints, jointMatrices.data());
 
-    std::vector<axec::Joint> interpolatedSkeleton; // Create a frame skeleton to store the interpolated skeletons in
-
-    // Compute the interpolated skeleton.
-    for (int i = 0; i < model.animations[index].numJoints; i++)
+    // The vertex shader skins the meshes, only the palette goes to the GPU when drawing.
+    if (skinningMode == MD5SkinningMode::GPU)
     {
-        axec::Joint tempJoint;
-        axec::Joint joint0 = model.animations[index].frameSkeleton[frame0][i];
-        axec::Joint joint1 = model.animations[index].frameSkeleton[frame1][i];
-
-        tempJoint.parentId = joint0.parentId;
-
-        // Turn the two quaternions into XMVECTORs for easy computations.
-        DirectX::XMVECTOR joint0Orient = DirectX::XMVectorSet(joint0.orientation.x, joint0.orientation.y, joint0.orientation.z, joint0.orientation.w);
-        DirectX::XMVECTOR joint1Orient = DirectX::XMVectorSet(joint1.orientation.x, joint1.orientation.y, joint1.orientation.z, joint1.orientation.w);
-
-        // Interpolate positions
-        tempJoint.position.x = joint0.position.x + (interpolation * (joint1.position.x - joint0.position.x));
-        tempJoint.position.y = joint0.position.y + (interpolation * (joint1.position.y - joint0.position.y));
-        tempJoint.position.z = joint0.position.z + (interpolation * (joint1.position.z - joint0.position.z));
-
-        // Interpolate orientations using spherical interpolation (Slerp).
-        DirectX::XMStoreFloat4(&tempJoint.orientation, DirectX::XMQuaternionSlerp(joint0Orient, joint1Orient, interpolation));
-
-        interpolatedSkeleton.push_back(tempJoint); // Push the joint back into our interpolated skeleton.
+        axec::MD5Skinning::BuildJointPalette(jointMatrices.data(), numJoints, jointPalette->jointMatrices);
+        return;
     }
 
-    for (int k = 0; k < model.numMeshes; k++)
+    // Skin the vertex ranges of all meshes on the task pool.
+    TaskPool::Get().ParallelFor(static_cast<uint32>(skinningRanges.size()), 1, [this](uint32 begin, uint32 end)
     {
-        for (int i = 0; i < model.meshes[k].vertices.size(); ++i)
+        for (uint32 i = begin; i < end; ++i)
         {
-            MD5Vertex tempVert = model.meshes[k].vertices[i];
-            tempVert.position = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f); // Make sure the vertex's pos is cleared first.
-            tempVert.normal = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f); // Clear vertices normal.
-
-            // Sum up the joints and weights information to get vertex's position and normal.
-            for (int j = 0; j < tempVert.WeightCount; ++j)
-            {
-                axec::Weight tempWeight = model.meshes[k].weights[tempVert.StartWeight + j];
-                axec::Joint tempJoint = interpolatedSkeleton[tempWeight.jointId];
-
-                // Convert joint orientation and weight pos to vectors for easier computation.
-                DirectX::XMVECTOR tempJointOrientation = DirectX::XMVectorSet(tempJoint.orientation.x, tempJoint.orientation.y, tempJoint.orientation.z, tempJoint.orientation.w);
-                DirectX::XMVECTOR tempWeightPos = DirectX::XMVectorSet(tempWeight.position.x, tempWeight.position.y, tempWeight.position.z, 0.0f);
-
-                // We will need to use the conjugate of the joint orientation quaternion
-                DirectX::XMVECTOR tempJointOrientationConjugate = DirectX::XMQuaternionInverse(tempJointOrientation);
-
-                // Calculate vertex position (in joint space, eg. rotate the point around (0,0,0)) for this weight using the joint orientation quaternion and its conjugate
-                // We can rotate a point using a quaternion with the equation "rotatedPoint = quaternion * point * quaternionConjugate"
-                DirectX::XMFLOAT3 rotatedPoint;
-                DirectX::XMStoreFloat3(&rotatedPoint, DirectX::XMQuaternionMultiply(DirectX::XMQuaternionMultiply(tempJointOrientation, tempWeightPos), tempJointOrientationConjugate));
-
-                // Now move the vertices position from joint space (0, 0, 0) to the joints position in world space, taking the weights bias into account
-                tempVert.position.x += (tempJoint.position.x + rotatedPoint.x) * tempWeight.bias;
-                tempVert.position.y += (tempJoint.position.y + rotatedPoint.y) * tempWeight.bias;
-                tempVert.position.z += (tempJoint.position.z + rotatedPoint.z) * tempWeight.bias;
-
-                // Compute the normals for this frames skeleton using the weight normals from before
-                // We can compute the normals the same way we compute the vertices position,
-                // only we don't have to translate them (just rotate).
-                DirectX::XMVECTOR tempWeightNormal = DirectX::XMVectorSet(tempWeight.normal.x, tempWeight.normal.y, tempWeight.normal.z, 0.0f);
-
-                // Rotate the normal
-                DirectX::XMStoreFloat3(&rotatedPoint, DirectX::XMQuaternionMultiply(DirectX::XMQuaternionMultiply(tempJointOrientation, tempWeightNormal), tempJointOrientationConjugate));
-
-                // Add to vertices normal and take weight bias into account
-                tempVert.normal.x -= rotatedPoint.x * tempWeight.bias;
-                tempVert.normal.y -= rotatedPoint.y * tempWeight.bias;
-                tempVert.normal.z -= rotatedPoint.z * tempWeight.bias;
-            }
-
-            model.meshes[k].vertices[i].position = tempVert.position;
-            model.meshes[k].vertices[i].normal = tempVert.normal;
-            DirectX::XMStoreFloat3(&model.meshes[k].vertices[i].normal, DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&model.meshes[k].vertices[i].normal)));
+            SkinningRange const& range = skinningRanges[i];
+            axec::MD5Skinning::SkinVertices(model->meshes[range.mesh], jointMatrices.data(), range.firstVertex, range.endVertex, skinnedMeshes[range.mesh].vertices.data());
         }
+    });
 
-        model.meshes[k].vertexBuffer.SetData(deviceContext, &model.meshes[k].vertices[0], static_cast<UINT>(model.meshes[k].vertices.size()));
-    }
+    // Upload on this thread, the device context isn't free threaded.
+    for (SkinnedMesh& mesh : skinnedMeshes)
+        mesh.vertexBuffer.SetData(deviceContext, mesh.vertices.data(), static_cast<UINT>(mesh.vertices.size()));
 }
 
 void MD5Model::Draw(ID3D11DeviceContext* deviceContext, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj)
 {
+    if (!model)
+        return;
+
     shader.SetShaderParameters(deviceContext, world, view, proj);
+
+    bool const skinnedOnGpu = skinningMode == MD5SkinningMode::GPU;
+    if (skinnedOnGpu)
+        shader.SetJointPalette(deviceContext, *jointPalette);
     
-    for (int i = 0; i < model.numMeshes; i++)
+    for (int i = 0; i < model->numMeshes; i++)
     {
-        deviceContext->IASetIndexBuffer(model.meshes[i].indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+        axec::md5_mesh_t const& mesh = model->meshes[i];
+        deviceContext->IASetIndexBuffer(mesh.indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
 
-        UINT stride = model.meshes[i].vertexBuffer.Stride();
         UINT offset = 0;
-        deviceContext->IASetVertexBuffers(0, 1, model.meshes[i].vertexBuffer.GetAddressOf(), &stride, &offset);
+        if (skinnedOnGpu)
+        {
+            deviceContext->IASetVertexBuffers(0, 1, mesh.skinnedVertexBuffer.GetAddressOf(), mesh.skinnedVertexBuffer.StridePtr(), &offset);
+        }
+        else
+        {
+            UINT stride = skinnedMeshes[i].vertexBuffer.Stride();
+            deviceContext->IASetVertexBuffers(0, 1, skinnedMeshes[i].vertexBuffer.GetAddressOf(), &stride, &offset);
+        }
+
+        shader.SetTexture(deviceContext, mesh.texture.Get());
+        shader.RenderShader(deviceContext, static_cast<UINT>(mesh.indices.size()));
+    }
+}
+
+void MD5Model::BuildSkinningRanges()
+{
+    skinningRanges.clear();
+
+    // Large meshes are split so their vertices can be skinned by several threads.
+    for (int k = 0; k < model->numMeshes; k++)
+    {
+        uint32 const vertexCount = static_cast<uint32>(model->meshes[k].vertices.size());
 
-        shader.SetTexture(deviceContext, model.meshes[i].texture.Get());
-        shader.RenderShader(deviceContext, static_cast<UINT>(model.meshes[i].indices.size()));
+        for (uint32 first = 0; first < vertexCount; first += SKINNING_GRAIN)
+            skinningRanges.push_back({ k, first, std::min(first + SKINNING_GRAIN, vertexCount) });
     }
 }
\ No newline at end of file
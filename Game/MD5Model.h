@@ -4,23 +4,64 @@
 
 #pragma once
 
+#include "DynamicVertexBuffer.h"
 #include "MD5ModelShader.h"
-#include "MD5Loader.h"
+#include "MD5Animator.h"
 
+// One instance of an MD5 model. The mesh and the animations are shared with the other instances of the same
+// files through the MD5Cache, this only keeps the playback state and the pose of the instance.
 class MD5Model
 {
     public:
         MD5Model();
         ~MD5Model();
         
-        bool LoadMesh(ID3D11DeviceContext* deviceContext, std::wstring const& fileName);
+        bool LoadMesh(ID3D11DeviceContext* deviceContext, std::wstring const& fileName, MD5SkinningMode skinningMode = MD5SkinningMode::CPU);
         bool LoadAnim(std::wstring const& fileName);
 
+        // Plays the animation index on the base layer, switching to another index crossfades to it.
         void Update(ID3D11DeviceContext* deviceContext, float deltaTime, int index);
         void Draw(ID3D11DeviceContext* deviceContext, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj);
 
+        // The layers above the base animation, e.g. an attack on the upper body while walking.
+        axec::MD5Animator& GetAnimator() { return animator; }
+        axec::md5_model_t const* GetMesh() const { return model.get(); }
+        axec::md5_anim_t const* GetAnimation(int index) const { return animations[index].get(); }
+
+    private:
+        // A range of vertices of one mesh that is skinned as one task.
+        struct SkinningRange
+        {
+            int mesh;
+            uint32 firstVertex;
+            uint32 endVertex;
+        };
+
+        // The vertices of a mesh skinned on the CPU for this instance and the buffer they are uploaded to.
+        struct SkinnedMesh
+        {
+            std::vector<MD5Vertex> vertices;
+            DX::DynamicVertexBuffer<MD5Vertex> vertexBuffer;
+        };
+
+        static constexpr uint32 SKINNING_GRAIN = 1024;
+        static constexpr float CROSSFADE_TIME = 0.2f;
+
+    private:
+        void BuildSkinningRanges();
+
     private:
-        axec::md5_model_t model;
+        std::shared_ptr<axec::md5_model_t const> model;
+        std::vector<std::shared_ptr<axec::md5_anim_t const>> animations;
+        MD5SkinningMode skinningMode;
         MD5ModelShader shader;
         int anim_index;
+        axec::MD5Animator animator;
+
+        // Per instance buffers sized when the mesh is loaded, so updating the animation doesn't allocate.
+        std::vector<axec::JointPose> pose;
+        std::vector<DirectX::XMFLOAT4X4A> jointMatrices;
+        std::vector<SkinningRange> skinningRanges;
+        std::vector<SkinnedMesh> skinnedMeshes;
+        std::unique_ptr<MD5ModelShader::JointPaletteBufferType> jointPalette;
 };
\ No newline at end of file
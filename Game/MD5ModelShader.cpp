@@ -4,11 +4,11 @@
 
 #include "pch.h"
 #include "MD5ModelShader.h"
-#include "MD5Vertex.h"
 
 namespace MD5ModelShaders
 {
 #include "MD5ModelVertexShader.shh"
+#include "MD5SkinnedVertexShader.shh"
 #include "MD5ModelPixelShader.shh"
 }
 
@@ -21,16 +21,26 @@ MD5ModelShader::~MD5ModelShader()
 {
 }
 
-void MD5ModelShader::InitializeShaders(ID3D11DeviceContext* deviceContext)
+void MD5ModelShader::InitializeShaders(ID3D11DeviceContext* deviceContext, MD5SkinningMode skinningMode)
 {
     ID3D11Device* device = DX::GetDevice(deviceContext);
     
     if (device == nullptr)
         return;
 
-    DX::ThrowIfFailed(device->CreateVertexShader(MD5ModelShaders::MD5ModelVertexShaderBytecode, sizeof(MD5ModelShaders::MD5ModelVertexShaderBytecode), nullptr, vertexShader.GetAddressOf()));
+    if (skinningMode == MD5SkinningMode::GPU)
+    {
+        DX::ThrowIfFailed(device->CreateVertexShader(MD5ModelShaders::MD5SkinnedVertexShaderBytecode, sizeof(MD5ModelShaders::MD5SkinnedVertexShaderBytecode), nullptr, vertexShader.GetAddressOf()));
+        DX::ThrowIfFailed(device->CreateInputLayout(MD5SkinnedVertex::InputElements, MD5SkinnedVertex::InputElementCount, MD5ModelShaders::MD5SkinnedVertexShaderBytecode, sizeof(MD5ModelShaders::MD5SkinnedVertexShaderBytecode), inputLayout.GetAddressOf()));
+        jointPaletteBuffer.Create(device);
+    }
+    else
+    {
+        DX::ThrowIfFailed(device->CreateVertexShader(MD5ModelShaders::MD5ModelVertexShaderBytecode, sizeof(MD5ModelShaders::MD5ModelVertexShaderBytecode), nullptr, vertexShader.GetAddressOf()));
+        DX::ThrowIfFailed(device->CreateInputLayout(MD5Vertex::InputElements, MD5Vertex::InputElementCount, MD5ModelShaders::MD5ModelVertexShaderBytecode, sizeof(MD5ModelShaders::MD5ModelVertexShaderBytecode), inputLayout.GetAddressOf()));
+    }
+
     DX::ThrowIfFailed(device->CreatePixelShader(MD5ModelShaders::MD5ModelPixelShaderBytecode, sizeof(MD5ModelShaders::MD5ModelPixelShaderBytecode), nullptr, pixelShader.GetAddressOf()));
-    DX::ThrowIfFailed(device->CreateInputLayout(MD5Vertex::InputElements, MD5Vertex::InputElementCount, MD5ModelShaders::MD5ModelVertexShaderBytecode, sizeof(MD5ModelShaders::MD5ModelVertexShaderBytecode), inputLayout.GetAddressOf()));
 
     states = std::make_unique<DirectX::CommonStates>(device);
 
@@ -62,6 +72,13 @@ void MD5ModelShader::SetShaderParameters(ID3D11DeviceContext* deviceContext, Dir
     deviceContext->PSSetConstantBuffers(0, 1, lightBuffer.GetAddressOf());
 }
 
+void MD5ModelShader::SetJointPalette(ID3D11DeviceContext* deviceContext, JointPaletteBufferType const& palette)
+{
+    jointPaletteBuffer.SetData(deviceContext, palette);
+
+    deviceContext->VSSetConstantBuffers(1, 1, jointPaletteBuffer.GetAddressOf());
+}
+
 void MD5ModelShader::SetTexture(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* texture)
 {
     ID3D11Device* device = DX::GetDevice(deviceContext);
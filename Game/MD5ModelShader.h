@@ -6,6 +6,7 @@
 
 #include "ConstantBuffer.h"
 #include "CommonStates.h"
+#include "MD5Vertex.h"
 
 class MD5ModelShader
 {
@@ -28,8 +29,17 @@ class MD5ModelShader
             float padding;
         };
 
-        void InitializeShaders(ID3D11DeviceContext* deviceContext);
+        // Joint matrices of the vertex shader skinning, keep the size in sync with MD5SkinnedVertexShader.hlsl.
+        static constexpr int MAX_JOINTS = 128;
+
+        struct JointPaletteBufferType
+        {
+            DirectX::XMFLOAT4X4 jointMatrices[MAX_JOINTS];
+        };
+
+        void InitializeShaders(ID3D11DeviceContext* deviceContext, MD5SkinningMode skinningMode = MD5SkinningMode::CPU);
         void SetShaderParameters(ID3D11DeviceContext* deviceContext, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj);
+        void SetJointPalette(ID3D11DeviceContext* deviceContext, JointPaletteBufferType const& palette);
         void SetTexture(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* texture);
         void RenderShader(ID3D11DeviceContext* deviceContext, UINT numIndices);
 
@@ -41,5 +51,6 @@ class MD5ModelShader
         Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout;
         DX::ConstantBuffer<MatrixBufferType> constantBuffer;
         DX::ConstantBuffer<LightBufferType> lightBuffer;
+        DX::ConstantBuffer<JointPaletteBufferType> jointPaletteBuffer;
 };
 
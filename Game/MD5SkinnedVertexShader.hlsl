@@ -0,0 +1,63 @@
+#include "Transform.hlsl"
+
+// Keep in sync with MD5ModelShader::MAX_JOINTS.
+#define MAX_JOINTS 128
+
+cbuffer JointPalette : register(b1)
+{
+    matrix jointMatrices[MAX_JOINTS];
+};
+
+struct VertexInputType
+{
+    float2 tex : TEXCOORD;
+    uint4 jointIndices : BLENDINDICES;
+    float4 weightPosition0 : WEIGHTPOSITION0;
+    float4 weightPosition1 : WEIGHTPOSITION1;
+    float4 weightPosition2 : WEIGHTPOSITION2;
+    float4 weightPosition3 : WEIGHTPOSITION3;
+    float4 weightNormal0 : WEIGHTNORMAL0;
+    float4 weightNormal1 : WEIGHTNORMAL1;
+    float4 weightNormal2 : WEIGHTNORMAL2;
+    float4 weightNormal3 : WEIGHTNORMAL3;
+};
+
+struct PixelInputType
+{
+    float4 position : SV_POSITION;
+    float3 normal : NORMAL;
+    float2 tex : TEXCOORD;
+};
+
+PixelInputType MD5SkinnedVertexShader(VertexInputType input)
+{
+    PixelInputType output;
+
+    // The weight positions are multiplied by their weight and carry it in w, so the joint translation is weighted too.
+    float4 position = mul(input.weightPosition0, jointMatrices[input.jointIndices.x]);
+    position += mul(input.weightPosition1, jointMatrices[input.jointIndices.y]);
+    position += mul(input.weightPosition2, jointMatrices[input.jointIndices.z]);
+    position += mul(input.weightPosition3, jointMatrices[input.jointIndices.w]);
+
+    float3 normal = mul(input.weightNormal0.xyz, (float3x3)jointMatrices[input.jointIndices.x]) * input.weightPosition0.w;
+    normal += mul(input.weightNormal1.xyz, (float3x3)jointMatrices[input.jointIndices.y]) * input.weightPosition1.w;
+    normal += mul(input.weightNormal2.xyz, (float3x3)jointMatrices[input.jointIndices.z]) * input.weightPosition2.w;
+    normal += mul(input.weightNormal3.xyz, (float3x3)jointMatrices[input.jointIndices.w]) * input.weightPosition3.w;
+
+    // The weights add up to one, so w is one again.
+    position.w = 1.0f;
+
+    // Calculate the position of the vertex against the world, view, and projection matrices.
+    output.position = mul(position, worldMatrix);
+    output.position = mul(output.position, viewMatrix);
+    output.position = mul(output.position, projectionMatrix);
+
+    // Store the texture coordinates for the pixel shader.
+    output.tex = input.tex;
+
+    // Calculate the normal vector against the world matrix only.
+    output.normal = mul(normal, (float3x3)worldMatrix);
+    output.normal = normalize(output.normal);
+
+    return output;
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+//
+// MD5Skinning.cpp
+//
+
+#include "pch.h"
+#include "MD5Skinning.h"
+
+using namespace axec;
+using namespace DirectX;
+
+void MD5Skinning::BuildJointMatrices(JointPose const* joints, int jointCount, XMFLOAT4X4A* matrices)
+{
+    for (int i = 0; i < jointCount; ++i)
+    {
+        XMVECTOR orientation = XMLoadFloat4(&joints[i].orientation);
+
+        // The weights are rotated by the conjugate of the orientation, see MD5Loader::PrepareMesh.
+        XMMATRIX matrix = XMMatrixRotationQuaternion(XMQuaternionConjugate(orientation));
+        matrix.r[3] = XMVectorSetW(XMLoadFloat3(&joints[i].position), 1.0f);
+
+        XMStoreFloat4x4A(&matrices[i], matrix);
+    }
+}
+
+void MD5Skinning::SkinVertices(md5_mesh_t const& mesh, XMFLOAT4X4A const* matrices, uint32 firstVertex, uint32 endVertex, MD5Vertex* vertices)
+{
+    SkinningWeights const& weights = mesh.skinningWeights;
+
+    for (uint32 i = firstVertex; i < endVertex; ++i)
+    {
+        MD5Vertex const& vertex = mesh.vertices[i];
+
+        XMVECTOR position = XMVectorZero();
+        XMVECTOR normal = XMVectorZero();
+
+        int const endWeight = vertex.StartWeight + vertex.WeightCount;
+        for (int j = vertex.StartWeight; j < endWeight; ++j)
+        {
+            XMMATRIX const joint = XMLoadFloat4x4A(&matrices[weights.jointIds[j]]);
+
+            // The position has the bias in w so the translation is scaled by it too, the normal has a w of zero.
+            position = XMVectorAdd(position, XMVector4Transform(XMLoadFloat4A(&weights.positions[j]), joint));
+            normal = XMVectorAdd(normal, XMVector3TransformNormal(XMLoadFloat4A(&weights.normals[j]), joint));
+        }
+
+        XMStoreFloat3(&vertices[i].position, position);
+        XMStoreFloat3(&vertices[i].normal, XMVector3Normalize(normal));
+    }
+}
+
+int MD5Skinning::ReduceWeights(Weight const* weights, int weightCount, int* selectedWeights, float* biases)
+{
+    int count = 0;
+    float sum = 0.0f;
+
+    // Pick the strongest weights one after another, the vertices rarely have more than a handful.
+    for (; count < MAX_JOINT_INFLUENCES && count < weightCount; ++count)
+    {
+        int strongest = -1;
+        for (int i = 0; i < weightCount; ++i)
+        {
+            if (std::find(selectedWeights, selectedWeights + count, i) != selectedWeights + count)
+                continue;
+
+            if (strongest < 0 || weights[i].bias > weights[strongest].bias)
+                strongest = i;
+        }
+
+        selectedWeights[count] = strongest;
+        sum += weights[strongest].bias;
+    }
+
+    float const scale = sum > 0.0f ? 1.0f / sum : 0.0f;
+
+    for (int i = 0; i < count; ++i)
+        biases[i] = weights[selectedWeights[i]].bias * scale;
+
+    return count;
+}
+
+void MD5Skinning::BuildSkinnedVertices(md5_mesh_t const& mesh, std::vector<MD5SkinnedVertex>& vertices)
+{
+    vertices.resize(mesh.vertices.size());
+
+    for (size_t i = 0; i < mesh.vertices.size(); ++i)
+    {
+        MD5Vertex const& vertex = mesh.vertices[i];
+        MD5SkinnedVertex& skinnedVertex = vertices[i];
+
+        // Unused slots stay zero, they add nothing in the shader.
+        skinnedVertex = { };
+        skinnedVertex.textureCoordinate = vertex.textureCoordinate;
+
+        int selectedWeights[MAX_JOINT_INFLUENCES];
+        float biases[MAX_JOINT_INFLUENCES];
+        Weight const* weights = &mesh.weights[vertex.StartWeight];
+        int const count = ReduceWeights(weights, vertex.WeightCount, selectedWeights, biases);
+
+        for (int j = 0; j < count; ++j)
+        {
+            Weight const& weight = weights[selectedWeights[j]];
+            float const bias = biases[j];
+
+            skinnedVertex.jointIndices[j] = static_cast<uint8>(weight.jointId);
+            skinnedVertex.weightPositions[j] = XMFLOAT4(weight.position.x * bias, weight.position.y * bias, weight.position.z * bias, bias);
+            skinnedVertex.weightNormals[j][0] = static_cast<int16>(std::lround(-weight.normal.x * 32767.0f));
+            skinnedVertex.weightNormals[j][1] = static_cast<int16>(std::lround(-weight.normal.y * 32767.0f));
+            skinnedVertex.weightNormals[j][2] = static_cast<int16>(std::lround(-weight.normal.z * 32767.0f));
+        }
+    }
+}
+
+void MD5Skinning::BuildJointPalette(XMFLOAT4X4A const* jointMatrices, int jointCount, XMFLOAT4X4* palette)
+{
+    for (int i = 0; i < jointCount; ++i)
+        XMStoreFloat4x4(&palette[i], XMMatrixTranspose(XMLoadFloat4x4A(&jointMatrices[i])));
+}
\ No newline at end of file
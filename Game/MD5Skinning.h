@@ -0,0 +1,36 @@
+//
+// MD5Skinning.h
+//
+
+#pragma once
+
+#include "MD5Loader.h"
+
+namespace axec
+{
+    // CPU skinning of the MD5 meshes. The joints of a pose are turned into matrices once per frame, so every
+    // weight of a vertex is a single matrix transform on the SIMD registers instead of two quaternion products.
+    class MD5Skinning
+    {
+        public:
+            // Joints a vertex can have in the vertex shader and joints the shader's palette can hold.
+            static constexpr int MAX_JOINT_INFLUENCES = 4;
+            static constexpr int MAX_PALETTE_JOINTS = 128;
+
+            // Rotates by the inverse joint orientation and moves to the joint position, the same transform the weights used to get.
+            static void BuildJointMatrices(JointPose const* joints, int jointCount, DirectX::XMFLOAT4X4A* matrices);
+
+            // Skins the vertices [firstVertex, endVertex) of a mesh into the vertices of an instance, different ranges can be
+            // skinned on different threads. Only the positions and normals of the instance vertices are written.
+            static void SkinVertices(md5_mesh_t const& mesh, DirectX::XMFLOAT4X4A const* matrices, uint32 firstVertex, uint32 endVertex, MD5Vertex* vertices);
+
+            // Picks the MAX_JOINT_INFLUENCES strongest weights and scales their biases to add up to one again, returns how many were picked.
+            static int ReduceWeights(Weight const* weights, int weightCount, int* selectedWeights, float* biases);
+
+            // Static vertices with the reduced weights for the skinning in the vertex shader.
+            static void BuildSkinnedVertices(md5_mesh_t const& mesh, std::vector<MD5SkinnedVertex>& vertices);
+
+            // The joint matrices transposed for the shader, this is all that is uploaded per frame.
+            static void BuildJointPalette(DirectX::XMFLOAT4X4A const* jointMatrices, int jointCount, DirectX::XMFLOAT4X4* palette);
+    };
+}
\ No newline at end of file
@@ -0,0 +1,122 @@
+//
+// MD5Tokenizer.cpp
+//
+
+#include "pch.h"
+#include "MD5Tokenizer.h"
+
+#include <charconv>
+
+using namespace axec;
+
+namespace
+{
+    bool IsWhiteSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+}
+
+MD5Tokenizer::MD5Tokenizer(char const* begin, char const* end)
+    : m_position(begin)
+    , m_end(end)
+    , m_failed(false)
+{
+}
+
+std::string_view MD5Tokenizer::NextToken()
+{
+    SkipWhiteSpace();
+
+    char const* begin = m_position;
+    while (m_position < m_end && !IsWhiteSpace(*m_position))
+        ++m_position;
+
+    return std::string_view(begin, m_position - begin);
+}
+
+std::string_view MD5Tokenizer::NextString()
+{
+    SkipWhiteSpace();
+
+    if (m_position == m_end || *m_position != '"')
+    {
+        m_failed = true;
+        return std::string_view();
+    }
+
+    char const* begin = ++m_position;
+    while (m_position < m_end && *m_position != '"')
+        ++m_position;
+
+    if (m_position == m_end)
+    {
+        m_failed = true;
+        return std::string_view();
+    }
+
+    return std::string_view(begin, m_position++ - begin);
+}
+
+int MD5Tokenizer::NextInt()
+{
+    return NextNumber<int>();
+}
+
+uint32 MD5Tokenizer::NextUInt()
+{
+    return NextNumber<uint32>();
+}
+
+float MD5Tokenizer::NextFloat()
+{
+    return NextNumber<float>();
+}
+
+void MD5Tokenizer::Skip(std::string_view expected)
+{
+    if (NextToken() != expected)
+        m_failed = true;
+}
+
+void MD5Tokenizer::SkipLine()
+{
+    while (m_position < m_end && *m_position != '\n')
+        ++m_position;
+}
+
+bool MD5Tokenizer::IsAtEnd()
+{
+    SkipWhiteSpace();
+    return m_position == m_end;
+}
+
+std::wstring MD5Tokenizer::Widen(std::string_view text)
+{
+    std::wstring wide(text.size(), L'\0');
+
+    for (size_t i = 0; i < text.size(); ++i)
+        wide[i] = static_cast<wchar_t>(static_cast<unsigned char>(text[i]));
+
+    return wide;
+}
+
+void MD5Tokenizer::SkipWhiteSpace()
+{
+    while (m_position < m_end && IsWhiteSpace(*m_position))
+        ++m_position;
+}
+
+template<typename T>
+T MD5Tokenizer::NextNumber()
+{
+    std::string_view token = NextToken();
+
+    // A number has to fill its whole token.
+    T value = T();
+    std::from_chars_result result = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (token.empty() || result.ec != std::errc() || result.ptr != token.data() + token.size())
+        m_failed = true;
+
+    return value;
+}
\ No newline at end of file
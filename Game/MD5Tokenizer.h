@@ -0,0 +1,47 @@
+//
+// MD5Tokenizer.h
+//
+
+#pragma once
+
+namespace axec
+{
+    // Splits the text of a .md5mesh or .md5anim file into tokens. The tokens point into the text, nothing is
+    // copied, and numbers are parsed with from_chars. A token that can't be parsed sets the failed flag.
+    class MD5Tokenizer
+    {
+        public:
+            MD5Tokenizer(char const* begin, char const* end);
+
+            // Next run of characters without white space, empty at the end of the text.
+            std::string_view NextToken();
+
+            // Next quoted string without the quotation marks, it may contain spaces.
+            std::string_view NextString();
+
+            int NextInt();
+            uint32 NextUInt();
+            float NextFloat();
+
+            // Reads the next token and fails if it isn't the expected one, used for the brackets.
+            void Skip(std::string_view expected);
+            void SkipLine();
+
+            bool IsAtEnd();
+            bool HasFailed() const { return m_failed; }
+
+            // Widens the characters of a token, the MD5 files only use ASCII for names and paths.
+            static std::wstring Widen(std::string_view text);
+
+        private:
+            void SkipWhiteSpace();
+
+            template<typename T>
+            T NextNumber();
+
+        private:
+            char const* m_position;
+            char const* m_end;
+            bool m_failed;
+    };
+}
\ No newline at end of file
@@ -4,6 +4,13 @@
 
 #pragma once
 
+// Where the MD5 meshes are skinned, on the CPU into a dynamic vertex buffer or in the vertex shader.
+enum class MD5SkinningMode
+{
+    CPU,
+    GPU
+};
+
 struct MD5Vertex
 {
     MD5Vertex() = default;
@@ -38,4 +45,19 @@ struct MD5Vertex
 
     static const int InputElementCount = 3;
     static const D3D11_INPUT_ELEMENT_DESC InputElements[InputElementCount];
+};
+
+// Vertex for skinning in the vertex shader with the four strongest weights of the vertex. The weights keep
+// their joint space positions like on the CPU, the MD5 weights of a vertex don't always agree on one bind pose.
+struct MD5SkinnedVertex
+{
+    DirectX::XMFLOAT2 textureCoordinate;
+    uint8 jointIndices[4];
+
+    // Position multiplied by the weight with the weight in w, and the negated normal in signed normalized 16 bit.
+    DirectX::XMFLOAT4 weightPositions[4];
+    int16 weightNormals[4][4];
+
+    static const int InputElementCount = 10;
+    static const D3D11_INPUT_ELEMENT_DESC InputElements[InputElementCount];
 };
\ No newline at end of file
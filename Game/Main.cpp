@@ -4,6 +4,7 @@
 
 #include "pch.h"
 #include "Application.h"
+#include "TestRunner.h"
 
 // Indicates to hybrid graphics systems to prefer the discrete part by default
 extern "C"
@@ -17,9 +18,14 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 {
     UNREFERENCED_PARAMETER(hInstance);
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
     UNREFERENCED_PARAMETER(nCmdShow);
 
+    // The tests log to the console they were started from and return the number of failed tests instead of running the game.
+    bool const runBenchmarks = wcsstr(lpCmdLine, L"--run-benchmarks") != nullptr;
+    bool const runTests = runBenchmarks || wcsstr(lpCmdLine, L"--run-tests") != nullptr;
+    if (runTests)
+        AttachConsole(ATTACH_PARENT_PROCESS);
+
     Logger::Init();
     Logger::Get()->info("Logging system initialized.");
 
@@ -32,6 +38,13 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
     if (FAILED(CoInitializeEx(nullptr, COINITBASE_MULTITHREADED)))
         return 1;
 
+    if (runTests)
+    {
+        int const failedCount = Tests::RunAll(runBenchmarks);
+        CoUninitialize();
+        return failedCount;
+    }
+
     std::unique_ptr<Application> app = std::make_unique<Application>();
     app->Initialize(800, 600);
 
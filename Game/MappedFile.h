@@ -0,0 +1,33 @@
+//
+// MappedFile.h
+//
+
+#pragma once
+
+// Read-only view of a whole file mapped into memory, the pages are loaded by the OS when they are touched.
+class MappedFile
+{
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        MappedFile(MappedFile const&) = delete;
+        MappedFile& operator=(MappedFile const&) = delete;
+
+        bool Open(char const* fileName);
+        bool Open(wchar_t const* fileName);
+        void Close();
+
+        bool IsOpen() const { return m_data != nullptr; }
+        uint8 const* GetData() const { return m_data; }
+        size_t GetSize() const { return m_size; }
+
+    private:
+        bool MapFile();
+
+    private:
+        HANDLE m_file;
+        HANDLE m_mapping;
+        uint8 const* m_data;
+        size_t m_size;
+};
\ No newline at end of file
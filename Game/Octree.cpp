@@ -4,12 +4,38 @@
 
 #include "pch.h"
 #include "Octree.h"
+#include "TriangleCollision.h"
 
+#include <bitset>
+
+namespace
+{
+    DirectX::XMFLOAT3 Add(DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b) { return DirectX::XMFLOAT3(a.x + b.x, a.y + b.y, a.z + b.z); }
+    DirectX::XMFLOAT3 Subtract(DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b) { return DirectX::XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z); }
+    DirectX::XMFLOAT3 Scale(DirectX::XMFLOAT3 const& a, float s) { return DirectX::XMFLOAT3(a.x * s, a.y * s, a.z * s); }
+    float Dot(DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b) { return (a.x * b.x) + (a.y * b.y) + (a.z * b.z); }
+
+    DirectX::XMFLOAT3 Cross(DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b)
+    {
+        return DirectX::XMFLOAT3((a.y * b.z) - (a.z * b.y), (a.z * b.x) - (a.x * b.z), (a.x * b.y) - (a.y * b.x));
+    }
+}
 
 Octree::Octree()
 {
     m_vertexList = nullptr;
-    m_pRootNode = nullptr;
+    m_indexList = nullptr;
+    m_drawCount = 0;
+    m_cullTestCount = 0;
+    m_visibleLeafCount = 0;
+    m_drawCallCount = 0;
+    m_stateBindCount = 0;
+    m_gridWidth = 0;
+    m_maxLeafTriangles = MAX_TRIANGLES;
+    m_taskPool = &TaskPool::Get();
+    m_cameraPosition = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+    m_lodScale = 0.0f;
+    m_packingParameters = {};
 }
 
 
@@ -19,133 +45,610 @@ Octree::~Octree()
 
 bool Octree::Initialize(Terrain* terrain, ID3D11DeviceContext* deviceContext)
 {
-    int vertexCount;
-    float centerX, centerY, centerZ, width;
+    int vertexCount, indexCount;
+    DirectX::VertexPositionNormalColorDualTexture* vertices;
+    uint32* indices;
+    bool result;
 
     // Get the number of vertices in the terrain vertex array.
     vertexCount = terrain->GetVertexCount();
 
-    // Store the total triangle count for the vertex list.
-    m_triangleCount = vertexCount / 3;
+    // Get the number of indices in the terrain index array.
+    indexCount = terrain->GetIndexCount();
 
     // Create a vertex array to hold all of the terrain vertices.
-    m_vertexList = new DirectX::VertexPositionNormalColorDualTexture[vertexCount];
-    if (!m_vertexList)
+    vertices = new DirectX::VertexPositionNormalColorDualTexture[vertexCount];
+    if (!vertices)
         return false;
 
-    // Copy the terrain vertices into the vertex list.
-    terrain->CopyVertexArray(static_cast<void*>(m_vertexList));
+    // Create an index array to hold all of the terrain triangles.
+    indices = new uint32[indexCount];
+    if (!indices)
+        return false;
+
+    // Copy the terrain vertices and indices into the lists.
+    terrain->CopyVertexArray(static_cast<void*>(vertices));
+    terrain->CopyIndexArray(static_cast<void*>(indices));
+
+    // Build the tree on the CPU.
+    result = Build(vertices, vertexCount, indices, indexCount, terrain->GetTerrainWidth());
+
+    // Release the vertex and index lists since the tree now has the vertices in each node.
+    delete[] vertices;
+    delete[] indices;
+
+    if (!result)
+        return false;
+
+    // Create the buffers of the leaf nodes, the vertices are stored in the packed terrain format.
+    m_packingParameters = terrain->GetPackingParameters();
+    Upload(deviceContext, TerrainVertexPacker(m_packingParameters));
+
+    shader.InitializeShaders(deviceContext, TerrainShader::VertexFormat::PACKED);
+
+    return true;
+}
+
+bool Octree::Build(DirectX::VertexPositionNormalColorDualTexture const* vertices, int vertexCount, uint32 const* indices, int indexCount, int gridWidth)
+{
+    float centerX, centerY, centerZ, width;
+
+    // Store the lists for the duration of the build.
+    m_vertexList = vertices;
+    m_indexList = indices;
+    m_gridWidth = gridWidth;
+
+    // Store the total triangle count for the index list.
+    m_triangleCount = indexCount / 3;
 
     // Calculate the center x, z and the size of the mesh.
     CalculateMeshDimensions(vertexCount, centerX, centerY, centerZ, width);
 
-    // Create the parent node for the quad tree.
-    m_pRootNode = new OctreeNode();
-    if (!m_pRootNode)
-        return false;
+    auto const buildStart = std::chrono::high_resolution_clock::now();
 
-    // Recursively build the octree based on the vertex list data and mesh dimensions.
-    CreateTreeNode(m_pRootNode, centerX, centerY, centerZ, width, deviceContext);
+    // Calculate the bounds of every triangle once, the tree build only compares these.
+    CalculateTriangleBounds();
 
-    // Release the vertex list since the quad tree now has the vertices in each node.
-    if (m_vertexList)
+    // Find the triangles that are inside the root node.
+    std::vector<uint32> allTriangles(m_triangleCount);
+    for (int i = 0; i < m_triangleCount; ++i)
+        allTriangles[i] = static_cast<uint32>(i);
+
+    std::vector<uint32> rootTriangles;
+    GatherTriangles(allTriangles, centerX, centerY, centerZ, width, rootTriangles);
+    allTriangles.clear();
+    allTriangles.shrink_to_fit();
+
+    // Create the parent node for the octree.
+    std::unique_ptr<BuildNode> rootNode = std::make_unique<BuildNode>();
+
+    // Recursively build the octree, every node only looks at the triangles of its parent and
+    // the children of a node are built in parallel on the task pool.
+    CreateTreeNode(rootNode.get(), centerX, centerY, centerZ, width, rootTriangles);
+
+    // Store the finished tree in the node array, starting with the root node.
+    m_nodes.clear();
+    m_leaves.clear();
+    m_nodes.resize(1);
+    LinearizeNode(rootNode.get(), 0);
+    rootNode.reset();
+    CopyNodeBounds();
+
+    // A triangle on the border of two nodes is in both of them, it is drawn by the first leaf it is in.
+    std::vector<uint32> triangleLeaves(m_triangleCount, INVALID_INDEX);
+    for (uint32 leafIndex = 0; leafIndex < static_cast<uint32>(m_leaves.size()); ++leafIndex)
     {
-        delete[] m_vertexList;
-        m_vertexList = nullptr;
+        for (uint32 triangleId : m_leaves[leafIndex].triangleIds)
+        {
+            if (triangleLeaves[triangleId] == INVALID_INDEX)
+                triangleLeaves[triangleId] = leafIndex;
+        }
     }
 
-    shader.InitializeShaders(deviceContext);
+    // The levels of detail of a leaf only depend on its own triangles.
+    m_taskPool->ParallelFor(static_cast<uint32>(m_leaves.size()), 1, [this, &triangleLeaves](uint32 begin, uint32 end)
+    {
+        for (uint32 leafIndex = begin; leafIndex < end; ++leafIndex)
+            BuildLeafLevels(leafIndex, triangleLeaves);
+    });
+
+    std::chrono::duration<float, std::milli> const buildTime = std::chrono::high_resolution_clock::now() - buildStart;
+    Logger::Get()->info("Octree: built {} nodes and {} leaves from {} triangles in {:.2f} ms on {} threads.",
+        m_nodes.size(), m_leaves.size(), m_triangleCount, buildTime.count(), m_taskPool->GetWorkerCount() + 1);
+
+    // The lists belong to the caller, the leaf nodes have their own copies now.
+    m_vertexList = nullptr;
+    m_indexList = nullptr;
+
+    m_triangleBounds.clear();
+    m_triangleBounds.shrink_to_fit();
 
     return true;
 }
 
-void Octree::Draw(ID3D11DeviceContext* deviceContext, Frustum* frustum, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj/*, TerrainShader* shader*/)
+void Octree::SetMaxLeafTriangles(int count)
 {
-    shader.SetShaderParameters(deviceContext, world, view, proj);
+    m_maxLeafTriangles = std::clamp(count, MIN_TRIANGLES, MAX_TRIANGLES);
+}
 
-    // Reset the number of triangles that are drawn for this frame.
+void Octree::SetTaskPool(TaskPool* taskPool)
+{
+    m_taskPool = taskPool;
+}
+
+void Octree::Upload(ID3D11DeviceContext* deviceContext, TerrainVertexPacker const& packer)
+{
+    std::vector<DirectX::VertexTerrainPacked> packedVertices;
+    std::vector<uint32> indices;
+    size_t vertexCount, indexCount;
+    int lod;
+
+    ID3D11Device* device = DX::GetDevice(deviceContext);
+    if (device == nullptr)
+        return;
+
+    vertexCount = 0;
+    indexCount = 0;
+    for (LeafMesh const& leaf : m_leaves)
+    {
+        vertexCount += leaf.vertices.size();
+        for (lod = 0; lod < LOD_COUNT; ++lod)
+            indexCount += leaf.lodIndices[lod].size();
+    }
+
+    packedVertices.reserve(vertexCount);
+    indices.reserve(indexCount);
+
+    // Append the leaves in the order of the leaf array, it is the depth first order of the tree.
+    for (LeafMesh& leaf : m_leaves)
+    {
+        leaf.firstVertex = static_cast<uint32>(packedVertices.size());
+
+        for (auto const& vertex : leaf.vertices)
+            packedVertices.push_back(packer.Pack(vertex));
+
+        // Release the array now that the data is stored in the buffer.
+        leaf.vertices.clear();
+        leaf.vertices.shrink_to_fit();
+    }
+
+    // Store the index lists one level after the other. The leaves below a node are next to each other in every level,
+    // so visible neighbours that use the same level can be drawn with one call.
+    for (lod = 0; lod < LOD_COUNT; ++lod)
+    {
+        for (LeafMesh& leaf : m_leaves)
+        {
+            leaf.lodFirstIndex[lod] = static_cast<uint32>(indices.size());
+
+            // The indices point into the shared vertex buffer, the ranges of different leaves then join without a base vertex.
+            for (unsigned long index : leaf.lodIndices[lod])
+                indices.push_back(leaf.firstVertex + static_cast<uint32>(index));
+
+            leaf.lodIndices[lod].clear();
+            leaf.lodIndices[lod].shrink_to_fit();
+        }
+    }
+
+    if (packedVertices.empty())
+        return;
+
+    // The buffers are created on this thread only, after the tree build has finished.
+    m_vertexBuffer.Create(device, packedVertices.data(), static_cast<uint32>(packedVertices.size()));
+    m_indexBuffer.Create(device, indices.data(), static_cast<uint32>(indices.size()));
+}
+
+void Octree::Cull(Frustum* frustum, DirectX::XMFLOAT3 const& cameraPosition, float lodScale)
+{
+    // Reset the number of triangles that are drawn and the number of plane tests for this frame.
     m_drawCount = 0;
+    m_cullTestCount = 0;
+    m_cameraPosition = cameraPosition;
+    m_lodScale = lodScale;
+
+    // Collect the index ranges of the visible leaves starting at the parent node and moving down the tree.
+    m_drawRanges.Clear();
+    if (!m_nodes.empty())
+        CullNode(frustum, 0, Frustum::ALL_PLANES);
+
+    m_drawRanges.Merge();
 
-    // Render each node that is visible starting at the parent node and moving down the tree.
-    DrawNode(deviceContext, frustum, m_pRootNode, world, view, proj);
+    m_visibleLeafCount = static_cast<int>(m_drawRanges.GetAddedCount());
+    m_drawCallCount = static_cast<int>(m_drawRanges.GetRanges().size());
 }
 
-void Octree::Shutdown()
+void Octree::Draw(ID3D11DeviceContext* deviceContext, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj/*, TerrainShader* shader*/)
 {
+    unsigned int offset;
+
+    DrawRangeMerger::Range const* ranges = m_drawRanges.GetRanges().data();
+    m_stateBindCount = 0;
+
+    if (m_drawCallCount == 0)
+        return;
+
+    shader.SetShaderParameters(deviceContext, world, view, proj);
+    shader.SetPackingParameters(deviceContext, m_packingParameters);
+
+    // Bind the shared buffers and the shader state once, every leaf uses the same ones.
+    offset = 0;
+    deviceContext->IASetVertexBuffers(0, 1, m_vertexBuffer.GetAddressOf(), m_vertexBuffer.StridePtr(), &offset);
+    m_stateBindCount++;
+
+    deviceContext->IASetIndexBuffer(m_indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+    m_stateBindCount++;
+
+    deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    m_stateBindCount++;
+
+    m_stateBindCount += shader.SetRenderState(deviceContext);
+
+    // One draw for every run of visible leaves that are next to each other in the index buffer.
+    for (int i = 0; i < m_drawCallCount; ++i)
+        deviceContext->DrawIndexed(ranges[i].indexCount, ranges[i].firstIndex, 0);
 }
 
-void Octree::CalculateMeshDimensions(int vertexCount, float& centerX, float& centerY, float& centerZ, float& meshWidth)
+bool Octree::SetHeights(ID3D11DeviceContext* deviceContext, Terrain* terrain, int firstColumn, int firstRow, int columnCount, int rowCount, float const* heights)
 {
-//    float minWidth, maxWidth, width, minDepth, maxDepth, depth, maxX, maxZ;
+    Terrain::GridRegion changedRegion;
 
-    float minWidth, minHeight, minDepth, maxWidth, maxHeight, maxDepth, maxX, maxY, maxZ, width, height, depth;
+    if (!terrain->SetHeights(deviceContext, firstColumn, firstRow, columnCount, rowCount, heights, changedRegion))
+        return false;
 
-    // Initialise the center position of the mesh to zero.
-    centerX = 512.0f;
-    centerY = 512.0f;
-    centerZ = 512.0f;
+    // The changed region is the rectangle plus the ring of samples around it whose normals changed.
+    UpdateRegion(deviceContext, terrain, changedRegion);
 
-    // Sum all vertices in the mesh.
-    //for (int i = 0; i < vertexCount; ++i)
-    //{
-    //    centerX += m_vertexList[i].position.x;
-    //    centerY += m_vertexList[i].position.y;
-    //    centerZ += m_vertexList[i].position.z;
-    //}
+    return true;
+}
 
-    // And then divide it by the number of vertices to find the mid-point of the mesh.
-    centerX = centerX / 2.0f;//centerX / static_cast<float>(vertexCount);
-    centerY = centerY / 2.0f;//256;//centerY / static_cast<float>(vertexCount);
-    centerZ = centerZ / 2.0f;//centerZ / static_cast<float>(vertexCount);
+// Re-uploads the vertices of a changed terrain region and refits the nodes around it.
+void Octree::UpdateRegion(ID3D11DeviceContext* deviceContext, Terrain const* terrain, Terrain::GridRegion const& region)
+{
+    if (!m_nodes.empty() && UpdateNode(deviceContext, terrain, region, TerrainVertexPacker(m_packingParameters), 0))
+        CopyNodeBounds();
+}
+
+bool Octree::UpdateNode(ID3D11DeviceContext* deviceContext, Terrain const* terrain, Terrain::GridRegion const& region, TerrainVertexPacker const& packer, uint32 nodeIndex)
+{
+    uint32 childIndex, lastChild;
+    bool changed;
+
+    OctreeNode& node = m_nodes[nodeIndex];
+
+    // Skip the nodes that don't overlap the region on the ground plane, the rows of the height map run against the z axis.
+    float const depthOffset = static_cast<float>(terrain->GetTerrainHeight() - 1);
+    if (node.maxX < static_cast<float>(region.minColumn) || node.minX > static_cast<float>(region.maxColumn) ||
+        node.maxZ < depthOffset - static_cast<float>(region.maxRow) || node.minZ > depthOffset - static_cast<float>(region.minRow))
+        return false;
+
+    if (node.leafIndex != INVALID_INDEX)
+        return UpdateLeaf(deviceContext, terrain, region, packer, node);
+
+    // Update the children that overlap the region.
+    changed = false;
+    lastChild = node.firstChild + static_cast<uint32>(std::bitset<8>(node.childMask).count());
+    for (childIndex = node.firstChild; childIndex < lastChild; ++childIndex)
+        changed |= UpdateNode(deviceContext, terrain, region, packer, childIndex);
+
+    if (!changed)
+        return false;
+
+    // Refit the heights of the node around its children, the edits don't move the vertices on the ground plane.
+    node.minY = FLT_MAX;
+    node.maxY = -FLT_MAX;
+    for (childIndex = node.firstChild; childIndex < lastChild; ++childIndex)
+    {
+        node.minY = std::min(node.minY, m_nodes[childIndex].minY);
+        node.maxY = std::max(node.maxY, m_nodes[childIndex].maxY);
+    }
+
+    return true;
+}
 
-    // Initialize the maximum and minimum size of the mesh.
-    minWidth = fabsf(m_vertexList[0].position.x - centerX);
-    maxWidth = 0.0f;
+bool Octree::UpdateLeaf(ID3D11DeviceContext* deviceContext, Terrain const* terrain, Terrain::GridRegion const& region, TerrainVertexPacker const& packer, OctreeNode& node)
+{
+    std::vector<DirectX::VertexTerrainPacked> packedVertices;
+    size_t first, last;
 
-    minHeight = fabsf(m_vertexList[0].position.y - centerY);
-    maxHeight = 0.0f;
+    LeafMesh& leaf = m_leaves[node.leafIndex];
+    DirectX::VertexPositionNormalColorDualTexture const* vertices = terrain->GetVertices();
+    uint32 const terrainWidth = static_cast<uint32>(terrain->GetTerrainWidth());
 
-    minDepth = fabsf(m_vertexList[0].position.z - centerZ);
-    maxDepth = 0.0f;
+    // The vertices of the leaf are sorted by their terrain position, so the changed vertices of a row are next to each other.
+    first = leaf.vertexIds.size();
+    last = 0;
 
-    // Go through all the vertices and find the maximum and minimum size and depth of the mesh.
-    for (int i = 0; i < vertexCount; ++i)
+    for (int row = region.minRow; row <= region.maxRow; ++row)
     {
-        width = fabsf(m_vertexList[i].position.x - centerX);
-        height = fabsf(m_vertexList[i].position.y - centerY);
-        depth = fabsf(m_vertexList[i].position.z - centerZ);
+        auto const begin = std::lower_bound(leaf.vertexIds.begin(), leaf.vertexIds.end(), row * terrainWidth + region.minColumn);
+        auto const end = std::upper_bound(begin, leaf.vertexIds.end(), row * terrainWidth + region.maxColumn);
+
+        if (begin != end)
+        {
+            first = std::min(first, static_cast<size_t>(begin - leaf.vertexIds.begin()));
+            last = std::max(last, static_cast<size_t>(end - leaf.vertexIds.begin()));
+        }
+    }
 
-        if (width < minWidth) { minWidth = width; }
-        if (width > maxWidth) { maxWidth = width; }
+    if (first >= last)
+        return false;
 
-        if (height < minHeight) { minHeight = height; }
-        if (height > maxHeight) { maxHeight = height; }
+    // Upload the range from the first to the last changed vertex.
+    packedVertices.resize(last - first);
+    for (size_t i = first; i < last; ++i)
+        packedVertices[i - first] = packer.Pack(vertices[leaf.vertexIds[i]]);
 
-        if (depth < minDepth) { minDepth = depth; }
-        if (depth > maxDepth) { maxDepth = depth; }
+    D3D11_BOX box = { };
+    box.left = static_cast<UINT>((leaf.firstVertex + first) * m_vertexBuffer.Stride());
+    box.right = static_cast<UINT>((leaf.firstVertex + last) * m_vertexBuffer.Stride());
+    box.bottom = 1;
+    box.back = 1;
+
+    deviceContext->UpdateSubresource(m_vertexBuffer.Get(), 0, &box, packedVertices.data(), 0, 0);
+
+    // Keep the positions of the collision queries in step with the buffer.
+    for (size_t i = first; i < last; ++i)
+        leaf.positions[i] = vertices[leaf.vertexIds[i]].position;
+
+    // Refit the heights of the leaf around its vertices.
+    node.minY = FLT_MAX;
+    node.maxY = -FLT_MAX;
+    for (uint32 vertexId : leaf.vertexIds)
+    {
+        node.minY = std::min(node.minY, vertices[vertexId].position.y);
+        node.maxY = std::max(node.maxY, vertices[vertexId].position.y);
     }
 
-    // Find the absolute maximum value between the min and max depth and size.
-    maxX = static_cast<float>(std::max(fabs(minWidth), fabs(maxWidth)));
-    maxY = static_cast<float>(std::max(fabs(minHeight), fabs(maxHeight)));
-    maxZ = static_cast<float>(std::max(fabs(minDepth), fabs(maxDepth)));
+    // The height errors of the coarser levels change with the heights.
+    CalculateLodErrors(leaf, vertices);
 
-    // Calculate the maximum diameter of the mesh.
-    //meshWidth = std::max(maxX, maxZ) * 2.0f;
-    meshWidth = 512.0f;//std::max(maxX, std::max(maxY, maxZ)) * 2.0f;
+    return true;
 }
 
-void Octree::CreateTreeNode(OctreeNode* node, float positionX, float positionY, float positionZ, float width, ID3D11DeviceContext* deviceContext)
+template<typename Function>
+void Octree::VisitLeaves(uint32 nodeIndex, DirectX::XMFLOAT3 const& boxMin, DirectX::XMFLOAT3 const& boxMax, Function const& function) const
 {
-    ID3D11Device* device = DX::GetDevice(deviceContext);
-    if (device == nullptr)
+    if (m_nodes.empty())
+        return;
+
+    OctreeNode const& node = m_nodes[nodeIndex];
+
+    // Skip the nodes whose bounds don't overlap the box.
+    if (node.maxX < boxMin.x || node.minX > boxMax.x || node.maxY < boxMin.y || node.minY > boxMax.y || node.maxZ < boxMin.z || node.minZ > boxMax.z)
         return;
 
-    int numTriangles, i, count, vertexCount, index, vertexIndex;
+    if (node.leafIndex != INVALID_INDEX)
+        function(m_leaves[node.leafIndex]);
+
+    uint32 const lastChild = node.firstChild + static_cast<uint32>(std::bitset<8>(node.childMask).count());
+    for (uint32 childIndex = node.firstChild; childIndex < lastChild; ++childIndex)
+        VisitLeaves(childIndex, boxMin, boxMax, function);
+}
+
+int Octree::OverlapBox(DirectX::XMFLOAT3 const& boxMin, DirectX::XMFLOAT3 const& boxMax, std::vector<Triangle>& triangles) const
+{
+    triangles.clear();
+
+    DirectX::XMFLOAT3 const center = Scale(Add(boxMin, boxMax), 0.5f);
+    DirectX::XMFLOAT3 const extents = Scale(Subtract(boxMax, boxMin), 0.5f);
+
+    VisitLeaves(0, boxMin, boxMax, [&](LeafMesh const& leaf)
+    {
+        DirectX::XMFLOAT3 corners[3];
+
+        for (size_t i = 0; i < leaf.triangleIds.size(); ++i)
+        {
+            uint16 const* triangleIndices = &leaf.triangleIndices[i * 3];
+            for (int corner = 0; corner < 3; ++corner)
+                corners[corner] = Subtract(leaf.positions[triangleIndices[corner]], center);
+
+            // Return the stored corners, adding the center back wouldn't always round to them.
+            if (TriangleCollision::TriangleOverlapsBox(corners, extents))
+                triangles.push_back({ leaf.positions[triangleIndices[0]], leaf.positions[triangleIndices[1]], leaf.positions[triangleIndices[2]], leaf.triangleIds[i] });
+        }
+    });
+
+    // Triangles on the border of two leaves are stored in both of them.
+    std::sort(triangles.begin(), triangles.end(), [](Triangle const& a, Triangle const& b) { return a.id < b.id; });
+    triangles.erase(std::unique(triangles.begin(), triangles.end(), [](Triangle const& a, Triangle const& b) { return a.id == b.id; }), triangles.end());
+
+    return static_cast<int>(triangles.size());
+}
+
+int Octree::OverlapCapsule(DirectX::XMFLOAT3 const& segmentStart, DirectX::XMFLOAT3 const& segmentEnd, float radius, std::vector<Triangle>& triangles) const
+{
+    triangles.clear();
+
+    DirectX::XMFLOAT3 const boxMin(std::min(segmentStart.x, segmentEnd.x) - radius, std::min(segmentStart.y, segmentEnd.y) - radius, std::min(segmentStart.z, segmentEnd.z) - radius);
+    DirectX::XMFLOAT3 const boxMax(std::max(segmentStart.x, segmentEnd.x) + radius, std::max(segmentStart.y, segmentEnd.y) + radius, std::max(segmentStart.z, segmentEnd.z) + radius);
+
+    VisitLeaves(0, boxMin, boxMax, [&](LeafMesh const& leaf)
+    {
+        DirectX::XMFLOAT3 corners[3], onSegment, onTriangle;
+
+        for (size_t i = 0; i < leaf.triangleIds.size(); ++i)
+        {
+            for (int corner = 0; corner < 3; ++corner)
+                corners[corner] = leaf.positions[leaf.triangleIndices[(i * 3) + corner]];
+
+            // Reject the triangles outside the bounds of the capsule before the exact distance.
+            if (std::max(corners[0].x, std::max(corners[1].x, corners[2].x)) < boxMin.x || std::min(corners[0].x, std::min(corners[1].x, corners[2].x)) > boxMax.x ||
+                std::max(corners[0].y, std::max(corners[1].y, corners[2].y)) < boxMin.y || std::min(corners[0].y, std::min(corners[1].y, corners[2].y)) > boxMax.y ||
+                std::max(corners[0].z, std::max(corners[1].z, corners[2].z)) < boxMin.z || std::min(corners[0].z, std::min(corners[1].z, corners[2].z)) > boxMax.z)
+                continue;
+
+            if (TriangleCollision::ClosestPointsOfSegmentTriangle(segmentStart, segmentEnd, corners, onSegment, onTriangle) <= radius * radius)
+                triangles.push_back({ corners[0], corners[1], corners[2], leaf.triangleIds[i] });
+        }
+    });
+
+    // Triangles on the border of two leaves are stored in both of them.
+    std::sort(triangles.begin(), triangles.end(), [](Triangle const& a, Triangle const& b) { return a.id < b.id; });
+    triangles.erase(std::unique(triangles.begin(), triangles.end(), [](Triangle const& a, Triangle const& b) { return a.id == b.id; }), triangles.end());
+
+    return static_cast<int>(triangles.size());
+}
+
+bool Octree::SweepCapsule(DirectX::XMFLOAT3 const& segmentStart, DirectX::XMFLOAT3 const& segmentEnd, float radius,
+    DirectX::XMFLOAT3 const& direction, float maxDistance, SweepHit& hit) const
+{
+    DirectX::XMFLOAT3 hitCorners[3];
+
+    hit.hit = false;
+    hit.distance = maxDistance;
+
+    float const length = sqrt(Dot(direction, direction));
+    if (!(length > 0.0f))
+        return false;
+
+    DirectX::XMFLOAT3 const unitDirection = Scale(direction, 1.0f / length);
+    DirectX::XMFLOAT3 const offset = Scale(unitDirection, maxDistance);
+
+    // Only the leaves inside the bounds of the whole movement can be touched.
+    DirectX::XMFLOAT3 const boxMin(
+        std::min(segmentStart.x, segmentEnd.x) + std::min(offset.x, 0.0f) - radius,
+        std::min(segmentStart.y, segmentEnd.y) + std::min(offset.y, 0.0f) - radius,
+        std::min(segmentStart.z, segmentEnd.z) + std::min(offset.z, 0.0f) - radius);
+    DirectX::XMFLOAT3 const boxMax(
+        std::max(segmentStart.x, segmentEnd.x) + std::max(offset.x, 0.0f) + radius,
+        std::max(segmentStart.y, segmentEnd.y) + std::max(offset.y, 0.0f) + radius,
+        std::max(segmentStart.z, segmentEnd.z) + std::max(offset.z, 0.0f) + radius);
+
+    VisitLeaves(0, boxMin, boxMax, [&](LeafMesh const& leaf)
+    {
+        DirectX::XMFLOAT3 corners[3], onSegment, onTriangle;
+
+        for (size_t i = 0; i < leaf.triangleIds.size(); ++i)
+        {
+            for (int corner = 0; corner < 3; ++corner)
+                corners[corner] = leaf.positions[leaf.triangleIndices[(i * 3) + corner]];
+
+            if (std::max(corners[0].x, std::max(corners[1].x, corners[2].x)) < boxMin.x || std::min(corners[0].x, std::min(corners[1].x, corners[2].x)) > boxMax.x ||
+                std::max(corners[0].y, std::max(corners[1].y, corners[2].y)) < boxMin.y || std::min(corners[0].y, std::min(corners[1].y, corners[2].y)) > boxMax.y ||
+                std::max(corners[0].z, std::max(corners[1].z, corners[2].z)) < boxMin.z || std::min(corners[0].z, std::min(corners[1].z, corners[2].z)) > boxMax.z)
+                continue;
+
+            // A capsule that already touches a triangle can't move at all.
+            float time = hit.distance;
+            if (TriangleCollision::ClosestPointsOfSegmentTriangle(segmentStart, segmentEnd, corners, onSegment, onTriangle) <= radius * radius)
+                time = 0.0f;
+            else if (!TriangleCollision::SweepCapsuleTriangle(segmentStart, segmentEnd, radius, unitDirection, corners, time))
+                continue;
+
+            if (time < hit.distance || !hit.hit)
+            {
+                hit.hit = true;
+                hit.distance = time;
+                hit.triangleId = leaf.triangleIds[i];
+                std::copy(corners, corners + 3, hitCorners);
+            }
+        }
+    });
+
+    if (!hit.hit)
+        return false;
+
+    // The normal goes from the contact on the triangle to the capsule, a capsule resting on the triangle uses the face normal.
+    DirectX::XMFLOAT3 onSegment, onTriangle;
+    DirectX::XMFLOAT3 const moved = Scale(unitDirection, hit.distance);
+    TriangleCollision::ClosestPointsOfSegmentTriangle(Add(segmentStart, moved), Add(segmentEnd, moved), hitCorners, onSegment, onTriangle);
+
+    DirectX::XMFLOAT3 normal = Subtract(onSegment, onTriangle);
+    if (Dot(normal, normal) < 1.0e-10f)
+    {
+        normal = Cross(Subtract(hitCorners[1], hitCorners[0]), Subtract(hitCorners[2], hitCorners[0]));
+        if (Dot(normal, unitDirection) > 0.0f)
+            normal = Scale(normal, -1.0f);
+    }
+
+    hit.normal = Scale(normal, 1.0f / sqrt(Dot(normal, normal)));
+
+    return true;
+}
+
+void Octree::GetLeafTriangles(int leafIndex, int lod, std::vector<uint32>& vertexIds) const
+{
+    LeafMesh const& leaf = m_leaves[leafIndex];
+
+    vertexIds.clear();
+    vertexIds.reserve(leaf.lodIndices[lod].size());
+
+    for (unsigned long index : leaf.lodIndices[lod])
+        vertexIds.push_back(leaf.vertexIds[index]);
+}
+
+void Octree::Shutdown()
+{
+    m_nodes.clear();
+    m_leaves.clear();
+    CopyNodeBounds();
+    m_vertexBuffer = DX::VertexBuffer<DirectX::VertexTerrainPacked>();
+    m_indexBuffer = DX::IndexBuffer<uint32>();
+}
+
+void Octree::CalculateMeshDimensions(int vertexCount, float& centerX, float& centerY, float& centerZ, float& meshWidth)
+{
+    float minX, minY, minZ, maxX, maxY, maxZ;
+
+    // Initialize the bounds of the mesh with the first vertex.
+    minX = maxX = m_vertexList[0].position.x;
+    minY = maxY = m_vertexList[0].position.y;
+    minZ = maxZ = m_vertexList[0].position.z;
+
+    // Go through all the vertices and find the minimum and maximum of the mesh.
+    for (int i = 1; i < vertexCount; ++i)
+    {
+        DirectX::XMFLOAT3 const& position = m_vertexList[i].position;
+
+        minX = std::min(minX, position.x);
+        minY = std::min(minY, position.y);
+        minZ = std::min(minZ, position.z);
+        maxX = std::max(maxX, position.x);
+        maxY = std::max(maxY, position.y);
+        maxZ = std::max(maxZ, position.z);
+    }
+
+    // The center of the root cube is the middle of the bounds.
+    centerX = (minX + maxX) * 0.5f;
+    centerY = (minY + maxY) * 0.5f;
+    centerZ = (minZ + maxZ) * 0.5f;
+
+    // The root cube has to hold the longest side of the mesh.
+    meshWidth = std::max(maxX - minX, std::max(maxY - minY, maxZ - minZ));
+}
+
+void Octree::CalculateTriangleBounds()
+{
+    uint32 index1, index2, index3;
+
+    m_triangleBounds.resize(m_triangleCount);
+
+    for (int i = 0; i < m_triangleCount; ++i)
+    {
+        // Get the three vertices of this triangle.
+        index1 = m_indexList[(i * 3)];
+        index2 = m_indexList[(i * 3) + 1];
+        index3 = m_indexList[(i * 3) + 2];
+
+        DirectX::XMFLOAT3 const& v1 = m_vertexList[index1].position;
+        DirectX::XMFLOAT3 const& v2 = m_vertexList[index2].position;
+        DirectX::XMFLOAT3 const& v3 = m_vertexList[index3].position;
+
+        // Store the minimum and maximum of the coordinates.
+        m_triangleBounds[i].minX = std::min(v1.x, std::min(v2.x, v3.x));
+        m_triangleBounds[i].minY = std::min(v1.y, std::min(v2.y, v3.y));
+        m_triangleBounds[i].minZ = std::min(v1.z, std::min(v2.z, v3.z));
+        m_triangleBounds[i].maxX = std::max(v1.x, std::max(v2.x, v3.x));
+        m_triangleBounds[i].maxY = std::max(v1.y, std::max(v2.y, v3.y));
+        m_triangleBounds[i].maxZ = std::max(v1.z, std::max(v2.z, v3.z));
+    }
+}
+
+void Octree::CreateTreeNode(BuildNode* node, float positionX, float positionY, float positionZ, float width, std::vector<uint32> const& triangles)
+{
+    int numTriangles, i, indexCount, index, corner;
     float offsetX, offsetY, offsetZ;
-    DirectX::VertexPositionNormalColorDualTexture* vertices;
-    unsigned long* indices;
-    bool result;
+    std::vector<uint32> globalIndices;
+    TaskPool::TaskGroup group;
 
     // Store the node position and size.
     node->x = positionX;
@@ -153,28 +656,15 @@ void Octree::CreateTreeNode(OctreeNode* node, float positionX, float positionY,
     node->z = positionZ;
     node->width = width;
 
-    // Initialize the triangle count to zero for the node.
-    node->triangleCount = 0;
-
-    // Initialize the children nodes of this node to nullptr.
-    node->nodes[0] = nullptr;
-    node->nodes[1] = nullptr;
-    node->nodes[2] = nullptr;
-    node->nodes[3] = nullptr;
-    node->nodes[4] = nullptr;
-    node->nodes[5] = nullptr;
-    node->nodes[6] = nullptr;
-    node->nodes[7] = nullptr;
-
-    // Count the number of triangles that are inside this node.
-    numTriangles = CountTriangles(positionX, positionY, positionZ, width);
+    // The parent already gathered the triangles that are inside this node.
+    numTriangles = static_cast<int>(triangles.size());
 
     // Case 1: If there are no triangles in this node then return as it is empty and requires no processing.
     if (numTriangles == 0)
         return;
 
-    // Case 2: If there are too many triangles in this node then split it into four equal sized smaller tree nodes.
-    if (numTriangles > MAX_TRIANGLES)
+    // Case 2: If there are too many triangles in this node then split it into eight equal sized smaller tree nodes.
+    if (numTriangles > m_maxLeafTriangles)
     {
         for (i = 0; i < 8; ++i)
         {
@@ -183,220 +673,491 @@ void Octree::CreateTreeNode(OctreeNode* node, float positionX, float positionY,
             offsetY = (((i & 4) ? 1.0f : -1.0f) * (width * 0.25f));
             offsetZ = (((i & 1) ? 1.0f : -1.0f) * (width * 0.25f));
 
-            // Set if there are any triangles in the new node.
-            count = CountTriangles((positionX + offsetX), (positionY + offsetY), (positionZ + offsetZ), (width * 0.5f));
-            if (count > 0)
+            // Every child is an independent task, the triangles of this node stay alive until all of them finished.
+            m_taskPool->Run(group, [this, node, i, &triangles, positionX, positionY, positionZ, offsetX, offsetY, offsetZ, width]()
             {
+                std::vector<uint32> childTriangles;
+
+                // Gather the triangles of this node that are also inside the new node.
+                GatherTriangles(triangles, (positionX + offsetX), (positionY + offsetY), (positionZ + offsetZ), (width * 0.5f), childTriangles);
+                if (childTriangles.empty())
+                    return;
+
                 // If there are triangles inside where this new node would be then create the child node.
-                node->nodes[i] = new OctreeNode();
+                node->nodes[i] = std::make_unique<BuildNode>();
 
                 // Extend the tree starting from this new child node new.
-                CreateTreeNode(node->nodes[i], (positionX + offsetX), (positionY + offsetY), (positionZ + offsetZ), (width * 0.5f), deviceContext);
-            }
+                CreateTreeNode(node->nodes[i].get(), (positionX + offsetX), (positionY + offsetY), (positionZ + offsetZ), (width * 0.5f), childTriangles);
+            });
         }
 
+        m_taskPool->Wait(group);
+
         return;
     }
 
     // Case 3: If this node is not empty and the triangle count for it is less than the max then.
     // this node is at the bottom of the tree so create the list of triangles to store in it.
-    node->triangleCount = numTriangles;
+    // Calculate the number of indices.
+    indexCount = numTriangles * 3;
+
+    // Collect the terrain vertices of all triangle corners of this node.
+    globalIndices.reserve(indexCount);
+    for (uint32 triangle : triangles)
+    {
+        for (corner = 0; corner < 3; ++corner)
+            globalIndices.push_back(m_indexList[(triangle * 3) + corner]);
+    }
 
-    // Calculate the number of vertices.
-    vertexCount = numTriangles * 3;
+    // Every vertex is stored once in the node, sorted by its position in the terrain vertex array.
+    // Leaves are built on several threads at once so this replaces a shared remap table.
+    std::vector<uint32> uniqueIndices(globalIndices);
+    std::sort(uniqueIndices.begin(), uniqueIndices.end());
+    uniqueIndices.erase(std::unique(uniqueIndices.begin(), uniqueIndices.end()), uniqueIndices.end());
 
-    // Create the vertex array.
-    vertices = new DirectX::VertexPositionNormalColorDualTexture[vertexCount];
+    node->vertices.reserve(uniqueIndices.size());
+    for (uint32 globalIndex : uniqueIndices)
+        node->vertices.push_back(m_vertexList[globalIndex]);
 
-    // Create the index array.
-    indices = new unsigned long[vertexCount];
+    // Point the indices of the node at its own vertex array.
+    node->indices.resize(indexCount);
+    for (index = 0; index < indexCount; ++index)
+    {
+        auto const found = std::lower_bound(uniqueIndices.begin(), uniqueIndices.end(), globalIndices[index]);
+        node->indices[index] = static_cast<unsigned long>(found - uniqueIndices.begin());
+    }
 
-    // Initialize the index for this new vertex and index array.
-    index = 0;
+    // Keep the terrain positions of the vertices for the height edits and the triangle numbers for the collision queries.
+    node->vertexIds = std::move(uniqueIndices);
+    node->triangleIds = triangles;
+}
 
-    // Ge through all the triangles in the vertex list.
-    for (i = 0; i < m_triangleCount; ++i)
+void Octree::LinearizeNode(BuildNode* buildNode, uint32 nodeIndex)
+{
+    uint32 firstChild;
+    uint8 childMask;
+    int i;
+
+    // Find the children of this node.
+    childMask = 0;
+    for (i = 0; i < 8; ++i)
     {
-        // If the triangle is inside this node then add it to the vertex array.
-        result = IsTriangleContained(i, positionX, positionY, positionZ, width);
-        if (result == true)
+        if (buildNode->nodes[i])
+            childMask |= static_cast<uint8>(1 << i);
+    }
+
+    // Start with empty bounds, they are fitted around the triangles below the node.
+    OctreeNode& node = m_nodes[nodeIndex];
+    node.minX = node.minY = node.minZ = FLT_MAX;
+    node.maxX = node.maxY = node.maxZ = -FLT_MAX;
+    node.firstChild = INVALID_INDEX;
+    node.leafIndex = INVALID_INDEX;
+    node.childMask = childMask;
+
+    // Move the geometry of a leaf node into the leaf array.
+    if (!buildNode->indices.empty())
+    {
+        node.leafIndex = static_cast<uint32>(m_leaves.size());
+
+        // The bounds of a leaf are the bounds of its vertices.
+        for (auto const& vertex : buildNode->vertices)
         {
-            // Calculate the index into the terrain vertex list.
-            vertexIndex = i * 3;
-
-            // Get the three vertices of this triangle from the vertex list.
-            vertices[index].position = m_vertexList[vertexIndex].position;
-            vertices[index].normal = m_vertexList[vertexIndex].normal;
-            vertices[index].color = m_vertexList[vertexIndex].color;
-            vertices[index].textureCoordinate0 = m_vertexList[vertexIndex].textureCoordinate0;
-            vertices[index].textureCoordinate1 = m_vertexList[vertexIndex].textureCoordinate1;
-            indices[index] = index;
-            index++;
-
-            vertexIndex++;
-            vertices[index].position = m_vertexList[vertexIndex].position;
-            vertices[index].normal = m_vertexList[vertexIndex].normal;
-            vertices[index].color = m_vertexList[vertexIndex].color;
-            vertices[index].textureCoordinate0 = m_vertexList[vertexIndex].textureCoordinate0;
-            vertices[index].textureCoordinate1 = m_vertexList[vertexIndex].textureCoordinate1;
-            indices[index] = index;
-            index++;
-
-            vertexIndex++;
-            vertices[index].position = m_vertexList[vertexIndex].position;
-            vertices[index].normal = m_vertexList[vertexIndex].normal;
-            vertices[index].color = m_vertexList[vertexIndex].color;
-            vertices[index].textureCoordinate0 = m_vertexList[vertexIndex].textureCoordinate0;
-            vertices[index].textureCoordinate1 = m_vertexList[vertexIndex].textureCoordinate1;
-            indices[index] = index;
-            index++;
+            node.minX = std::min(node.minX, vertex.position.x);
+            node.minY = std::min(node.minY, vertex.position.y);
+            node.minZ = std::min(node.minZ, vertex.position.z);
+            node.maxX = std::max(node.maxX, vertex.position.x);
+            node.maxY = std::max(node.maxY, vertex.position.y);
+            node.maxZ = std::max(node.maxZ, vertex.position.z);
         }
+
+        // Leaf indices are stored in 16 bits for the collision queries, a leaf has at most three vertices per triangle.
+        static_assert(MAX_TRIANGLES * 3 <= 0xFFFF, "The vertices of a leaf don't fit 16 bit indices.");
+
+        LeafMesh leaf;
+        leaf.firstVertex = 0;
+
+        // Keep a copy of the triangles with nothing but the positions on the CPU.
+        leaf.positions.reserve(buildNode->vertices.size());
+        for (auto const& vertex : buildNode->vertices)
+            leaf.positions.push_back(vertex.position);
+
+        leaf.triangleIndices.assign(buildNode->indices.begin(), buildNode->indices.end());
+        leaf.triangleIds = std::move(buildNode->triangleIds);
+
+        leaf.vertices = std::move(buildNode->vertices);
+        leaf.vertexIds = std::move(buildNode->vertexIds);
+        m_leaves.push_back(std::move(leaf));
     }
 
-    // Create vertex and index buffers for this node.
-    node->vertexBuffer.Create(device, &vertices[0], vertexCount);
-    node->indexBuffer.Create(device, &indices[0], vertexCount);
+    if (childMask == 0)
+        return;
 
-    // Release the vertex and index arrays now that the data is stored in the buffers in the node.
-    delete[] vertices;
-    vertices = nullptr;
+    // Reserve the children next to each other before going down, the node reference isn't valid after the resize.
+    firstChild = static_cast<uint32>(m_nodes.size());
+    m_nodes[nodeIndex].firstChild = firstChild;
+    m_nodes.resize(firstChild + std::bitset<8>(childMask).count());
 
-    delete[] indices;
-    indices = nullptr;
+    for (i = 0; i < 8; ++i)
+    {
+        if (buildNode->nodes[i])
+        {
+            LinearizeNode(buildNode->nodes[i].get(), firstChild);
+            buildNode->nodes[i].reset();
+            firstChild++;
+        }
+    }
+
+    // Refit the bounds of this node around the bounds of its children, they are all done at this point.
+    OctreeNode& parent = m_nodes[nodeIndex];
+    for (uint32 childIndex = parent.firstChild; childIndex < firstChild; ++childIndex)
+    {
+        OctreeNode const& child = m_nodes[childIndex];
+        parent.minX = std::min(parent.minX, child.minX);
+        parent.minY = std::min(parent.minY, child.minY);
+        parent.minZ = std::min(parent.minZ, child.minZ);
+        parent.maxX = std::max(parent.maxX, child.maxX);
+        parent.maxY = std::max(parent.maxY, child.maxY);
+        parent.maxZ = std::max(parent.maxZ, child.maxZ);
+    }
 }
 
-int Octree::CountTriangles(float positionX, float positionY, float positionZ, float width)
+void Octree::CopyNodeBounds()
 {
-    // initialize the count to zero.
-    int count = 0;
+    size_t const nodeCount = m_nodes.size();
 
-    // Go through all the triangles in the entire mesh and check which ones should be inside this node.
-    for (int i = 0; i < m_triangleCount; ++i)
+    m_nodeMinX.resize(nodeCount);
+    m_nodeMinY.resize(nodeCount);
+    m_nodeMinZ.resize(nodeCount);
+    m_nodeMaxX.resize(nodeCount);
+    m_nodeMaxY.resize(nodeCount);
+    m_nodeMaxZ.resize(nodeCount);
+
+    for (size_t i = 0; i < nodeCount; ++i)
+    {
+        m_nodeMinX[i] = m_nodes[i].minX;
+        m_nodeMinY[i] = m_nodes[i].minY;
+        m_nodeMinZ[i] = m_nodes[i].minZ;
+        m_nodeMaxX[i] = m_nodes[i].maxX;
+        m_nodeMaxY[i] = m_nodes[i].maxY;
+        m_nodeMaxZ[i] = m_nodes[i].maxZ;
+    }
+}
+
+void Octree::BuildLeafLevels(uint32 leafIndex, std::vector<uint32> const& triangleLeaves)
+{
+    std::vector<uint32> triangleQuads, fullQuads, blocks;
+    std::vector<unsigned int> blockIndices;
+    uint32 triangle, corner, column, row, stride;
+    int lod;
+
+    LeafMesh& leaf = m_leaves[leafIndex];
+    uint32 const gridWidth = static_cast<uint32>(m_gridWidth);
+
+    // Level 0 draws the triangles of the leaf that aren't drawn by an earlier leaf. The quad of a triangle is the
+    // lowest column and row of its corners, the two triangles of a quad always have the same one.
+    for (triangle = 0; triangle < static_cast<uint32>(leaf.triangleIds.size()); ++triangle)
+    {
+        if (triangleLeaves[leaf.triangleIds[triangle]] != leafIndex)
+            continue;
+
+        column = std::numeric_limits<uint32>::max();
+        row = std::numeric_limits<uint32>::max();
+        for (corner = 0; corner < 3; ++corner)
+        {
+            uint16 const index = leaf.triangleIndices[(triangle * 3) + corner];
+            leaf.lodIndices[0].push_back(index);
+
+            column = std::min(column, leaf.vertexIds[index] % gridWidth);
+            row = std::min(row, leaf.vertexIds[index] / gridWidth);
+        }
+
+        triangleQuads.push_back((row * gridWidth) + column);
+    }
+
+    // Only the quads whose two triangles are drawn by this leaf can be part of a coarser block.
+    fullQuads = triangleQuads;
+    std::sort(fullQuads.begin(), fullQuads.end());
+    for (size_t i = 0; i + 1 < fullQuads.size(); ++i)
+    {
+        if (fullQuads[i] == fullQuads[i + 1])
+            blocks.push_back(fullQuads[i]);
+    }
+    fullQuads.swap(blocks);
+
+    for (lod = 1; lod < LOD_COUNT; ++lod)
+    {
+        stride = 1u << lod;
+
+        // The blocks of stride by stride quads that are all full quads of the leaf can be joined, a block of a level
+        // is made of four blocks of the level before it.
+        blocks.clear();
+        for (uint32 fullQuad : fullQuads)
+            blocks.push_back((((fullQuad / gridWidth) / stride) * stride * gridWidth) + (((fullQuad % gridWidth) / stride) * stride));
+
+        std::sort(blocks.begin(), blocks.end());
+        blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+        blocks.erase(std::remove_if(blocks.begin(), blocks.end(), [&](uint32 candidate)
+        {
+            for (uint32 z = 0; z < stride; ++z)
+            {
+                for (uint32 x = 0; x < stride; ++x)
+                {
+                    if (!std::binary_search(fullQuads.begin(), fullQuads.end(), candidate + (z * gridWidth) + x))
+                        return true;
+                }
+            }
+
+            return false;
+        }), blocks.end());
+
+        leaf.lodBlocks[lod] = blocks;
+    }
+
+    // The level of a block a quad is drawn with, the biggest one that can be joined up to the given level, or 0.
+    auto const getBlockLod = [&](uint32 quadSample, int maxLod)
+    {
+        for (int blockLod = maxLod; blockLod > 0; --blockLod)
+        {
+            uint32 const blockStride = 1u << blockLod;
+            uint32 const blockSample = (((quadSample / gridWidth) / blockStride) * blockStride * gridWidth) + (((quadSample % gridWidth) / blockStride) * blockStride);
+
+            if (std::binary_search(leaf.lodBlocks[blockLod].begin(), leaf.lodBlocks[blockLod].end(), blockSample))
+                return blockLod;
+        }
+
+        return 0;
+    };
+
+    for (lod = 1; lod < LOD_COUNT; ++lod)
     {
-        // If the triangle is inside the node then increment the count by one.
-        if (IsTriangleContained(i, positionX, positionY, positionZ, width))
-            count++;
+        // The triangles outside the blocks are drawn at full resolution.
+        for (size_t i = 0; i < triangleQuads.size(); ++i)
+        {
+            if (getBlockLod(triangleQuads[i], lod) == 0)
+                leaf.lodIndices[lod].insert(leaf.lodIndices[lod].end(), &leaf.lodIndices[0][i * 3], &leaf.lodIndices[0][i * 3] + 3);
+        }
+
+        // Where a block can't be joined at this level its smaller blocks are drawn. A side of a block is a single edge
+        // when the block next to it is drawn with the same size, any other neighbour has every sample along the side at
+        // any level, in this leaf or another one.
+        for (int blockLod = 1; blockLod <= lod; ++blockLod)
+        {
+            stride = 1u << blockLod;
+
+            auto const isDrawnBlock = [&](uint32 blockSample)
+            {
+                return std::binary_search(leaf.lodBlocks[blockLod].begin(), leaf.lodBlocks[blockLod].end(), blockSample) && getBlockLod(blockSample, lod) == blockLod;
+            };
+
+            for (uint32 blockSample : leaf.lodBlocks[blockLod])
+            {
+                if (getBlockLod(blockSample, lod) != blockLod)
+                    continue;
+
+                column = blockSample % gridWidth;
+                row = blockSample / gridWidth;
+
+                blockIndices.clear();
+                TerrainCell::AddLodBlock(static_cast<int>(gridWidth), static_cast<int>(column), static_cast<int>(row), static_cast<int>(stride),
+                    column < stride || !isDrawnBlock(blockSample - stride), !isDrawnBlock(blockSample + stride),
+                    row < stride || !isDrawnBlock(blockSample - (stride * gridWidth)), !isDrawnBlock(blockSample + (stride * gridWidth)), blockIndices);
+
+                // Every sample of a block is a corner of one of its quads, so it is a vertex of the leaf.
+                for (unsigned int sample : blockIndices)
+                {
+                    auto const found = std::lower_bound(leaf.vertexIds.begin(), leaf.vertexIds.end(), sample);
+                    leaf.lodIndices[lod].push_back(static_cast<unsigned long>(found - leaf.vertexIds.begin()));
+                }
+            }
+        }
+    }
+
+    for (lod = 0; lod < LOD_COUNT; ++lod)
+    {
+        leaf.lodFirstIndex[lod] = 0;
+        leaf.lodIndexCount[lod] = static_cast<uint32>(leaf.lodIndices[lod].size());
     }
 
-    return count;
+    CalculateLodErrors(leaf, m_vertexList);
 }
 
-bool Octree::IsTriangleContained(int index, float positionX, float positionY, float positionZ, float width)
+void Octree::CalculateLodErrors(LeafMesh& leaf, DirectX::VertexPositionNormalColorDualTexture const* vertices) const
 {
-    float radius;
-    int vertexIndex;
+    uint32 const gridWidth = static_cast<uint32>(m_gridWidth);
+    float fx, fz, h00, h10, h01, h11, interpolated, error;
 
-    float x1, y1, z1, x2, y2, z2, x3, y3, z3;
-    float minimumX, maximumX, minimumY, maximumY, minimumZ, maximumZ;
+    leaf.lodError[0] = 0.0f;
 
-    // Calculate the radius of this node.
-    radius = width / 2.0f;
+    for (int lod = 1; lod < LOD_COUNT; ++lod)
+    {
+        uint32 const stride = 1u << lod;
+        error = 0.0f;
+
+        // Compare the height of every sample of a block with the height of the coarse quad it is covered by.
+        for (uint32 block : leaf.lodBlocks[lod])
+        {
+            h00 = vertices[block].position.y;
+            h10 = vertices[block + stride].position.y;
+            h01 = vertices[block + (stride * gridWidth)].position.y;
+            h11 = vertices[block + (stride * gridWidth) + stride].position.y;
+
+            for (uint32 z = 0; z <= stride; ++z)
+            {
+                for (uint32 x = 0; x <= stride; ++x)
+                {
+                    fx = static_cast<float>(x) / static_cast<float>(stride);
+                    fz = static_cast<float>(z) / static_cast<float>(stride);
+
+                    // The quad is split from the bottom left to the upper right corner.
+                    if (fz >= fx)
+                        interpolated = h00 + (fx * (h11 - h01)) + (fz * (h01 - h00));
+                    else
+                        interpolated = h00 + (fx * (h10 - h00)) + (fz * (h11 - h10));
+
+                    error = std::max(error, fabsf(vertices[block + (z * gridWidth) + x].position.y - interpolated));
+                }
+            }
+        }
 
-    // Get the index into the vertex list.
-    vertexIndex = index * 3;
+        // A coarser level is never more exact than the one before it.
+        leaf.lodError[lod] = std::max(error, leaf.lodError[lod - 1]);
+    }
+}
 
+int Octree::SelectLod(LeafMesh const& leaf, OctreeNode const& node) const
+{
+    float dx, dy, dz, distance;
 
-    // Get the three vertices of this triangle from the vertexList.
-    x1 = m_vertexList[vertexIndex].position.x;
-    y1 = m_vertexList[vertexIndex].position.y;
-    z1 = m_vertexList[vertexIndex].position.z;
-    vertexIndex++;
+    if (m_lodScale <= 0.0f)
+        return 0;
 
-    x2 = m_vertexList[vertexIndex].position.x;
-    y2 = m_vertexList[vertexIndex].position.y;
-    z2 = m_vertexList[vertexIndex].position.z;
-    vertexIndex++;
+    // Find the distance from the camera to the closest point of the leaf bounds.
+    dx = std::max(std::max(node.minX - m_cameraPosition.x, 0.0f), m_cameraPosition.x - node.maxX);
+    dy = std::max(std::max(node.minY - m_cameraPosition.y, 0.0f), m_cameraPosition.y - node.maxY);
+    dz = std::max(std::max(node.minZ - m_cameraPosition.z, 0.0f), m_cameraPosition.z - node.maxZ);
+    distance = sqrtf((dx * dx) + (dy * dy) + (dz * dz));
 
-    x3 = m_vertexList[vertexIndex].position.x;
-    y3 = m_vertexList[vertexIndex].position.y;
-    z3 = m_vertexList[vertexIndex].position.z;
+    // Use the coarsest level whose height error stays below the allowed number of pixels on screen.
+    for (int lod = LOD_COUNT - 1; lod > 0; --lod)
+    {
+        if (leaf.lodError[lod] * m_lodScale <= LOD_PIXEL_ERROR * distance)
+            return lod;
+    }
+
+    return 0;
+}
+
+void Octree::GatherTriangles(std::vector<uint32> const& triangles, float positionX, float positionY, float positionZ, float width, std::vector<uint32>& contained)
+{
+    contained.clear();
+
+    // Keep the triangles of the list that are inside the node, the order of the list stays the same.
+    for (uint32 triangle : triangles)
+    {
+        if (IsTriangleContained(triangle, positionX, positionY, positionZ, width))
+            contained.push_back(triangle);
+    }
+}
+
+bool Octree::IsTriangleContained(uint32 index, float positionX, float positionY, float positionZ, float width)
+{
+    // Calculate the radius of this node.
+    float const radius = width / 2.0f;
+
+    // Get the bounds of this triangle.
+    TriangleBounds const& bounds = m_triangleBounds[index];
 
     // Check to see if the minimum of the x coordinates of the triangle is inside the node.
-    minimumX = std::min(x1, std::min(x2, x3));
-    if (minimumX > (positionX + radius))
+    if (bounds.minX > (positionX + radius))
         return false;
 
     // Check to see if the maximum of the x coordinates of the triangle is inside the node.
-    maximumX = std::max(x1, std::max(x2, x3));
-    if (maximumX < (positionX - radius))
+    if (bounds.maxX < (positionX - radius))
         return false;
 
     // Check to see if the minimum of the y coordinates of the triangle is inside the node.
-    minimumY = std::min(y1, std::min(y2, y3));
-    if (minimumY > (positionY + radius))
+    if (bounds.minY > (positionY + radius))
         return false;
 
     // Check to see if the maximum of the y coordinates of the tirangle is inside the node.
-    maximumY = std::max(y1, std::max(y2, y3));
-    if (maximumY < (positionY - radius))
+    if (bounds.maxY < (positionY - radius))
         return false;
 
     // Check to see if the minimum of the z coordinates of the triangle is inside the node.
-    minimumZ = std::min(z1, std::min(z2, z3));
-    if (minimumZ > (positionZ + radius))
+    if (bounds.minZ > (positionZ + radius))
         return false;
 
     // Check to see if the maximum of the z coordinates of the triangle is inside the node.
-    maximumZ = std::max(z1, std::max(z2, z3));
-    if (maximumZ < (positionZ - radius))
+    if (bounds.maxZ < (positionZ - radius))
         return false;
 
     return true;
 }
 
-void Octree::ReleaseNode(OctreeNode* node)
+void Octree::CullNode(Frustum* frustum, uint32 nodeIndex, uint32 planeMask)
 {
-}
+    Frustum::Visibility visibility;
+    uint32 childCount, visibleChildren, i;
 
-void Octree::DrawNode(ID3D11DeviceContext* deviceContext, Frustum* frustum, OctreeNode* node, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj)
-{
-    bool result;
-    int count, i, indexCount;
+    OctreeNode const& node = m_nodes[nodeIndex];
 
-    // Check to see if the node can be viewed, height doesn't matter in a quad tree.
-    result = frustum->CheckCube(DirectX::XMFLOAT3(node->x, node->y, node->z), (node->width * 0.5f));
-    //result = frustum->CheckRectangle(node->minWidth, node->minHeight, node->minDepth, node->maxWidth, node->maxHeight, node->maxDepth);
-    
+    // Check to see if the bounds of the node can be viewed, a node that is completely inside the planes of its parent isn't tested again.
+    if (planeMask != 0)
+    {
+        visibility = frustum->ClassifyRectangle(node.minX, node.minY, node.minZ,
+            node.maxX, node.maxY, node.maxZ, planeMask, m_cullTestCount);
 
-    // If it can't be seen then none of its children can either so don't continue down the tree, this is where the speed is gained.
-    if (!result)
-        return;
+        // If it can't be seen then none of its children can either so don't continue down the tree, this is where the speed is gained.
+        if (visibility == Frustum::Visibility::OUTSIDE)
+            return;
+    }
 
-    // If it can be seen then check all eight child nodes to see if they can also be seen.
-    count = 0;
-    for (i = 0; i < 8; ++i)
+    // If it can be seen then check all child nodes to see if they can also be seen, they are next to each other in the array.
+    if (node.childMask != 0)
     {
-        if (node->nodes[i] != nullptr)
+        childCount = static_cast<uint32>(std::bitset<8>(node.childMask).count());
+
+        // Test the bounds of all children in one batch, unless the node is completely inside the frustum.
+        visibleChildren = 0xFF;
+        if (planeMask != 0)
         {
-            count++;
-            DrawNode(deviceContext, frustum, node->nodes[i], world, view, proj);
+            frustum->CheckRectangles(&m_nodeMinX[node.firstChild], &m_nodeMinY[node.firstChild], &m_nodeMinZ[node.firstChild],
+                &m_nodeMaxX[node.firstChild], &m_nodeMaxY[node.firstChild], &m_nodeMaxZ[node.firstChild], childCount, &visibleChildren);
+            m_cullTestCount += static_cast<int>(childCount) * Frustum::TOTAL_PLANES;
         }
-    }
-
-    // If there were any children nodes then there is no need to continue as parent nodes won't contain any triangles to render.
-    if (count != 0)
-        return;
 
-    // Otherwise if this node can be seen and has triangles in it then render these triangles.
-
-    // Set vertex buffer stride and offset.
-    unsigned int offset = 0;
+        for (i = 0; i < childCount; ++i)
+        {
+            if ((visibleChildren & (1u << i)) == 0)
+                continue;
+
+            // A visible leaf is queued right away, a node with children of its own is classified to find the planes it is
+            // completely inside of, so its children test fewer of them.
+            OctreeNode const& child = m_nodes[node.firstChild + i];
+            if (child.childMask == 0)
+                AddLeaf(child);
+            else
+                CullNode(frustum, node.firstChild + i, planeMask);
+        }
 
-    // Set the vertex buffer to active in the input assambler so it can be rendered.
-    deviceContext->IASetVertexBuffers(0, 1, node->vertexBuffer.GetAddressOf(), node->vertexBuffer.StridePtr(), &offset);
+        // If there were any children nodes then there is no need to continue as parent nodes won't contain any triangles to render.
+        return;
+    }
 
-    // Set the index buffer to active in the 
-    deviceContext->IASetIndexBuffer(node->indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+    AddLeaf(node);
+}
 
-    // Set the type of primitive that should be rendered from this vertex buffer, in this case triangles.
-    deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+void Octree::AddLeaf(OctreeNode const& node)
+{
+    // Empty nodes have nothing to render.
+    if (node.leafIndex == INVALID_INDEX)
+        return;
 
-    // Determine the number of indices in this node.
-    indexCount = node->triangleCount * 3;
+    // Otherwise if this node can be seen and has triangles in it then queue the triangles of its level of detail.
+    LeafMesh const& leaf = m_leaves[node.leafIndex];
+    int const lod = SelectLod(leaf, node);
+    m_drawRanges.Add(leaf.lodFirstIndex[lod], leaf.lodIndexCount[lod]);
 
     // Increase the count of the number of polygons that have been rendered during this frame.
-    m_drawCount += node->triangleCount;
-
-    // Call the terrain shader to render the polygons in this node.
-    shader.RenderShader(deviceContext, indexCount);
+    m_drawCount += static_cast<int>(leaf.lodIndexCount[lod] / 3);
 }
\ No newline at end of file
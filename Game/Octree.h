@@ -9,42 +9,193 @@
 #include "Terrain.h"
 #include "TerrainShader.h"
 #include "Frustum.h"
+#include "TaskPool.h"
+#include "DrawRangeMerger.h"
 
 class Octree
 {
+    public:
+        // Terrain triangle returned by the collision queries, the id is the number of the triangle in the terrain index list.
+        struct Triangle
+        {
+            DirectX::XMFLOAT3 v0, v1, v2;
+            uint32 id;
+        };
+
+        // First contact of a swept shape, the normal points from the triangle towards the shape.
+        struct SweepHit
+        {
+            bool hit;
+            float distance;
+            DirectX::XMFLOAT3 normal;
+            uint32 triangleId;
+        };
+
+        // Level of detail 0 is the full mesh, every next level skips twice as many samples of the height map grid.
+        static constexpr int const LOD_COUNT = 4;
+
     public:
         Octree();
         ~Octree();
 
         bool Initialize(Terrain* terrain, ID3D11DeviceContext* deviceContext);
-        void Draw(ID3D11DeviceContext* deviceContext, Frustum* frustum, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj);
+
+        // Builds the tree on the CPU. The vertices are the samples of a height map grid with gridWidth samples per row and
+        // two triangles per quad like the terrain index list, the levels of detail of the leaves are built on that grid.
+        bool Build(DirectX::VertexPositionNormalColorDualTexture const* vertices, int vertexCount, uint32 const* indices, int indexCount, int gridWidth);
+        void Upload(ID3D11DeviceContext* deviceContext, TerrainVertexPacker const& packer);
+
+        // Largest number of triangles in a leaf of the next build, a node with more is split. Smaller leaves make a deeper
+        // tree with more nodes. The count is kept between MIN_TRIANGLES and MAX_TRIANGLES.
+        void SetMaxLeafTriangles(int count);
+
+        // The task pool the next build runs on, TaskPool::Get() unless another one is set. With a pool that has no
+        // workers the whole build runs on the calling thread.
+        void SetTaskPool(TaskPool* taskPool);
+
+        // Finds the visible leaves and the level of detail of each one without touching the device, Draw draws the result.
+        // lodScale converts a height error at a distance into pixels, it is the screen height divided by 2 * tan(fieldOfViewY / 2).
+        // A lodScale of 0 draws every leaf at full resolution.
+        void Cull(Frustum* frustum, DirectX::XMFLOAT3 const& cameraPosition, float lodScale);
+        void Draw(ID3D11DeviceContext* deviceContext, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj);
+
+        // Replaces the heights of a rectangle of terrain samples, the heights are passed row by row. This is the one place to
+        // edit the terrain the tree was built from: the terrain rebuilds its vertices, cells and ray blocks, and the tree
+        // re-uploads the changed vertices and refits the collision triangles, bounds and level of detail errors of its leaves.
+        bool SetHeights(ID3D11DeviceContext* deviceContext, Terrain* terrain, int firstColumn, int firstRow, int columnCount, int rowCount, float const* heights);
         void Shutdown();
 
+        // Collision queries against the CPU copy of the leaf triangles. A sphere is a capsule whose segment has no length.
+        // The queries only read the tree, they may run on several threads as long as no region is updated.
+        int OverlapBox(DirectX::XMFLOAT3 const& boxMin, DirectX::XMFLOAT3 const& boxMax, std::vector<Triangle>& triangles) const;
+        int OverlapCapsule(DirectX::XMFLOAT3 const& segmentStart, DirectX::XMFLOAT3 const& segmentEnd, float radius, std::vector<Triangle>& triangles) const;
+        bool SweepCapsule(DirectX::XMFLOAT3 const& segmentStart, DirectX::XMFLOAT3 const& segmentEnd, float radius,
+            DirectX::XMFLOAT3 const& direction, float maxDistance, SweepHit& hit) const;
+
         int GetDrawCount() const { return m_drawCount; }
+        int GetCullTestCount() const { return m_cullTestCount; }
+        int GetVisibleLeafCount() const { return m_visibleLeafCount; }
+        int GetDrawCallCount() const { return m_drawCallCount; }
+
+        // The buffer and render state binds Draw made in the last frame, counted where they are made.
+        int GetStateBindCount() const { return m_stateBindCount; }
+        int GetNodeCount() const { return static_cast<int>(m_nodes.size()); }
+        int GetLeafCount() const { return static_cast<int>(m_leaves.size()); }
+
+        // Terrain vertex numbers of the triangles a leaf draws at a level of detail, three per triangle. The triangles
+        // are only on the CPU until the tree is uploaded.
+        void GetLeafTriangles(int leafIndex, int lod, std::vector<uint32>& vertexIds) const;
+
+        // Terrain triangle numbers of all triangles inside a leaf in index list order, with the ones on the border of
+        // two leaves in both of them.
+        std::vector<uint32> const& GetLeafTriangleIds(int leafIndex) const { return m_leaves[leafIndex].triangleIds; }
 
     private:
-        struct OctreeNode
+        // Node of the tree while it is being built, the children of a node are built in parallel.
+        struct BuildNode
         {
             float x, y, z, width;
-            int triangleCount;
-            DX::VertexBuffer<DirectX::VertexPositionNormalColorDualTexture> vertexBuffer;
-            DX::IndexBuffer<unsigned long> indexBuffer;
-            OctreeNode* nodes[8];
+            std::vector<DirectX::VertexPositionNormalColorDualTexture> vertices;
+            std::vector<unsigned long> indices;
+            std::vector<uint32> vertexIds;
+            std::vector<uint32> triangleIds;
+            std::unique_ptr<BuildNode> nodes[8];
+        };
+
+        // Culling data of a node, the bounds fit the triangles below the node. The nodes are stored depth first
+        // in one array and the children of a node are next to each other, in the order of the bits set in the child mask.
+        struct OctreeNode
+        {
+            float minX, minY, minZ;
+            float maxX, maxY, maxZ;
+            uint32 firstChild;
+            uint32 leafIndex;
+            uint8 childMask;
+        };
+
+        // Geometry of a leaf node, kept apart from the nodes so culling doesn't touch it. The vertices and indices
+        // of all leaves are stored in one shared vertex and index buffer, the leaf knows where its part starts.
+        struct LeafMesh
+        {
+            uint32 firstVertex;
+            std::vector<DirectX::VertexPositionNormalColorDualTexture> vertices;
+
+            // Triangles of every level as indices into the vertices of the leaf, with their place in the shared index buffer.
+            // A triangle that is in several leaves is only drawn by the first one, so the leaves never overlap.
+            std::vector<unsigned long> lodIndices[LOD_COUNT];
+            uint32 lodFirstIndex[LOD_COUNT];
+            uint32 lodIndexCount[LOD_COUNT];
+
+            // Bottom left sample of every block of the stride of a level whose quads are all drawn by the leaf, a level draws
+            // every quad with the biggest block up to its stride it is in. The largest height error of every level.
+            std::vector<uint32> lodBlocks[LOD_COUNT];
+            float lodError[LOD_COUNT];
+
+            // Position of every vertex of the leaf in the terrain vertex array, in ascending order.
+            std::vector<uint32> vertexIds;
+
+            // Triangles of the leaf on the CPU for the collision queries. The positions follow vertexIds and the
+            // indices point into them, a leaf never has more vertices than a 16 bit index can reach.
+            std::vector<DirectX::XMFLOAT3> positions;
+            std::vector<uint16> triangleIndices;
+            std::vector<uint32> triangleIds;
+        };
+
+        struct TriangleBounds
+        {
+            float minX, minY, minZ;
+            float maxX, maxY, maxZ;
         };
 
     private:
         void CalculateMeshDimensions(int vertexCount, float& centerX, float& centerY, float& centerZ, float& meshWidth);
-        void CreateTreeNode(OctreeNode* node, float positionX, float positionY, float positionZ, float width, ID3D11DeviceContext* deviceContext);
-        int CountTriangles(float positionX, float positionY, float positionZ, float width);
-        bool IsTriangleContained(int index, float positionX, float positionY, float positionZ, float width);
-        void ReleaseNode(OctreeNode* node);
-        void DrawNode(ID3D11DeviceContext* deviceContext, Frustum* frustum, OctreeNode* node, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj);
+        void CalculateTriangleBounds();
+        void CreateTreeNode(BuildNode* node, float positionX, float positionY, float positionZ, float width, std::vector<uint32> const& triangles);
+        void LinearizeNode(BuildNode* buildNode, uint32 nodeIndex);
+        void CopyNodeBounds();
+        void UpdateRegion(ID3D11DeviceContext* deviceContext, Terrain const* terrain, Terrain::GridRegion const& region);
+        void BuildLeafLevels(uint32 leafIndex, std::vector<uint32> const& triangleLeaves);
+        void CalculateLodErrors(LeafMesh& leaf, DirectX::VertexPositionNormalColorDualTexture const* vertices) const;
+        int SelectLod(LeafMesh const& leaf, OctreeNode const& node) const;
+        void GatherTriangles(std::vector<uint32> const& triangles, float positionX, float positionY, float positionZ, float width, std::vector<uint32>& contained);
+        bool IsTriangleContained(uint32 index, float positionX, float positionY, float positionZ, float width);
+        bool UpdateNode(ID3D11DeviceContext* deviceContext, Terrain const* terrain, Terrain::GridRegion const& region, TerrainVertexPacker const& packer, uint32 nodeIndex);
+        bool UpdateLeaf(ID3D11DeviceContext* deviceContext, Terrain const* terrain, Terrain::GridRegion const& region, TerrainVertexPacker const& packer, OctreeNode& node);
+        template<typename Function>
+        void VisitLeaves(uint32 nodeIndex, DirectX::XMFLOAT3 const& boxMin, DirectX::XMFLOAT3 const& boxMax, Function const& function) const;
+        void CullNode(Frustum* frustum, uint32 nodeIndex, uint32 planeMask);
+        void AddLeaf(OctreeNode const& node);
 
     private:
         static constexpr int const MAX_TRIANGLES = 10000;
 
-        int m_triangleCount, m_drawCount;
-        DirectX::VertexPositionNormalColorDualTexture* m_vertexList;
-        OctreeNode* m_pRootNode;
+        // The bounds of the eight triangles of the quads around a grid sample overlap every node at the sample, a node
+        // that may only hold fewer is split forever.
+        static constexpr int const MIN_TRIANGLES = 8;
+        static constexpr uint32 const INVALID_INDEX = 0xFFFFFFFF;
+
+        // Largest height error in pixels a leaf may have on screen before a finer level of detail is used.
+        static constexpr float const LOD_PIXEL_ERROR = 2.0f;
+
+        int m_gridWidth, m_maxLeafTriangles;
+        TaskPool* m_taskPool;
+        DirectX::XMFLOAT3 m_cameraPosition;
+        float m_lodScale;
+        int m_triangleCount, m_drawCount, m_cullTestCount, m_visibleLeafCount, m_drawCallCount, m_stateBindCount;
+        DirectX::VertexPositionNormalColorDualTexture const* m_vertexList;
+        uint32 const* m_indexList;
+        std::vector<TriangleBounds> m_triangleBounds;
+        std::vector<OctreeNode> m_nodes;
+        std::vector<LeafMesh> m_leaves;
+
+        // Bounds of every node with one array per component, the children of a node are next to each other so they are
+        // culled in one batch.
+        std::vector<float> m_nodeMinX, m_nodeMinY, m_nodeMinZ;
+        std::vector<float> m_nodeMaxX, m_nodeMaxY, m_nodeMaxZ;
+
+        DX::VertexBuffer<DirectX::VertexTerrainPacked> m_vertexBuffer;
+        DX::IndexBuffer<uint32> m_indexBuffer;
+        DrawRangeMerger m_drawRanges;
+        TerrainVertexPacker::Parameters m_packingParameters;
         TerrainShader shader;
 };
\ No newline at end of file
@@ -13,6 +13,8 @@
 #include "WindowEvents.h"
 #include "Application.h"
 
+#include <filesystem>
+
 PlayScene PlayScene::s_instance;
 
 using namespace DirectX;
@@ -58,6 +60,8 @@ bool PlayScene::Load(SceneManager* sceneManager, Window& window)
     terrain.Initialize(m_deviceContext);
     octree.Initialize(&terrain, m_deviceContext);
 
+    terrainStreamerLoaded = LoadTerrainStreamer();
+
     m_pDeviceResources->SetCamera(&camera);
 
     player.Initialize(m_deviceContext);
@@ -75,13 +79,13 @@ bool PlayScene::Load(SceneManager* sceneManager, Window& window)
     npc.Initialize(m_deviceContext);
     npc.SetPosition(188.0f, 16.5f, 220.0f);
     npc.SetRotation(0.0f, 90.0f, 0.0f);
-    npc.LoadMesh(m_deviceContext, L"Data/guard.md5mesh");
+    npc.LoadMesh(m_deviceContext, L"Data/guard.md5mesh", MD5SkinningMode::GPU);
     npc.LoadAnim(L"Data/guard.md5anim");
 
     reptile.Initialize(m_deviceContext);
     reptile.SetPosition(200.0f, 19.0f, 220.0f);
     reptile.SetRotation(0.0f, 90.0f, 0.0f);
-    reptile.LoadMesh(m_deviceContext, L"Data/Models/Reptile/reptile.md5mesh");
+    reptile.LoadMesh(m_deviceContext, L"Data/Models/Reptile/reptile.md5mesh", MD5SkinningMode::GPU);
     reptile.LoadAnim(L"Data/Models/Reptile/idle.md5anim");
     reptile.LoadAnim(L"Data/Models/Reptile/walk.md5anim");
     reptile.LoadAnim(L"Data/Models/Reptile/jump.md5anim");
@@ -89,7 +93,7 @@ bool PlayScene::Load(SceneManager* sceneManager, Window& window)
     jugger.Initialize(m_deviceContext);
     jugger.SetPosition(200.0f, 19.0f, 240.0f);
     jugger.SetRotation(0.0f, 90.0f, 0.0f);
-    jugger.LoadMesh(m_deviceContext, L"Data/Models/Juggernaut/Juggernaut.md5mesh");
+    jugger.LoadMesh(m_deviceContext, L"Data/Models/Juggernaut/Juggernaut.md5mesh", MD5SkinningMode::GPU);
     jugger.LoadAnim(L"Data/Models/Juggernaut/Juggernaut_idle.md5anim");
 
     effect = std::make_unique<DirectX::BasicEffect>(device);
@@ -124,6 +128,32 @@ bool PlayScene::Load(SceneManager* sceneManager, Window& window)
 void PlayScene::Unload()
 {
     // @todo: Unload resources here.
+    terrainStreamer.Shutdown();
+}
+
+bool PlayScene::LoadTerrainStreamer()
+{
+    // Cut the height map into tiles when there is no tile file yet or the height map changed since.
+    std::error_code error;
+    std::filesystem::file_time_type const sourceTime = std::filesystem::last_write_time(TERRAIN_HEIGHT_MAP_FILE, error);
+    std::filesystem::file_time_type const tileTime = std::filesystem::last_write_time(TERRAIN_TILE_FILE, error);
+
+    if (error || tileTime < sourceTime)
+    {
+        if (!TerrainStreamer::ConvertRawHeightMap(TERRAIN_HEIGHT_MAP_FILE, TERRAIN_SIZE, TERRAIN_SIZE, TERRAIN_HEIGHT_SCALE, TERRAIN_TILE_SIZE, TERRAIN_TILE_FILE))
+        {
+            Logger::Get()->error("Failed to convert the height map {} to terrain tiles", TERRAIN_HEIGHT_MAP_FILE);
+            return false;
+        }
+    }
+
+    if (!terrainStreamer.Initialize(TERRAIN_TILE_FILE, TERRAIN_STREAMING_BUDGET, TERRAIN_STREAMING_RADIUS, m_deviceContext))
+    {
+        Logger::Get()->error("Failed to load the terrain tiles {}", TERRAIN_TILE_FILE);
+        return false;
+    }
+
+    return true;
 }
 
 void PlayScene::Update(DX::StepTimer const& timer)
@@ -265,6 +295,9 @@ void PlayScene::Update(DX::StepTimer const& timer)
     camera.SetOrigin(player.GetPositionFloat3());
     camera.UpdateMatrix();
 
+    if (streamTerrain)
+        terrainStreamer.Update(m_deviceContext, camera.cameraPos);
+
     m_pDeviceResources->SetCamera(&camera);
     m_pDeviceResources->SetCamera2D(&camera2d);
 
@@ -283,7 +316,17 @@ void PlayScene::Render()
 
     // Terrain drawing.
     frustum.Construct(500.0f, camera.GetViewMatrix(), camera.GetProjectionMatrix());
-    octree.Draw(m_deviceContext, &frustum, m_world, camera.GetViewMatrix(), camera.GetProjectionMatrix());
+
+    if (streamTerrain)
+        terrainStreamer.Draw(m_deviceContext, &frustum, m_world, camera.GetViewMatrix(), camera.GetProjectionMatrix());
+    else
+    {
+        // The projection scales y by 1 / tan(fieldOfViewY / 2), the levels of detail need half the screen height times that.
+        float const lodScale = pWindow->GetSize().y * 0.5f * XMVectorGetY(camera.GetProjectionMatrix().r[1]);
+
+        octree.Cull(&frustum, camera.cameraPos, lodScale);
+        octree.Draw(m_deviceContext, m_world, camera.GetViewMatrix(), camera.GetProjectionMatrix());
+    }
 
     player.Draw(m_deviceContext, camera.GetViewMatrix(), camera.GetProjectionMatrix());
     npc.Draw(m_deviceContext, camera.GetViewMatrix(), camera.GetProjectionMatrix());
@@ -330,6 +373,23 @@ void PlayScene::Render()
     ImGui::SliderAngle("Pitch", &camera.pitch, -180.0f, 180.0f);
     ImGui::SliderAngle("Yaw", &camera.yaw, -180.0f, 180.0f);
 
+    // The visible leaves share one buffer binding and shader state.
+    ImGui::Text("Terrain");
+    ImGui::Text("Visible leaves: %d, draw calls: %d, triangles: %d", octree.GetVisibleLeafCount(), octree.GetDrawCallCount(), octree.GetDrawCount());
+    ImGui::Text("State binds: %d", octree.GetStateBindCount());
+
+    // The tiles stay resident while the octree is drawn, they are only streamed while the switch is on.
+    if (terrainStreamerLoaded)
+    {
+        ImGui::Checkbox("Stream terrain", &streamTerrain);
+        ImGui::Text("Tiles: %d resident, %d pending, %d failed", terrainStreamer.GetResidentTileCount(),
+            terrainStreamer.GetPendingTileCount(), terrainStreamer.GetFailedTileCount());
+        ImGui::Text("Resident memory: %.1f of %.1f MB", terrainStreamer.GetResidentMemory() / (1024.0f * 1024.0f),
+            terrainStreamer.GetMemoryBudget() / (1024.0f * 1024.0f));
+        ImGui::Text("Page-in latency: %.1f ms average, %.1f ms max", terrainStreamer.GetAveragePageInLatency(),
+            terrainStreamer.GetMaxPageInLatency());
+    }
+
     ImGui::End();
 
     light->SpawnControlWindow();
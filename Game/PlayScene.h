@@ -16,6 +16,7 @@
 #include "ThirdPersonCamera.h"
 #include "Terrain.h"
 #include "Octree.h"
+#include "TerrainStreamer.h"
 
 #include "Frustum.h"
 #include "Model.h"
@@ -60,6 +61,18 @@ class PlayScene : public Scene
         // Instance of our play scene.
         static PlayScene s_instance;
 
+        // The streamed terrain is made from the same height map as the octree terrain, cut into tiles once.
+        static constexpr char const* TERRAIN_HEIGHT_MAP_FILE = "Data/terrain.raw";
+        static constexpr char const* TERRAIN_TILE_FILE = "Data/terrain.tiles";
+        static constexpr int TERRAIN_SIZE = 512;
+        static constexpr float TERRAIN_HEIGHT_SCALE = 400.0f;
+        static constexpr int TERRAIN_TILE_SIZE = 64;
+        static constexpr size_t TERRAIN_STREAMING_BUDGET = 8 * 1024 * 1024;
+        static constexpr float TERRAIN_STREAMING_RADIUS = 200.0f;
+
+    private:
+        bool LoadTerrainStreamer();
+
     private:
         std::unique_ptr<DirectX::GeometricPrimitive> water;
         std::unique_ptr<DirectX::GeometricPrimitive> sky;
@@ -79,6 +92,11 @@ class PlayScene : public Scene
         Octree octree;
         Frustum frustum;
 
+        // Draws the terrain from tiles streamed around the camera instead of the octree when it is switched on.
+        TerrainStreamer terrainStreamer;
+        bool terrainStreamerLoaded = false;
+        bool streamTerrain = false;
+
         RenderableGameObject player;
         RenderableGameObject npc;
         RenderableGameObject reptile;
@@ -5,11 +5,17 @@
 #include "pch.h"
 #include "QuadTree.h"
 
+#include <bitset>
+
 
 QuadTree::QuadTree()
 {
     m_vertexList = nullptr;
-    m_parentNode = nullptr;
+    m_indexList = nullptr;
+    m_drawCount = 0;
+    m_cullTestCount = 0;
+    m_visibleLeafCount = 0;
+    m_drawCallCount = 0;
 }
 
 
@@ -19,135 +25,266 @@ QuadTree::~QuadTree()
 
 bool QuadTree::Initialize(Terrain* terrain, ID3D11DeviceContext* deviceContext)
 {
-    int vertexCount;
-    float centerX, centerZ, width;
+    int vertexCount, indexCount;
+    DirectX::VertexPositionNormalColorDualTexture* vertices;
+    uint32* indices;
+    bool result;
 
     // Get the number of vertices in the terrain vertex array.
     vertexCount = terrain->GetVertexCount();
 
-    // Store the total triangle count for the vertex list.
-    m_triangleCount = vertexCount / 3;
+    // Get the number of indices in the terrain index array.
+    indexCount = terrain->GetIndexCount();
 
     // Create a vertex array to hold all of the terrain vertices.
-    m_vertexList = new DirectX::VertexPositionNormalColorDualTexture[vertexCount];
-    if (!m_vertexList)
+    vertices = new DirectX::VertexPositionNormalColorDualTexture[vertexCount];
+    if (!vertices)
+        return false;
+
+    // Create an index array to hold all of the terrain triangles.
+    indices = new uint32[indexCount];
+    if (!indices)
+        return false;
+
+    // Copy the terrain vertices and indices into the lists.
+    terrain->CopyVertexArray(static_cast<void*>(vertices));
+    terrain->CopyIndexArray(static_cast<void*>(indices));
+
+    // Build the tree on the CPU.
+    result = Build(vertices, vertexCount, indices, indexCount);
+
+    // Release the vertex and index lists since the tree now has the vertices in each node.
+    delete[] vertices;
+    delete[] indices;
+
+    if (!result)
         return false;
 
-    // Copy the terrain vertices into the vertex list.
-    terrain->CopyVertexArray(static_cast<void*>(m_vertexList));
+    // Create the buffers of the leaf nodes.
+    Upload(deviceContext);
+
+    shader.InitializeShaders(deviceContext);
+
+    return true;
+}
+
+bool QuadTree::Build(DirectX::VertexPositionNormalColorDualTexture const* vertices, int vertexCount, uint32 const* indices, int indexCount)
+{
+    float centerX, centerZ, width;
+
+    // Store the lists for the duration of the build.
+    m_vertexList = vertices;
+    m_indexList = indices;
+
+    // Store the total triangle count for the index list.
+    m_triangleCount = indexCount / 3;
 
     // Calculate the center x, z and the size of the mesh.
     CalculateMeshDimensions(vertexCount, centerX, centerZ, width);
 
+    auto const buildStart = std::chrono::high_resolution_clock::now();
+
+    // Calculate the bounds of every triangle once, the tree build only compares these.
+    CalculateTriangleBounds();
+
+    // Find the triangles that are inside the root node.
+    std::vector<uint32> allTriangles(m_triangleCount);
+    for (int i = 0; i < m_triangleCount; ++i)
+        allTriangles[i] = static_cast<uint32>(i);
+
+    std::vector<uint32> rootTriangles;
+    GatherTriangles(allTriangles, centerX, centerZ, width, rootTriangles);
+    allTriangles.clear();
+    allTriangles.shrink_to_fit();
+
     // Create the parent node for the quad tree.
-    m_parentNode = new NodeType();
-    if (!m_parentNode)
-        return false;
+    std::unique_ptr<BuildNode> parentNode = std::make_unique<BuildNode>();
+
+    // Recursively build the quad tree, every node only looks at the triangles of its parent and
+    // the children of a node are built in parallel on the task pool.
+    CreateTreeNode(parentNode.get(), centerX, centerZ, width, rootTriangles);
+
+    // Store the finished tree in the node array, starting with the parent node.
+    m_nodes.clear();
+    m_leaves.clear();
+    m_nodes.resize(1);
+    LinearizeNode(parentNode.get(), 0);
+    parentNode.reset();
+
+    std::chrono::duration<float, std::milli> const buildTime = std::chrono::high_resolution_clock::now() - buildStart;
+    Logger::Get()->info("QuadTree: built {} nodes and {} leaves from {} triangles in {:.2f} ms on {} threads.",
+        m_nodes.size(), m_leaves.size(), m_triangleCount, buildTime.count(), TaskPool::Get().GetWorkerCount() + 1);
 
-    // Recursively build the quad tree based on the vertex list data and mesh dimensions.
-    CreateTreeNode(m_parentNode, centerX, centerZ, width, deviceContext);
+    // The lists belong to the caller, the leaf nodes have their own copies now.
+    m_vertexList = nullptr;
+    m_indexList = nullptr;
+
+    m_triangleBounds.clear();
+    m_triangleBounds.shrink_to_fit();
+
+    return true;
+}
+
+void QuadTree::Upload(ID3D11DeviceContext* deviceContext)
+{
+    std::vector<DirectX::VertexPositionNormalColorDualTexture> vertices;
+    std::vector<uint32> indices;
+    size_t vertexCount, indexCount;
+
+    ID3D11Device* device = DX::GetDevice(deviceContext);
+    if (device == nullptr)
+        return;
 
-    // Release the vertex list since the quad tree now has the vertices in each node.
-    if (m_vertexList)
+    vertexCount = 0;
+    indexCount = 0;
+    for (LeafMesh const& leaf : m_leaves)
     {
-        delete[] m_vertexList;
-        m_vertexList = nullptr;
+        vertexCount += leaf.vertices.size();
+        indexCount += leaf.indices.size();
     }
 
-    shader.InitializeShaders(deviceContext);
+    vertices.reserve(vertexCount);
+    indices.reserve(indexCount);
 
-    return true;
+    // Append the leaves in the order of the leaf array, it is the depth first order of the tree. The leaves
+    // below a node are next to each other in the buffers, so visible neighbours can be drawn with one call.
+    for (LeafMesh& leaf : m_leaves)
+    {
+        leaf.firstVertex = static_cast<uint32>(vertices.size());
+        leaf.firstIndex = static_cast<uint32>(indices.size());
+
+        vertices.insert(vertices.end(), leaf.vertices.begin(), leaf.vertices.end());
+
+        // The indices point into the shared vertex buffer, the ranges of different leaves then join without a base vertex.
+        for (unsigned long index : leaf.indices)
+            indices.push_back(leaf.firstVertex + static_cast<uint32>(index));
+
+        // Release the arrays now that the data is stored in the buffers.
+        leaf.vertices.clear();
+        leaf.vertices.shrink_to_fit();
+        leaf.indices.clear();
+        leaf.indices.shrink_to_fit();
+    }
+
+    if (vertices.empty())
+        return;
+
+    // The buffers are created on this thread only, after the tree build has finished.
+    m_vertexBuffer.Create(device, vertices.data(), static_cast<uint32>(vertices.size()));
+    m_indexBuffer.Create(device, indices.data(), static_cast<uint32>(indices.size()));
 }
 
 void QuadTree::Draw(ID3D11DeviceContext* deviceContext, Frustum* frustum, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj/*, TerrainShader* shader*/)
 {
-    shader.SetShaderParameters(deviceContext, world, view, proj);
+    unsigned int offset;
 
-    // Reset the number of triangles that are drawn for this frame.
+    // Reset the number of triangles that are drawn and the number of plane tests for this frame.
     m_drawCount = 0;
+    m_cullTestCount = 0;
+
+    // Collect the index ranges of the visible leaves starting at the parent node and moving down the tree.
+    m_drawRanges.Clear();
+    if (!m_nodes.empty())
+        CullNode(frustum, 0, Frustum::ALL_PLANES);
+
+    m_drawRanges.Merge();
+
+    DrawRangeMerger::Range const* ranges = m_drawRanges.GetRanges().data();
+    m_visibleLeafCount = static_cast<int>(m_drawRanges.GetAddedCount());
+    m_drawCallCount = static_cast<int>(m_drawRanges.GetRanges().size());
+
+    if (m_drawCallCount == 0)
+        return;
 
-    // Render each node that is visible starting at the parent node and moving down the tree.
-    DrawNode(deviceContext, frustum, m_parentNode, world, view, proj);
+    shader.SetShaderParameters(deviceContext, world, view, proj);
+
+    // Bind the shared buffers and the shader state once, every leaf uses the same ones.
+    offset = 0;
+    deviceContext->IASetVertexBuffers(0, 1, m_vertexBuffer.GetAddressOf(), m_vertexBuffer.StridePtr(), &offset);
+    deviceContext->IASetIndexBuffer(m_indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+    deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+    shader.SetRenderState(deviceContext);
+
+    // One draw for every run of visible leaves that are next to each other in the index buffer.
+    for (int i = 0; i < m_drawCallCount; ++i)
+        deviceContext->DrawIndexed(ranges[i].indexCount, ranges[i].firstIndex, 0);
 }
 
 void QuadTree::Shutdown()
 {
+    m_nodes.clear();
+    m_leaves.clear();
+    m_vertexBuffer = Bind::VertexBuffer<DirectX::VertexPositionNormalColorDualTexture>();
+    m_indexBuffer = Bind::IndexBuffer<uint32>();
 }
 
 void QuadTree::CalculateMeshDimensions(int vertexCount, float& centerX, float& centerZ, float& meshWidth)
 {
-    float minWidth, maxWidth, width, minDepth, maxDepth, depth, maxX, maxZ;
+    float minX, minZ, maxX, maxZ;
 
-    // Initialise the center position of the mesh to zero.
-    centerX = 0.0f;
-    centerZ = 0.0f;
+    // Initialize the bounds of the mesh with the first vertex.
+    minX = maxX = m_vertexList[0].position.x;
+    minZ = maxZ = m_vertexList[0].position.z;
 
-    // Sum all vertices in the mesh.
-    for (int i = 0; i < vertexCount; ++i)
+    // Go through all the vertices and find the minimum and maximum of the mesh, height doesn't matter in a quad tree.
+    for (int i = 1; i < vertexCount; ++i)
     {
-        centerX += m_vertexList[i].position.x;
-        centerZ += m_vertexList[i].position.z;
+        DirectX::XMFLOAT3 const& position = m_vertexList[i].position;
+
+        minX = std::min(minX, position.x);
+        minZ = std::min(minZ, position.z);
+        maxX = std::max(maxX, position.x);
+        maxZ = std::max(maxZ, position.z);
     }
 
-    // And then divide it by the number of vertices to find the mid-point of the mesh.
-    centerX = centerX / static_cast<float>(vertexCount);
-    centerZ = centerZ / static_cast<float>(vertexCount);
+    // The center of the root square is the middle of the bounds, like the root cube of the octree.
+    centerX = (minX + maxX) * 0.5f;
+    centerZ = (minZ + maxZ) * 0.5f;
 
-    // Initialize the maximum and minimum size of the mesh.
-    minWidth = fabsf(m_vertexList[0].position.x - centerX);
-    maxWidth = 0.0f;
+    // The root square has to hold the longest side of the mesh.
+    meshWidth = std::max(maxX - minX, maxZ - minZ);
+}
 
-    minDepth = fabsf(m_vertexList[0].position.z - centerZ);
-    maxDepth = 0.0f;
+void QuadTree::CalculateTriangleBounds()
+{
+    uint32 index1, index2, index3;
 
-    // Go through all the vertices and find the maximum and minimum size and depth of the mesh.
-    for (int i = 0; i < vertexCount; ++i)
-    {
-        width = fabsf(m_vertexList[i].position.x - centerX);
-        depth = fabsf(m_vertexList[i].position.z - centerZ);
+    m_triangleBounds.resize(m_triangleCount);
 
-        if (width < minWidth) { minWidth = width; }
-        if (width > maxWidth) { maxWidth = width; }
-        if (depth < minDepth) { minDepth = depth; }
-        if (depth > maxDepth) { maxDepth = depth; }
+    for (int i = 0; i < m_triangleCount; ++i)
+    {
+        // Get the three vertices of this triangle.
+        index1 = m_indexList[(i * 3)];
+        index2 = m_indexList[(i * 3) + 1];
+        index3 = m_indexList[(i * 3) + 2];
+
+        DirectX::XMFLOAT3 const& v1 = m_vertexList[index1].position;
+        DirectX::XMFLOAT3 const& v2 = m_vertexList[index2].position;
+        DirectX::XMFLOAT3 const& v3 = m_vertexList[index3].position;
+
+        // Store the minimum and maximum of the x and z coordinates, height doesn't matter in a quad tree.
+        m_triangleBounds[i].minX = std::min(v1.x, std::min(v2.x, v3.x));
+        m_triangleBounds[i].minZ = std::min(v1.z, std::min(v2.z, v3.z));
+        m_triangleBounds[i].maxX = std::max(v1.x, std::max(v2.x, v3.x));
+        m_triangleBounds[i].maxZ = std::max(v1.z, std::max(v2.z, v3.z));
     }
-
-    // Find the absolute maximum value between the min and max depth and size.
-    maxX = static_cast<float>(std::max(fabs(minWidth), fabs(maxWidth)));
-    maxZ = static_cast<float>(std::max(fabs(minDepth), fabs(maxDepth)));
-
-    // Calculate the maximum diameter of the mesh.
-    meshWidth = std::max(maxX, maxZ) * 2.0f;
 }
 
-void QuadTree::CreateTreeNode(NodeType* node, float positionX, float positionZ, float width, ID3D11DeviceContext* deviceContext/*, ID3D11Device* device*/)
+void QuadTree::CreateTreeNode(BuildNode* node, float positionX, float positionZ, float width, std::vector<uint32> const& triangles)
 {
-    ID3D11Device* device = DX::GetDevice(deviceContext);
-    if (device == nullptr)
-        return;
-
-    int numTriangles, i, count, vertexCount, index, vertexIndex;
+    int numTriangles, i, indexCount, index, corner;
     float offsetX, offsetZ;
-    DirectX::VertexPositionNormalColorDualTexture* vertices;
-    unsigned long* indices;
-    bool result;
+    std::vector<uint32> globalIndices;
+    TaskPool::TaskGroup group;
 
     // Store the node position and size.
     node->positionX = positionX;
     node->positionZ = positionZ;
     node->width = width;
 
-    // Initialize the triangle count to zero for the node.
-    node->triangleCount = 0;
-
-    // Initialize the children nodes of this node to nullptr.
-    node->nodes[0] = nullptr;
-    node->nodes[1] = nullptr;
-    node->nodes[2] = nullptr;
-    node->nodes[3] = nullptr;
-
-    // Count the number of triangles that are inside this node.
-    numTriangles = CountTriangles(positionX, positionZ, width);
+    // The parent already gathered the triangles that are inside this node.
+    numTriangles = static_cast<int>(triangles.size());
     
     // Case 1: If there are no tirnalges in this node then return as it is empty and requires no processing.
     if (numTriangles == 0)
@@ -162,205 +299,216 @@ void QuadTree::CreateTreeNode(NodeType* node, float positionX, float positionZ,
             offsetX = (((i % 2) < 1) ? -1.0f : 1.0f) * (width / 4.0f);
             offsetZ = (((i % 4) < 2) ? -1.0f : 1.0f) * (width / 4.0f);
 
-            // Set if there are any triangles in the new node.
-            count = CountTriangles((positionX + offsetX), (positionZ + offsetZ), (width / 2.0f));
-            if (count > 0)
+            // Every child is an independent task, the triangles of this node stay alive until all of them finished.
+            TaskPool::Get().Run(group, [this, node, i, &triangles, positionX, positionZ, offsetX, offsetZ, width]()
             {
+                std::vector<uint32> childTriangles;
+
+                // Gather the triangles of this node that are also inside the new node.
+                GatherTriangles(triangles, (positionX + offsetX), (positionZ + offsetZ), (width / 2.0f), childTriangles);
+                if (childTriangles.empty())
+                    return;
+
                 // If there are triangles inside where this new node would be then create the child node.
-                node->nodes[i] = new NodeType();
+                node->nodes[i] = std::make_unique<BuildNode>();
 
                 // Extend the tree starting from this new child node new.
-                CreateTreeNode(node->nodes[i], (positionX + offsetX), (positionZ + offsetZ), (width / 2.0f), deviceContext);
-            }
+                CreateTreeNode(node->nodes[i].get(), (positionX + offsetX), (positionZ + offsetZ), (width / 2.0f), childTriangles);
+            });
         }
 
+        TaskPool::Get().Wait(group);
+
         return;
     }
 
     // Case 3: If this node is not empty and the triangle count for it is less than the max then.
     // this node is at the bottom of the tree so create the list of triangles to store in it.
-    node->triangleCount = numTriangles;
+    // Calculate the number of indices.
+    indexCount = numTriangles * 3;
 
-    // Calculate the number of vertices.
-    vertexCount = numTriangles * 3;
+    // Collect the terrain vertices of all triangle corners of this node.
+    globalIndices.reserve(indexCount);
+    for (uint32 triangle : triangles)
+    {
+        for (corner = 0; corner < 3; ++corner)
+            globalIndices.push_back(m_indexList[(triangle * 3) + corner]);
+    }
 
-    // Create the vertex array.
-    vertices = new DirectX::VertexPositionNormalColorDualTexture[vertexCount];
+    // Every vertex is stored once in the node, sorted by its position in the terrain vertex array.
+    // Leaves are built on several threads at once so this replaces a shared remap table.
+    std::vector<uint32> uniqueIndices(globalIndices);
+    std::sort(uniqueIndices.begin(), uniqueIndices.end());
+    uniqueIndices.erase(std::unique(uniqueIndices.begin(), uniqueIndices.end()), uniqueIndices.end());
 
-    // Create the index array.
-    indices = new unsigned long[vertexCount];
+    node->vertices.reserve(uniqueIndices.size());
+    for (uint32 globalIndex : uniqueIndices)
+        node->vertices.push_back(m_vertexList[globalIndex]);
 
-    // Initialize the index for this new vertex and index array.
-    index = 0;
+    // Point the indices of the node at its own vertex array.
+    node->indices.resize(indexCount);
+    for (index = 0; index < indexCount; ++index)
+    {
+        auto const found = std::lower_bound(uniqueIndices.begin(), uniqueIndices.end(), globalIndices[index]);
+        node->indices[index] = static_cast<unsigned long>(found - uniqueIndices.begin());
+    }
+}
 
-    // Ge through all the triangles in the vertex list.
-    for (i = 0; i < m_triangleCount; ++i)
+void QuadTree::LinearizeNode(BuildNode* buildNode, uint32 nodeIndex)
+{
+    uint32 firstChild;
+    uint8 childMask;
+    int i;
+
+    // Find the children of this node.
+    childMask = 0;
+    for (i = 0; i < 4; ++i)
     {
-        // If the triangle is inside this node then add it to the vertex array.
-        result = IsTriangleContained(i, positionX, positionZ, width);
-        if (result == true)
+        if (buildNode->nodes[i])
+            childMask |= static_cast<uint8>(1 << i);
+    }
+
+    // Start with empty bounds, they are fitted around the triangles below the node.
+    NodeType& node = m_nodes[nodeIndex];
+    node.minX = node.minY = node.minZ = FLT_MAX;
+    node.maxX = node.maxY = node.maxZ = -FLT_MAX;
+    node.firstChild = INVALID_INDEX;
+    node.leafIndex = INVALID_INDEX;
+    node.childMask = childMask;
+
+    // Move the geometry of a leaf node into the leaf array.
+    if (!buildNode->indices.empty())
+    {
+        node.leafIndex = static_cast<uint32>(m_leaves.size());
+
+        // The bounds of a leaf are the bounds of its vertices.
+        for (auto const& vertex : buildNode->vertices)
         {
-            // Calculate the index into the terrain vertex list.
-            vertexIndex = i * 3;
-
-            // Get the three vertices of this triangle from the vertex list.
-            vertices[index].position = m_vertexList[vertexIndex].position;
-            vertices[index].normal = m_vertexList[vertexIndex].normal;
-            vertices[index].color = m_vertexList[vertexIndex].color;
-            vertices[index].textureCoordinate0 = m_vertexList[vertexIndex].textureCoordinate0;
-            vertices[index].textureCoordinate1 = m_vertexList[vertexIndex].textureCoordinate1;
-            indices[index] = index;
-            index++;
-
-            vertexIndex++;
-            vertices[index].position = m_vertexList[vertexIndex].position;
-            vertices[index].normal = m_vertexList[vertexIndex].normal;
-            vertices[index].color = m_vertexList[vertexIndex].color;
-            vertices[index].textureCoordinate0 = m_vertexList[vertexIndex].textureCoordinate0;
-            vertices[index].textureCoordinate1 = m_vertexList[vertexIndex].textureCoordinate1;
-            indices[index] = index;
-            index++;
-
-            vertexIndex++;
-            vertices[index].position = m_vertexList[vertexIndex].position;
-            vertices[index].normal = m_vertexList[vertexIndex].normal;
-            vertices[index].color = m_vertexList[vertexIndex].color;
-            vertices[index].textureCoordinate0 = m_vertexList[vertexIndex].textureCoordinate0;
-            vertices[index].textureCoordinate1 = m_vertexList[vertexIndex].textureCoordinate1;
-            indices[index] = index;
-            index++;
+            node.minX = std::min(node.minX, vertex.position.x);
+            node.minY = std::min(node.minY, vertex.position.y);
+            node.minZ = std::min(node.minZ, vertex.position.z);
+            node.maxX = std::max(node.maxX, vertex.position.x);
+            node.maxY = std::max(node.maxY, vertex.position.y);
+            node.maxZ = std::max(node.maxZ, vertex.position.z);
         }
+
+        LeafMesh leaf;
+        leaf.triangleCount = static_cast<int>(buildNode->indices.size() / 3);
+        leaf.firstVertex = 0;
+        leaf.firstIndex = 0;
+        leaf.vertices = std::move(buildNode->vertices);
+        leaf.indices = std::move(buildNode->indices);
+        m_leaves.push_back(std::move(leaf));
     }
 
-    // Create vertex and index buffers for this node.
-    node->vertexBuffer.Create(device, &vertices[0], vertexCount);
-    node->indexBuffer.Create(device, &indices[0], vertexCount);
+    if (childMask == 0)
+        return;
 
-    // Release the vertex and index arrays now that the data is stored in the buffers in the node.
-    delete[] vertices;
-    vertices = nullptr;
+    // Reserve the children next to each other before going down, the node reference isn't valid after the resize.
+    firstChild = static_cast<uint32>(m_nodes.size());
+    m_nodes[nodeIndex].firstChild = firstChild;
+    m_nodes.resize(firstChild + std::bitset<4>(childMask).count());
 
-    delete[] indices;
-    indices = nullptr;
+    for (i = 0; i < 4; ++i)
+    {
+        if (buildNode->nodes[i])
+        {
+            LinearizeNode(buildNode->nodes[i].get(), firstChild);
+            buildNode->nodes[i].reset();
+            firstChild++;
+        }
+    }
+
+    // Refit the bounds of this node around the bounds of its children, they are all done at this point.
+    NodeType& parent = m_nodes[nodeIndex];
+    for (uint32 childIndex = parent.firstChild; childIndex < firstChild; ++childIndex)
+    {
+        NodeType const& child = m_nodes[childIndex];
+        parent.minX = std::min(parent.minX, child.minX);
+        parent.minY = std::min(parent.minY, child.minY);
+        parent.minZ = std::min(parent.minZ, child.minZ);
+        parent.maxX = std::max(parent.maxX, child.maxX);
+        parent.maxY = std::max(parent.maxY, child.maxY);
+        parent.maxZ = std::max(parent.maxZ, child.maxZ);
+    }
 }
 
-int QuadTree::CountTriangles(float positionX, float positionZ, float width)
+void QuadTree::GatherTriangles(std::vector<uint32> const& triangles, float positionX, float positionZ, float width, std::vector<uint32>& contained)
 {
-    // initialize the count to zero.
-    int count = 0;
+    contained.clear();
 
-    // Go through all the triangles in the entire mesh and check which ones should be inside this node.
-    for (int i = 0; i < m_triangleCount; ++i)
+    // Keep the triangles of the list that are inside the node, the order of the list stays the same.
+    for (uint32 triangle : triangles)
     {
-        // If the triangle is inside the node then increment the count by one.
-        if (IsTriangleContained(i, positionX, positionZ, width))
-            count++;
+        if (IsTriangleContained(triangle, positionX, positionZ, width))
+            contained.push_back(triangle);
     }
-
-    return count;
 }
 
-bool QuadTree::IsTriangleContained(int index, float positionX, float positionZ, float width)
+bool QuadTree::IsTriangleContained(uint32 index, float positionX, float positionZ, float width)
 {
-    float radius;
-    int vertexIndex;
-
-    float x1, z1, x2, z2, x3, z3;
-    float minimumX, maximumX, minimumZ, maximumZ;
-
     // Calculate the radius of this node.
-    radius = width / 2.0f;
-
-    // Get the index into the vertex list.
-    vertexIndex = index * 3;
-
+    float const radius = width / 2.0f;
 
-    // Get the three vertices of this triangle from the vertexList.
-    x1 = m_vertexList[vertexIndex].position.x;
-    z1 = m_vertexList[vertexIndex].position.z;
-    vertexIndex++;
-
-    x2 = m_vertexList[vertexIndex].position.x;
-    z2 = m_vertexList[vertexIndex].position.z;
-    vertexIndex++;
-
-    x3 = m_vertexList[vertexIndex].position.x;
-    z3 = m_vertexList[vertexIndex].position.z;
+    // Get the bounds of this triangle.
+    TriangleBounds const& bounds = m_triangleBounds[index];
 
     // Check to see if the minimum of the x coordinates of the triangle is inside the node.
-    minimumX = std::min(x1, std::min(x2, x3));
-    if (minimumX > (positionX + radius))
+    if (bounds.minX > (positionX + radius))
         return false;
 
     // Check to see if the maximum of the x coordinates of the triangle is inside the node.
-    maximumX = std::max(x1, std::max(x2, x3));
-    if (maximumX < (positionX - radius))
+    if (bounds.maxX < (positionX - radius))
         return false;
 
     // Check to see if the minimum of the z coordinates of the triangle is inside the node.
-    minimumZ = std::min(z1, std::min(z2, z3));
-    if (minimumZ > (positionZ + radius))
+    if (bounds.minZ > (positionZ + radius))
         return false;
 
     // Check to see if the maximum of the z coordinates of the triangle is inside the node.
-    maximumZ = std::max(z1, std::max(z2, z3));
-    if (maximumZ < (positionZ - radius))
+    if (bounds.maxZ < (positionZ - radius))
         return false;
 
     return true;
 }
 
-void QuadTree::ReleaseNode(NodeType* node)
+void QuadTree::CullNode(Frustum* frustum, uint32 nodeIndex, uint32 planeMask)
 {
-}
+    Frustum::Visibility visibility;
+    uint32 childIndex, lastChild;
 
-void QuadTree::DrawNode(ID3D11DeviceContext* deviceContext, Frustum* frustum, NodeType* node, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj/*, TerrainShader* shader*/)
-{
-    bool result;
-    int count, i, indexCount;
+    NodeType const& node = m_nodes[nodeIndex];
 
-    // Check to see if the node can be viewed, height doesn't matter in a quad tree.
-    result = frustum->CheckCube(DirectX::XMFLOAT3(node->positionX, 0.0f, node->positionZ), (node->width / 2.0f));
+    // Check to see if the bounds of the node can be viewed, a node that is completely inside the planes of its parent isn't tested again.
+    if (planeMask != 0)
+    {
+        visibility = frustum->ClassifyRectangle(node.minX, node.minY, node.minZ,
+            node.maxX, node.maxY, node.maxZ, planeMask, m_cullTestCount);
 
-    // If it can't be seen then none of its children can either so don't continue down the tree, this is where the speed is gained.
-    if (!result)
-        return;
+        // If it can't be seen then none of its children can either so don't continue down the tree, this is where the speed is gained.
+        if (visibility == Frustum::Visibility::OUTSIDE)
+            return;
+    }
 
-    // If it can be seen then check all four child nodes to see if they can also be seen.
-    count = 0;
-    for (i = 0; i < 4; ++i)
+    // If it can be seen then check all child nodes to see if they can also be seen, they are next to each other in the array.
+    if (node.childMask != 0)
     {
-        if (node->nodes[i] != nullptr)
-        {
-            count++;
-            DrawNode(deviceContext, frustum, node->nodes[i], world, view, proj);
-        }
-    }
+        lastChild = node.firstChild + static_cast<uint32>(std::bitset<4>(node.childMask).count());
+        for (childIndex = node.firstChild; childIndex < lastChild; ++childIndex)
+            CullNode(frustum, childIndex, planeMask);
 
-    // If there were any children nodes then there is no need to continue as parent nodes won't contain any triangles to render.
-    if (count != 0)
+        // If there were any children nodes then there is no need to continue as parent nodes won't contain any triangles to render.
         return;
+    }
 
-    // Otherwise if this node can be seen and has triangles in it then render these triangles.
-
-    // Set vertex buffer stride and offset.
-    unsigned int offset = 0;
-
-    // Set the vertex buffer to active in the input assambler so it can be rendered.
-    deviceContext->IASetVertexBuffers(0, 1, node->vertexBuffer.GetAddressOf(), node->vertexBuffer.StridePtr(), &offset);
-
-    // Set the index buffer to active in the 
-    deviceContext->IASetIndexBuffer(node->indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
-
-    // Set the type of primitive that should be rendered from this vertex buffer, in this case triangles.
-    deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    // Empty nodes have nothing to render.
+    if (node.leafIndex == INVALID_INDEX)
+        return;
 
-    // Determine the number of indices in this node.
-    indexCount = node->triangleCount * 3;
+    // Otherwise if this node can be seen and has triangles in it then queue the triangles of its leaf.
+    LeafMesh const& leaf = m_leaves[node.leafIndex];
+    m_drawRanges.Add(leaf.firstIndex, static_cast<uint32>(leaf.triangleCount * 3));
 
     // Increase the count of the number of polygons that have been rendered during this frame.
-    m_drawCount += node->triangleCount;
-
-    // Call the terrain shader to render the polygons in this node.
-    shader.RenderShader(deviceContext, indexCount);
+    m_drawCount += leaf.triangleCount;
 }
\ No newline at end of file
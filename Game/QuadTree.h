@@ -9,6 +9,8 @@
 #include "Terrain.h"
 #include "TerrainShader.h"
 #include "Frustum.h"
+#include "TaskPool.h"
+#include "DrawRangeMerger.h"
 
 class QuadTree
 {
@@ -17,34 +19,76 @@ class QuadTree
         ~QuadTree();
 
         bool Initialize(Terrain* terrain, ID3D11DeviceContext* deviceContext);
+        bool Build(DirectX::VertexPositionNormalColorDualTexture const* vertices, int vertexCount, uint32 const* indices, int indexCount);
+        void Upload(ID3D11DeviceContext* deviceContext);
         void Draw(ID3D11DeviceContext* deviceContext, Frustum* frustum, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj);
         void Shutdown();
 
         int GetDrawCount() const { return m_drawCount; }
+        int GetCullTestCount() const { return m_cullTestCount; }
+        int GetVisibleLeafCount() const { return m_visibleLeafCount; }
+        int GetDrawCallCount() const { return m_drawCallCount; }
+        int GetNodeCount() const { return static_cast<int>(m_nodes.size()); }
         
     private:
-        struct NodeType
+        // Node of the tree while it is being built, the children of a node are built in parallel.
+        struct BuildNode
         {
             float positionX, positionZ, width;
+            std::vector<DirectX::VertexPositionNormalColorDualTexture> vertices;
+            std::vector<unsigned long> indices;
+            std::unique_ptr<BuildNode> nodes[4];
+        };
+
+        // Culling data of a node, the bounds fit the triangles below the node. The nodes are stored depth first
+        // in one array and the children of a node are next to each other, in the order of the bits set in the child mask.
+        struct NodeType
+        {
+            float minX, minY, minZ;
+            float maxX, maxY, maxZ;
+            uint32 firstChild;
+            uint32 leafIndex;
+            uint8 childMask;
+        };
+
+        // Geometry of a leaf node, kept apart from the nodes so culling doesn't touch it. The vertices and indices
+        // of all leaves are stored in one shared vertex and index buffer, the leaf knows where its part starts.
+        struct LeafMesh
+        {
             int triangleCount;
-            Bind::VertexBuffer<DirectX::VertexPositionNormalColorDualTexture> vertexBuffer;
-            Bind::IndexBuffer<unsigned long> indexBuffer;
-            NodeType* nodes[4];
+            uint32 firstVertex;
+            uint32 firstIndex;
+            std::vector<DirectX::VertexPositionNormalColorDualTexture> vertices;
+            std::vector<unsigned long> indices;
+        };
+
+        struct TriangleBounds
+        {
+            float minX, minZ;
+            float maxX, maxZ;
         };
 
     private:
         void CalculateMeshDimensions(int vertexCount, float& centerX, float& centerZ, float& meshWidth);
-        void CreateTreeNode(NodeType* node, float positionX, float positionZ, float width, ID3D11DeviceContext* deviceContext);
-        int CountTriangles(float positionX, float positionZ, float width);
-        bool IsTriangleContained(int index, float positionX, float positionZ, float width);
-        void ReleaseNode(NodeType* node);
-        void DrawNode(ID3D11DeviceContext* deviceContext, Frustum* frustum, NodeType* node, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj);
+        void CalculateTriangleBounds();
+        void CreateTreeNode(BuildNode* node, float positionX, float positionZ, float width, std::vector<uint32> const& triangles);
+        void LinearizeNode(BuildNode* buildNode, uint32 nodeIndex);
+        void GatherTriangles(std::vector<uint32> const& triangles, float positionX, float positionZ, float width, std::vector<uint32>& contained);
+        bool IsTriangleContained(uint32 index, float positionX, float positionZ, float width);
+        void CullNode(Frustum* frustum, uint32 nodeIndex, uint32 planeMask);
         
     private:
         static constexpr int const MAX_TRIANGLES = 10000;
+        static constexpr uint32 const INVALID_INDEX = 0xFFFFFFFF;
 
-        int m_triangleCount, m_drawCount;
-        DirectX::VertexPositionNormalColorDualTexture* m_vertexList;
-        NodeType* m_parentNode;
+        int m_triangleCount, m_drawCount, m_cullTestCount, m_visibleLeafCount, m_drawCallCount;
+        DirectX::VertexPositionNormalColorDualTexture const* m_vertexList;
+        uint32 const* m_indexList;
+        std::vector<TriangleBounds> m_triangleBounds;
+        std::vector<NodeType> m_nodes;
+        std::vector<LeafMesh> m_leaves;
+        Bind::VertexBuffer<DirectX::VertexPositionNormalColorDualTexture> m_vertexBuffer;
+        Bind::IndexBuffer<uint32> m_indexBuffer;
+        DrawRangeMerger m_drawRanges;
         TerrainShader shader;
 };
\ No newline at end of file
@@ -17,9 +17,9 @@ void RenderableGameObject::Initialize(ID3D11DeviceContext* deviceContext)
     SetRotation(0.0f, 0.0f, 0.0f);
 }
 
-void RenderableGameObject::LoadMesh(ID3D11DeviceContext* deviceContext, std::wstring const& fileName)
+void RenderableGameObject::LoadMesh(ID3D11DeviceContext* deviceContext, std::wstring const& fileName, MD5SkinningMode skinningMode)
 {
-    model.LoadMesh(deviceContext, fileName);
+    model.LoadMesh(deviceContext, fileName, skinningMode);
 }
 
 void RenderableGameObject::LoadAnim(std::wstring const& fileName)
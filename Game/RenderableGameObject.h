@@ -12,7 +12,7 @@ class RenderableGameObject : public GameObject3D
 
         void Initialize(ID3D11DeviceContext* deviceContext);
 
-        void LoadMesh(ID3D11DeviceContext* deviceContext, std::wstring const& fileName);
+        void LoadMesh(ID3D11DeviceContext* deviceContext, std::wstring const& fileName, MD5SkinningMode skinningMode = MD5SkinningMode::CPU);
         void LoadAnim(std::wstring const& fileName); 
 
         void Update(ID3D11DeviceContext* deviceContext, float deltaTime, int index);
@@ -0,0 +1,60 @@
+//
+// SpscQueue.h
+//
+
+#pragma once
+
+#include <atomic>
+
+// Bounded lock-free queue between exactly one producer thread and one consumer thread.
+template<typename T>
+class SpscQueue
+{
+    public:
+        // One slot stays empty to tell a full queue from an empty one.
+        explicit SpscQueue(uint32 capacity) : m_buffer(capacity + 1), m_head(0), m_tail(0) {}
+
+        SpscQueue(SpscQueue const&) = delete;
+        SpscQueue& operator=(SpscQueue const&) = delete;
+
+        // Called by the producer only, returns false if the queue is full.
+        bool TryPush(T value)
+        {
+            uint32 const tail = m_tail.load(std::memory_order_relaxed);
+            uint32 const next = Next(tail);
+
+            if (next == m_head.load(std::memory_order_acquire))
+                return false;
+
+            m_buffer[tail] = std::move(value);
+            m_tail.store(next, std::memory_order_release);
+
+            return true;
+        }
+
+        // Called by the consumer only, returns false if the queue is empty.
+        bool TryPop(T& value)
+        {
+            uint32 const head = m_head.load(std::memory_order_relaxed);
+
+            if (head == m_tail.load(std::memory_order_acquire))
+                return false;
+
+            value = std::move(m_buffer[head]);
+            m_head.store(Next(head), std::memory_order_release);
+
+            return true;
+        }
+
+        bool IsEmpty() const { return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire); }
+
+    private:
+        uint32 Next(uint32 index) const { return index + 1 == m_buffer.size() ? 0 : index + 1; }
+
+    private:
+        std::vector<T> m_buffer;
+
+        // Keep the indices on separate cache lines so the two threads don't fight over them.
+        alignas(64) std::atomic<uint32> m_head;
+        alignas(64) std::atomic<uint32> m_tail;
+};
\ No newline at end of file
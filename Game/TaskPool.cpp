@@ -0,0 +1,181 @@
+//
+// TaskPool.cpp
+//
+
+#include "pch.h"
+#include "TaskPool.h"
+
+namespace
+{
+    // The pool and queue of the worker that runs on this thread, threads outside a pool share the last queue.
+    thread_local TaskPool const* t_pPool = nullptr;
+    thread_local uint32 t_queueIndex = 0;
+}
+
+TaskPool::TaskPool(uint32 workerCount)
+    : m_queuedCount(0)
+    , m_stop(false)
+{
+    // One queue for every worker plus one for the threads that are not part of the pool.
+    for (uint32 i = 0; i < workerCount + 1; ++i)
+        m_queues.push_back(std::make_unique<WorkQueue>());
+
+    m_workers.reserve(workerCount);
+    for (uint32 i = 0; i < workerCount; ++i)
+        m_workers.emplace_back(&TaskPool::WorkerLoop, this, i);
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+
+    m_wakeCondition.notify_all();
+
+    for (std::thread& worker : m_workers)
+        worker.join();
+}
+
+TaskPool& TaskPool::Get()
+{
+    // Leave one core for the thread that creates the work, it helps out while it waits anyway.
+    static TaskPool s_pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    return s_pool;
+}
+
+void TaskPool::Run(TaskGroup& group, std::function<void()> task)
+{
+    group.m_pending.fetch_add(1, std::memory_order_relaxed);
+
+    // Workers push onto their own queue so forked tasks stay on the thread that created them unless stolen.
+    WorkQueue& queue = *m_queues[GetQueueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back({ std::move(task), &group });
+    }
+
+    m_queuedCount.fetch_add(1);
+
+    // Take the sleep lock so a worker can't miss the wake up between checking the count and going to sleep.
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+
+    m_wakeCondition.notify_one();
+}
+
+void TaskPool::Wait(TaskGroup& group)
+{
+    uint32 const queueIndex = GetQueueIndex();
+
+    // Help executing tasks instead of blocking, this also keeps nested forks on workers from deadlocking.
+    while (group.m_pending.load(std::memory_order_acquire) > 0)
+    {
+        if (!TryExecuteTask(queueIndex))
+            std::this_thread::yield();
+    }
+
+    // Hand the first exception of a task over to the thread that waits for it.
+    if (group.m_exception)
+    {
+        std::exception_ptr exception = group.m_exception;
+        group.m_exception = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+void TaskPool::WorkerLoop(uint32 queueIndex)
+{
+    t_pPool = this;
+    t_queueIndex = queueIndex;
+
+    while (true)
+    {
+        if (TryExecuteTask(queueIndex))
+            continue;
+
+        // Sleep until there is new work or the pool shuts down.
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wakeCondition.wait(lock, [this]() { return m_stop || m_queuedCount.load() > 0; });
+
+        if (m_stop)
+            return;
+    }
+}
+
+uint32 TaskPool::GetQueueIndex() const
+{
+    if (t_pPool == this)
+        return t_queueIndex;
+
+    return static_cast<uint32>(m_queues.size()) - 1;
+}
+
+bool TaskPool::TryExecuteTask(uint32 queueIndex)
+{
+    Task task;
+
+    // Take the newest task of our own queue first, otherwise steal the oldest task of another queue.
+    if (!PopTask(queueIndex, task) && !StealTask(queueIndex, task))
+        return false;
+
+    m_queuedCount.fetch_sub(1);
+    ExecuteTask(task);
+
+    return true;
+}
+
+bool TaskPool::PopTask(uint32 queueIndex, Task& task)
+{
+    WorkQueue& queue = *m_queues[queueIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (queue.tasks.empty())
+        return false;
+
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+
+    return true;
+}
+
+bool TaskPool::StealTask(uint32 queueIndex, Task& task)
+{
+    uint32 const queueCount = static_cast<uint32>(m_queues.size());
+
+    for (uint32 i = 1; i < queueCount; ++i)
+    {
+        WorkQueue& queue = *m_queues[(queueIndex + i) % queueCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.tasks.empty())
+            continue;
+
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+
+        return true;
+    }
+
+    return false;
+}
+
+void TaskPool::ExecuteTask(Task& task)
+{
+    TaskGroup* group = task.group;
+
+    try
+    {
+        task.function();
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(group->m_exceptionMutex);
+        if (!group->m_exception)
+            group->m_exception = std::current_exception();
+    }
+
+    group->m_pending.fetch_sub(1, std::memory_order_release);
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+//
+// TaskPool.h
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class TaskPool
+{
+    public:
+        // Tracks the tasks of one fork/join section, Wait returns when all of them have finished.
+        class TaskGroup
+        {
+            friend class TaskPool;
+
+            public:
+                TaskGroup() : m_pending(0) {}
+
+                TaskGroup(TaskGroup const&) = delete;
+                TaskGroup& operator=(TaskGroup const&) = delete;
+
+            private:
+                std::atomic<int> m_pending;
+                std::mutex m_exceptionMutex;
+                std::exception_ptr m_exception;
+        };
+
+    public:
+        explicit TaskPool(uint32 workerCount);
+        ~TaskPool();
+
+        TaskPool(TaskPool const&) = delete;
+        TaskPool& operator=(TaskPool const&) = delete;
+
+        static TaskPool& Get();
+
+        void Run(TaskGroup& group, std::function<void()> task);
+        void Wait(TaskGroup& group);
+
+        template<typename Function>
+        void ParallelFor(uint32 count, uint32 grainSize, Function const& function);
+
+        uint32 GetWorkerCount() const { return static_cast<uint32>(m_workers.size()); }
+
+    private:
+        struct Task
+        {
+            std::function<void()> function;
+            TaskGroup* group;
+        };
+
+        struct WorkQueue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+    private:
+        void WorkerLoop(uint32 queueIndex);
+        uint32 GetQueueIndex() const;
+        bool TryExecuteTask(uint32 queueIndex);
+        bool PopTask(uint32 queueIndex, Task& task);
+        bool StealTask(uint32 queueIndex, Task& task);
+        void ExecuteTask(Task& task);
+
+    private:
+        std::vector<std::thread> m_workers;
+        std::vector<std::unique_ptr<WorkQueue>> m_queues;
+        std::mutex m_sleepMutex;
+        std::condition_variable m_wakeCondition;
+        std::atomic<int> m_queuedCount;
+        bool m_stop;
+};
+
+template<typename Function>
+void TaskPool::ParallelFor(uint32 count, uint32 grainSize, Function const& function)
+{
+    TaskGroup group;
+
+    // Split the range into chunks of grainSize items, the calling thread helps with them while waiting.
+    grainSize = std::max(grainSize, 1u);
+    for (uint32 begin = 0; begin < count; begin += grainSize)
+    {
+        uint32 const end = std::min(begin + grainSize, count);
+        Run(group, [&function, begin, end]() { function(begin, end); });
+    }
+
+    Wait(group);
+}
\ No newline at end of file
@@ -1,7 +1,43 @@
 #include "pch.h"
 #include "Terrain.h"
 
+namespace
+{
+    // Clips the parameter range of a ray to the part where one coordinate is between 0 and maxCoordinate.
+    bool ClipRay(float origin, float direction, float maxCoordinate, float& tEnter, float& tExit)
+    {
+        if (direction == 0.0f)
+            return origin >= 0.0f && origin <= maxCoordinate;
+
+        float t0 = (0.0f - origin) / direction;
+        float t1 = (maxCoordinate - origin) / direction;
+        if (t0 > t1)
+            std::swap(t0, t1);
+
+        tEnter = std::max(tEnter, t0);
+        tExit = std::min(tExit, t1);
+
+        return tEnter <= tExit;
+    }
+}
+
 Terrain::Terrain()
+    : m_terrainWidth(0)
+    , m_terrainHeight(0)
+    , m_vertexCount(0)
+    , m_indexCount(0)
+    , m_heightScale(0.0f)
+    , m_terrainModel(nullptr)
+    , m_pTerrainCells(nullptr)
+    , m_vertices(nullptr)
+    , m_indices(nullptr)
+    , m_rayBlockCountX(0)
+    , m_rayBlockCountZ(0)
+    , m_iCellCount(0)
+    , m_iCellRowCount(0)
+    , m_iDrawCount(0)
+    , m_iCellsDrawn(0)
+    , m_iCellsCulled(0)
 {
 }
 
@@ -12,10 +48,10 @@ Terrain::~Terrain()
         delete[] m_vertices;
         m_vertices = nullptr;
     }
-    if (m_heightMap != nullptr)
+    if (m_indices != nullptr)
     {
-        delete[] m_heightMap;
-        m_heightMap = nullptr;
+        delete[] m_indices;
+        m_indices = nullptr;
     }
 
     ShutdownTerrainCells();
@@ -27,152 +63,418 @@ void Terrain::Initialize(ID3D11DeviceContext* deviceContext)
     m_terrainHeight = 512;
     m_heightScale = 400.0f;
 
-    LoadRawHeightMap("Data/terrain.raw");
-    SetTerrainCoordinates();
-    CalculateNormals();
+    auto const startTime = std::chrono::steady_clock::now();
 
-    SetTextureCoordinates();
-    SetTextureCoordinates1();
+    // Map the height map, its hash tells whether the cache next to it was built from the same data.
+    MappedFile heightMapFile;
+    if (!heightMapFile.Open(HEIGHT_MAP_FILE))
+    {
+        Logger::Get()->error("Failed to open the height map {}", HEIGHT_MAP_FILE);
+        return;
+    }
 
-    int index, index1, index2, index3, index4;
-    float u, v;
+    uint64 const sourceHash = HashBytes(heightMapFile.GetData(), heightMapFile.GetSize());
 
-    // Calculate the number of vertices in the terrain mesh.
-    m_vertexCount = (m_terrainWidth - 1) * (m_terrainHeight - 1) * 6;
+    // Every height map sample becomes exactly one vertex.
+    m_vertexCount = m_terrainWidth * m_terrainHeight;
 
-    // Create the vertex array.
-    m_vertices = new DirectX::VertexPositionNormalColorDualTexture[m_vertexCount];
+    // Two triangles per quad, the quads share their corner vertices.
+    m_indexCount = (m_terrainWidth - 1) * (m_terrainHeight - 1) * 6;
+
+    // Use the finished vertices of the cache if possible, otherwise build them and store them for the next start.
+    bool const cached = LoadTerrainCache(HEIGHT_MAP_CACHE_FILE, sourceHash);
+    if (!cached)
+    {
+        if (!LoadRawHeightMap(heightMapFile))
+        {
+            Logger::Get()->error("The height map {} is smaller than {}x{} samples", HEIGHT_MAP_FILE, m_terrainWidth, m_terrainHeight);
+            return;
+        }
+
+        BuildVertexArray();
 
-    // Initialize the index to the vertex array.
+        if (!SaveTerrainCache(HEIGHT_MAP_CACHE_FILE, sourceHash))
+            Logger::Get()->warn("Failed to write the terrain cache {}", HEIGHT_MAP_CACHE_FILE);
+    }
+
+    // Find the highest sample of every block for the ray casts.
+    UpdateRayBlocks({ 0, 0, m_terrainWidth - 1, m_terrainHeight - 1 });
+
+    uint32 index, index1, index2, index3, index4;
+
+    // Create the index array.
+    m_indices = new uint32[m_indexCount];
+
+    // Initialize the index to the index array.
     index = 0;
 
-    for (uint16 j = 0; j < (m_terrainHeight - 1); ++j)
+    for (int j = 0; j < (m_terrainHeight - 1); ++j)
     {
-        for (uint16 i = 0; i < (m_terrainWidth - 1); ++i)
+        for (int i = 0; i < (m_terrainWidth - 1); ++i)
         {
             // Get the indexes to the four points of the quad.
-            index1 = (m_terrainHeight * (j + 1)) + i;       // Upper left.
-            index2 = (m_terrainHeight * (j + 1)) + (i + 1); // Upper right.
-            index3 = (m_terrainHeight * j) + i;             // Bottom left.
-            index4 = (m_terrainHeight * j) + (i + 1);       // Bottom right.
-
-            // Upper left.
-            u = m_heightMap[index1].u;
-            v = m_heightMap[index1].v;
-
-            // Modify the texture coordinates to cover the top edge.
-            if (u == 1.0f) { u = 0.0f; }
-            if (v == 1.0f) { v = 0.0f; }
-
-
-            // Now create two triangles for that quad.
-            // Triangle 1 - Upper left.
-            m_vertices[index].position = DirectX::XMFLOAT3(m_heightMap[index1].x, m_heightMap[index1].y, m_heightMap[index1].z);
-            m_vertices[index].normal = DirectX::XMFLOAT3(m_heightMap[index1].nx, m_heightMap[index1].ny, m_heightMap[index1].nz);
-            m_vertices[index].color = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-            m_vertices[index].textureCoordinate0 = DirectX::XMFLOAT2(u, v);
-            m_vertices[index].textureCoordinate1 = DirectX::XMFLOAT2(m_heightMap[index1].u1, m_heightMap[index1].v1);
-            index++;
-
-
-            // Upper right.
-            u = m_heightMap[index2].u;
-            v = m_heightMap[index2].v;
-
-            // Modify the texture coordinates to cover the top and right edge.
-            if (u == 0.0f) { u = 1.0f; }
-            if (v == 1.0f) { v = 0.0f; }
-
-            // Triangle 1 - Upper right.
-            m_vertices[index].position = DirectX::XMFLOAT3(m_heightMap[index2].x, m_heightMap[index2].y, m_heightMap[index2].z);
-            m_vertices[index].normal = DirectX::XMFLOAT3(m_heightMap[index2].nx, m_heightMap[index2].ny, m_heightMap[index2].nz);
-            m_vertices[index].color = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-            m_vertices[index].textureCoordinate0 = DirectX::XMFLOAT2(u, v);
-            m_vertices[index].textureCoordinate1 = DirectX::XMFLOAT2(m_heightMap[index2].u1, m_heightMap[index2].v1);
-            index++;
-
-
-            // Bottom left.
-            u = m_heightMap[index3].u;
-            v = m_heightMap[index3].v;
-
-            if (u == 1.0f) { u = 0.0f; }
-            if (v == 0.0f) { v = 1.0f; }
-
-            // Triangle 1 - Bottom left.
-            m_vertices[index].position = DirectX::XMFLOAT3(m_heightMap[index3].x, m_heightMap[index3].y, m_heightMap[index3].z);
-            m_vertices[index].normal = DirectX::XMFLOAT3(m_heightMap[index3].nx, m_heightMap[index3].ny, m_heightMap[index3].nz);
-            m_vertices[index].color = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-            m_vertices[index].textureCoordinate0 = DirectX::XMFLOAT2(u, v);
-            m_vertices[index].textureCoordinate1 = DirectX::XMFLOAT2(m_heightMap[index3].u1, m_heightMap[index3].v1);
-            index++;
-
-            // Bottom left.
-            u = m_heightMap[index3].u;
-            v = m_heightMap[index3].v;
-
-            if (u == 1.0f) { u = 0.0f; }
-            if (v == 0.0f) { v = 1.0f; }
-
-            // Triangle 2 - Bottom left.
-            m_vertices[index].position = DirectX::XMFLOAT3(m_heightMap[index3].x, m_heightMap[index3].y, m_heightMap[index3].z);
-            m_vertices[index].normal = DirectX::XMFLOAT3(m_heightMap[index3].nx, m_heightMap[index3].ny, m_heightMap[index3].nz);
-            m_vertices[index].color = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-            m_vertices[index].textureCoordinate0 = DirectX::XMFLOAT2(u, v);
-            m_vertices[index].textureCoordinate1 = DirectX::XMFLOAT2(m_heightMap[index3].u1, m_heightMap[index3].v1);
-            index++;
-
-            // Upper right.
-            u = m_heightMap[index2].u;
-            v = m_heightMap[index2].v;
-
-            // Modify the texture coordinates to cover the top and right edge.
-            if (u == 0.0f) { u = 1.0f; }
-            if (v == 1.0f) { v = 0.0f; }
-
-            // Triangle 2 - Upper right.
-            m_vertices[index].position = DirectX::XMFLOAT3(m_heightMap[index2].x, m_heightMap[index2].y, m_heightMap[index2].z);
-            m_vertices[index].normal = DirectX::XMFLOAT3(m_heightMap[index2].nx, m_heightMap[index2].ny, m_heightMap[index2].nz);
-            m_vertices[index].color = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-            m_vertices[index].textureCoordinate0 = DirectX::XMFLOAT2(u, v);
-            m_vertices[index].textureCoordinate1 = DirectX::XMFLOAT2(m_heightMap[index2].u1, m_heightMap[index2].v1);
-            index++;
-
-            // Bottom right.
-            u = m_heightMap[index4].u;
-            v = m_heightMap[index4].v;
-
-            // Modify the texture coordinates to cover the right edge.
-            if (u == 0.0f) { u = 1.0f; }
-            if (v == 0.0f) { v = 1.0f; }
-
-            // Triangle 2 - Bottom right.
-            m_vertices[index].position = DirectX::XMFLOAT3(m_heightMap[index4].x, m_heightMap[index4].y, m_heightMap[index4].z);
-            m_vertices[index].normal = DirectX::XMFLOAT3(m_heightMap[index4].nx, m_heightMap[index4].ny, m_heightMap[index4].nz);
-            m_vertices[index].color = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-            m_vertices[index].textureCoordinate0 = DirectX::XMFLOAT2(u, v);
-            m_vertices[index].textureCoordinate1 = DirectX::XMFLOAT2(m_heightMap[index4].u1, m_heightMap[index4].v1);
-            index++;
+            index1 = (m_terrainWidth * (j + 1)) + i;       // Upper left.
+            index2 = (m_terrainWidth * (j + 1)) + (i + 1); // Upper right.
+            index3 = (m_terrainWidth * j) + i;             // Bottom left.
+            index4 = (m_terrainWidth * j) + (i + 1);       // Bottom right.
+
+            // Triangle 1 - Upper left, upper right, bottom left.
+            m_indices[index++] = index1;
+            m_indices[index++] = index2;
+            m_indices[index++] = index3;
+
+            // Triangle 2 - Bottom left, upper right, bottom right.
+            m_indices[index++] = index3;
+            m_indices[index++] = index2;
+            m_indices[index++] = index4;
         }
     }
+
+    float const loadTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    Logger::Get()->info("Terrain loaded in {} ms ({})", loadTime, cached ? "cache hit" : "cache miss");
+
     //LoadTerrainCells(DX::GetDevice(deviceContext));
 }
 
+void Terrain::BuildVertexArray()
+{
+    // Create the vertex array.
+    m_vertices = new DirectX::VertexPositionNormalColorDualTexture[m_vertexCount];
+
+    // A vertex row only needs the heights of its neighbouring rows, so blocks of rows are built in parallel.
+    TaskPool::Get().ParallelFor(m_terrainHeight, ROW_GRAIN, [this](uint32 begin, uint32 end)
+    {
+        // Normals of the face rows below and above the current vertex row, the faces only differ in x and z.
+        std::vector<float> belowX(m_terrainWidth - 1), belowZ(m_terrainWidth - 1);
+        std::vector<float> aboveX(m_terrainWidth - 1), aboveZ(m_terrainWidth - 1);
+
+        if (begin > 0)
+            CalculateFaceNormals(begin - 1, 0, m_terrainWidth - 1, belowX.data(), belowZ.data());
+
+        for (uint32 j = begin; j < end; ++j)
+        {
+            if (static_cast<int>(j) < m_terrainHeight - 1)
+                CalculateFaceNormals(j, 0, m_terrainWidth - 1, aboveX.data(), aboveZ.data());
+
+            BuildVertexRow(j, 0, m_terrainWidth, belowX.data(), belowZ.data(), aboveX.data(), aboveZ.data());
+
+            // The faces above this row are below the next one.
+            belowX.swap(aboveX);
+            belowZ.swap(aboveZ);
+        }
+    });
+}
+
+bool Terrain::RebuildVertexArray()
+{
+    if (m_heights.empty())
+        return false;
+
+    delete[] m_vertices;
+    BuildVertexArray();
+
+    return true;
+}
+
+// Calculates the normals of the faces firstFace to endFace - 1 of a row, face i is stored at index i.
+void Terrain::CalculateFaceNormals(int row, int firstFace, int endFace, float* normalX, float* normalZ) const
+{
+    using namespace DirectX;
+
+    // The face uses the samples (i, j), (i + 1, j) and (i, j + 1). The grid spacing is one, so the cross product
+    // of (0, y1 - y3, 1) and (-1, y3 - y2, -1) is (-(y1 - y3) - (y3 - y2), -1, y1 - y3).
+    float const* heights = m_heights.data() + row * m_terrainWidth;
+    float const* heightsAbove = heights + m_terrainWidth;
+    int i = firstFace;
+
+    // Four faces at once.
+    for (; i + 4 <= endFace; i += 4)
+    {
+        XMVECTOR const y1 = XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(heights + i));
+        XMVECTOR const y2 = XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(heights + i + 1));
+        XMVECTOR const y3 = XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(heightsAbove + i));
+
+        XMVECTOR const a = XMVectorSubtract(y1, y3);
+        XMVECTOR const b = XMVectorSubtract(y3, y2);
+
+        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(normalX + i), XMVectorSubtract(XMVectorNegate(a), b));
+        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(normalZ + i), a);
+    }
+
+    // The rest of the row.
+    for (; i < endFace; ++i)
+    {
+        float const a = heights[i] - heightsAbove[i];
+        float const b = heightsAbove[i] - heights[i + 1];
+
+        normalX[i] = -a - b;
+        normalZ[i] = a;
+    }
+}
+
+// Builds the vertices firstColumn to endColumn - 1 of a row, the normals of the faces around them have to be calculated.
+void Terrain::BuildVertexRow(int row, int firstColumn, int endColumn, float const* belowX, float const* belowZ, float const* aboveX, float const* aboveZ)
+{
+    using namespace DirectX;
+
+    float const textureIncrement = static_cast<float>(TEXTURE_REPEAT) / static_cast<float>(m_terrainWidth);
+    float const alphaIncrementX = 1.0f / m_terrainWidth;
+    float const alphaIncrementZ = 1.0f / m_terrainHeight;
+    bool const interiorRow = row > 0 && row < m_terrainHeight - 1;
+
+    DirectX::VertexPositionNormalColorDualTexture* vertices = m_vertices + row * m_terrainWidth;
+    float const* heights = m_heights.data() + row * m_terrainWidth;
+
+    // Average the normals of the faces around each vertex, inner vertices always touch four faces so four of them are
+    // averaged and normalized at once. The faces are summed in the same order as for the vertices at the edges.
+    alignas(16) float normalX[4], normalY[4], normalZ[4];
+    int blockStart = firstColumn, blockEnd = firstColumn;
+
+    for (int i = firstColumn; i < endColumn; ++i)
+    {
+        if (i >= blockEnd)
+        {
+            if (interiorRow && i > 0 && i + 4 <= std::min(endColumn, m_terrainWidth - 1))
+            {
+                XMVECTOR sumX = XMVectorAdd(XMVectorAdd(XMVectorAdd(
+                    XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(belowX + i - 1)),
+                    XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(belowX + i))),
+                    XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(aboveX + i - 1))),
+                    XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(aboveX + i)));
+                XMVECTOR sumZ = XMVectorAdd(XMVectorAdd(XMVectorAdd(
+                    XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(belowZ + i - 1)),
+                    XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(belowZ + i))),
+                    XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(aboveZ + i - 1))),
+                    XMLoadFloat4(reinterpret_cast<XMFLOAT4 const*>(aboveZ + i)));
+
+                // Every face has a y of -1, so the average has one as well.
+                XMVECTOR const count = XMVectorReplicate(4.0f);
+                XMVECTOR const one = XMVectorReplicate(1.0f);
+                sumX = XMVectorDivide(sumX, count);
+                sumZ = XMVectorDivide(sumZ, count);
+
+                XMVECTOR const length = XMVectorSqrt(XMVectorAdd(XMVectorAdd(XMVectorMultiply(sumX, sumX), one), XMVectorMultiply(sumZ, sumZ)));
+
+                XMStoreFloat4A(reinterpret_cast<XMFLOAT4A*>(normalX), XMVectorDivide(sumX, length));
+                XMStoreFloat4A(reinterpret_cast<XMFLOAT4A*>(normalY), XMVectorDivide(XMVectorNegate(one), length));
+                XMStoreFloat4A(reinterpret_cast<XMFLOAT4A*>(normalZ), XMVectorDivide(sumZ, length));
+
+                blockStart = i;
+                blockEnd = i + 4;
+            }
+            else
+            {
+                CalculateVertexNormal(row, i, belowX, belowZ, aboveX, aboveZ, normalX[0], normalY[0], normalZ[0]);
+                blockStart = i;
+                blockEnd = i + 1;
+            }
+        }
+
+        int const lane = i - blockStart;
+
+        // The alpha map coordinates of the last row and column repeat the ones before them.
+        vertices[i].position = XMFLOAT3(static_cast<float>(i), heights[i], static_cast<float>(m_terrainHeight - 1 - row));
+        vertices[i].normal = XMFLOAT3(normalX[lane], normalY[lane], normalZ[lane]);
+        vertices[i].color = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+        vertices[i].textureCoordinate0 = XMFLOAT2(textureIncrement * static_cast<float>(i), 1.0f - (textureIncrement * static_cast<float>(row)));
+        vertices[i].textureCoordinate1 = XMFLOAT2(alphaIncrementX * std::min(i, m_terrainWidth - 2), alphaIncrementZ * std::min(row, m_terrainHeight - 2));
+    }
+}
+
+void Terrain::CalculateVertexNormal(int row, int column, float const* belowX, float const* belowZ, float const* aboveX, float const* aboveZ,
+    float& normalX, float& normalY, float& normalZ) const
+{
+    float sumX = 0.0f, sumY = 0.0f, sumZ = 0.0f;
+    int count = 0;
+
+    bool const hasLeft = column > 0;
+    bool const hasRight = column < m_terrainWidth - 1;
+    bool const hasBelow = row > 0;
+    bool const hasAbove = row < m_terrainHeight - 1;
+
+    // Bottom left face.
+    if (hasLeft && hasBelow)
+    {
+        sumX += belowX[column - 1];
+        sumY += -1.0f;
+        sumZ += belowZ[column - 1];
+        count++;
+    }
+
+    // Bottom right face.
+    if (hasRight && hasBelow)
+    {
+        sumX += belowX[column];
+        sumY += -1.0f;
+        sumZ += belowZ[column];
+        count++;
+    }
+
+    // Upper left face.
+    if (hasLeft && hasAbove)
+    {
+        sumX += aboveX[column - 1];
+        sumY += -1.0f;
+        sumZ += aboveZ[column - 1];
+        count++;
+    }
+
+    // Upper right face.
+    if (hasRight && hasAbove)
+    {
+        sumX += aboveX[column];
+        sumY += -1.0f;
+        sumZ += aboveZ[column];
+        count++;
+    }
+
+    // Take the average of the faces touching this vertex and normalize it.
+    sumX /= static_cast<float>(count);
+    sumY /= static_cast<float>(count);
+    sumZ /= static_cast<float>(count);
+
+    float const length = sqrt((sumX * sumX) + (sumY * sumY) + (sumZ * sumZ));
+
+    normalX = sumX / length;
+    normalY = sumY / length;
+    normalZ = sumZ / length;
+}
+
+bool Terrain::SetHeights(ID3D11DeviceContext* deviceContext, int firstColumn, int firstRow, int columnCount, int rowCount, float const* heights, GridRegion& changedRegion)
+{
+    // The rectangle has to be inside a loaded height map, the size is set before the loading and stays when it fails.
+    if (m_heights.empty() || columnCount <= 0 || rowCount <= 0 || firstColumn < 0 || firstRow < 0 ||
+        firstColumn + columnCount > m_terrainWidth || firstRow + rowCount > m_terrainHeight)
+        return false;
+
+    // Store the new heights.
+    for (int row = 0; row < rowCount; ++row)
+        memcpy(&m_heights[(firstRow + row) * m_terrainWidth + firstColumn], heights + row * columnCount, columnCount * sizeof(float));
+
+    // The normals of the samples around the rectangle use the faces of the edited samples as well.
+    changedRegion.minColumn = std::max(firstColumn - 1, 0);
+    changedRegion.minRow = std::max(firstRow - 1, 0);
+    changedRegion.maxColumn = std::min(firstColumn + columnCount, m_terrainWidth - 1);
+    changedRegion.maxRow = std::min(firstRow + rowCount, m_terrainHeight - 1);
+
+    UpdateVertices(changedRegion);
+    UpdateCells(deviceContext, changedRegion);
+    UpdateRayBlocks(changedRegion);
+
+    return true;
+}
+
+bool Terrain::GetHeights(int firstColumn, int firstRow, int columnCount, int rowCount, float* heights) const
+{
+    // The rectangle has to be inside a loaded height map, the size is set before the loading and stays when it fails.
+    if (m_heights.empty() || columnCount <= 0 || rowCount <= 0 || firstColumn < 0 || firstRow < 0 ||
+        firstColumn + columnCount > m_terrainWidth || firstRow + rowCount > m_terrainHeight)
+        return false;
+
+    for (int row = 0; row < rowCount; ++row)
+        memcpy(heights + row * columnCount, &m_heights[(firstRow + row) * m_terrainWidth + firstColumn], columnCount * sizeof(float));
+
+    return true;
+}
+
+void Terrain::UpdateVertices(GridRegion const& region)
+{
+    int const faceCount = m_terrainWidth - 1;
+
+    // The face rows are kept between edits, only the faces around the region are calculated.
+    if (m_editFaceNormals.empty())
+        m_editFaceNormals.resize(faceCount * 4);
+
+    float* belowX = m_editFaceNormals.data();
+    float* belowZ = belowX + faceCount;
+    float* aboveX = belowZ + faceCount;
+    float* aboveZ = aboveX + faceCount;
+
+    // The vertices of the region use the faces one column and row further out.
+    int const firstFace = std::max(region.minColumn - 1, 0);
+    int const endFace = std::min(region.maxColumn + 1, faceCount);
+
+    if (region.minRow > 0)
+        CalculateFaceNormals(region.minRow - 1, firstFace, endFace, belowX, belowZ);
+
+    for (int row = region.minRow; row <= region.maxRow; ++row)
+    {
+        if (row < m_terrainHeight - 1)
+            CalculateFaceNormals(row, firstFace, endFace, aboveX, aboveZ);
+
+        BuildVertexRow(row, region.minColumn, region.maxColumn + 1, belowX, belowZ, aboveX, aboveZ);
+
+        // The faces above this row are below the next one.
+        std::swap(belowX, aboveX);
+        std::swap(belowZ, aboveZ);
+    }
+}
+
+void Terrain::UpdateCells(ID3D11DeviceContext* deviceContext, GridRegion const& region)
+{
+    if (m_pTerrainCells == nullptr)
+        return;
+
+    // Neighbouring cells share their border samples, so a sample on a border is in two cells.
+    int const cellQuads = CELL_SIZE - 1;
+    int const firstCellX = std::max((region.minColumn - 1) / cellQuads, 0);
+    int const firstCellZ = std::max((region.minRow - 1) / cellQuads, 0);
+    int const lastCellX = std::min(region.maxColumn / cellQuads, m_iCellRowCount - 1);
+    int const lastCellZ = std::min(region.maxRow / cellQuads, m_iCellRowCount - 1);
+
+    for (int j = firstCellZ; j <= lastCellZ; ++j)
+    {
+        for (int i = firstCellX; i <= lastCellX; ++i)
+        {
+            int const index = (m_iCellRowCount * j) + i;
+
+            m_pTerrainCells[index].UpdateVertices(deviceContext, m_vertices, m_terrainWidth,
+                region.minColumn, region.minRow, region.maxColumn, region.maxRow);
+
+            // Refresh the culling bounds of the cell.
+            m_pTerrainCells[index].GetCellDimensions(m_cellMinX[index], m_cellMinY[index], m_cellMinZ[index],
+                m_cellMaxX[index], m_cellMaxY[index], m_cellMaxZ[index]);
+        }
+    }
+}
+
 void Terrain::CopyVertexArray(void* vertexList)
 {
     memcpy(vertexList, m_vertices, sizeof(DirectX::VertexPositionNormalColorDualTexture) * m_vertexCount);
 }
 
-bool Terrain::DrawCell(ID3D11DeviceContext* deviceContext, int cellId, Frustum* frustum)
+void Terrain::CopyIndexArray(void* indexList)
 {
-    float minWidth, minHeight, minDepth, maxWidth, maxHeight, maxDepth;
-    bool result;
+    memcpy(indexList, m_indices, sizeof(uint32) * m_indexCount);
+}
 
-    // Get the dimensions of the terrain cell.
-    m_pTerrainCells[cellId].GetCellDimensions(minWidth, minHeight, minDepth, maxWidth, maxHeight, maxDepth);
+// lodScale converts an error at a distance into pixels, it is the screen height divided by 2 * tan(fieldOfViewY / 2).
+void Terrain::CullCells(Frustum* frustum, DirectX::XMFLOAT3 const& cameraPosition, float lodScale)
+{
+    // Reset the counters for this frame.
+    m_iDrawCount = 0;
+    m_iCellsDrawn = 0;
+    m_iCellsCulled = 0;
+
+    // Check all the cells against the frustum at once, DrawCell reads the result.
+    m_cellVisibility.resize((m_iCellCount + 31) / 32);
+    frustum->CheckRectangles(m_cellMinX.data(), m_cellMinY.data(), m_cellMinZ.data(),
+        m_cellMaxX.data(), m_cellMaxY.data(), m_cellMaxZ.data(), static_cast<uint32>(m_iCellCount), m_cellVisibility.data());
+
+    // Pick the level of detail of the visible cells by their height error on screen.
+    for (int i = 0; i < m_iCellCount; ++i)
+    {
+        if ((m_cellVisibility[i / 32] & (1u << (i % 32))) != 0)
+            m_pTerrainCells[i].SelectLod(cameraPosition, lodScale, LOD_PIXEL_ERROR);
+    }
+}
+
+bool Terrain::DrawCell(ID3D11DeviceContext* deviceContext, int cellId)
+{
+    bool result;
 
-    // Check if the cell is visible. If it is not visible then just return and don't draw it.
-    result = frustum->CheckRectangle(minWidth, minHeight, minDepth, maxWidth, maxHeight, maxDepth);
+    // Check if the cell was visible in CullCells. If it is not visible then just return and don't draw it.
+    result = (m_cellVisibility[cellId / 32] & (1u << (cellId % 32))) != 0;
 
     if (!result)
     {
@@ -185,7 +487,7 @@ bool Terrain::DrawCell(ID3D11DeviceContext* deviceContext, int cellId, Frustum*
     m_pTerrainCells[cellId].Draw(deviceContext);
 
     // Add the polygons in the cell to the draw count.
-    m_iDrawCount += (m_pTerrainCells[cellId].GetVertexCount() / 3);
+    m_iDrawCount += (m_pTerrainCells[cellId].GetLodIndexCount() / 3);
 
     // Increment the number of cells that were actually drawn.
     m_iCellsDrawn++;
@@ -200,7 +502,7 @@ void Terrain::DrawCellLines(ID3D11DeviceContext* deviceContext, int cellId)
 
 int Terrain::GetCellIndexCount(int cellId)
 {
-    return m_pTerrainCells[cellId].GetIndexCount();
+    return m_pTerrainCells[cellId].GetLodIndexCount();
 }
 
 int Terrain::GetCellLinesIndexCount(int cellId)
@@ -230,298 +532,338 @@ int Terrain::GetCellsCulled()
 
 bool Terrain::GetHeightAtPosition(float x, float z, float& height)
 {
-    int i, cellId, index;
-    float vertex1[3], vertex2[3], vertex3[3];
-    bool foundHeight;
-    float minWidth, minHeight, minDepth, maxWidth, maxHeight, maxDepth;
+    float gridX, gridZ;
 
+    // Convert the position into height map coordinates, the rows of the height map go along negative z.
+    gridX = x;
+    gridZ = static_cast<float>(m_terrainHeight - 1) - z;
 
-    // Loop through all of the terrain cells to find out which one the inputX and inputZ would be inside.
-    cellId = -1;
-    for (i = 0; i < m_iCellCount; i++)
-    {
-        // Get the current cell dimensions.
-        m_pTerrainCells[i].GetCellDimensions(minWidth, minHeight, minDepth, maxWidth, maxHeight, maxDepth);
+    // If the position is off the terrain grid or the height map wasn't loaded there is no height.
+    if (m_heights.empty() || !(gridX >= 0.0f && gridZ >= 0.0f && gridX <= static_cast<float>(m_terrainWidth - 1) && gridZ <= static_cast<float>(m_terrainHeight - 1)))
+        return false;
 
-        // Check to see if the positions are in this cell.
-        if ((x < maxWidth) && (x > minWidth) && (z < maxDepth) && (z > minDepth))
-        {
-            cellId = i;
-            i = m_iCellCount;
-        }
-    }
+    height = InterpolateHeight(gridX, gridZ);
 
-    // If we didn't find a cell then the input position is off the terrain grid.
-    if (cellId == -1)
-    {
-        return false;
-    }
+    return true;
+}
 
-    // If this is the right cell then check all the triangles in this cell to see what the height of the triangle at this position is.
-    for (i = 0; i < (m_pTerrainCells[cellId].GetVertexCount() / 3); i++)
-    {
-        index = i * 3;
+int Terrain::GetHeightAtPosition(float const* x, float const* z, float* height, int count)
+{
+    float gridX, gridZ, maxX, maxZ;
+    int found;
 
-        vertex1[0] = m_pTerrainCells[cellId].pVertexList[index].x;
-        vertex1[1] = m_pTerrainCells[cellId].pVertexList[index].y;
-        vertex1[2] = m_pTerrainCells[cellId].pVertexList[index].z;
-        index++;
+    maxX = static_cast<float>(m_terrainWidth - 1);
+    maxZ = static_cast<float>(m_terrainHeight - 1);
+    found = 0;
 
-        vertex2[0] = m_pTerrainCells[cellId].pVertexList[index].x;
-        vertex2[1] = m_pTerrainCells[cellId].pVertexList[index].y;
-        vertex2[2] = m_pTerrainCells[cellId].pVertexList[index].z;
-        index++;
+    if (m_heights.empty())
+        return 0;
 
-        vertex3[0] = m_pTerrainCells[cellId].pVertexList[index].x;
-        vertex3[1] = m_pTerrainCells[cellId].pVertexList[index].y;
-        vertex3[2] = m_pTerrainCells[cellId].pVertexList[index].z;
+    // Same as the single position version, positions that are off the terrain grid keep their height.
+    for (int i = 0; i < count; ++i)
+    {
+        gridX = x[i];
+        gridZ = maxZ - z[i];
 
-        // Check to see if this is the polygon we are looking for.
-        foundHeight = GetHeightOfTriangle(x, z, height, vertex1, vertex2, vertex3);
-        if (foundHeight)
-        {
-            return true;
-        }
+        if (!(gridX >= 0.0f && gridZ >= 0.0f && gridX <= maxX && gridZ <= maxZ))
+            continue;
+
+        height[i] = InterpolateHeight(gridX, gridZ);
+        found++;
     }
 
-    return false;
+    return found;
 }
 
-void Terrain::SetTerrainCoordinates()
+float Terrain::InterpolateHeight(float gridX, float gridZ) const
 {
-    int i, j, index;
+    int i, j;
+    float fx, fz, h00, h10, h01, h11;
 
-    // Loop through all the elements in the height map array and adjust their coordinates correctly.
-    for (j = 0; j < m_terrainHeight; ++j)
-    {
-        for (i = 0; i < m_terrainWidth; ++i)
-        {
-            index = (m_terrainWidth * j) + i;
+    // Find the quad the position is in, positions on the last row and column use the quad before them.
+    i = std::min(static_cast<int>(gridX), m_terrainWidth - 2);
+    j = std::min(static_cast<int>(gridZ), m_terrainHeight - 2);
 
-            // Set the X and Z coordinates.
-            m_heightMap[index].x = static_cast<float>(i);
-            m_heightMap[index].z = -static_cast<float>(j);
+    // Get the position inside the quad.
+    fx = gridX - static_cast<float>(i);
+    fz = gridZ - static_cast<float>(j);
 
-            // Move the terrain depth into the positive range. for example from (0, -256) to (256, 0).
-            m_heightMap[index].z += static_cast<float>(m_terrainHeight - 1);
+    // Get the heights of the bottom left, bottom right, upper left and upper right corners.
+    h00 = m_heights[(m_terrainWidth * j) + i];
+    h10 = m_heights[(m_terrainWidth * j) + (i + 1)];
+    h01 = m_heights[(m_terrainWidth * (j + 1)) + i];
+    h11 = m_heights[(m_terrainWidth * (j + 1)) + (i + 1)];
 
-            // Scale the height.
-            m_heightMap[index].y /= m_heightScale;
-        }
-    }
+    // The quad is split from the bottom left to the upper right corner, interpolate on the triangle the position is in.
+    if (fz >= fx)
+        return h00 + (fx * (h11 - h01)) + (fz * (h01 - h00));
+
+    return h00 + (fx * (h10 - h00)) + (fz * (h11 - h10));
 }
 
-void Terrain::SetTextureCoordinates()
+bool Terrain::Raycast(DirectX::XMFLOAT3 const& origin, DirectX::XMFLOAT3 const& direction, float maxDistance, RayHit& hit) const
 {
-    int incrementCount, i, j, uCount, vCount;
-    float incrementValue, uCoordinate, vCoordinate;
-
-    // Calculate how much to increment the texture coordinates by.
-    incrementValue = static_cast<float>(TEXTURE_REPEAT) / static_cast<float>(m_terrainWidth);
+    hit.hit = false;
 
-    // Calculate how many times to repeat the texture.
-    incrementCount = m_terrainWidth / TEXTURE_REPEAT;
+    float const length = sqrt((direction.x * direction.x) + (direction.y * direction.y) + (direction.z * direction.z));
+    if (m_heights.empty() || !(length > 0.0f))
+        return false;
 
-    // Initialize the u and v coordinate values.
-    uCoordinate = 0.0f;
-    vCoordinate = 1.0f;
+    // Work in height map coordinates with a normalized direction, the rows of the height map go along negative z.
+    float const gridOrigin[3] = { origin.x, origin.y, static_cast<float>(m_terrainHeight - 1) - origin.z };
+    float const gridDirection[3] = { direction.x / length, direction.y / length, -direction.z / length };
 
-    // Initialize the u and v coordinate indexes.
-    uCount = 0;
-    vCount = 0;
+    // Only the part of the ray above the height map grid can hit it.
+    float tEnter = 0.0f;
+    float tExit = maxDistance;
+    if (!ClipRay(gridOrigin[0], gridDirection[0], static_cast<float>(m_terrainWidth - 1), tEnter, tExit) ||
+        !ClipRay(gridOrigin[2], gridDirection[2], static_cast<float>(m_terrainHeight - 1), tEnter, tExit))
+        return false;
 
-    // Loop through the entire height map and calculate the u and v texture coordinates for each vertex.
-    for (j = 0; j < m_terrainHeight; ++j)
+    // Start in the block the ray enters the grid in.
+    float const blockSize = static_cast<float>(RAY_BLOCK_QUADS);
+    int blockX = static_cast<int>((gridOrigin[0] + gridDirection[0] * tEnter) / blockSize);
+    int blockZ = static_cast<int>((gridOrigin[2] + gridDirection[2] * tEnter) / blockSize);
+    blockX = std::min(std::max(blockX, 0), m_rayBlockCountX - 1);
+    blockZ = std::min(std::max(blockZ, 0), m_rayBlockCountZ - 1);
+
+    // Step from block border to block border like a 2D DDA, nextX and nextZ are the distances to the next borders.
+    int const stepX = gridDirection[0] > 0.0f ? 1 : -1;
+    int const stepZ = gridDirection[2] > 0.0f ? 1 : -1;
+    float const deltaX = gridDirection[0] != 0.0f ? blockSize / fabs(gridDirection[0]) : FLT_MAX;
+    float const deltaZ = gridDirection[2] != 0.0f ? blockSize / fabs(gridDirection[2]) : FLT_MAX;
+    float nextX = gridDirection[0] != 0.0f ? ((blockX + (stepX > 0 ? 1 : 0)) * blockSize - gridOrigin[0]) / gridDirection[0] : FLT_MAX;
+    float nextZ = gridDirection[2] != 0.0f ? ((blockZ + (stepZ > 0 ? 1 : 0)) * blockSize - gridOrigin[2]) / gridDirection[2] : FLT_MAX;
+
+    float t = tEnter;
+    while (true)
     {
-        for (i = 0; i < m_terrainWidth; ++i)
-        {
-            // Store the texture coordinate in the height map.
-            m_heightMap[(m_terrainHeight * j) + i].u = uCoordinate;
-            m_heightMap[(m_terrainHeight * j) + i].v = vCoordinate;
+        float const tNext = std::min(std::min(nextX, nextZ), tExit);
 
-            // Increment the u texture coordinate by the increment value and increment the index by one.
-            uCoordinate += incrementValue;
-            uCount++;
+        // Only walk the quads of the block if the ray gets down to its highest sample inside it.
+        float const lowestY = gridOrigin[1] + gridDirection[1] * (gridDirection[1] < 0.0f ? tNext : t);
+        if (lowestY <= m_rayBlockMaxY[(m_rayBlockCountX * blockZ) + blockX])
+        {
+            int const firstColumn = blockX * RAY_BLOCK_QUADS;
+            int const firstRow = blockZ * RAY_BLOCK_QUADS;
+            int const lastColumn = std::min(firstColumn + RAY_BLOCK_QUADS, m_terrainWidth - 1) - 1;
+            int const lastRow = std::min(firstRow + RAY_BLOCK_QUADS, m_terrainHeight - 1) - 1;
 
-            // Check if at the far right end of the texture and if so then start at the beginning again.
-            if (uCount == incrementCount)
-            {
-                uCoordinate = 0.0f;
-                uCount = 0;
-            }
+            if (RaycastQuads(gridOrigin, gridDirection, t, tNext, maxDistance, firstColumn, firstRow, lastColumn, lastRow, hit))
+                break;
         }
 
-        // Increment the v texture coordinate by the increment value and increment the index by one.
-        vCoordinate -= incrementValue;
-        vCount++;
+        if (tNext >= tExit)
+            return false;
 
-        // Check if at the top of the texture and if so then start at the bottom again.
-        if (vCount == incrementCount)
+        // Move on to the block whose border is crossed first.
+        if (nextX < nextZ)
         {
-            vCoordinate = 1.0f;
-            vCount = 0;
+            blockX += stepX;
+            nextX += deltaX;
         }
+        else
+        {
+            blockZ += stepZ;
+            nextZ += deltaZ;
+        }
+
+        if (blockX < 0 || blockZ < 0 || blockX >= m_rayBlockCountX || blockZ >= m_rayBlockCountZ)
+            return false;
+
+        t = tNext;
     }
 
+    hit.position.x = origin.x + (direction.x / length) * hit.distance;
+    hit.position.y = origin.y + (direction.y / length) * hit.distance;
+    hit.position.z = origin.z + (direction.z / length) * hit.distance;
+
+    return true;
 }
 
-void Terrain::SetTextureCoordinates1()
+int Terrain::Raycast(DirectX::XMFLOAT3 const* origins, DirectX::XMFLOAT3 const* directions, float const* maxDistances, int count, RayHit* hits) const
 {
-    int index1, index2, index3, index4;
+    if (count <= 0)
+        return 0;
+
+    std::atomic<int> hitCount(0);
 
-    for (uint16 j = 0; j < m_terrainHeight - 1; ++j)
+    // The rays are independent of each other, blocks of them are cast on the workers of the task pool.
+    TaskPool::Get().ParallelFor(static_cast<uint32>(count), RAY_GRAIN, [&](uint32 begin, uint32 end)
     {
-        for (uint16 i = 0; i < m_terrainWidth - 1; ++i)
+        int blockHits = 0;
+
+        for (uint32 i = begin; i < end; ++i)
         {
-            // Get the indexes to the four points of the quad.
-            index1 = (m_terrainHeight * (j + 1)) + i;       // Upper left.
-            index2 = (m_terrainHeight * (j + 1)) + (i + 1); // Upper right.
-            index3 = (m_terrainHeight * j) + i;             // Bottom left.
-            index4 = (m_terrainHeight * j) + (i + 1);       // Bottom right.
+            if (Raycast(origins[i], directions[i], maxDistances[i], hits[i]))
+                blockHits++;
+        }
 
-            // Store the texture coordinate in the height map.
-            m_heightMap[index1].u1 = 1.0f / m_terrainWidth * i;
-            m_heightMap[index1].v1 = 1.0f / m_terrainHeight * j;
+        hitCount.fetch_add(blockHits, std::memory_order_relaxed);
+    });
 
-            m_heightMap[index2].u1 = 1.0f / m_terrainWidth * i;
-            m_heightMap[index2].v1 = 1.0f / m_terrainHeight * j;
+    return hitCount.load();
+}
 
-            m_heightMap[index3].u1 = 1.0f / m_terrainWidth * i;
-            m_heightMap[index3].v1 = 1.0f / m_terrainHeight * j;
+bool Terrain::HasLineOfSight(DirectX::XMFLOAT3 const& from, DirectX::XMFLOAT3 const& to) const
+{
+    DirectX::XMFLOAT3 const direction(to.x - from.x, to.y - from.y, to.z - from.z);
+    float const distance = sqrt((direction.x * direction.x) + (direction.y * direction.y) + (direction.z * direction.z));
 
-            m_heightMap[index4].u1 = 1.0f / m_terrainWidth * i;
-            m_heightMap[index4].v1 = 1.0f / m_terrainHeight * j;
-        }
-    }
+    if (!(distance > 0.0f))
+        return true;
+
+    RayHit hit;
+    return !Raycast(from, direction, distance, hit);
 }
 
-void Terrain::CalculateNormals()
+bool Terrain::RaycastQuads(float const* origin, float const* direction, float tEnter, float tExit, float maxDistance,
+    int firstColumn, int firstRow, int lastColumn, int lastRow, RayHit& hit) const
 {
-    uint32 index1, index2, index3, index, count;
-    float vertex1[3], vertex2[3], vertex3[3], vector1[3], vector2[3], sum[3], length;
-    VectorType* normals;
+    // Start in the quad the ray enters the block in, clamped against rounding at the block border.
+    int column = static_cast<int>(origin[0] + direction[0] * tEnter);
+    int row = static_cast<int>(origin[2] + direction[2] * tEnter);
+    column = std::min(std::max(column, firstColumn), lastColumn);
+    row = std::min(std::max(row, firstRow), lastRow);
+
+    // Same walk as over the blocks, with quads of size one.
+    int const stepX = direction[0] > 0.0f ? 1 : -1;
+    int const stepZ = direction[2] > 0.0f ? 1 : -1;
+    float const deltaX = direction[0] != 0.0f ? 1.0f / fabs(direction[0]) : FLT_MAX;
+    float const deltaZ = direction[2] != 0.0f ? 1.0f / fabs(direction[2]) : FLT_MAX;
+    float nextX = direction[0] != 0.0f ? (static_cast<float>(column + (stepX > 0 ? 1 : 0)) - origin[0]) / direction[0] : FLT_MAX;
+    float nextZ = direction[2] != 0.0f ? (static_cast<float>(row + (stepZ > 0 ? 1 : 0)) - origin[2]) / direction[2] : FLT_MAX;
+
+    float t = tEnter;
+    while (true)
+    {
+        float const tNext = std::min(std::min(nextX, nextZ), tExit);
+
+        // The quads are visited front to back, so the first hit is the nearest one.
+        if (IntersectQuad(origin, direction, t, tNext, maxDistance, column, row, hit))
+            return true;
 
-    // Create a temporary array to hold the un-normalized normal vectors.
-    normals = new VectorType[(m_terrainHeight - 1) * (m_terrainWidth - 1)];
+        if (tNext >= tExit)
+            return false;
 
-    // Go through all the faces in the mesh and calculate their normals.
-    for (uint16 j = 0; j < (m_terrainHeight - 1); ++j)
-    {
-        for (uint16 i = 0; i < (m_terrainWidth - 1); ++i)
+        if (nextX < nextZ)
         {
-            index1 = (j * m_terrainHeight) + i;
-            index2 = (j * m_terrainHeight) + (i + 1);
-            index3 = ((j + 1) * m_terrainHeight) + i;
-
-            // Get three vertices from the face.
-            vertex1[0] = m_heightMap[index1].x;
-            vertex1[1] = m_heightMap[index1].y;
-            vertex1[2] = m_heightMap[index1].z;
-
-            vertex2[0] = m_heightMap[index2].x;
-            vertex2[1] = m_heightMap[index2].y;
-            vertex2[2] = m_heightMap[index2].z;
-
-            vertex3[0] = m_heightMap[index3].x;
-            vertex3[1] = m_heightMap[index3].y;
-            vertex3[2] = m_heightMap[index3].z;
-
-            // Calculate the two vectors for this face.
-            vector1[0] = vertex1[0] - vertex3[0];
-            vector1[1] = vertex1[1] - vertex3[1];
-            vector1[2] = vertex1[2] - vertex3[2];
-            vector2[0] = vertex3[0] - vertex2[0];
-            vector2[1] = vertex3[1] - vertex2[1];
-            vector2[2] = vertex3[2] - vertex2[2];
-
-            index = (j * (m_terrainHeight - 1)) + i;
-
-            // Calculate the cross product of those two vectors to get the un-normalized value for this face normal.
-            normals[index].x = (vector1[1] * vector2[2]) - (vector1[2] * vector2[1]);
-            normals[index].y = (vector1[2] * vector2[0]) - (vector1[0] * vector2[2]);
-            normals[index].z = (vector1[0] * vector2[1]) - (vector1[1] * vector2[0]);
+            column += stepX;
+            nextX += deltaX;
         }
+        else
+        {
+            row += stepZ;
+            nextZ += deltaZ;
+        }
+
+        if (column < firstColumn || row < firstRow || column > lastColumn || row > lastRow)
+            return false;
+
+        t = tNext;
     }
+}
 
-    // Now go through all the vertices and take an average of each face normal 	
-    // that the vertex touches to get the averaged normal for that vertex.
-    for (uint16 j = 0; j < m_terrainHeight; ++j)
-    {
-        for (uint16 i = 0; i < m_terrainWidth; ++i)
-        {
-            // Initialize the sum.
-            sum[0] = 0.0f;
-            sum[1] = 0.0f;
-            sum[2] = 0.0f;
+bool Terrain::IntersectQuad(float const* origin, float const* direction, float tEnter, float tExit, float maxDistance, int column, int row, RayHit& hit) const
+{
+    float const epsilon = 1.0e-5f;
+
+    // Get the heights of the bottom left, bottom right, upper left and upper right corners.
+    int const index = (m_terrainWidth * row) + column;
+    float const h00 = m_heights[index];
+    float const h10 = m_heights[index + 1];
+    float const h01 = m_heights[index + m_terrainWidth];
+    float const h11 = m_heights[index + m_terrainWidth + 1];
+
+    // Skip the quad if the ray stays above its highest corner while it crosses it.
+    float const lowestY = origin[1] + direction[1] * (direction[1] < 0.0f ? tExit : tEnter);
+    if (lowestY > std::max(std::max(h00, h10), std::max(h01, h11)))
+        return false;
 
-            // Initialize the count.
-            count = 0;
+    // Both triangles are planes h00 + slopeX * fx + slopeZ * fz over the quad, the same ones InterpolateHeight uses.
+    // The first one is the upper left triangle with fz >= fx, the second one the bottom right triangle.
+    float const slopeX[2] = { h11 - h01, h10 - h00 };
+    float const slopeZ[2] = { h01 - h00, h11 - h10 };
+    float const fx0 = origin[0] - static_cast<float>(column);
+    float const fz0 = origin[2] - static_cast<float>(row);
 
-            // Bottom left face.
-            if (((i - 1) >= 0) && ((j - 1) >= 0))
-            {
-                index = ((j - 1) * (m_terrainHeight - 1)) + (i - 1);
+    float nearest = FLT_MAX;
+    int nearestTriangle = -1;
 
-                sum[0] += normals[index].x;
-                sum[1] += normals[index].y;
-                sum[2] += normals[index].z;
-                count++;
-            }
+    for (int k = 0; k < 2; ++k)
+    {
+        // The height of the ray above the plane changes linearly along the ray, find where it is zero.
+        float const heightAbove = origin[1] - h00 - (slopeX[k] * fx0) - (slopeZ[k] * fz0);
+        float const heightChange = direction[1] - (slopeX[k] * direction[0]) - (slopeZ[k] * direction[2]);
+        if (heightChange == 0.0f)
+            continue;
+
+        float const t = -heightAbove / heightChange;
+        if (!(t >= 0.0f && t <= maxDistance && t < nearest))
+            continue;
+
+        // The point has to be inside the triangle of the plane.
+        float const fx = fx0 + direction[0] * t;
+        float const fz = fz0 + direction[2] * t;
+        if (fx < -epsilon || fz < -epsilon || fx > 1.0f + epsilon || fz > 1.0f + epsilon)
+            continue;
+        if (k == 0 ? fz < fx - epsilon : fz > fx + epsilon)
+            continue;
+
+        nearest = t;
+        nearestTriangle = k;
+    }
 
-            // Bottom right face.
-            if ((i < (m_terrainWidth - 1)) && ((j - 1) >= 0))
-            {
-                index = ((j - 1) * (m_terrainHeight - 1)) + i;
+    if (nearestTriangle < 0)
+        return false;
 
-                sum[0] += normals[index].x;
-                sum[1] += normals[index].y;
-                sum[2] += normals[index].z;
-                count++;
-            }
+    // The rows of the height map go along negative z, so the slope along the rows flips for the normal.
+    float const normalX = -slopeX[nearestTriangle];
+    float const normalZ = slopeZ[nearestTriangle];
+    float const length = sqrt((normalX * normalX) + 1.0f + (normalZ * normalZ));
 
-            // Upper left face.
-            if (((i - 1) >= 0) && (j < (m_terrainHeight - 1)))
-            {
-                index = (j * (m_terrainHeight - 1)) + (i - 1);
+    hit.hit = true;
+    hit.distance = nearest;
+    hit.normal = DirectX::XMFLOAT3(normalX / length, 1.0f / length, normalZ / length);
 
-                sum[0] += normals[index].x;
-                sum[1] += normals[index].y;
-                sum[2] += normals[index].z;
-                count++;
-            }
+    return true;
+}
 
-            // Upper right face.
-            if ((i < (m_terrainWidth - 1)) && (j < (m_terrainHeight - 1)))
-            {
-                index = (j * (m_terrainHeight - 1)) + i;
+void Terrain::UpdateRayBlocks(GridRegion const& region)
+{
+    int const quadsX = m_terrainWidth - 1;
+    int const quadsZ = m_terrainHeight - 1;
 
-                sum[0] += normals[index].x;
-                sum[1] += normals[index].y;
-                sum[2] += normals[index].z;
-                count++;
-            }
+    if (m_rayBlockMaxY.empty())
+    {
+        m_rayBlockCountX = (quadsX + RAY_BLOCK_QUADS - 1) / RAY_BLOCK_QUADS;
+        m_rayBlockCountZ = (quadsZ + RAY_BLOCK_QUADS - 1) / RAY_BLOCK_QUADS;
+        m_rayBlockMaxY.resize(m_rayBlockCountX * m_rayBlockCountZ);
+    }
 
-            // Take the average of the faces touching this vertex.
-            sum[0] = (sum[0] / static_cast<float>(count));
-            sum[1] = (sum[1] / static_cast<float>(count));
-            sum[2] = (sum[2] / static_cast<float>(count));
+    // Neighbouring blocks share their border samples like the cells do.
+    int const firstBlockX = std::max((region.minColumn - 1) / RAY_BLOCK_QUADS, 0);
+    int const firstBlockZ = std::max((region.minRow - 1) / RAY_BLOCK_QUADS, 0);
+    int const lastBlockX = std::min(region.maxColumn / RAY_BLOCK_QUADS, m_rayBlockCountX - 1);
+    int const lastBlockZ = std::min(region.maxRow / RAY_BLOCK_QUADS, m_rayBlockCountZ - 1);
 
-            // Calculate the length of this normal.
-            length = sqrt((sum[0] * sum[0]) + (sum[1] * sum[1]) + (sum[2] * sum[2]));
+    for (int j = firstBlockZ; j <= lastBlockZ; ++j)
+    {
+        for (int i = firstBlockX; i <= lastBlockX; ++i)
+        {
+            int const lastColumn = std::min((i + 1) * RAY_BLOCK_QUADS, quadsX);
+            int const lastRow = std::min((j + 1) * RAY_BLOCK_QUADS, quadsZ);
+            float maxY = -FLT_MAX;
 
-            // Get an index to the vertex location in the height map array.
-            index = (j * m_terrainHeight) + i;
+            for (int row = j * RAY_BLOCK_QUADS; row <= lastRow; ++row)
+            {
+                for (int column = i * RAY_BLOCK_QUADS; column <= lastColumn; ++column)
+                    maxY = std::max(maxY, m_heights[(m_terrainWidth * row) + column]);
+            }
 
-            // Normalize the final shared normal for this vertex and store it in the height map array.
-            m_heightMap[index].nx = (sum[0] / length);
-            m_heightMap[index].ny = (sum[1] / length);
-            m_heightMap[index].nz = (sum[2] / length);
+            m_rayBlockMaxY[(m_rayBlockCountX * j) + i] = maxY;
         }
     }
-
-    // Release the temporary normals.
-    delete[] normals;
-    normals = nullptr;
 }
 
 bool Terrain::LoadTerrainCells(ID3D11Device* device)
@@ -530,11 +872,12 @@ bool Terrain::LoadTerrainCells(ID3D11Device* device)
     bool result;
 
     // Set the height and width of each terrain cell to a fixed 33x33 vertex array.
-    cellWidth = 33;
-    cellHeight = 33;
+    cellWidth = CELL_SIZE;
+    cellHeight = CELL_SIZE;
 
     // Calculate the number of cells needed to store the terrain data.
     cellRowCount = (m_terrainWidth - 1) / (cellWidth - 1);
+    m_iCellRowCount = cellRowCount;
     m_iCellCount = cellRowCount * cellRowCount;
 
     // Create the terrain cell array.
@@ -549,12 +892,29 @@ bool Terrain::LoadTerrainCells(ID3D11Device* device)
         {
             index = (cellRowCount * j) + i;
 
-            result = m_pTerrainCells[index].Initialize(device, m_heightMap, i, j, cellWidth, cellHeight, m_terrainWidth);
+            result = m_pTerrainCells[index].Initialize(device, m_vertices, i, j, cellWidth, cellHeight, m_terrainWidth);
 
             if (!result)
                 return false;
         }
     }
+
+    // Store the dimensions of all cells for the culling.
+    m_cellMinX.resize(m_iCellCount);
+    m_cellMinY.resize(m_iCellCount);
+    m_cellMinZ.resize(m_iCellCount);
+    m_cellMaxX.resize(m_iCellCount);
+    m_cellMaxY.resize(m_iCellCount);
+    m_cellMaxZ.resize(m_iCellCount);
+
+    for (i = 0; i < m_iCellCount; ++i)
+    {
+        m_pTerrainCells[i].GetCellDimensions(m_cellMinX[i], m_cellMinY[i], m_cellMinZ[i], m_cellMaxX[i], m_cellMaxY[i], m_cellMaxZ[i]);
+    }
+
+    // Nothing is visible until the cells are culled for the first time.
+    m_cellVisibility.assign((m_iCellCount + 31) / 32, 0);
+
     return true;
 }
 
@@ -570,173 +930,95 @@ void Terrain::ShutdownTerrainCells()
     }
 }
 
-bool Terrain::GetHeightOfTriangle(float x, float z, float& height, float v0[3], float v1[3], float v2[3])
+bool Terrain::LoadRawHeightMap(MappedFile const& file)
 {
-    float startVector[3], directionVector[3], edge1[3], edge2[3], normal[3];
-    float Q[3], e1[3], e2[3], e3[3], edgeNormal[3], temp[3];
-    float magnitude, D, denominator, numerator, t, determinant;
-
-    // Starting position of the ray that is being cast.
-    startVector[0] = x;
-    startVector[1] = 0.0f;
-    startVector[2] = z;
-
-    // The direction the ray is being cast.
-    directionVector[0] = 0.0f;
-    directionVector[1] = -1.0f;
-    directionVector[2] = 0.0f;
-
-    // Calculate the two edges from the three points given.
-    edge1[0] = v1[0] - v0[0];
-    edge1[1] = v1[1] - v0[1];
-    edge1[2] = v1[2] - v0[2];
-
-    edge2[0] = v2[0] - v0[0];
-    edge2[1] = v2[1] - v0[1];
-    edge2[2] = v2[2] - v0[2];
-
-    // Calculate the normal of the triangle from the two edges.
-    normal[0] = (edge1[1] * edge2[2]) - (edge1[2] * edge2[1]);
-    normal[1] = (edge1[2] * edge2[0]) - (edge1[0] * edge2[2]);
-    normal[2] = (edge1[0] * edge2[1]) - (edge1[1] * edge2[0]);
-
-    magnitude = (float)sqrt((normal[0] * normal[0]) + (normal[1] * normal[1]) + (normal[2] * normal[2]));
-    normal[0] = normal[0] / magnitude;
-    normal[1] = normal[1] / magnitude;
-    normal[2] = normal[2] / magnitude;
-
-    // Find the distance from the origin to the plane.
-    D = ((-normal[0] * v0[0]) + (-normal[1] * v0[1]) + (-normal[2] * v0[2]));
-
-    // Get the denominator of the equation.
-    denominator = ((normal[0] * directionVector[0]) + (normal[1] * directionVector[1]) + (normal[2] * directionVector[2]));
+    // Calculate the size of the raw image data.
+    uint32 const imageSize = m_terrainWidth * m_terrainHeight;
 
-    // Make sure the result doesn't get too close to zero to prevent divide by zero.
-    if (fabs(denominator) < 0.0001f)
-    {
+    // The file holds one little endian 16 bit sample per point, .r16 and .raw files share the layout.
+    if (file.GetSize() < imageSize * sizeof(uint16))
         return false;
-    }
-
-    // Get the numerator of the equation.
-    numerator = -1.0f * (((normal[0] * startVector[0]) + (normal[1] * startVector[1]) + (normal[2] * startVector[2])) + D);
 
-    // Calculate where we intersect the triangle.
-    t = numerator / denominator;
+    // Keep the heights in their own array, the vertices and the height queries are built from it.
+    m_heights.resize(imageSize);
 
-    // Find the intersection vector.
-    Q[0] = startVector[0] + (directionVector[0] * t);
-    Q[1] = startVector[1] + (directionVector[1] * t);
-    Q[2] = startVector[2] + (directionVector[2] * t);
-
-    // Find the three edges of the triangle.
-    e1[0] = v1[0] - v0[0];
-    e1[1] = v1[1] - v0[1];
-    e1[2] = v1[2] - v0[2];
-
-    e2[0] = v2[0] - v1[0];
-    e2[1] = v2[1] - v1[1];
-    e2[2] = v2[2] - v1[2];
-
-    e3[0] = v0[0] - v2[0];
-    e3[1] = v0[1] - v2[1];
-    e3[2] = v0[2] - v2[2];
-
-    // Calculate the normal for the first edge.
-    edgeNormal[0] = (e1[1] * normal[2]) - (e1[2] * normal[1]);
-    edgeNormal[1] = (e1[2] * normal[0]) - (e1[0] * normal[2]);
-    edgeNormal[2] = (e1[0] * normal[1]) - (e1[1] * normal[0]);
-
-    // Calculate the determinant to see if it is on the inside, outside, or directly on the edge.
-    temp[0] = Q[0] - v0[0];
-    temp[1] = Q[1] - v0[1];
-    temp[2] = Q[2] - v0[2];
-
-    determinant = ((edgeNormal[0] * temp[0]) + (edgeNormal[1] * temp[1]) + (edgeNormal[2] * temp[2]));
-
-    // Check if it is outside.
-    if (determinant > 0.001f)
+    // Read the scaled samples straight out of the mapped file, a block of rows at a time.
+    uint8 const* data = file.GetData();
+    TaskPool::Get().ParallelFor(m_terrainHeight, ROW_GRAIN, [this, data](uint32 begin, uint32 end)
     {
-        return false;
-    }
-
-    // Calculate the normal for the second edge.
-    edgeNormal[0] = (e2[1] * normal[2]) - (e2[2] * normal[1]);
-    edgeNormal[1] = (e2[2] * normal[0]) - (e2[0] * normal[2]);
-    edgeNormal[2] = (e2[0] * normal[1]) - (e2[1] * normal[0]);
+        for (uint32 index = begin * m_terrainWidth; index < end * m_terrainWidth; ++index)
+        {
+            uint16 sample;
+            memcpy(&sample, data + index * sizeof(uint16), sizeof(uint16));
 
-    // Calculate the determinant to see if it is on the inside, outside, or directly on the edge.
-    temp[0] = Q[0] - v1[0];
-    temp[1] = Q[1] - v1[1];
-    temp[2] = Q[2] - v1[2];
+            m_heights[index] = static_cast<float>(sample) / m_heightScale;
+        }
+    });
 
-    determinant = ((edgeNormal[0] * temp[0]) + (edgeNormal[1] * temp[1]) + (edgeNormal[2] * temp[2]));
+    return true;
+}
 
-    // Check if it is outside.
-    if (determinant > 0.001f)
-    {
+bool Terrain::LoadTerrainCache(char const* fileName, uint64 sourceHash)
+{
+    MappedFile file;
+    if (!file.Open(fileName))
         return false;
-    }
 
-    // Calculate the normal for the third edge.
-    edgeNormal[0] = (e3[1] * normal[2]) - (e3[2] * normal[1]);
-    edgeNormal[1] = (e3[2] * normal[0]) - (e3[0] * normal[2]);
-    edgeNormal[2] = (e3[0] * normal[1]) - (e3[1] * normal[0]);
-
-    // Calculate the determinant to see if it is on the inside, outside, or directly on the edge.
-    temp[0] = Q[0] - v2[0];
-    temp[1] = Q[1] - v2[1];
-    temp[2] = Q[2] - v2[2];
+    // The cache is only used if it was built from the same height map with the same settings.
+    size_t const vertexDataSize = sizeof(DirectX::VertexPositionNormalColorDualTexture) * m_vertexCount;
+    if (file.GetSize() != sizeof(CacheHeader) + vertexDataSize)
+        return false;
 
-    determinant = ((edgeNormal[0] * temp[0]) + (edgeNormal[1] * temp[1]) + (edgeNormal[2] * temp[2]));
+    CacheHeader header;
+    memcpy(&header, file.GetData(), sizeof(header));
 
-    // Check if it is outside.
-    if (determinant > 0.001f)
-    {
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.sourceHash != sourceHash ||
+        header.width != static_cast<uint32>(m_terrainWidth) || header.height != static_cast<uint32>(m_terrainHeight) ||
+        header.heightScale != m_heightScale)
         return false;
-    }
 
-    // Now we have our height.
-    height = Q[1];
+    // The vertices are stored in the layout of the vertex buffer so they are copied as they are.
+    m_vertices = new DirectX::VertexPositionNormalColorDualTexture[m_vertexCount];
+    memcpy(m_vertices, file.GetData() + sizeof(CacheHeader), vertexDataSize);
+
+    // Keep the heights in their own array for the height queries.
+    m_heights.resize(m_vertexCount);
+    for (int i = 0; i < m_vertexCount; ++i)
+        m_heights[i] = m_vertices[i].position.y;
 
     return true;
 }
 
-bool Terrain::LoadRawHeightMap(char const* fileName)
+bool Terrain::SaveTerrainCache(char const* fileName, uint64 sourceHash) const
 {
-    // Calculate the size of the raw image data.
-    uint32 const imageSize = m_terrainWidth * m_terrainHeight;
-
-    // Create the float array to hold the height map data.
-    m_heightMap = new HeightMapType[imageSize];
-    if (!m_heightMap)
+    CacheHeader header;
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.width = m_terrainWidth;
+    header.height = m_terrainHeight;
+    header.heightScale = m_heightScale;
+    header.padding = 0;
+    header.sourceHash = sourceHash;
+
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
         return false;
 
-    // Open raw file to read.
-    std::ifstream File(fileName, std::ios::binary);
-    if (!File.is_open())
-        return false;
+    file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    file.write(reinterpret_cast<char const*>(m_vertices), sizeof(DirectX::VertexPositionNormalColorDualTexture) * m_vertexCount);
 
-    // Read raw data from file.
-    uint16* rawImage = new uint16[imageSize];
-    File.seekg(0, std::ios::beg);
-    File.read(reinterpret_cast<int8*>(rawImage), imageSize * sizeof(uint16));
-    File.close();
+    return file.good();
+}
 
-    // Copy the image data into the height map array.
-    for (uint16 j = 0; j < m_terrainHeight; ++j)
+uint64 Terrain::HashBytes(uint8 const* data, size_t size)
+{
+    // 64 bit FNV-1a.
+    uint64 hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i)
     {
-        for (uint16 i = 0; i < m_terrainWidth; ++i)
-        {
-            uint32 const index = (m_terrainWidth * j) + i;
-
-            // Store the height at this point in the height map array.
-            m_heightMap[index].y = static_cast<float>(rawImage[index]);
-        }
+        hash ^= data[i];
+        hash *= 1099511628211ull;
     }
 
-    // Release the bitmap image data.
-    delete[] rawImage;
-    rawImage = nullptr;
-
-    return false;
+    return hash;
 }
\ No newline at end of file
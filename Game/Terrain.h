@@ -11,6 +11,9 @@
 #include "CommonStates.h"
 #include "Frustum.h"
 #include "TerrainCell.h"
+#include "MappedFile.h"
+#include "TaskPool.h"
+#include "TerrainVertexPacker.h"
 
 class Terrain
 {
@@ -18,7 +21,7 @@ class Terrain
         Terrain();
         ~Terrain();
 
-        struct HeightMapType
+        struct ModelType
         {
             float x, y, z;
             float nx, ny, nz;
@@ -26,25 +29,48 @@ class Terrain
             float u1, v1;
         };
 
-        struct ModelType
+        // Rectangle of height map samples, the maximum column and row are part of it.
+        struct GridRegion
         {
-            float x, y, z;
-            float nx, ny, nz;
-            float u, v;
-            float u1, v1;
+            int minColumn, minRow;
+            int maxColumn, maxRow;
         };
-        
-        struct VectorType
+
+        // Result of a ray cast against the terrain, the normal faces up.
+        struct RayHit
         {
-            float x, y, z;
+            bool hit;
+            float distance;
+            DirectX::XMFLOAT3 position;
+            DirectX::XMFLOAT3 normal;
         };
 
         void Initialize(ID3D11DeviceContext* deviceContext);
+
+        // Replaces the heights of a rectangle of samples, the heights are passed row by row. Only the vertices of the
+        // changed region are rebuilt, it is the rectangle plus the ring of samples around it whose normals change.
+        // A terrain that is drawn by an octree is edited with Octree::SetHeights, which updates the tree as well.
+        // Both fail when the height map wasn't loaded.
+        bool SetHeights(ID3D11DeviceContext* deviceContext, int firstColumn, int firstRow, int columnCount, int rowCount, float const* heights, GridRegion& changedRegion);
+        bool GetHeights(int firstColumn, int firstRow, int columnCount, int rowCount, float* heights) const;
+
+        // Builds every vertex again from the heights, the same parallel pass that loads a height map without a cache.
+        // The cells and trees built from the old vertices aren't updated. Fails when the height map wasn't loaded.
+        bool RebuildVertexArray();
+
         void CopyVertexArray(void* vertexList);
+        void CopyIndexArray(void* indexList);
+
+        TerrainVertexPacker::Parameters GetPackingParameters() const { return { m_heightScale, m_terrainWidth, m_terrainHeight, TEXTURE_REPEAT }; }
 
+        DirectX::VertexPositionNormalColorDualTexture const* GetVertices() const { return m_vertices; }
+        int GetTerrainWidth() const { return m_terrainWidth; }
+        int GetTerrainHeight() const { return m_terrainHeight; }
         int GetVertexCount() const { return m_vertexCount; }
+        int GetIndexCount() const { return m_indexCount; }
 
-        bool DrawCell(ID3D11DeviceContext* deviceContext, int cellId, Frustum* frustum);
+        void CullCells(Frustum* frustum, DirectX::XMFLOAT3 const& cameraPosition, float lodScale);
+        bool DrawCell(ID3D11DeviceContext* deviceContext, int cellId);
         void DrawCellLines(ID3D11DeviceContext* deviceContext, int cellId);
 
         int GetCellIndexCount(int cellId);
@@ -56,33 +82,104 @@ class Terrain
 
         bool GetHeightAtPosition(float x, float z, float& height);
 
+        // Grounds count positions at once. Returns how many of them are on the terrain, the others keep their height.
+        int GetHeightAtPosition(float const* x, float const* z, float* height, int count);
+
+        // Finds the first point where the ray hits the terrain, the distance is measured along the normalized direction.
+        // The ray casts only read the terrain, they may run on several threads as long as no heights are edited.
+        bool Raycast(DirectX::XMFLOAT3 const& origin, DirectX::XMFLOAT3 const& direction, float maxDistance, RayHit& hit) const;
+
+        // Casts count rays at once, spread over the task pool. Returns how many of them hit the terrain.
+        int Raycast(DirectX::XMFLOAT3 const* origins, DirectX::XMFLOAT3 const* directions, float const* maxDistances, int count, RayHit* hits) const;
+
+        bool HasLineOfSight(DirectX::XMFLOAT3 const& from, DirectX::XMFLOAT3 const& to) const;
+
     private:
-        bool LoadRawHeightMap(char const* fileName);
+        // Header of the cache next to the height map, it is followed by the finished vertex array.
+        struct CacheHeader
+        {
+            uint32 magic;
+            uint32 version;
+            uint32 width;
+            uint32 height;
+            float heightScale;
+            uint32 padding;
+            uint64 sourceHash;
+        };
 
-        void SetTerrainCoordinates();
-        void SetTextureCoordinates();
-        void SetTextureCoordinates1();
-        void CalculateNormals();
+        bool LoadRawHeightMap(MappedFile const& file);
+        bool LoadTerrainCache(char const* fileName, uint64 sourceHash);
+        bool SaveTerrainCache(char const* fileName, uint64 sourceHash) const;
+        static uint64 HashBytes(uint8 const* data, size_t size);
+
+        void BuildVertexArray();
+        void CalculateFaceNormals(int row, int firstFace, int endFace, float* normalX, float* normalZ) const;
+        void BuildVertexRow(int row, int firstColumn, int endColumn, float const* belowX, float const* belowZ, float const* aboveX, float const* aboveZ);
+        void CalculateVertexNormal(int row, int column, float const* belowX, float const* belowZ, float const* aboveX, float const* aboveZ,
+            float& normalX, float& normalY, float& normalZ) const;
 
         bool BuildTerrainModel();
         void ShutdownTerrainModel();
 
+        void UpdateVertices(GridRegion const& region);
+        void UpdateCells(ID3D11DeviceContext* deviceContext, GridRegion const& region);
+
         bool LoadTerrainCells(ID3D11Device* device);
         void ShutdownTerrainCells();
 
-        bool GetHeightOfTriangle(float x, float z, float& height, float v0[3], float v1[3], float v2[3]);
+        float InterpolateHeight(float gridX, float gridZ) const;
+
+        void UpdateRayBlocks(GridRegion const& region);
+        bool RaycastQuads(float const* origin, float const* direction, float tEnter, float tExit, float maxDistance,
+            int firstColumn, int firstRow, int lastColumn, int lastRow, RayHit& hit) const;
+        bool IntersectQuad(float const* origin, float const* direction, float tEnter, float tExit, float maxDistance, int column, int row, RayHit& hit) const;
 
     private:
         static constexpr int const TEXTURE_REPEAT = 16;
+        static constexpr int const CELL_SIZE = 33;
+
+        static constexpr char const* HEIGHT_MAP_FILE = "Data/terrain.raw";
+        static constexpr char const* HEIGHT_MAP_CACHE_FILE = "Data/terrain.raw.cache";
+        static constexpr uint32 const CACHE_MAGIC = 0x48435254; // "TRCH"
+        static constexpr uint32 const CACHE_VERSION = 1;
+
+        // Number of quads along the side of a block of the ray cast acceleration grid, a block covers one cell.
+        static constexpr int const RAY_BLOCK_QUADS = CELL_SIZE - 1;
+
+        // Number of rays in one task of the batched ray casts.
+        static constexpr uint32 const RAY_GRAIN = 64;
+
+        // Number of height map rows in one task of the parallel setup passes.
+        static constexpr uint32 const ROW_GRAIN = 16;
+
+        // Largest height error in pixels a cell may have on screen before a finer level of detail is used.
+        static constexpr float const LOD_PIXEL_ERROR = 2.0f;
 
         int m_terrainWidth, m_terrainHeight;
-        int m_vertexCount;
+        int m_vertexCount, m_indexCount;
         float m_heightScale;
-        HeightMapType* m_heightMap;
         ModelType* m_terrainModel;
         TerrainCell* m_pTerrainCells;
+
+        // One vertex per height map sample, the quads are built through the index list.
         DirectX::VertexPositionNormalColorDualTexture* m_vertices;
+        uint32* m_indices;
+
+        // Height of every height map sample, row by row.
+        std::vector<float> m_heights;
+
+        // Highest sample of every block of quads, the ray casts skip the blocks the ray passes above.
+        std::vector<float> m_rayBlockMaxY;
+        int m_rayBlockCountX, m_rayBlockCountZ;
+
+        // Face normals of two rows, used by the height edits.
+        std::vector<float> m_editFaceNormals;
+
+        // Bounds of every cell with one array per component, all cells are culled in one batch.
+        std::vector<float> m_cellMinX, m_cellMinY, m_cellMinZ;
+        std::vector<float> m_cellMaxX, m_cellMaxY, m_cellMaxZ;
+        std::vector<uint32> m_cellVisibility;
 
     private:
-        int m_iCellCount, m_iDrawCount, m_iCellsDrawn, m_iCellsCulled;
+        int m_iCellCount, m_iCellRowCount, m_iDrawCount, m_iCellsDrawn, m_iCellsCulled;
 };
\ No newline at end of file
@@ -6,6 +6,14 @@ TerrainCell::TerrainCell()
     : m_iVertexCount(0)
     , m_iIndexCount(0)
     , m_iLineIndexCount(0)
+    , m_iFirstColumn(0)
+    , m_iFirstRow(0)
+    , m_iCellWidth(0)
+    , m_iCellHeight(0)
+    , m_iLod(0)
+    , m_iLodCount(0)
+    , m_lodIndexCount{}
+    , m_lodError{}
     , m_fMinWidth(0.0f)
     , m_fMinHeight(0.0f)
     , m_fMinDepth(0.0f)
@@ -20,23 +28,23 @@ TerrainCell::~TerrainCell()
 {
 }
 
-bool TerrainCell::Initialize(ID3D11Device* device, void* terrainModelPtr, int nodeIndexX,
+bool TerrainCell::Initialize(ID3D11Device* device, DirectX::VertexPositionNormalColorDualTexture const* terrainVertices, int nodeIndexX,
     int nodeIndexY, int cellWidth, int cellHeight, int terrainWidth)
 {
-    ModelType* terrainModel;
     bool result;
 
-    terrainModel = (ModelType*)terrainModelPtr;
-
-    result = InitializeBuffers(device, nodeIndexX, nodeIndexY, cellWidth, cellHeight, terrainWidth, terrainModel);
+    result = InitializeBuffers(device, nodeIndexX, nodeIndexY, cellWidth, cellHeight, terrainWidth, terrainVertices);
 
     if (!result)
         return false;
 
-    terrainModel = nullptr;
-
     CalculateCellDimensions();
 
+    result = BuildLodBuffers(device, cellWidth, cellHeight);
+
+    if (!result)
+        return false;
+
     result = BuildLineBuffers(device);
     
     if (!result)
@@ -74,11 +82,96 @@ int TerrainCell::GetIndexCount()
     return m_iIndexCount;
 }
 
+int TerrainCell::GetLodIndexCount()
+{
+    return m_lodIndexCount[m_iLod];
+}
+
 int TerrainCell::GetLineBuffersIndexCount()
 {
     return m_iLineIndexCount;
 }
 
+void TerrainCell::UpdateVertices(ID3D11DeviceContext* deviceContext, DirectX::VertexPositionNormalColorDualTexture const* terrainVertices, int terrainWidth,
+    int minColumn, int minRow, int maxColumn, int maxRow)
+{
+    std::vector<DirectX::VertexPositionNormalColorDualTexture> vertices;
+    int firstColumn, firstRow, lastColumn, lastRow, first, last, index, lod;
+    float minHeight, maxHeight;
+
+    // Clip the changed region to the samples of this cell.
+    firstColumn = std::max(minColumn - m_iFirstColumn, 0);
+    firstRow = std::max(minRow - m_iFirstRow, 0);
+    lastColumn = std::min(maxColumn - m_iFirstColumn, m_iCellWidth - 1);
+    lastRow = std::min(maxRow - m_iFirstRow, m_iCellHeight - 1);
+
+    if (firstColumn > lastColumn || firstRow > lastRow)
+        return;
+
+    // The changed vertices are a contiguous range of the vertex buffer from the first to the last changed sample.
+    first = (m_iCellWidth * firstRow) + firstColumn;
+    last = (m_iCellWidth * lastRow) + lastColumn;
+
+    vertices.resize(last - first + 1);
+    for (index = first; index <= last; ++index)
+    {
+        int const row = index / m_iCellWidth;
+        int const column = index % m_iCellWidth;
+
+        vertices[index - first] = terrainVertices[((m_iFirstRow + row) * terrainWidth) + m_iFirstColumn + column];
+        pVertexList[index].y = vertices[index - first].position.y;
+    }
+
+    // Only upload the changed range.
+    D3D11_BOX box = { };
+    box.left = first * pVertexBuffer.Stride();
+    box.right = (last + 1) * pVertexBuffer.Stride();
+    box.bottom = 1;
+    box.back = 1;
+
+    deviceContext->UpdateSubresource(pVertexBuffer.Get(), 0, &box, vertices.data(), 0, 0);
+
+    // The bounds and the errors of the levels of detail depend on the heights.
+    minHeight = m_fMinHeight;
+    maxHeight = m_fMaxHeight;
+
+    CalculateCellDimensions();
+
+    // The bounding box lines follow the new height range.
+    if (m_fMinHeight != minHeight || m_fMaxHeight != maxHeight)
+    {
+        std::vector<ColorVertexType> lineVertices;
+        BuildLineVertices(lineVertices);
+
+        deviceContext->UpdateSubresource(pLineVertexBuffer.Get(), 0, nullptr, lineVertices.data(), 0, 0);
+    }
+
+    for (lod = 1; lod < m_iLodCount; ++lod)
+        m_lodError[lod] = std::max(CalculateLodError(m_iCellWidth, m_iCellHeight, 1 << lod), m_lodError[lod - 1]);
+}
+
+void TerrainCell::SelectLod(DirectX::XMFLOAT3 const& cameraPosition, float lodScale, float maxPixelError)
+{
+    float dx, dy, dz, distance;
+
+    // Find the distance from the camera to the closest point of the cell bounds.
+    dx = std::max(std::max(m_fMinWidth - cameraPosition.x, 0.0f), cameraPosition.x - m_fMaxWidth);
+    dy = std::max(std::max(m_fMinHeight - cameraPosition.y, 0.0f), cameraPosition.y - m_fMaxHeight);
+    dz = std::max(std::max(m_fMinDepth - cameraPosition.z, 0.0f), cameraPosition.z - m_fMaxDepth);
+    distance = sqrtf((dx * dx) + (dy * dy) + (dz * dz));
+
+    // Use the coarsest level whose height error stays below the allowed number of pixels on screen.
+    m_iLod = 0;
+    for (int lod = m_iLodCount - 1; lod > 0; --lod)
+    {
+        if (m_lodError[lod] * lodScale <= maxPixelError * distance)
+        {
+            m_iLod = lod;
+            break;
+        }
+    }
+}
+
 void TerrainCell::GetCellDimensions(float& minWidth, float& minHeight, float& minDepth,
     float& maxWidth, float& maxHeight, float& maxDepth)
 {
@@ -91,58 +184,74 @@ void TerrainCell::GetCellDimensions(float& minWidth, float& minHeight, float& mi
 }
 
 bool TerrainCell::InitializeBuffers(ID3D11Device* device, int nodeIndexX, int nodeIndexY,
-    int cellWidth, int cellHeight, int terrainWidth, ModelType* terrainModel)
+    int cellWidth, int cellHeight, int terrainWidth, DirectX::VertexPositionNormalColorDualTexture const* terrainVertices)
 {
     DirectX::VertexPositionNormalColorDualTexture* vertices;
-    unsigned int* indices;
     int i, j, modelIndex, index;
-    HRESULT result;
 
-    // Calculate the number of vertices in this terrain cell.
-    m_iVertexCount = (cellHeight - 1) * (cellWidth - 1) * 6;
+    // Calculate the number of vertices in this terrain cell, one for every height map sample it covers.
+    m_iVertexCount = cellHeight * cellWidth;
 
-    // Set the index count to the same as the vertex count.
-    m_iIndexCount = m_iVertexCount;
+    // Calculate the number of indices, two triangles for every quad of the cell.
+    m_iIndexCount = (cellHeight - 1) * (cellWidth - 1) * 6;
 
     // Create the vertex array.
     vertices = new DirectX::VertexPositionNormalColorDualTexture[m_iVertexCount];
     if (!vertices)
         return false;
 
-    // Create the index array.
-    indices = new unsigned int[m_iIndexCount];
-    if (!indices)
+    // Create the index array, it is kept around for the height queries.
+    pIndexList = new unsigned int[m_iIndexCount];
+    if (!pIndexList)
         return false;
 
-    // Setup the indexes into the terrain model data and the local vertex/index array.
-    modelIndex = ((nodeIndexX * (cellWidth - 1)) + (nodeIndexY * (cellHeight - 1) * (terrainWidth - 1))) * 6;
+    // Remember where the cell is in the height map for the height edits.
+    m_iFirstColumn = nodeIndexX * (cellWidth - 1);
+    m_iFirstRow = nodeIndexY * (cellHeight - 1);
+    m_iCellWidth = cellWidth;
+    m_iCellHeight = cellHeight;
+
+    // Setup the index of the bottom left sample of this cell in the terrain vertices.
+    modelIndex = (nodeIndexX * (cellWidth - 1)) + (nodeIndexY * (cellHeight - 1) * terrainWidth);
 
     index = 0;
 
-    // Load the vertex array and index array width data.
-    for (j = 0; j < (cellHeight - 1); ++j)
+    // Load the vertex array with the samples of this cell.
+    for (j = 0; j < cellHeight; ++j)
     {
-        for (i = 0; i < ((cellWidth - 1) * 6); ++i)
+        for (i = 0; i < cellWidth; ++i)
         {
-            vertices[index].position = DirectX::XMFLOAT3(terrainModel[modelIndex].x, terrainModel[modelIndex].y, terrainModel[modelIndex].z);
-            //vertices[index].texture = DirectX::XMFLOAT2(terrainModel[modelIndex].tu, terrainModel[modelIndex].tv);
-            vertices[index].normal = DirectX::XMFLOAT3(terrainModel[modelIndex].nx, terrainModel[modelIndex].ny, terrainModel[modelIndex].nz);
-            //vertices[index].tangent = DirectX::XMFLOAT3(terrainModel[modelIndex].tx, terrainModel[modelIndex].ty, terrainModel[modelIndex].tz);
-            //vertices[index].binormal = DirectX::XMFLOAT3(terrainModel[modelIndex].bx, terrainModel[modelIndex].by, terrainModel[modelIndex].bz);
-            //vertices[index].color = DirectX::XMFLOAT3(terrainModel[modelIndex].b, terrainModel[modelIndex].g, terrainModel[modelIndex].b);
-            //vertices[index].texture2 = DirectX::XMFLOAT2(terrainModel[modelIndex].tu2, terrainModel[modelIndex].tv2);
-            vertices[index].textureCoordinate0 = DirectX::XMFLOAT2(terrainModel[modelIndex].u, terrainModel[modelIndex].v);
-            vertices[index].textureCoordinate1 = DirectX::XMFLOAT2(terrainModel[modelIndex].u1, terrainModel[modelIndex].v1);
-            indices[index] = index;
+            vertices[index] = terrainVertices[modelIndex];
             modelIndex++;
             index++;
         }
-        modelIndex += (terrainWidth * 6) - (cellWidth * 6);
+        modelIndex += terrainWidth - cellWidth;
     }
 
-    // Create the vertex and index buffers.
+    index = 0;
+
+    // Load the index array with the same triangle layout the terrain uses.
+    for (j = 0; j < (cellHeight - 1); ++j)
+    {
+        for (i = 0; i < (cellWidth - 1); ++i)
+        {
+            unsigned int const upperLeft = (cellWidth * (j + 1)) + i;
+            unsigned int const upperRight = (cellWidth * (j + 1)) + (i + 1);
+            unsigned int const bottomLeft = (cellWidth * j) + i;
+            unsigned int const bottomRight = (cellWidth * j) + (i + 1);
+
+            pIndexList[index++] = upperLeft;
+            pIndexList[index++] = upperRight;
+            pIndexList[index++] = bottomLeft;
+
+            pIndexList[index++] = bottomLeft;
+            pIndexList[index++] = upperRight;
+            pIndexList[index++] = bottomRight;
+        }
+    }
+
+    // Create the vertex buffer, the index buffers of every level of detail are created after the cell dimensions.
     pVertexBuffer.Create(device, vertices, m_iVertexCount);
-    pIndexBuffer.Create(device, indices, m_iIndexCount);
 
     // Create a public vertex array that will be used for accessing vertex information about this cell.
     pVertexList = new VectorType[m_iVertexCount];
@@ -160,9 +269,6 @@ bool TerrainCell::InitializeBuffers(ID3D11Device* device, int nodeIndexX, int no
     delete[] vertices;
     vertices = nullptr;
 
-    delete[] indices;
-    indices = nullptr;
-
     return true;
 }
 
@@ -173,6 +279,12 @@ void TerrainCell::ShutdownBuffers()
         delete[] pVertexList;
         pVertexList = nullptr;
     }
+
+    if (pIndexList)
+    {
+        delete[] pIndexList;
+        pIndexList = nullptr;
+    }
 }
 
 void TerrainCell::RenderBuffers(ID3D11DeviceContext* deviceContext)
@@ -180,7 +292,7 @@ void TerrainCell::RenderBuffers(ID3D11DeviceContext* deviceContext)
     unsigned int offset = 0;
 
     deviceContext->IASetVertexBuffers(0, 1, pVertexBuffer.GetAddressOf(), pVertexBuffer.StridePtr(), &offset);
-    deviceContext->IASetIndexBuffer(pIndexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+    deviceContext->IASetIndexBuffer(pLodIndexBuffers[m_iLod].Get(), DXGI_FORMAT_R32_UINT, 0);
     deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 }
 
@@ -231,89 +343,191 @@ void TerrainCell::CalculateCellDimensions()
     m_fPositionZ = (m_fMaxDepth - m_fMinDepth) + m_fMinDepth;
 }
 
-bool TerrainCell::BuildLineBuffers(ID3D11Device* device)
+bool TerrainCell::BuildLodBuffers(ID3D11Device* device, int cellWidth, int cellHeight)
 {
-    std::vector<ColorVertexType> vertices;
     std::vector<unsigned int> indices;
+    int lod, stride;
 
-    HRESULT result;
-    DirectX::XMFLOAT4 lineColor = DirectX::XMFLOAT4(1.0f, 0.5f, 0.0f, 1.0f);
+    // Level 0 is the full resolution index list.
+    pLodIndexBuffers[0].Create(device, pIndexList, m_iIndexCount);
+    m_lodIndexCount[0] = m_iIndexCount;
+    m_lodError[0] = 0.0f;
+    m_iLodCount = 1;
 
-    int index = 0, vertexCount = 24, indexCount = vertexCount;
+    // Add the coarser levels as long as the stride fits the cell.
+    for (lod = 1; lod < LOD_COUNT; ++lod)
+    {
+        stride = 1 << lod;
+        if (((cellWidth - 1) % stride) != 0 || ((cellHeight - 1) % stride) != 0)
+            break;
 
-    // 8 Horizontal lines.
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMinHeight, m_fMinDepth), lineColor });
+        BuildLodIndices(cellWidth, cellHeight, stride, indices);
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMinHeight, m_fMinDepth), lineColor });
+        pLodIndexBuffers[lod].Create(device, indices.data(), static_cast<uint32>(indices.size()));
+        m_lodIndexCount[lod] = static_cast<int>(indices.size());
+        m_lodError[lod] = std::max(CalculateLodError(cellWidth, cellHeight, stride), m_lodError[lod - 1]);
+        m_iLodCount++;
+    }
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMinHeight, m_fMaxDepth), lineColor });
+    return true;
+}
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMinHeight, m_fMaxDepth), lineColor });
+void TerrainCell::BuildLodIndices(int cellWidth, int cellHeight, int stride, std::vector<unsigned int>& indices)
+{
+    int i, j;
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMinHeight, m_fMinDepth), lineColor });
+    indices.clear();
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMinHeight, m_fMaxDepth), lineColor });
+    // The quads on the border of the cell keep every sample along the border, so they always match the neighbour
+    // cell whatever its level is.
+    for (j = 0; j < (cellHeight - 1); j += stride)
+    {
+        for (i = 0; i < (cellWidth - 1); i += stride)
+            AddLodBlock(cellWidth, i, j, stride, i == 0, (i + stride) == (cellWidth - 1), j == 0, (j + stride) == (cellHeight - 1), indices);
+    }
+}
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMinHeight, m_fMinDepth), lineColor });
+void TerrainCell::AddLodBlock(int gridWidth, int column, int row, int stride, bool fullLeft, bool fullRight, bool fullBottom, bool fullTop,
+    std::vector<unsigned int>& indices)
+{
+    std::vector<unsigned int> ring;
+    int k, step;
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMinHeight, m_fMaxDepth), lineColor });
+    unsigned int const upperLeft = (gridWidth * (row + stride)) + column;
+    unsigned int const upperRight = (gridWidth * (row + stride)) + (column + stride);
+    unsigned int const bottomLeft = (gridWidth * row) + column;
+    unsigned int const bottomRight = (gridWidth * row) + (column + stride);
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMaxHeight, m_fMinDepth), lineColor });
+    // Inner blocks use two triangles with the same layout as the full resolution quads.
+    if (stride == 1 || !(fullLeft || fullRight || fullBottom || fullTop))
+    {
+        indices.push_back(upperLeft);
+        indices.push_back(upperRight);
+        indices.push_back(bottomLeft);
+
+        indices.push_back(bottomLeft);
+        indices.push_back(upperRight);
+        indices.push_back(bottomRight);
+        return;
+    }
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMaxHeight, m_fMinDepth), lineColor });
+    // Walk around the block in the same direction as the triangles above, with single steps along the full sides.
+    ring.reserve(4 * stride);
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMaxHeight, m_fMaxDepth), lineColor });
+    step = fullTop ? 1 : stride;
+    for (k = 0; k < stride; k += step)
+        ring.push_back((gridWidth * (row + stride)) + (column + k));
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMaxHeight, m_fMaxDepth), lineColor });
+    step = fullRight ? 1 : stride;
+    for (k = stride; k > 0; k -= step)
+        ring.push_back((gridWidth * (row + k)) + (column + stride));
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMaxHeight, m_fMinDepth), lineColor });
+    step = fullBottom ? 1 : stride;
+    for (k = stride; k > 0; k -= step)
+        ring.push_back((gridWidth * row) + (column + k));
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMaxHeight, m_fMaxDepth), lineColor });
+    step = fullLeft ? 1 : stride;
+    for (k = 0; k < stride; k += step)
+        ring.push_back((gridWidth * (row + k)) + column);
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMaxHeight, m_fMinDepth), lineColor });
+    // Fan the ring from the sample in the middle of the block.
+    unsigned int const center = (gridWidth * (row + (stride / 2))) + (column + (stride / 2));
+    for (k = 0; k < static_cast<int>(ring.size()); ++k)
+    {
+        indices.push_back(center);
+        indices.push_back(ring[k]);
+        indices.push_back(ring[(k + 1) % ring.size()]);
+    }
+}
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMaxHeight, m_fMaxDepth), lineColor });
+void TerrainCell::GetBorderEdges(int cellWidth, int cellHeight, std::vector<unsigned int> const& indices, CellSide side,
+    std::vector<std::pair<int, int>>& edges)
+{
+    // Returns the position of a sample along the side, or -1 when the sample isn't on that side.
+    auto sidePosition = [&](unsigned int index)
+    {
+        int const column = static_cast<int>(index) % cellWidth;
+        int const row = static_cast<int>(index) / cellWidth;
 
-    // 4 Verticle lines.
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMaxHeight, m_fMaxDepth), lineColor });
+        switch (side)
+        {
+            case CellSide::LEFT:
+                return column == 0 ? row : -1;
+            case CellSide::RIGHT:
+                return column == cellWidth - 1 ? row : -1;
+            case CellSide::BOTTOM:
+                return row == 0 ? column : -1;
+            default:
+                return row == cellHeight - 1 ? column : -1;
+        }
+    };
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMinHeight, m_fMaxDepth), lineColor });
+    edges.clear();
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMaxHeight, m_fMaxDepth), lineColor });
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            int const first = sidePosition(indices[i + k]);
+            int const second = sidePosition(indices[i + ((k + 1) % 3)]);
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMinHeight, m_fMaxDepth), lineColor });
+            if (first >= 0 && second >= 0)
+                edges.emplace_back(std::min(first, second), std::max(first, second));
+        }
+    }
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMaxHeight, m_fMinDepth), lineColor });
+    std::sort(edges.begin(), edges.end());
+}
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMinHeight, m_fMinDepth), lineColor });
+float TerrainCell::CalculateLodError(int cellWidth, int cellHeight, int stride)
+{
+    int i, j, x, z;
+    float fx, fz, h00, h10, h01, h11, interpolated, error;
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMaxHeight, m_fMinDepth), lineColor });
+    error = 0.0f;
 
-    indices.push_back(static_cast<int>(vertices.size()));
-    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMinHeight, m_fMinDepth), lineColor });
+    // Compare the height of every sample with the height of the coarse quad it is covered by.
+    for (j = 0; j < (cellHeight - 1); j += stride)
+    {
+        for (i = 0; i < (cellWidth - 1); i += stride)
+        {
+            h00 = pVertexList[(cellWidth * j) + i].y;
+            h10 = pVertexList[(cellWidth * j) + (i + stride)].y;
+            h01 = pVertexList[(cellWidth * (j + stride)) + i].y;
+            h11 = pVertexList[(cellWidth * (j + stride)) + (i + stride)].y;
+
+            for (z = 0; z <= stride; ++z)
+            {
+                for (x = 0; x <= stride; ++x)
+                {
+                    fx = static_cast<float>(x) / static_cast<float>(stride);
+                    fz = static_cast<float>(z) / static_cast<float>(stride);
+
+                    // The quad is split from the bottom left to the upper right corner.
+                    if (fz >= fx)
+                        interpolated = h00 + (fx * (h11 - h01)) + (fz * (h01 - h00));
+                    else
+                        interpolated = h00 + (fx * (h10 - h00)) + (fz * (h11 - h10));
+
+                    error = std::max(error, fabsf(pVertexList[(cellWidth * (j + z)) + (i + x)].y - interpolated));
+                }
+            }
+        }
+    }
+
+    return error;
+}
+
+bool TerrainCell::BuildLineBuffers(ID3D11Device* device)
+{
+    std::vector<ColorVertexType> vertices;
+    std::vector<unsigned int> indices;
+
+    BuildLineVertices(vertices);
+
+    // Every line has its own two vertices.
+    for (unsigned int i = 0; i < vertices.size(); ++i)
+        indices.push_back(i);
 
     pLineVertexBuffer.Create(device, &vertices[0], static_cast<uint32>(vertices.size()));
     pLineIndexBuffer.Create(device, &indices[0], static_cast<uint32>(indices.size()));
@@ -323,6 +537,41 @@ bool TerrainCell::BuildLineBuffers(ID3D11Device* device)
     return true;
 }
 
+void TerrainCell::BuildLineVertices(std::vector<ColorVertexType>& vertices) const
+{
+    DirectX::XMFLOAT4 lineColor = DirectX::XMFLOAT4(1.0f, 0.5f, 0.0f, 1.0f);
+
+    vertices.clear();
+
+    // 8 Horizontal lines.
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMinHeight, m_fMinDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMinHeight, m_fMinDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMinHeight, m_fMaxDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMinHeight, m_fMaxDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMinHeight, m_fMinDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMinHeight, m_fMaxDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMinHeight, m_fMinDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMinHeight, m_fMaxDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMaxHeight, m_fMinDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMaxHeight, m_fMinDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMaxHeight, m_fMaxDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMaxHeight, m_fMaxDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMaxHeight, m_fMinDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMaxHeight, m_fMaxDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMaxHeight, m_fMinDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMaxHeight, m_fMaxDepth), lineColor });
+
+    // 4 Verticle lines.
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMaxHeight, m_fMaxDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMinHeight, m_fMaxDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMaxHeight, m_fMaxDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMinHeight, m_fMaxDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMaxHeight, m_fMinDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMaxWidth, m_fMinHeight, m_fMinDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMaxHeight, m_fMinDepth), lineColor });
+    vertices.push_back(ColorVertexType{ DirectX::XMFLOAT3(m_fMinWidth, m_fMinHeight, m_fMinDepth), lineColor });
+}
+
 void TerrainCell::ShutdownLineBuffers()
 {
 }
@@ -6,30 +6,6 @@
 
 class TerrainCell
 {
-    struct ModelType
-    {
-        float x, y, z;
-        //float tu, tv;
-        float nx, ny, nz;
-        //float tx, ty, tz;
-        //float bx, by, bz;
-        //float r, g, b;
-        //float tu2, tv2;
-        float u, v;
-        float u1, v1;
-    };
-
-    //struct VertexType
-    //{
-    //    DirectX::XMFLOAT3 position;
-    //    DirectX::XMFLOAT3 normal;
-    //    //DirectX::XMFLOAT3 tangent;
-    //    //DirectX::XMFLOAT3 binormal;
-    //    //DirectX::XMFLOAT3 color;
-    //    DirectX::XMFLOAT2 texture;
-    //    DirectX::XMFLOAT2 texture2;
-    //};
-
     struct VectorType
     {
         float x, y, z;
@@ -46,7 +22,7 @@ class TerrainCell
         TerrainCell(TerrainCell const&) = default;
         ~TerrainCell();
 
-        bool Initialize(ID3D11Device* device, void* terrainModelPtr, int nodeIndexX,
+        bool Initialize(ID3D11Device* device, DirectX::VertexPositionNormalColorDualTexture const* terrainVertices, int nodeIndexX,
             int nodeIndexY, int cellWidth, int cellHeight, int terrainWidth);
 
         void Shutdown();
@@ -56,29 +32,68 @@ class TerrainCell
 
         int GetVertexCount();
         int GetIndexCount();
+        int GetLodIndexCount();
         int GetLineBuffersIndexCount();
 
+        // Copies the changed terrain vertices that are inside this cell into its vertex buffer.
+        void UpdateVertices(ID3D11DeviceContext* deviceContext, DirectX::VertexPositionNormalColorDualTexture const* terrainVertices, int terrainWidth,
+            int minColumn, int minRow, int maxColumn, int maxRow);
+
+        void SelectLod(DirectX::XMFLOAT3 const& cameraPosition, float lodScale, float maxPixelError);
+        int GetLod() const { return m_iLod; }
+
+        enum class CellSide
+        {
+            LEFT,
+            RIGHT,
+            BOTTOM,
+            TOP
+        };
+
+        static void BuildLodIndices(int cellWidth, int cellHeight, int stride, std::vector<unsigned int>& indices);
+
+        // Adds the triangles of a block of stride by stride quads of a grid with gridWidth samples per row. The full sides
+        // keep every sample so they match a neighbour at any level, the other sides are a single edge.
+        static void AddLodBlock(int gridWidth, int column, int row, int stride, bool fullLeft, bool fullRight, bool fullBottom, bool fullTop,
+            std::vector<unsigned int>& indices);
+
+        // Collects the triangle edges of an index list that lie on one side of the cell, as pairs of sample positions along
+        // that side sorted from the first sample. Two neighbour cells are watertight when their shared sides have the same edges.
+        static void GetBorderEdges(int cellWidth, int cellHeight, std::vector<unsigned int> const& indices, CellSide side,
+            std::vector<std::pair<int, int>>& edges);
+
         void GetCellDimensions(float& minWidth, float& minHeight, float& minDepth,
             float& maxWidth, float& maxHeight, float& maxDepth);
 
     private:
         bool InitializeBuffers(ID3D11Device* device, int nodeIndexX, int nodeIndexY,
-            int cellWidth, int cellHeight, int terrainWidth, ModelType* terrainModel);
+            int cellWidth, int cellHeight, int terrainWidth, DirectX::VertexPositionNormalColorDualTexture const* terrainVertices);
 
         void ShutdownBuffers();
         void RenderBuffers(ID3D11DeviceContext* deviceContext);
         void CalculateCellDimensions();
+        bool BuildLodBuffers(ID3D11Device* device, int cellWidth, int cellHeight);
+        float CalculateLodError(int cellWidth, int cellHeight, int stride);
         bool BuildLineBuffers(ID3D11Device* device);
+        void BuildLineVertices(std::vector<ColorVertexType>& vertices) const;
         void ShutdownLineBuffers();
 
     public:
         VectorType* pVertexList = nullptr;
+        unsigned int* pIndexList = nullptr;
 
     private:
+        // Level of detail 0 is the full cell, every next level skips twice as many samples.
+        static constexpr int const LOD_COUNT = 4;
+
         int m_iVertexCount, m_iIndexCount, m_iLineIndexCount;
+        int m_iFirstColumn, m_iFirstRow, m_iCellWidth, m_iCellHeight;
+        int m_iLod, m_iLodCount;
+        int m_lodIndexCount[LOD_COUNT];
+        float m_lodError[LOD_COUNT];
 
         DX::VertexBuffer<DirectX::VertexPositionNormalColorDualTexture> pVertexBuffer;
-        DX::IndexBuffer<unsigned int> pIndexBuffer;
+        DX::IndexBuffer<unsigned int> pLodIndexBuffers[LOD_COUNT];
         DX::VertexBuffer<ColorVertexType> pLineVertexBuffer;
         DX::IndexBuffer<unsigned int> pLineIndexBuffer;
 
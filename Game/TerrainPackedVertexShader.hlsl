@@ -0,0 +1,62 @@
+#include "Transform.hlsl"
+
+cbuffer PackingBuffer : register(b1)
+{
+    float heightScale;
+    float textureIncrement;
+    float2 alphaIncrement;
+    float2 maxAlphaIndex;
+    float depthOffset;
+    float padding;
+};
+
+struct VertexInputType
+{
+    uint4 position : POSITION;
+    float2 normal : NORMAL;
+};
+
+struct PixelInputType
+{
+    float4 position : SV_POSITION;
+    float3 normal : NORMAL;
+    float4 color : COLOR;
+    float2 tex : TEXCOORD0;
+    float2 tex1 : TEXCOORD1;
+};
+
+// Octahedral decoding, this has to match TerrainVertexPacker::DecodeNormal.
+float3 DecodeNormal(float2 encoded)
+{
+    float3 normal = float3(encoded.x, encoded.y, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float fold = saturate(-normal.z);
+    normal.xy += (normal.xy >= 0.0f) ? -fold : fold;
+
+    return normalize(normal);
+}
+
+PixelInputType TerrainPackedVertexShader(VertexInputType input)
+{
+    PixelInputType output;
+
+    // Rebuild the position from the grid index and the height, the rows of the height map run against the z axis.
+    float2 grid = float2(input.position.xy);
+    float4 position = float4(grid.x, float(input.position.z) / heightScale, depthOffset - grid.y, 1.0f);
+
+    // Calculate the position of the vertex against the world, view, and projection matrices.
+    output.position = mul(position, worldMatrix);
+    output.position = mul(output.position, viewMatrix);
+    output.position = mul(output.position, projectionMatrix);
+
+    // Terrain vertices are always white.
+    output.color = float4(1.0f, 1.0f, 1.0f, 1.0f);
+
+    // Derive the texture coordinates from the grid index.
+    output.tex = float2(textureIncrement * grid.x, 1.0f - textureIncrement * grid.y);
+    output.tex1 = alphaIncrement * min(grid, maxAlphaIndex);
+
+    // Calculate the normal vector against the world matrix only.
+    output.normal = normalize(mul(DecodeNormal(input.normal), (float3x3)worldMatrix));
+
+    return output;
+}
\ No newline at end of file
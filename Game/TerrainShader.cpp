@@ -9,6 +9,7 @@
 namespace TerrainShaders
 {
 #include "TerrainVertexShader.shh"
+#include "TerrainPackedVertexShader.shh"
 #include "TerrainPixelShader.shh"
 }
 
@@ -20,16 +21,24 @@ TerrainShader::~TerrainShader()
 {
 }
 
-void TerrainShader::InitializeShaders(ID3D11DeviceContext* deviceContext)
+void TerrainShader::InitializeShaders(ID3D11DeviceContext* deviceContext, VertexFormat vertexFormat)
 {
     // Helper to get device.
     ID3D11Device* device = DX::GetDevice(deviceContext);
 
+    if (vertexFormat == VertexFormat::PACKED)
+    {
+        DX::ThrowIfFailed(device->CreateVertexShader(TerrainShaders::TerrainPackedVertexShaderBytecode, sizeof(TerrainShaders::TerrainPackedVertexShaderBytecode), nullptr, vertexShader.GetAddressOf()));
+        DX::ThrowIfFailed(device->CreateInputLayout(DirectX::VertexTerrainPacked::InputElements, DirectX::VertexTerrainPacked::InputElementCount, TerrainShaders::TerrainPackedVertexShaderBytecode, sizeof(TerrainShaders::TerrainPackedVertexShaderBytecode), inputLayout.GetAddressOf()));
+        packingBuffer.Create(device);
+    }
+    else
+    {
+        DX::ThrowIfFailed(device->CreateVertexShader(TerrainShaders::TerrainVertexShaderBytecode, sizeof(TerrainShaders::TerrainVertexShaderBytecode), nullptr, vertexShader.GetAddressOf()));
+        DX::ThrowIfFailed(device->CreateInputLayout(DirectX::VertexPositionNormalColorDualTexture::InputElements, DirectX::VertexPositionNormalColorDualTexture::InputElementCount, TerrainShaders::TerrainVertexShaderBytecode, sizeof(TerrainShaders::TerrainVertexShaderBytecode), inputLayout.GetAddressOf()));
+    }
 
-
-    DX::ThrowIfFailed(device->CreateVertexShader(TerrainShaders::TerrainVertexShaderBytecode, sizeof(TerrainShaders::TerrainVertexShaderBytecode), nullptr, vertexShader.GetAddressOf()));
     DX::ThrowIfFailed(device->CreatePixelShader(TerrainShaders::TerrainPixelShaderBytecode, sizeof(TerrainShaders::TerrainPixelShaderBytecode), nullptr, pixelShader.GetAddressOf()));
-    DX::ThrowIfFailed(device->CreateInputLayout(DirectX::VertexPositionNormalColorDualTexture::InputElements, DirectX::VertexPositionNormalColorDualTexture::InputElementCount, TerrainShaders::TerrainVertexShaderBytecode, sizeof(TerrainShaders::TerrainVertexShaderBytecode), inputLayout.GetAddressOf()));
 
     states = std::make_unique<DirectX::CommonStates>(device);
 
@@ -69,19 +78,53 @@ void TerrainShader::SetShaderParameters(ID3D11DeviceContext* deviceContext, Dire
     deviceContext->PSSetShaderResources(4, 1, texture4.GetAddressOf());
 }
 
+void TerrainShader::SetPackingParameters(ID3D11DeviceContext* deviceContext, TerrainVertexPacker::Parameters const& parameters)
+{
+    // This has to match TerrainVertexPacker::Unpack.
+    PackingBufferType packing;
+    packing.heightScale = parameters.heightScale;
+    packing.textureIncrement = static_cast<float>(parameters.textureRepeat) / static_cast<float>(parameters.terrainWidth);
+    packing.alphaIncrement = DirectX::XMFLOAT2(1.0f / parameters.terrainWidth, 1.0f / parameters.terrainHeight);
+    packing.maxAlphaIndex = DirectX::XMFLOAT2(static_cast<float>(parameters.terrainWidth - 2), static_cast<float>(parameters.terrainHeight - 2));
+    packing.depthOffset = static_cast<float>(parameters.terrainHeight - 1);
+    packing.padding = 0.0f;
+    packingBuffer.SetData(deviceContext, packing);
+
+    deviceContext->VSSetConstantBuffers(1, 1, packingBuffer.GetAddressOf());
+}
+
 void TerrainShader::RenderShader(ID3D11DeviceContext* deviceContext, int numIndices)
 {
+    SetRenderState(deviceContext);
+
+    deviceContext->DrawIndexed(numIndices, 0, 0);
+}
+
+int TerrainShader::SetRenderState(ID3D11DeviceContext* deviceContext)
+{
+    int bindCount = 0;
+
     deviceContext->IASetInputLayout(inputLayout.Get());
+    bindCount++;
+
     deviceContext->VSSetShader(vertexShader.Get(), nullptr, 0);
+    bindCount++;
+
     deviceContext->PSSetShader(pixelShader.Get(), nullptr, 0);
+    bindCount++;
 
-    ID3D11SamplerState* samplerState = states->AnisotropicClamp();
+    // Terrain texture coordinates run past 1.0 and rely on wrapping to tile the textures.
+    ID3D11SamplerState* samplerState = states->AnisotropicWrap();
 
     deviceContext->PSSetSamplers(0, 1, &samplerState);
+    bindCount++;
+
     deviceContext->PSSetSamplers(1, 1, &samplerState);
+    bindCount++;
 
     ID3D11RasterizerState* raster = states->CullClockwise();
     deviceContext->RSSetState(raster);
+    bindCount++;
 
-    deviceContext->DrawIndexed(numIndices, 0, 0);
+    return bindCount;
 }
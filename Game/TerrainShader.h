@@ -5,10 +5,17 @@
 #pragma once
 
 #include "ConstantBuffer.h"
+#include "TerrainVertexPacker.h"
 
 class TerrainShader
 {
     public:
+        enum class VertexFormat
+        {
+            FULL,
+            PACKED
+        };
+
         struct MatrixBufferType
         {
             DirectX::XMMATRIX world;
@@ -24,13 +31,29 @@ class TerrainShader
             float padding;
         };
 
+        // Values the vertex shader of the packed format needs to rebuild the vertices.
+        struct PackingBufferType
+        {
+            float heightScale;
+            float textureIncrement;
+            DirectX::XMFLOAT2 alphaIncrement;
+            DirectX::XMFLOAT2 maxAlphaIndex;
+            float depthOffset;
+            float padding;
+        };
+
         TerrainShader();
         ~TerrainShader();
 
-        void InitializeShaders(ID3D11DeviceContext* deviceContext);
+        void InitializeShaders(ID3D11DeviceContext* deviceContext, VertexFormat vertexFormat = VertexFormat::FULL);
         void SetShaderParameters(ID3D11DeviceContext* deviceContext, DirectX::XMMATRIX worldMatrix, DirectX::XMMATRIX viewMatrix, DirectX::XMMATRIX projectionMatrix);
+        void SetPackingParameters(ID3D11DeviceContext* deviceContext, TerrainVertexPacker::Parameters const& parameters);
         void RenderShader(ID3D11DeviceContext* deviceContext, int numIndices);
 
+        // Binds the shaders and states of RenderShader without drawing, for callers that issue several draws in a row.
+        // Returns the number of state calls it made on the device context.
+        int SetRenderState(ID3D11DeviceContext* deviceContext);
+
     private:
         std::unique_ptr<DirectX::CommonStates> states;
         Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture0;
@@ -43,4 +66,5 @@ class TerrainShader
         Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout;
         DX::ConstantBuffer<MatrixBufferType> constantBuffer;
         DX::ConstantBuffer<LightBufferType> lightBuffer;
+        DX::ConstantBuffer<PackingBufferType> packingBuffer;
 };
\ No newline at end of file
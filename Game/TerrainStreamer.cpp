@@ -0,0 +1,513 @@
+//
+// TerrainStreamer.cpp
+//
+
+#include "pch.h"
+#include "TerrainStreamer.h"
+
+namespace
+{
+    // World units covered by one repeat of the detail textures, the same as 16 repeats over the 512 terrain.
+    constexpr float TEXTURE_TILE_SIZE = 32.0f;
+
+    // Tiles that were loaded are only evicted once they are this much further away than the load radius.
+    constexpr float EVICT_HYSTERESIS = 1.25f;
+
+    uint32 GetTileSampleCount(TerrainStreamer::FileHeader const& header)
+    {
+        return (header.tileSize + 3) * (header.tileSize + 3);
+    }
+}
+
+TerrainStreamer::TerrainStreamer()
+    : m_header()
+    , m_requests(QUEUE_CAPACITY)
+    , m_completed(QUEUE_CAPACITY)
+    , m_stop(false)
+    , m_memoryBudget(0)
+    , m_residentMemory(0)
+    , m_pendingMemory(0)
+    , m_indexMemory(0)
+    , m_loadRadius(0.0f)
+    , m_residentCount(0)
+    , m_pendingCount(0)
+    , m_failedCount(0)
+    , m_drawCount(0)
+    , m_pageInTime(0.0f)
+    , m_maxPageInTime(0.0f)
+    , m_pageInCount(0)
+{
+}
+
+TerrainStreamer::~TerrainStreamer()
+{
+    Shutdown();
+}
+
+bool TerrainStreamer::ConvertRawHeightMap(char const* rawFileName, int width, int height, float heightScale, int tileSize, char const* tileFileName)
+{
+    if (width < 2 || height < 2 || tileSize < 1 || tileSize > 0xFFFF - 3)
+        return false;
+
+    std::ifstream input(rawFileName, std::ios::binary);
+    if (!input.is_open())
+        return false;
+
+    // The conversion is an offline step so the whole source height map is read at once.
+    std::vector<uint16> rawHeights(static_cast<size_t>(width) * height);
+    input.read(reinterpret_cast<char*>(rawHeights.data()), rawHeights.size() * sizeof(uint16));
+    if (!input)
+        return false;
+
+    FileHeader header;
+    header.magic = FILE_MAGIC;
+    header.version = FILE_VERSION;
+    header.width = width;
+    header.height = height;
+    header.tileSize = tileSize;
+    header.tilesX = (width - 2) / tileSize + 1;
+    header.tilesZ = (height - 2) / tileSize + 1;
+    header.heightScale = heightScale;
+
+    std::ofstream output(tileFileName, std::ios::binary);
+    if (!output.is_open())
+        return false;
+
+    output.write(reinterpret_cast<char const*>(&header), sizeof(header));
+
+    int const stride = tileSize + 3;
+    std::vector<uint16> samples(GetTileSampleCount(header));
+
+    for (uint32 tz = 0; tz < header.tilesZ; ++tz)
+    {
+        for (uint32 tx = 0; tx < header.tilesX; ++tx)
+        {
+            // Copy the samples of the tile and its border, samples outside of the height map repeat the edge.
+            for (int b = 0; b < stride; ++b)
+            {
+                int const j = std::clamp(static_cast<int>(tz) * tileSize + b - 1, 0, height - 1);
+
+                for (int a = 0; a < stride; ++a)
+                {
+                    int const i = std::clamp(static_cast<int>(tx) * tileSize + a - 1, 0, width - 1);
+                    samples[b * stride + a] = rawHeights[static_cast<size_t>(j) * width + i];
+                }
+            }
+
+            output.write(reinterpret_cast<char const*>(samples.data()), samples.size() * sizeof(uint16));
+        }
+    }
+
+    return output.good();
+}
+
+bool TerrainStreamer::Initialize(char const* fileName, size_t memoryBudget, float loadRadius, ID3D11DeviceContext* deviceContext)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    // Only the header is read here, the tiles are read by the I/O thread when they are needed.
+    file.read(reinterpret_cast<char*>(&m_header), sizeof(m_header));
+    if (!file || m_header.magic != FILE_MAGIC || m_header.version != FILE_VERSION)
+        return false;
+
+    m_fileName = fileName;
+    m_memoryBudget = memoryBudget;
+    m_loadRadius = loadRadius;
+
+    // Create the tiles, the bounds on the height axis are known once the tile has been loaded.
+    uint32 const tileSize = m_header.tileSize;
+    m_tiles.resize(m_header.tilesX * m_header.tilesZ);
+
+    for (uint32 tz = 0; tz < m_header.tilesZ; ++tz)
+    {
+        for (uint32 tx = 0; tx < m_header.tilesX; ++tx)
+        {
+            Tile& tile = m_tiles[tz * m_header.tilesX + tx];
+
+            tile.state = TileState::UNLOADED;
+            tile.quadsX = static_cast<int>(std::min(tileSize, m_header.width - 1 - tx * tileSize));
+            tile.quadsZ = static_cast<int>(std::min(tileSize, m_header.height - 1 - tz * tileSize));
+
+            // The rows of the height map run against the z axis, the same as in Terrain.
+            tile.minX = static_cast<float>(tx * tileSize);
+            tile.maxX = tile.minX + static_cast<float>(tile.quadsX);
+            tile.maxZ = static_cast<float>(m_header.height - 1 - tz * tileSize);
+            tile.minZ = tile.maxZ - static_cast<float>(tile.quadsZ);
+            tile.minY = 0.0f;
+            tile.maxY = 0.0f;
+
+            tile.memorySize = sizeof(DirectX::VertexPositionNormalColorDualTexture) * (tile.quadsX + 1) * (tile.quadsZ + 1);
+            tile.indexBuffer = nullptr;
+        }
+    }
+
+    shader.InitializeShaders(deviceContext);
+
+    m_stop = false;
+    m_ioThread = std::thread(&TerrainStreamer::IoThreadLoop, this);
+
+    Logger::Get()->info("Terrain streamer: {}x{} samples in {}x{} tiles, budget {} MB",
+        m_header.width, m_header.height, m_header.tilesX, m_header.tilesZ, m_memoryBudget / (1024 * 1024));
+
+    return true;
+}
+
+void TerrainStreamer::Shutdown()
+{
+    if (m_ioThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_wakeMutex);
+            m_stop = true;
+        }
+
+        m_wakeCondition.notify_one();
+        m_ioThread.join();
+    }
+
+    // Drop the requests and meshes that never made it to the other thread.
+    uint32 tileIndex;
+    while (m_requests.TryPop(tileIndex))
+        ;
+
+    TileMesh* mesh;
+    while (m_completed.TryPop(mesh))
+        delete mesh;
+
+    m_tiles.clear();
+    m_indexBuffers.clear();
+    m_residentMemory = 0;
+    m_pendingMemory = 0;
+    m_indexMemory = 0;
+    m_residentCount = 0;
+    m_pendingCount = 0;
+    m_failedCount = 0;
+}
+
+void TerrainStreamer::Update(ID3D11DeviceContext* deviceContext, DirectX::XMFLOAT3 const& cameraPosition)
+{
+    ID3D11Device* device = DX::GetDevice(deviceContext);
+    if (device == nullptr)
+        return;
+
+    // Create the buffers of a few finished tiles, the rest waits in the queue so one frame doesn't stall on many uploads.
+    TileMesh* mesh;
+    for (int i = 0; i < MAX_UPLOADS_PER_FRAME && m_completed.TryPop(mesh); ++i)
+    {
+        std::unique_ptr<TileMesh> ownedMesh(mesh);
+
+        if (ownedMesh->loaded)
+            UploadTile(device, *ownedMesh);
+        else
+            DropTile(m_tiles[ownedMesh->tileIndex]);
+    }
+
+    // Evict the tiles that the camera has moved away from.
+    for (Tile& tile : m_tiles)
+    {
+        if (tile.state == TileState::RESIDENT && GetTileDistance(tile, cameraPosition) > m_loadRadius * EVICT_HYSTERESIS)
+            EvictTile(tile);
+    }
+
+    // Find the tiles within the load radius that still have to be loaded, nearest first.
+    std::vector<std::pair<float, uint32>> candidates;
+    for (uint32 i = 0; i < m_tiles.size(); ++i)
+    {
+        if (m_tiles[i].state != TileState::UNLOADED)
+            continue;
+
+        float const distance = GetTileDistance(m_tiles[i], cameraPosition);
+        if (distance <= m_loadRadius)
+            candidates.emplace_back(distance, i);
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+
+    bool requested = false;
+    for (auto const& candidate : candidates)
+    {
+        Tile& tile = m_tiles[candidate.second];
+
+        // Make room by evicting resident tiles that are further away than this one.
+        while (m_residentMemory + m_pendingMemory + m_indexMemory + tile.memorySize > m_memoryBudget)
+        {
+            Tile* farthest = nullptr;
+            float farthestDistance = candidate.first;
+
+            for (Tile& other : m_tiles)
+            {
+                if (other.state != TileState::RESIDENT)
+                    continue;
+
+                float const distance = GetTileDistance(other, cameraPosition);
+                if (distance > farthestDistance)
+                {
+                    farthest = &other;
+                    farthestDistance = distance;
+                }
+            }
+
+            if (farthest == nullptr)
+                break;
+
+            EvictTile(*farthest);
+        }
+
+        // Stop when the budget is used up by nearer tiles or the I/O thread has enough to do.
+        if (m_residentMemory + m_pendingMemory + m_indexMemory + tile.memorySize > m_memoryBudget)
+            break;
+
+        if (!m_requests.TryPush(candidate.second))
+            break;
+
+        tile.state = TileState::PENDING;
+        tile.requestTime = std::chrono::steady_clock::now();
+        m_pendingMemory += tile.memorySize;
+        ++m_pendingCount;
+        requested = true;
+    }
+
+    if (requested)
+    {
+        // Take the lock so the I/O thread can't miss the wake up between checking the queue and going to sleep.
+        {
+            std::lock_guard<std::mutex> lock(m_wakeMutex);
+        }
+
+        m_wakeCondition.notify_one();
+    }
+}
+
+void TerrainStreamer::Draw(ID3D11DeviceContext* deviceContext, Frustum* frustum, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj)
+{
+    shader.SetShaderParameters(deviceContext, world, view, proj);
+
+    // Reset the number of triangles that are drawn for this frame.
+    m_drawCount = 0;
+
+    // Set the type of primitive that should be rendered, it is the same for all tiles.
+    deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+    for (Tile& tile : m_tiles)
+    {
+        if (tile.state != TileState::RESIDENT)
+            continue;
+
+        // Skip the tiles that can't be seen.
+        if (!frustum->CheckRectangle(tile.minX, tile.minY, tile.minZ, tile.maxX, tile.maxY, tile.maxZ))
+            continue;
+
+        unsigned int offset = 0;
+
+        deviceContext->IASetVertexBuffers(0, 1, tile.vertexBuffer.GetAddressOf(), tile.vertexBuffer.StridePtr(), &offset);
+        deviceContext->IASetIndexBuffer(tile.indexBuffer->Get(), DXGI_FORMAT_R32_UINT, 0);
+
+        m_drawCount += tile.quadsX * tile.quadsZ * 2;
+
+        shader.RenderShader(deviceContext, tile.quadsX * tile.quadsZ * 6);
+    }
+}
+
+void TerrainStreamer::IoThreadLoop()
+{
+    // The file stays open for the lifetime of the thread and is only touched by it.
+    std::ifstream file(m_fileName, std::ios::binary);
+    std::vector<uint16> samples(GetTileSampleCount(m_header));
+
+    while (true)
+    {
+        uint32 tileIndex;
+        if (!m_requests.TryPop(tileIndex))
+        {
+            // Sleep until there is a new request or the streamer shuts down.
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_wakeCondition.wait(lock, [this]() { return m_stop || !m_requests.IsEmpty(); });
+
+            if (m_stop)
+                return;
+
+            continue;
+        }
+
+        std::unique_ptr<TileMesh> mesh = BuildTileMesh(file, tileIndex, samples);
+
+        // The render thread takes a few meshes per frame, wait for a free slot if it is behind.
+        while (!m_completed.TryPush(mesh.get()))
+        {
+            if (m_stop)
+                return;
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        mesh.release();
+    }
+}
+
+std::unique_ptr<TerrainStreamer::TileMesh> TerrainStreamer::BuildTileMesh(std::ifstream& file, uint32 tileIndex, std::vector<uint16>& samples) const
+{
+    auto mesh = std::make_unique<TileMesh>();
+    mesh->tileIndex = tileIndex;
+    mesh->minY = FLT_MAX;
+    mesh->maxY = -FLT_MAX;
+
+    mesh->loaded = false;
+
+    // Read the samples of the tile. A failed read still completes the request, without a mesh, so the tile isn't left pending.
+    std::streamoff const offset = sizeof(FileHeader) + static_cast<std::streamoff>(tileIndex) * samples.size() * sizeof(uint16);
+    file.clear();
+    file.seekg(offset);
+    file.read(reinterpret_cast<char*>(samples.data()), samples.size() * sizeof(uint16));
+    if (!file)
+    {
+        Logger::Get()->error("Terrain streamer: failed to read tile {} at offset {} of {}", tileIndex, offset, m_fileName);
+        return mesh;
+    }
+
+    mesh->loaded = true;
+
+    uint32 const tx = tileIndex % m_header.tilesX;
+    uint32 const tz = tileIndex / m_header.tilesX;
+    int const stride = m_header.tileSize + 3;
+    int const quadsX = static_cast<int>(std::min(m_header.tileSize, m_header.width - 1 - tx * m_header.tileSize));
+    int const quadsZ = static_cast<int>(std::min(m_header.tileSize, m_header.height - 1 - tz * m_header.tileSize));
+    float const inverseScale = 1.0f / m_header.heightScale;
+
+    auto height = [&](int a, int b)
+    {
+        return static_cast<float>(samples[b * stride + a]) * inverseScale;
+    };
+
+    mesh->vertices.resize((quadsX + 1) * (quadsZ + 1));
+
+    // The border samples start at zero so the samples of the tile itself start at one.
+    for (int b = 0; b <= quadsZ; ++b)
+    {
+        int const j = static_cast<int>(tz * m_header.tileSize) + b;
+
+        for (int a = 0; a <= quadsX; ++a)
+        {
+            int const i = static_cast<int>(tx * m_header.tileSize) + a;
+            float const y = height(a + 1, b + 1);
+
+            DirectX::VertexPositionNormalColorDualTexture& vertex = mesh->vertices[b * (quadsX + 1) + a];
+
+            vertex.position = DirectX::XMFLOAT3(static_cast<float>(i), y, static_cast<float>(m_header.height - 1 - j));
+
+            // Central differences over the neighbouring samples, oriented the same way as the normals of Terrain.
+            DirectX::XMVECTOR normal = DirectX::XMVectorSet(
+                (height(a + 2, b + 1) - height(a, b + 1)) * 0.5f,
+                -1.0f,
+                (height(a + 1, b) - height(a + 1, b + 2)) * 0.5f,
+                0.0f);
+            DirectX::XMStoreFloat3(&vertex.normal, DirectX::XMVector3Normalize(normal));
+
+            vertex.color = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+
+            // The coordinates continue across tiles so the textures line up at the seams.
+            vertex.textureCoordinate0 = DirectX::XMFLOAT2(static_cast<float>(i) / TEXTURE_TILE_SIZE, 1.0f - static_cast<float>(j) / TEXTURE_TILE_SIZE);
+            vertex.textureCoordinate1 = DirectX::XMFLOAT2(static_cast<float>(i) / m_header.width, static_cast<float>(j) / m_header.height);
+
+            mesh->minY = std::min(mesh->minY, y);
+            mesh->maxY = std::max(mesh->maxY, y);
+        }
+    }
+
+    return mesh;
+}
+
+DX::IndexBuffer<uint32>* TerrainStreamer::GetIndexBuffer(ID3D11Device* device, int quadsX, int quadsZ)
+{
+    // All full tiles share one index buffer, only the tiles at the far edges of the world need their own.
+    uint32 const key = (static_cast<uint32>(quadsX) << 16) | static_cast<uint32>(quadsZ);
+
+    auto it = m_indexBuffers.find(key);
+    if (it != m_indexBuffers.end())
+        return &it->second;
+
+    std::vector<uint32> indices;
+    indices.reserve(quadsX * quadsZ * 6);
+
+    for (int j = 0; j < quadsZ; ++j)
+    {
+        for (int i = 0; i < quadsX; ++i)
+        {
+            // Get the indexes to the four points of the quad.
+            uint32 const index1 = ((quadsX + 1) * (j + 1)) + i;       // Upper left.
+            uint32 const index2 = ((quadsX + 1) * (j + 1)) + (i + 1); // Upper right.
+            uint32 const index3 = ((quadsX + 1) * j) + i;             // Bottom left.
+            uint32 const index4 = ((quadsX + 1) * j) + (i + 1);       // Bottom right.
+
+            // Triangle 1 - Upper left, upper right, bottom left.
+            indices.push_back(index1);
+            indices.push_back(index2);
+            indices.push_back(index3);
+
+            // Triangle 2 - Bottom left, upper right, bottom right.
+            indices.push_back(index3);
+            indices.push_back(index2);
+            indices.push_back(index4);
+        }
+    }
+
+    DX::IndexBuffer<uint32>& indexBuffer = m_indexBuffers[key];
+    indexBuffer.Create(device, indices.data(), static_cast<uint32>(indices.size()));
+    m_indexMemory += indices.size() * sizeof(uint32);
+
+    return &indexBuffer;
+}
+
+void TerrainStreamer::UploadTile(ID3D11Device* device, TileMesh& mesh)
+{
+    Tile& tile = m_tiles[mesh.tileIndex];
+
+    m_pendingMemory -= tile.memorySize;
+    --m_pendingCount;
+
+    tile.vertexBuffer.Create(device, mesh.vertices.data(), static_cast<uint32>(mesh.vertices.size()));
+    tile.indexBuffer = GetIndexBuffer(device, tile.quadsX, tile.quadsZ);
+    tile.minY = mesh.minY;
+    tile.maxY = mesh.maxY;
+    tile.state = TileState::RESIDENT;
+
+    m_residentMemory += tile.memorySize;
+    ++m_residentCount;
+
+    // The latency covers the time in the request queue, the read, the mesh build and the wait for the upload.
+    float const latency = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - tile.requestTime).count();
+    m_pageInTime += latency;
+    m_maxPageInTime = std::max(m_maxPageInTime, latency);
+    ++m_pageInCount;
+}
+
+void TerrainStreamer::DropTile(Tile& tile)
+{
+    // The tile couldn't be read, it is never requested again so a broken file doesn't keep the I/O thread busy.
+    tile.state = TileState::FAILED;
+
+    m_pendingMemory -= tile.memorySize;
+    --m_pendingCount;
+    ++m_failedCount;
+}
+
+void TerrainStreamer::EvictTile(Tile& tile)
+{
+    // Release the vertex buffer, the index buffers are shared and stay alive.
+    tile.vertexBuffer = DX::VertexBuffer<DirectX::VertexPositionNormalColorDualTexture>();
+    tile.indexBuffer = nullptr;
+    tile.state = TileState::UNLOADED;
+
+    m_residentMemory -= tile.memorySize;
+    --m_residentCount;
+}
+
+float TerrainStreamer::GetTileDistance(Tile const& tile, DirectX::XMFLOAT3 const& position) const
+{
+    // Distance on the ground plane from the position to the closest point of the tile.
+    float const dx = std::max(std::max(tile.minX - position.x, 0.0f), position.x - tile.maxX);
+    float const dz = std::max(std::max(tile.minZ - position.z, 0.0f), position.z - tile.maxZ);
+
+    return std::sqrt(dx * dx + dz * dz);
+}
\ No newline at end of file
@@ -0,0 +1,132 @@
+//
+// TerrainStreamer.h
+//
+
+#pragma once
+
+#include "VertexBuffer.h"
+#include "IndexBuffer.h"
+#include "TerrainShader.h"
+#include "Frustum.h"
+#include "SpscQueue.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Streams the tiles of a large terrain in and out around the camera. The tiles are read and turned
+// into meshes on a background I/O thread, the render thread only creates the buffers of finished tiles.
+class TerrainStreamer
+{
+    public:
+        // Layout of a tiled terrain file: the header followed by the height samples of every tile, row by row.
+        // A tile stores its (tileSize + 1)^2 samples plus a border of one sample for the normals of its edges.
+        struct FileHeader
+        {
+            uint32 magic;
+            uint32 version;
+            uint32 width;
+            uint32 height;
+            uint32 tileSize;
+            uint32 tilesX;
+            uint32 tilesZ;
+            float heightScale;
+        };
+
+        static constexpr uint32 FILE_MAGIC = 0x4C495454; // "TTIL"
+        static constexpr uint32 FILE_VERSION = 1;
+
+    public:
+        TerrainStreamer();
+        ~TerrainStreamer();
+
+        TerrainStreamer(TerrainStreamer const&) = delete;
+        TerrainStreamer& operator=(TerrainStreamer const&) = delete;
+
+        static bool ConvertRawHeightMap(char const* rawFileName, int width, int height, float heightScale, int tileSize, char const* tileFileName);
+
+        bool Initialize(char const* fileName, size_t memoryBudget, float loadRadius, ID3D11DeviceContext* deviceContext);
+        void Update(ID3D11DeviceContext* deviceContext, DirectX::XMFLOAT3 const& cameraPosition);
+        void Draw(ID3D11DeviceContext* deviceContext, Frustum* frustum, DirectX::XMMATRIX world, DirectX::XMMATRIX view, DirectX::XMMATRIX proj);
+        void Shutdown();
+
+        size_t GetResidentMemory() const { return m_residentMemory + m_indexMemory; }
+        size_t GetMemoryBudget() const { return m_memoryBudget; }
+        int GetResidentTileCount() const { return m_residentCount; }
+        int GetPendingTileCount() const { return m_pendingCount; }
+        int GetFailedTileCount() const { return m_failedCount; }
+        int GetDrawCount() const { return m_drawCount; }
+        float GetAveragePageInLatency() const { return m_pageInCount > 0 ? m_pageInTime / m_pageInCount : 0.0f; }
+        float GetMaxPageInLatency() const { return m_maxPageInTime; }
+
+    private:
+        enum class TileState
+        {
+            UNLOADED,
+            PENDING,
+            RESIDENT,
+            FAILED
+        };
+
+        struct Tile
+        {
+            TileState state;
+            int quadsX, quadsZ;
+            float minX, minY, minZ, maxX, maxY, maxZ;
+            size_t memorySize;
+            DX::VertexBuffer<DirectX::VertexPositionNormalColorDualTexture> vertexBuffer;
+            DX::IndexBuffer<uint32>* indexBuffer;
+            std::chrono::steady_clock::time_point requestTime;
+        };
+
+        // Mesh of a tile that was built by the I/O thread, it is handed over to the render thread for the upload.
+        // A tile that couldn't be read comes back without vertices and loaded set to false.
+        struct TileMesh
+        {
+            uint32 tileIndex;
+            bool loaded;
+            float minY, maxY;
+            std::vector<DirectX::VertexPositionNormalColorDualTexture> vertices;
+        };
+
+        static constexpr uint32 QUEUE_CAPACITY = 64;
+        static constexpr int MAX_UPLOADS_PER_FRAME = 2;
+
+    private:
+        void IoThreadLoop();
+        std::unique_ptr<TileMesh> BuildTileMesh(std::ifstream& file, uint32 tileIndex, std::vector<uint16>& samples) const;
+        DX::IndexBuffer<uint32>* GetIndexBuffer(ID3D11Device* device, int quadsX, int quadsZ);
+        void UploadTile(ID3D11Device* device, TileMesh& mesh);
+        void DropTile(Tile& tile);
+        void EvictTile(Tile& tile);
+        float GetTileDistance(Tile const& tile, DirectX::XMFLOAT3 const& position) const;
+
+    private:
+        std::string m_fileName;
+        FileHeader m_header;
+        std::vector<Tile> m_tiles;
+        std::unordered_map<uint32, DX::IndexBuffer<uint32>> m_indexBuffers;
+        TerrainShader shader;
+
+        // Requests go from the render thread to the I/O thread, finished meshes come back the other way.
+        SpscQueue<uint32> m_requests;
+        SpscQueue<TileMesh*> m_completed;
+        std::thread m_ioThread;
+        std::mutex m_wakeMutex;
+        std::condition_variable m_wakeCondition;
+        std::atomic<bool> m_stop;
+
+        size_t m_memoryBudget;
+        size_t m_residentMemory;
+        size_t m_pendingMemory;
+        size_t m_indexMemory;
+        float m_loadRadius;
+        int m_residentCount;
+        int m_pendingCount;
+        int m_failedCount;
+        int m_drawCount;
+
+        float m_pageInTime;
+        float m_maxPageInTime;
+        int m_pageInCount;
+};
\ No newline at end of file
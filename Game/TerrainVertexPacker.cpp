@@ -0,0 +1,100 @@
+//
+// TerrainVertexPacker.cpp
+//
+
+#include "pch.h"
+#include "TerrainVertexPacker.h"
+
+namespace
+{
+    float SignNotZero(float value)
+    {
+        return value >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    int16 QuantizeSnorm(float value)
+    {
+        return static_cast<int16>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    float DequantizeSnorm(int16 value)
+    {
+        // The same conversion the input assembler does for DXGI_FORMAT_R16G16_SNORM.
+        return std::max(static_cast<float>(value) / 32767.0f, -1.0f);
+    }
+}
+
+TerrainVertexPacker::TerrainVertexPacker(Parameters const& parameters)
+    : m_parameters(parameters)
+{
+}
+
+DirectX::VertexTerrainPacked TerrainVertexPacker::Pack(DirectX::VertexPositionNormalColorDualTexture const& vertex) const
+{
+    DirectX::VertexTerrainPacked packed;
+
+    // The rows of the height map run against the z axis.
+    packed.gridX = static_cast<uint16>(std::lround(vertex.position.x));
+    packed.gridZ = static_cast<uint16>(std::lround(static_cast<float>(m_parameters.terrainHeight - 1) - vertex.position.z));
+    packed.height = static_cast<uint16>(std::clamp(std::lround(vertex.position.y * m_parameters.heightScale), 0l, 65535l));
+    packed.padding = 0;
+
+    EncodeNormal(vertex.normal, packed.normalX, packed.normalY);
+
+    return packed;
+}
+
+DirectX::VertexPositionNormalColorDualTexture TerrainVertexPacker::Unpack(DirectX::VertexTerrainPacked const& vertex) const
+{
+    DirectX::VertexPositionNormalColorDualTexture unpacked;
+
+    float const textureIncrement = static_cast<float>(m_parameters.textureRepeat) / static_cast<float>(m_parameters.terrainWidth);
+    int const i = vertex.gridX;
+    int const j = vertex.gridZ;
+
+    // This has to match TerrainPackedVertexShader.
+    unpacked.position = DirectX::XMFLOAT3(static_cast<float>(i), static_cast<float>(vertex.height) / m_parameters.heightScale, static_cast<float>(m_parameters.terrainHeight - 1 - j));
+    unpacked.normal = DecodeNormal(vertex.normalX, vertex.normalY);
+    unpacked.color = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+    unpacked.textureCoordinate0 = DirectX::XMFLOAT2(textureIncrement * static_cast<float>(i), 1.0f - (textureIncrement * static_cast<float>(j)));
+    unpacked.textureCoordinate1 = DirectX::XMFLOAT2(
+        1.0f / m_parameters.terrainWidth * std::min(i, m_parameters.terrainWidth - 2),
+        1.0f / m_parameters.terrainHeight * std::min(j, m_parameters.terrainHeight - 2));
+
+    return unpacked;
+}
+
+void TerrainVertexPacker::EncodeNormal(DirectX::XMFLOAT3 const& normal, int16& x, int16& y)
+{
+    // Project the normal onto the octahedron and unfold the lower half over the corners.
+    float const length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    float u = normal.x / length;
+    float v = normal.y / length;
+
+    if (normal.z < 0.0f)
+    {
+        float const foldedU = (1.0f - std::abs(v)) * SignNotZero(u);
+        float const foldedV = (1.0f - std::abs(u)) * SignNotZero(v);
+        u = foldedU;
+        v = foldedV;
+    }
+
+    x = QuantizeSnorm(u);
+    y = QuantizeSnorm(v);
+}
+
+DirectX::XMFLOAT3 TerrainVertexPacker::DecodeNormal(int16 x, int16 y)
+{
+    float const u = DequantizeSnorm(x);
+    float const v = DequantizeSnorm(y);
+
+    // Fold the corners back onto the lower half, this has to match the shader.
+    DirectX::XMFLOAT3 normal(u, v, 1.0f - std::abs(u) - std::abs(v));
+    float const fold = std::max(-normal.z, 0.0f);
+    normal.x += normal.x >= 0.0f ? -fold : fold;
+    normal.y += normal.y >= 0.0f ? -fold : fold;
+
+    DirectX::XMStoreFloat3(&normal, DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&normal)));
+
+    return normal;
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+//
+// TerrainVertexPacker.h
+//
+
+#pragma once
+
+#include "VertexBufferTypes.h"
+
+// Converts terrain vertices to the packed terrain vertex and back. Only the values that can't be derived from
+// the grid index are stored, so the terrain has to be a regular grid with one unit between the samples.
+class TerrainVertexPacker
+{
+    public:
+        struct Parameters
+        {
+            float heightScale;
+            int terrainWidth;
+            int terrainHeight;
+            int textureRepeat;
+        };
+
+    public:
+        explicit TerrainVertexPacker(Parameters const& parameters);
+
+        DirectX::VertexTerrainPacked Pack(DirectX::VertexPositionNormalColorDualTexture const& vertex) const;
+        DirectX::VertexPositionNormalColorDualTexture Unpack(DirectX::VertexTerrainPacked const& vertex) const;
+
+        static void EncodeNormal(DirectX::XMFLOAT3 const& normal, int16& x, int16& y);
+        static DirectX::XMFLOAT3 DecodeNormal(int16 x, int16 y);
+
+        Parameters const& GetParameters() const { return m_parameters; }
+
+    private:
+        Parameters m_parameters;
+};
\ No newline at end of file
@@ -0,0 +1,104 @@
+//
+// DrawRangeMergerTests.cpp
+//
+
+#include "pch.h"
+#include "TestRunner.h"
+#include "DrawRangeMerger.h"
+#include <random>
+
+namespace
+{
+    constexpr int RANDOM_ROUNDS = 200;
+    constexpr uint32 RANDOM_BUFFER_SIZE = 300;
+
+    using Ranges = std::vector<DrawRangeMerger::Range>;
+
+    Ranges Merge(DrawRangeMerger& merger, Ranges const& added)
+    {
+        merger.Clear();
+        for (DrawRangeMerger::Range const& range : added)
+            merger.Add(range.firstIndex, range.indexCount);
+
+        merger.Merge();
+        return merger.GetRanges();
+    }
+
+    bool IsSame(Ranges const& ranges, Ranges const& expected)
+    {
+        if (ranges.size() != expected.size())
+            return false;
+
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            if (ranges[i].firstIndex != expected[i].firstIndex || ranges[i].indexCount != expected[i].indexCount)
+                return false;
+        }
+
+        return true;
+    }
+}
+
+void Tests::DrawRangeMergerRanges(TestContext& context)
+{
+    DrawRangeMerger merger;
+
+    // Nothing added, or only empty ranges.
+    TEST_CHECK(context, Merge(merger, {}).empty());
+    TEST_CHECK(context, merger.GetAddedCount() == 0);
+    TEST_CHECK(context, Merge(merger, { { 5, 0 }, { 0, 0 } }).empty());
+    TEST_CHECK(context, merger.GetAddedCount() == 0);
+
+    // Ranges that touch are joined in and out of order, an empty range between them changes nothing.
+    TEST_CHECK(context, IsSame(Merge(merger, { { 0, 6 }, { 6, 3 }, { 9, 0 }, { 9, 12 } }), { { 0, 21 } }));
+    TEST_CHECK(context, merger.GetAddedCount() == 3);
+    TEST_CHECK(context, IsSame(Merge(merger, { { 9, 12 }, { 0, 6 }, { 6, 3 } }), { { 0, 21 } }));
+
+    // Overlapping and contained ranges are drawn once.
+    TEST_CHECK(context, IsSame(Merge(merger, { { 0, 10 }, { 5, 10 } }), { { 0, 15 } }));
+    TEST_CHECK(context, IsSame(Merge(merger, { { 0, 10 }, { 2, 3 } }), { { 0, 10 } }));
+    TEST_CHECK(context, IsSame(Merge(merger, { { 4, 3 }, { 0, 30 }, { 12, 6 } }), { { 0, 30 } }));
+
+    // Ranges with gaps stay apart and come out sorted.
+    TEST_CHECK(context, IsSame(Merge(merger, { { 30, 3 }, { 0, 3 }, { 10, 3 } }), { { 0, 3 }, { 10, 3 }, { 30, 3 } }));
+    TEST_CHECK(context, merger.GetAddedCount() == 3);
+
+    // Clear starts over.
+    merger.Clear();
+    merger.Merge();
+    TEST_CHECK(context, merger.GetRanges().empty());
+    TEST_CHECK(context, merger.GetAddedCount() == 0);
+
+    // Random ranges cover the same indices as they did before the merge, with sorted ranges that don't touch.
+    std::mt19937 random(17);
+    std::uniform_int_distribution<uint32> randomCount(0, 8);
+    std::uniform_int_distribution<uint32> randomStart(0, RANDOM_BUFFER_SIZE - 20);
+
+    for (int round = 0; round < RANDOM_ROUNDS; ++round)
+    {
+        Ranges added(randomCount(random) * 3);
+        std::vector<bool> expected(RANDOM_BUFFER_SIZE, false), covered(RANDOM_BUFFER_SIZE, false);
+
+        for (DrawRangeMerger::Range& range : added)
+        {
+            range = { randomStart(random), randomCount(random) * 2 };
+            for (uint32 i = 0; i < range.indexCount; ++i)
+                expected[range.firstIndex + i] = true;
+        }
+
+        Ranges const merged = Merge(merger, added);
+
+        bool separate = true;
+        for (size_t i = 0; i < merged.size(); ++i)
+        {
+            if (merged[i].indexCount == 0 || (i > 0 && merged[i - 1].firstIndex + merged[i - 1].indexCount >= merged[i].firstIndex))
+                separate = false;
+
+            for (uint32 j = 0; j < merged[i].indexCount; ++j)
+                covered[merged[i].firstIndex + j] = true;
+        }
+
+        TEST_CHECK(context, separate);
+        TEST_CHECK(context, covered == expected);
+    }
+}
\ No newline at end of file
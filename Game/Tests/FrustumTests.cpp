@@ -0,0 +1,181 @@
+//
+// FrustumTests.cpp
+//
+
+#include "pch.h"
+#include "TestRunner.h"
+#include "Frustum.h"
+#include <random>
+
+namespace
+{
+    // Batch sizes around the four lanes of a test and the 32 bits of a mask word, none of the odd ones fill the last block.
+    constexpr uint32 TEST_COUNTS[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 31, 32, 33, 63, 64, 65, 1001 };
+    constexpr int TEST_VIEWS = 8;
+
+    constexpr uint32 BENCHMARK_COUNT = 10000;
+    constexpr int BENCHMARK_ROUNDS = 200;
+
+    // The volumes are spread around the camera, the frustum of PlayScene sees some, cuts some and misses the others.
+    constexpr float WORLD_SIZE = 600.0f;
+    constexpr float MAX_EXTENT = 40.0f;
+
+    struct Volumes
+    {
+        std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+        std::vector<float> centerX, centerY, centerZ, radius;
+    };
+
+    void ConstructFrustum(Frustum& frustum, std::mt19937& random)
+    {
+        using namespace DirectX;
+
+        std::uniform_real_distribution<float> position(-WORLD_SIZE * 0.25f, WORLD_SIZE * 0.25f);
+
+        XMVECTOR const eye = XMVectorSet(position(random), position(random) * 0.2f, position(random), 1.0f);
+        XMVECTOR const target = XMVectorSet(position(random), position(random) * 0.2f, position(random), 1.0f);
+
+        frustum.Construct(500.0f, XMMatrixLookAtLH(eye, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)),
+            XMMatrixPerspectiveFovLH(XMConvertToRadians(90.0f), 800.0f / 600.0f, 0.1f, 1500.0f));
+    }
+
+    void BuildVolumes(uint32 count, std::mt19937& random, Volumes& volumes)
+    {
+        std::uniform_real_distribution<float> position(-WORLD_SIZE * 0.5f, WORLD_SIZE * 0.5f);
+        std::uniform_real_distribution<float> extent(0.0f, MAX_EXTENT);
+
+        volumes = Volumes();
+
+        for (uint32 i = 0; i < count; ++i)
+        {
+            float const x = position(random), y = position(random) * 0.2f, z = position(random);
+
+            volumes.minX.push_back(x);
+            volumes.minY.push_back(y);
+            volumes.minZ.push_back(z);
+            volumes.maxX.push_back(x + extent(random));
+            volumes.maxY.push_back(y + extent(random));
+            volumes.maxZ.push_back(z + extent(random));
+
+            volumes.centerX.push_back(x);
+            volumes.centerY.push_back(y);
+            volumes.centerZ.push_back(z);
+            volumes.radius.push_back(extent(random));
+        }
+    }
+
+    bool IsVisible(std::vector<uint32> const& visibleMask, uint32 index)
+    {
+        return (visibleMask[index / 32] & (1u << (index % 32))) != 0;
+    }
+}
+
+void Tests::FrustumBatchMatchesScalar(TestContext& context)
+{
+    std::mt19937 random(5);
+    Frustum frustum;
+    Volumes volumes;
+
+    for (int view = 0; view < TEST_VIEWS; ++view)
+    {
+        ConstructFrustum(frustum, random);
+
+        for (uint32 count : TEST_COUNTS)
+        {
+            BuildVolumes(count, random, volumes);
+
+            // One word more than needed, filled with a pattern the batch has to leave alone.
+            uint32 const wordCount = (count + 31) / 32;
+            std::vector<uint32> rectangleMask(wordCount + 1, 0xA5A5A5A5u), sphereMask(wordCount + 1, 0xA5A5A5A5u);
+
+            frustum.CheckRectangles(volumes.minX.data(), volumes.minY.data(), volumes.minZ.data(),
+                volumes.maxX.data(), volumes.maxY.data(), volumes.maxZ.data(), count, rectangleMask.data());
+            frustum.CheckSpheres(volumes.centerX.data(), volumes.centerY.data(), volumes.centerZ.data(), volumes.radius.data(), count, sphereMask.data());
+
+            int rectangleMismatches = 0, sphereMismatches = 0, visibleCount = 0;
+            for (uint32 i = 0; i < count; ++i)
+            {
+                bool const rectangleVisible = frustum.CheckRectangle(volumes.minX[i], volumes.minY[i], volumes.minZ[i],
+                    volumes.maxX[i], volumes.maxY[i], volumes.maxZ[i]);
+                bool const sphereVisible = frustum.CheckSphere({ volumes.centerX[i], volumes.centerY[i], volumes.centerZ[i] }, volumes.radius[i]);
+
+                if (rectangleVisible != IsVisible(rectangleMask, i))
+                    ++rectangleMismatches;
+
+                if (sphereVisible != IsVisible(sphereMask, i))
+                    ++sphereMismatches;
+
+                if (rectangleVisible)
+                    ++visibleCount;
+            }
+
+            // The bits past the last volume of the last word stay clear.
+            uint32 const usedBits = count % 32;
+            if (usedBits != 0)
+            {
+                TEST_CHECK(context, (rectangleMask[wordCount - 1] >> usedBits) == 0);
+                TEST_CHECK(context, (sphereMask[wordCount - 1] >> usedBits) == 0);
+            }
+
+            TEST_CHECK(context, rectangleMismatches == 0);
+            TEST_CHECK(context, sphereMismatches == 0);
+            TEST_CHECK(context, rectangleMask[wordCount] == 0xA5A5A5A5u);
+            TEST_CHECK(context, sphereMask[wordCount] == 0xA5A5A5A5u);
+
+            // The large batches have to see both kinds of volumes, or they don't check anything.
+            if (count >= 1000)
+                TEST_CHECK(context, visibleCount > 0 && visibleCount < static_cast<int>(count));
+        }
+    }
+}
+
+void Tests::FrustumBatchBenchmark(TestContext& context)
+{
+    std::mt19937 random(5);
+    Frustum frustum;
+    Volumes volumes;
+    std::vector<uint32> visibleMask((BENCHMARK_COUNT + 31) / 32);
+    int visibleCount = 0;
+
+    ConstructFrustum(frustum, random);
+    BuildVolumes(BENCHMARK_COUNT, random, volumes);
+
+    // The visible counts are summed up so the compiler can't drop the tests.
+    auto startTime = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCHMARK_ROUNDS; ++round)
+    {
+        for (uint32 i = 0; i < BENCHMARK_COUNT; ++i)
+            visibleCount += frustum.CheckRectangle(volumes.minX[i], volumes.minY[i], volumes.minZ[i], volumes.maxX[i], volumes.maxY[i], volumes.maxZ[i]) ? 1 : 0;
+    }
+    float const scalarTime = std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+
+    startTime = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCHMARK_ROUNDS; ++round)
+    {
+        frustum.CheckRectangles(volumes.minX.data(), volumes.minY.data(), volumes.minZ.data(),
+            volumes.maxX.data(), volumes.maxY.data(), volumes.maxZ.data(), BENCHMARK_COUNT, visibleMask.data());
+        visibleCount += static_cast<int>(visibleMask[0] & 1u);
+    }
+    float const batchTime = std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+
+    startTime = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCHMARK_ROUNDS; ++round)
+    {
+        for (uint32 i = 0; i < BENCHMARK_COUNT; ++i)
+            visibleCount += frustum.CheckSphere({ volumes.centerX[i], volumes.centerY[i], volumes.centerZ[i] }, volumes.radius[i]) ? 1 : 0;
+    }
+    float const scalarSphereTime = std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+
+    startTime = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCHMARK_ROUNDS; ++round)
+    {
+        frustum.CheckSpheres(volumes.centerX.data(), volumes.centerY.data(), volumes.centerZ.data(), volumes.radius.data(), BENCHMARK_COUNT, visibleMask.data());
+        visibleCount += static_cast<int>(visibleMask[0] & 1u);
+    }
+    float const batchSphereTime = std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+
+    float const testCount = static_cast<float>(BENCHMARK_COUNT) * BENCHMARK_ROUNDS;
+    Logger::Get()->info("Frustum boxes: CheckRectangle {:.2f} ns, CheckRectangles {:.2f} ns per box.", scalarTime / testCount, batchTime / testCount);
+    Logger::Get()->info("Frustum spheres: CheckSphere {:.2f} ns, CheckSpheres {:.2f} ns per sphere ({} visible in total).",
+        scalarSphereTime / testCount, batchSphereTime / testCount, visibleCount);
+}
\ No newline at end of file
@@ -0,0 +1,288 @@
+//
+// MD5AnimatorTests.cpp
+//
+
+#include "pch.h"
+#include "TestRunner.h"
+#include "MD5Animator.h"
+#include "MD5Cache.h"
+
+namespace
+{
+    constexpr wchar_t const* MESH_FILE = L"Data/Models/Reptile/reptile.md5mesh";
+    constexpr wchar_t const* UPPER_BODY_JOINT = L"CATRigSpine1";
+
+    // Steps that add up to the fade time without rounding, so the fade ends exactly on the last one.
+    constexpr float FADE_TIME = 0.25f;
+    constexpr float FADE_STEP = 1.0f / 64.0f;
+    constexpr int FADE_STEPS = 16;
+    constexpr int LEAD_IN_STEPS = 23;
+
+    // Removing the reference rotation of an additive clip leaves a rounding error in the quaternion products. Poses
+    // that differ by more than it are different.
+    constexpr float MAX_ADDITIVE_ERROR = 1e-5f;
+
+    constexpr int BENCHMARK_CHARACTERS = 100;
+    constexpr int WARMUP_FRAMES = 30;
+    constexpr int BENCHMARK_FRAMES = 600;
+    constexpr float FRAME_TIME = 1.0f / 60.0f;
+
+    // The mesh and the clips of the reptile, held while a test runs so the cache can free them afterwards.
+    struct Reptile
+    {
+        std::shared_ptr<axec::md5_model_t const> model;
+        std::shared_ptr<axec::md5_anim_t const> idle, walk, run, attack;
+    };
+
+    bool LoadReptile(ID3D11DeviceContext* deviceContext, Reptile& reptile)
+    {
+        reptile.model = axec::MD5Cache::ResolveMesh(deviceContext, MESH_FILE, MD5SkinningMode::CPU);
+        reptile.idle = axec::MD5Cache::ResolveAnim(L"Data/Models/Reptile/idle.md5anim");
+        reptile.walk = axec::MD5Cache::ResolveAnim(L"Data/Models/Reptile/walk.md5anim");
+        reptile.run = axec::MD5Cache::ResolveAnim(L"Data/Models/Reptile/run.md5anim");
+        reptile.attack = axec::MD5Cache::ResolveAnim(L"Data/Models/Reptile/attack1.md5anim");
+
+        return reptile.model && reptile.idle && reptile.walk && reptile.run && reptile.attack;
+    }
+
+    void ReleaseReptile(Reptile& reptile)
+    {
+        reptile = Reptile();
+        axec::MD5Cache::Clear();
+    }
+
+    // The largest difference of a joint's position or orientation, the orientations as 1 - |cos| of half their angle.
+    float GetJointError(axec::JointPose const& a, axec::JointPose const& b)
+    {
+        using namespace DirectX;
+
+        float const positionError = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&a.position), XMLoadFloat3(&b.position))));
+        float const orientationError = 1.0f - fabsf(XMVectorGetX(XMVector4Dot(XMLoadFloat4(&a.orientation), XMLoadFloat4(&b.orientation))));
+
+        return std::max(positionError, orientationError);
+    }
+
+    float GetPoseError(std::vector<axec::JointPose> const& a, std::vector<axec::JointPose> const& b)
+    {
+        float error = 0.0f;
+        for (size_t i = 0; i < a.size(); ++i)
+            error = std::max(error, GetJointError(a[i], b[i]));
+
+        return error;
+    }
+
+    bool IsSameJoint(axec::JointPose const& a, axec::JointPose const& b)
+    {
+        return memcmp(&a, &b, sizeof(a)) == 0;
+    }
+
+    bool IsSamePose(std::vector<axec::JointPose> const& a, std::vector<axec::JointPose> const& b)
+    {
+        return memcmp(a.data(), b.data(), a.size() * sizeof(axec::JointPose)) == 0;
+    }
+
+    void Advance(axec::MD5Animator& animator, int steps)
+    {
+        for (int i = 0; i < steps; ++i)
+            animator.Update(FADE_STEP);
+    }
+}
+
+void Tests::MD5AnimatorCrossfade(TestContext& context)
+{
+    Reptile reptile;
+    if (!TEST_CHECK(context, LoadReptile(context.GetDeviceContext(), reptile)))
+        return;
+
+    int const jointCount = reptile.model->numJoints;
+    std::vector<axec::JointPose> fadePose(jointCount), sourcePose(jointCount), targetPose(jointCount);
+
+    // One animator crossfades from walking to running, the other two play only the walk or only the run.
+    axec::MD5Animator fading, source, target;
+    fading.Initialize(*reptile.model);
+    source.Initialize(*reptile.model);
+    target.Initialize(*reptile.model);
+
+    TEST_CHECK(context, fading.Play(0, reptile.walk.get(), 0.0f));
+    TEST_CHECK(context, source.Play(0, reptile.walk.get(), 0.0f));
+    Advance(fading, LEAD_IN_STEPS);
+    Advance(source, LEAD_IN_STEPS);
+
+    TEST_CHECK(context, fading.Play(0, reptile.run.get(), FADE_TIME));
+    TEST_CHECK(context, target.Play(0, reptile.run.get(), 0.0f));
+
+    // When the fade starts nothing of the run shows yet.
+    fading.Evaluate(fadePose.data());
+    source.Evaluate(sourcePose.data());
+    TEST_CHECK(context, IsSamePose(fadePose, sourcePose));
+
+    // Halfway both clips show, the pose is neither of them.
+    Advance(fading, FADE_STEPS / 2);
+    Advance(source, FADE_STEPS / 2);
+    Advance(target, FADE_STEPS / 2);
+
+    fading.Evaluate(fadePose.data());
+    source.Evaluate(sourcePose.data());
+    target.Evaluate(targetPose.data());
+    TEST_CHECK(context, GetPoseError(fadePose, sourcePose) > MAX_ADDITIVE_ERROR);
+    TEST_CHECK(context, GetPoseError(fadePose, targetPose) > MAX_ADDITIVE_ERROR);
+
+    // When it ends only the run is left, at the time it has played since the fade started.
+    Advance(fading, FADE_STEPS / 2);
+    Advance(target, FADE_STEPS / 2);
+
+    fading.Evaluate(fadePose.data());
+    target.Evaluate(targetPose.data());
+    TEST_CHECK(context, IsSamePose(fadePose, targetPose));
+
+    ReleaseReptile(reptile);
+}
+
+void Tests::MD5AnimatorLayers(TestContext& context)
+{
+    Reptile reptile;
+    if (!TEST_CHECK(context, LoadReptile(context.GetDeviceContext(), reptile)))
+        return;
+
+    int const jointCount = reptile.model->numJoints;
+    std::vector<axec::JointPose> basePose(jointCount), layeredPose(jointCount);
+    std::vector<float> mask(jointCount);
+
+    axec::MD5Animator base, layered;
+    base.Initialize(*reptile.model);
+    layered.Initialize(*reptile.model);
+
+    int const upperBody = layered.FindJoint(UPPER_BODY_JOINT);
+    if (!TEST_CHECK(context, upperBody >= 0))
+        return;
+
+    layered.BuildJointMask(upperBody, 1.0f, mask.data());
+
+    // Both walk, one of them attacks with the upper body. The legs and the hips have to walk as if it didn't.
+    for (axec::MD5Animator* animator : { &base, &layered })
+    {
+        animator->Play(0, reptile.walk.get(), 0.0f);
+        Advance(*animator, LEAD_IN_STEPS);
+    }
+
+    TEST_CHECK(context, layered.Play(1, reptile.attack.get(), 0.0f));
+    layered.SetLayerMask(1, mask.data());
+
+    Advance(base, FADE_STEPS);
+    Advance(layered, FADE_STEPS);
+    base.Evaluate(basePose.data());
+
+    for (float layerWeight : { 1.0f, 0.5f })
+    {
+        layered.SetLayerWeight(1, layerWeight);
+        layered.Evaluate(layeredPose.data());
+
+        int changedOutside = 0;
+        float maskedError = 0.0f;
+
+        for (int i = 0; i < jointCount; ++i)
+        {
+            if (mask[i] == 0.0f && !IsSameJoint(layeredPose[i], basePose[i]))
+                ++changedOutside;
+            else if (mask[i] > 0.0f)
+                maskedError = std::max(maskedError, GetJointError(layeredPose[i], basePose[i]));
+        }
+
+        TEST_CHECK(context, changedOutside == 0);
+        TEST_CHECK(context, maskedError > MAX_ADDITIVE_ERROR);
+    }
+
+    layered.Stop(1, 0.0f);
+
+    // An additive layer on its first frame adds the difference of the clip to itself, which is nothing, at any weight
+    // and mask. Once it plays on it moves the pose.
+    TEST_CHECK(context, layered.Play(2, reptile.idle.get(), 0.0f));
+    layered.SetLayerMode(2, axec::MD5Animator::LayerMode::ADDITIVE);
+
+    for (float layerWeight : { 1.0f, 0.5f })
+    {
+        layered.SetLayerWeight(2, layerWeight);
+        layered.SetLayerMask(2, layerWeight < 1.0f ? mask.data() : nullptr);
+        layered.Evaluate(layeredPose.data());
+
+        TEST_CHECK(context, GetPoseError(layeredPose, basePose) <= MAX_ADDITIVE_ERROR);
+    }
+
+    layered.SetLayerWeight(2, 1.0f);
+    layered.SetLayerMask(2, nullptr);
+    layered.Update(reptile.idle->totalAnimTime * 0.5f);
+    base.Update(reptile.idle->totalAnimTime * 0.5f);
+
+    layered.Evaluate(layeredPose.data());
+    base.Evaluate(basePose.data());
+    TEST_CHECK(context, GetPoseError(layeredPose, basePose) > MAX_ADDITIVE_ERROR);
+
+    ReleaseReptile(reptile);
+}
+
+void Tests::MD5AnimatorBenchmark(TestContext& context)
+{
+    Reptile reptile;
+    if (!TEST_CHECK(context, LoadReptile(context.GetDeviceContext(), reptile)))
+        return;
+
+    int const jointCount = reptile.model->numJoints;
+    std::vector<axec::MD5Animator> animators(BENCHMARK_CHARACTERS);
+    std::vector<axec::JointPose> pose(jointCount);
+    std::vector<float> mask(jointCount);
+
+    // Three layers per character: walking blended with running by speed, an attack on the upper body and an
+    // additive idle on top. Every character starts at another time so they don't all sample the same frames.
+    axec::md5_anim_t const* locomotion[] = { reptile.walk.get(), reptile.run.get() };
+    float weights[] = { 0.7f, 0.3f };
+
+    for (int i = 0; i < BENCHMARK_CHARACTERS; ++i)
+    {
+        axec::MD5Animator& animator = animators[i];
+        animator.Initialize(*reptile.model);
+        animator.BuildJointMask(animator.FindJoint(UPPER_BODY_JOINT), 1.0f, mask.data());
+
+        animator.PlayBlend(0, locomotion, weights, 2, 0.0f);
+        animator.Play(1, reptile.attack.get(), 0.0f);
+        animator.SetLayerMask(1, mask.data());
+        animator.Play(2, reptile.idle.get(), 0.0f);
+        animator.SetLayerMode(2, axec::MD5Animator::LayerMode::ADDITIVE);
+        animator.SetLayerWeight(2, 0.5f);
+        animator.Update(FRAME_TIME * (i % 97));
+    }
+
+    // The speed changes every frame and every character restarts its attack with a crossfade once a second.
+    auto playFrame = [&](int frame)
+    {
+        weights[0] = 0.5f + (0.5f * sinf(frame * 0.01f));
+        weights[1] = 1.0f - weights[0];
+
+        for (int i = 0; i < BENCHMARK_CHARACTERS; ++i)
+        {
+            axec::MD5Animator& animator = animators[i];
+
+            if ((frame + i) % 60 == 0)
+                animator.Play(1, reptile.attack.get(), 0.2f);
+
+            animator.SetBlendWeights(0, weights, 2);
+            animator.Update(FRAME_TIME);
+            animator.Evaluate(pose.data());
+        }
+    };
+
+    for (int frame = 0; frame < WARMUP_FRAMES; ++frame)
+        playFrame(frame);
+
+    auto const startTime = std::chrono::steady_clock::now();
+
+    for (int frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+        playFrame(frame);
+
+    float const totalTime = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+
+    Logger::Get()->info("MD5Animator with 3 layers: {:.2f} us per character, {:.2f} ms per frame for {} characters of {} joints.",
+        totalTime / (BENCHMARK_FRAMES * BENCHMARK_CHARACTERS), totalTime / BENCHMARK_FRAMES / 1000.0f, BENCHMARK_CHARACTERS, jointCount);
+
+    animators.clear();
+    ReleaseReptile(reptile);
+}
\ No newline at end of file
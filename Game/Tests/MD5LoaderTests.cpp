@@ -0,0 +1,599 @@
+//
+// MD5LoaderTests.cpp
+//
+
+#include "pch.h"
+#include "TestRunner.h"
+#include "MD5Loader.h"
+#include "MD5Cooker.h"
+#include "StringHelper.h"
+#include <filesystem>
+#include <map>
+#include <random>
+
+namespace
+{
+    // Lines of "<file> <section> <hash>", one for every section of every MD5 file in the Data directory.
+    constexpr char const* PARSE_REFERENCE_FILE = "Tests/MD5ParseReference.txt";
+
+    constexpr char const* BENCHMARK_DIRECTORY = "Data";
+    constexpr int BENCHMARK_ROUNDS = 5;
+
+    constexpr wchar_t const* NORMALS_MESH_FILES[] = { L"Data/guard.md5mesh", L"Data/monster.md5mesh", L"Data/wraith.md5mesh",
+        L"Data/Models/Reptile/reptile.md5mesh", L"Data/Models/Juggernaut/Juggernaut.md5mesh" };
+
+    // Quads per side of the synthetic meshes, two triangles each. The reference takes time for every vertex times
+    // every triangle, so the mesh it checks is smaller than the one of the benchmark with its 100k triangles.
+    constexpr int NORMALS_TEST_QUADS = 48;
+    constexpr int NORMALS_BENCHMARK_QUADS = 224;
+    constexpr int NORMALS_JOINT_COUNT = 8;
+
+    template<typename T>
+    bool IsSameArray(std::vector<T> const& a, std::vector<T> const& b)
+    {
+        return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+    }
+
+    // A cooked model has to be the parsed one bit for bit, with the positions and normals the parsing computed.
+    bool IsSameModel(axec::md5_model_t const& a, axec::md5_model_t const& b)
+    {
+        if (a.numJoints != b.numJoints || a.numMeshes != b.numMeshes || a.joints.size() != b.joints.size() || a.meshes.size() != b.meshes.size())
+            return false;
+
+        for (size_t i = 0; i < a.joints.size(); ++i)
+        {
+            axec::Joint const& jointA = a.joints[i];
+            axec::Joint const& jointB = b.joints[i];
+
+            if (jointA.name != jointB.name || jointA.parentId != jointB.parentId || std::memcmp(&jointA.position, &jointB.position, sizeof(jointA.position)) != 0 ||
+                std::memcmp(&jointA.orientation, &jointB.orientation, sizeof(jointA.orientation)) != 0)
+                return false;
+        }
+
+        for (size_t i = 0; i < a.meshes.size(); ++i)
+        {
+            axec::md5_mesh_t const& meshA = a.meshes[i];
+            axec::md5_mesh_t const& meshB = b.meshes[i];
+
+            if (meshA.shader != meshB.shader || meshA.trianglesCount != meshB.trianglesCount || !IsSameArray(meshA.vertices, meshB.vertices) ||
+                !IsSameArray(meshA.indices, meshB.indices) || !IsSameArray(meshA.weights, meshB.weights))
+                return false;
+        }
+
+        return true;
+    }
+
+    // The frame times are worked out by LoadMD5Anim after either of them.
+    bool IsSameAnimation(axec::md5_anim_t const& a, axec::md5_anim_t const& b)
+    {
+        return a.numFrames == b.numFrames && a.numJoints == b.numJoints && a.frameRate == b.frameRate && IsSameArray(a.frameBounds, b.frameBounds) &&
+            IsSameArray(a.frameSkeleton, b.frameSkeleton) && IsSameArray(a.localFrameSkeleton, b.localFrameSkeleton);
+    }
+
+    // FNV-1a over the fields that are parsed straight from the text. Those are the same on every compiler, the
+    // positions and normals computed from them depend on the floating point model and are left out.
+    class FieldHash
+    {
+        public:
+            void Add(int32 value) { AddBytes(&value, sizeof(value)); }
+            void Add(uint32 value) { AddBytes(&value, sizeof(value)); }
+            void AddCount(size_t count) { Add(static_cast<uint32>(count)); }
+
+            void Add(float value)
+            {
+                uint32 bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                Add(bits);
+            }
+
+            // The characters one at a time, wchar_t doesn't have the same size everywhere.
+            void Add(std::wstring const& value)
+            {
+                AddCount(value.size());
+                for (wchar_t character : value)
+                    Add(static_cast<uint32>(character));
+            }
+
+            void Add(DirectX::XMFLOAT3 const& value)
+            {
+                Add(value.x);
+                Add(value.y);
+                Add(value.z);
+            }
+
+            // The w of the orientations is computed from the other three.
+            void AddOrientation(DirectX::XMFLOAT4 const& value)
+            {
+                Add(value.x);
+                Add(value.y);
+                Add(value.z);
+            }
+
+            uint64 Get() const { return hash; }
+
+        private:
+            void AddBytes(void const* data, size_t size)
+            {
+                uint8 const* bytes = static_cast<uint8 const*>(data);
+                for (size_t i = 0; i < size; ++i)
+                {
+                    hash ^= bytes[i];
+                    hash *= 1099511628211ull;
+                }
+            }
+
+        private:
+            uint64 hash = 14695981039346656037ull;
+    };
+
+    using SectionHashes = std::map<std::string, uint64>;
+
+    bool HashMesh(std::string const& fileName, SectionHashes& hashes)
+    {
+        axec::md5_model_t model;
+        if (!axec::MD5Loader::ParseMD5Mesh(StringHelper::NarrowToWide(fileName), model))
+            return false;
+
+        FieldHash joints;
+        joints.Add(model.numJoints);
+        joints.AddCount(model.joints.size());
+        for (axec::Joint const& joint : model.joints)
+        {
+            joints.Add(joint.name);
+            joints.Add(joint.parentId);
+            joints.Add(joint.position);
+            joints.AddOrientation(joint.orientation);
+        }
+
+        FieldHash meshes;
+        meshes.Add(model.numMeshes);
+        meshes.AddCount(model.meshes.size());
+        for (axec::md5_mesh_t const& mesh : model.meshes)
+        {
+            meshes.Add(mesh.shader);
+
+            meshes.AddCount(mesh.vertices.size());
+            for (MD5Vertex const& vertex : mesh.vertices)
+            {
+                meshes.Add(vertex.textureCoordinate.x);
+                meshes.Add(vertex.textureCoordinate.y);
+                meshes.Add(vertex.StartWeight);
+                meshes.Add(vertex.WeightCount);
+            }
+
+            meshes.Add(mesh.trianglesCount);
+            meshes.AddCount(mesh.indices.size());
+            for (DWORD index : mesh.indices)
+                meshes.Add(static_cast<uint32>(index));
+
+            meshes.AddCount(mesh.weights.size());
+            for (axec::Weight const& weight : mesh.weights)
+            {
+                meshes.Add(weight.jointId);
+                meshes.Add(weight.bias);
+                meshes.Add(weight.position);
+            }
+        }
+
+        hashes["joints"] = joints.Get();
+        hashes["meshes"] = meshes.Get();
+        return true;
+    }
+
+    bool HashAnim(std::string const& fileName, SectionHashes& hashes)
+    {
+        axec::md5_anim_t animation;
+        if (!axec::MD5Loader::ParseMD5Anim(StringHelper::NarrowToWide(fileName), animation))
+            return false;
+
+        FieldHash header;
+        header.Add(animation.numFrames);
+        header.Add(animation.numJoints);
+        header.Add(animation.frameRate);
+        header.Add(animation.numAnimatedComponents);
+
+        FieldHash hierarchy;
+        hierarchy.AddCount(animation.jointInfo.size());
+        for (axec::JointInfo const& jointInfo : animation.jointInfo)
+        {
+            hierarchy.Add(jointInfo.name);
+            hierarchy.Add(jointInfo.parentId);
+            hierarchy.Add(jointInfo.flags);
+            hierarchy.Add(jointInfo.startIndex);
+        }
+
+        FieldHash bounds;
+        bounds.AddCount(animation.frameBounds.size());
+        for (axec::BoundingBox const& box : animation.frameBounds)
+        {
+            bounds.Add(box.min);
+            bounds.Add(box.max);
+        }
+
+        FieldHash baseFrame;
+        baseFrame.AddCount(animation.baseFrameJoints.size());
+        for (axec::Joint const& joint : animation.baseFrameJoints)
+        {
+            baseFrame.Add(joint.position);
+            baseFrame.AddOrientation(joint.orientation);
+        }
+
+        FieldHash frames;
+        frames.AddCount(animation.frameData.size());
+        for (axec::FrameData const& frame : animation.frameData)
+        {
+            frames.Add(frame.frameId);
+            frames.AddCount(frame.frameData.size());
+            for (float value : frame.frameData)
+                frames.Add(value);
+        }
+
+        hashes["header"] = header.Get();
+        hashes["hierarchy"] = hierarchy.Get();
+        hashes["bounds"] = bounds.Get();
+        hashes["baseframe"] = baseFrame.Get();
+        hashes["frames"] = frames.Get();
+        return true;
+    }
+
+    bool HashFile(std::string const& fileName, SectionHashes& hashes)
+    {
+        std::string const extension = std::filesystem::path(fileName).extension().string();
+
+        if (extension == ".md5mesh")
+            return HashMesh(fileName, hashes);
+
+        if (extension == ".md5anim")
+            return HashAnim(fileName, hashes);
+
+        return false;
+    }
+
+    // The normals as PrepareNormals built them before it accumulated them in one pass, searching all triangles for the
+    // ones that use each vertex.
+    void PrepareNormalsReference(axec::md5_mesh_t& mesh, axec::md5_model_t const& model)
+    {
+        using namespace DirectX;
+
+        std::vector<XMFLOAT3> faceNormals(mesh.trianglesCount);
+        for (unsigned int i = 0; i < mesh.trianglesCount; ++i)
+        {
+            XMVECTOR const position0 = XMLoadFloat3(&mesh.vertices[mesh.indices[i * 3]].position);
+            XMVECTOR const position1 = XMLoadFloat3(&mesh.vertices[mesh.indices[i * 3 + 1]].position);
+            XMVECTOR const position2 = XMLoadFloat3(&mesh.vertices[mesh.indices[i * 3 + 2]].position);
+
+            XMStoreFloat3(&faceNormals[i], XMVector3Cross(XMVectorSubtract(position0, position2), XMVectorSubtract(position2, position1)));
+        }
+
+        for (unsigned int i = 0; i < mesh.vertices.size(); ++i)
+        {
+            XMFLOAT3 normalSum(0.0f, 0.0f, 0.0f);
+            int facesUsing = 0;
+
+            for (unsigned int j = 0; j < mesh.trianglesCount; ++j)
+            {
+                if (mesh.indices[j * 3] == i || mesh.indices[j * 3 + 1] == i || mesh.indices[j * 3 + 2] == i)
+                {
+                    normalSum.x += faceNormals[j].x;
+                    normalSum.y += faceNormals[j].y;
+                    normalSum.z += faceNormals[j].z;
+                    facesUsing++;
+                }
+            }
+
+            XMVECTOR const normal = XMVector3Normalize(XMLoadFloat3(&normalSum) / static_cast<float>(facesUsing));
+            XMStoreFloat3(&mesh.vertices[i].normal, XMVectorNegate(normal));
+
+            MD5Vertex const& vertex = mesh.vertices[i];
+            for (int k = 0; k < vertex.WeightCount; k++)
+            {
+                axec::Weight& weight = mesh.weights[vertex.StartWeight + k];
+                XMVECTOR const jointOrientation = XMLoadFloat4(&model.joints[weight.jointId].orientation);
+
+                XMStoreFloat3(&weight.normal, XMVector3Normalize(XMQuaternionMultiply(XMQuaternionMultiply(XMQuaternionInverse(jointOrientation), normal), jointOrientation)));
+            }
+        }
+    }
+
+    // A rippled grid of quads with up to three weights per vertex on joints with random orientations. The last
+    // triangles use a vertex twice, which has to count once for it.
+    void BuildGridMesh(int quads, axec::md5_model_t& model, axec::md5_mesh_t& mesh)
+    {
+        std::mt19937 random(5489u);
+        std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+        model.numJoints = NORMALS_JOINT_COUNT;
+        model.joints.resize(NORMALS_JOINT_COUNT);
+        for (axec::Joint& joint : model.joints)
+        {
+            joint.parentId = -1;
+            joint.position = DirectX::XMFLOAT3(distribution(random), distribution(random), distribution(random));
+
+            DirectX::XMVECTOR const orientation = DirectX::XMVectorSet(distribution(random), distribution(random), distribution(random), distribution(random));
+            DirectX::XMStoreFloat4(&joint.orientation, DirectX::XMQuaternionNormalize(orientation));
+        }
+
+        int const rowLength = quads + 1;
+        mesh.vertices.resize(rowLength * rowLength);
+
+        for (int z = 0; z < rowLength; ++z)
+        {
+            for (int x = 0; x < rowLength; ++x)
+            {
+                MD5Vertex& vertex = mesh.vertices[z * rowLength + x];
+                vertex.position = DirectX::XMFLOAT3(static_cast<float>(x), 0.3f * std::sin(x * 0.37f) * std::cos(z * 0.21f) + 0.05f * distribution(random), static_cast<float>(z));
+                vertex.textureCoordinate = DirectX::XMFLOAT2(0.0f, 0.0f);
+                vertex.StartWeight = static_cast<int>(mesh.weights.size());
+                vertex.WeightCount = 1 + static_cast<int>(random() % 3);
+
+                for (int k = 0; k < vertex.WeightCount; ++k)
+                {
+                    axec::Weight weight = {};
+                    weight.jointId = static_cast<int>(random() % NORMALS_JOINT_COUNT);
+                    weight.bias = 1.0f / vertex.WeightCount;
+                    mesh.weights.push_back(weight);
+                }
+            }
+        }
+
+        for (int z = 0; z < quads; ++z)
+        {
+            for (int x = 0; x < quads; ++x)
+            {
+                DWORD const corner = z * rowLength + x;
+                DWORD const quad[6] = { corner, corner + rowLength, corner + 1, corner + 1, corner + rowLength, corner + rowLength + 1 };
+                mesh.indices.insert(mesh.indices.end(), std::begin(quad), std::end(quad));
+            }
+        }
+
+        DWORD const degenerate[6] = { 0, 0, 1, 2, static_cast<DWORD>(rowLength + 2), 2 };
+        mesh.indices.insert(mesh.indices.end(), std::begin(degenerate), std::end(degenerate));
+
+        mesh.trianglesCount = static_cast<unsigned int>(mesh.indices.size() / 3);
+    }
+
+    // Runs PrepareNormals and the reference on copies of the mesh. Returns the largest difference of their normals and
+    // counts the normals that aren't the same to the bit.
+    float CompareNormals(axec::md5_mesh_t const& mesh, axec::md5_model_t& model, int& differentCount)
+    {
+        axec::md5_mesh_t prepared = mesh;
+        axec::md5_mesh_t reference = mesh;
+
+        axec::MD5Loader::PrepareNormals(prepared, model);
+        PrepareNormalsReference(reference, model);
+
+        float maxDifference = 0.0f;
+        auto compare = [&](DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b)
+        {
+            if (std::memcmp(&a, &b, sizeof(a)) != 0)
+                ++differentCount;
+
+            maxDifference = std::max({ maxDifference, std::abs(a.x - b.x), std::abs(a.y - b.y), std::abs(a.z - b.z) });
+        };
+
+        for (size_t i = 0; i < mesh.vertices.size(); ++i)
+            compare(prepared.vertices[i].normal, reference.vertices[i].normal);
+
+        for (size_t i = 0; i < mesh.weights.size(); ++i)
+            compare(prepared.weights[i].normal, reference.weights[i].normal);
+
+        return maxDifference;
+    }
+}
+
+void Tests::MD5ParseReference(TestContext& context)
+{
+    std::ifstream referenceFile(PARSE_REFERENCE_FILE);
+    if (!TEST_CHECK(context, referenceFile.is_open()))
+        return;
+
+    std::map<std::string, SectionHashes> files;
+    int sectionCount = 0;
+
+    std::string line;
+    while (std::getline(referenceFile, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream lineStream(line);
+        std::string fileName, section;
+        uint64 hash = 0;
+
+        if (!TEST_CHECK(context, static_cast<bool>(lineStream >> fileName >> section >> std::hex >> hash)))
+            continue;
+
+        // Every file is parsed once, the first time one of its sections comes up.
+        auto const file = files.try_emplace(fileName);
+        if (file.second && !HashFile(fileName, file.first->second))
+            Logger::Get()->error("Failed to parse {}.", fileName);
+
+        SectionHashes const& hashes = file.first->second;
+        auto const parsed = hashes.find(section);
+        if (!TEST_CHECK(context, parsed != hashes.end()))
+            continue;
+
+        if (parsed->second != hash)
+            Logger::Get()->error("{} {} parsed to {:016x}, the reference is {:016x}.", fileName, section, parsed->second, hash);
+
+        TEST_CHECK(context, parsed->second == hash);
+        ++sectionCount;
+    }
+
+    Logger::Get()->info("Compared {} sections of {} MD5 files.", sectionCount, files.size());
+    TEST_CHECK(context, sectionCount > 0);
+}
+
+void Tests::MD5ParseBenchmark(TestContext& context)
+{
+    std::vector<std::wstring> fileNames;
+    uintmax_t totalSize = 0;
+
+    for (std::filesystem::directory_entry const& entry : std::filesystem::recursive_directory_iterator(BENCHMARK_DIRECTORY))
+    {
+        if (entry.is_regular_file() && entry.path().extension() == ".md5anim")
+        {
+            fileNames.push_back(entry.path().wstring());
+            totalSize += entry.file_size();
+        }
+    }
+
+    if (!TEST_CHECK(context, !fileNames.empty()))
+        return;
+
+    // The first round reads the files into the file cache, the rounds after it time the parsing alone.
+    float bestTime = 0.0f;
+
+    for (int round = 0; round <= BENCHMARK_ROUNDS; ++round)
+    {
+        auto const startTime = std::chrono::steady_clock::now();
+
+        for (std::wstring const& fileName : fileNames)
+        {
+            axec::md5_anim_t animation;
+            TEST_CHECK(context, axec::MD5Loader::ParseMD5Anim(fileName, animation));
+        }
+
+        float const roundTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        if (round == 1 || (round > 1 && roundTime < bestTime))
+            bestTime = roundTime;
+    }
+
+    float const megabytes = static_cast<float>(totalSize) / (1024.0f * 1024.0f);
+    Logger::Get()->info("Parsed {} MD5 animations ({:.2f} MB) in {:.2f} ms, {:.1f} MB/s.", fileNames.size(), megabytes, bestTime, megabytes / (bestTime / 1000.0f));
+}
+
+void Tests::MD5PrepareNormals(TestContext& context)
+{
+    axec::md5_model_t gridModel;
+    gridModel.meshes.resize(1);
+    BuildGridMesh(NORMALS_TEST_QUADS, gridModel, gridModel.meshes[0]);
+
+    int differentCount = 0;
+    float maxDifference = CompareNormals(gridModel.meshes[0], gridModel, differentCount);
+
+    // Both add up the same face normals in the same order, so the normals are the same to the bit.
+    Logger::Get()->info("Synthetic mesh of {} triangles: {} normals differ from the reference, by up to {}.", gridModel.meshes[0].trianglesCount, differentCount, maxDifference);
+    TEST_CHECK(context, differentCount == 0);
+
+    for (wchar_t const* fileName : NORMALS_MESH_FILES)
+    {
+        axec::md5_model_t model;
+        if (!TEST_CHECK(context, axec::MD5Loader::ParseMD5Mesh(fileName, model)))
+            continue;
+
+        differentCount = 0;
+        maxDifference = 0.0f;
+
+        for (axec::md5_mesh_t const& mesh : model.meshes)
+            maxDifference = std::max(maxDifference, CompareNormals(mesh, model, differentCount));
+
+        Logger::Get()->info("{}: {} normals differ from the reference, by up to {}.", StringHelper::WideToNarrow(fileName), differentCount, maxDifference);
+        TEST_CHECK(context, differentCount == 0);
+    }
+}
+
+void Tests::MD5PrepareNormalsBenchmark(TestContext& context)
+{
+    axec::md5_model_t model;
+    model.meshes.resize(1);
+    BuildGridMesh(NORMALS_BENCHMARK_QUADS, model, model.meshes[0]);
+
+    axec::md5_mesh_t const& mesh = model.meshes[0];
+    float bestTime = 0.0f;
+
+    for (int round = 0; round < BENCHMARK_ROUNDS; ++round)
+    {
+        axec::md5_mesh_t prepared = mesh;
+
+        auto const startTime = std::chrono::steady_clock::now();
+        axec::MD5Loader::PrepareNormals(prepared, model);
+        float const roundTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+        if (round == 0 || roundTime < bestTime)
+            bestTime = roundTime;
+    }
+
+    Logger::Get()->info("PrepareNormals of {} triangles and {} vertices in {:.2f} ms.", mesh.trianglesCount, mesh.vertices.size(), bestTime);
+}
+
+void Tests::MD5CookedLoadBenchmark(TestContext& context)
+{
+    std::vector<std::wstring> meshNames, animationNames;
+
+    for (std::filesystem::directory_entry const& entry : std::filesystem::recursive_directory_iterator(BENCHMARK_DIRECTORY))
+    {
+        if (entry.is_regular_file() && entry.path().extension() == ".md5mesh")
+            meshNames.push_back(entry.path().wstring());
+        else if (entry.is_regular_file() && entry.path().extension() == ".md5anim")
+            animationNames.push_back(entry.path().wstring());
+    }
+
+    if (!TEST_CHECK(context, !meshNames.empty() && !animationNames.empty()))
+        return;
+
+    // Cook every file again so none is out of date, and check that the cooked file loads to what the text parses to.
+    int differentCount = 0;
+
+    for (std::wstring const& fileName : meshNames)
+    {
+        axec::md5_model_t parsed, cooked;
+        if (!TEST_CHECK(context, axec::MD5Loader::CookMD5Mesh(fileName) && axec::MD5Cooker::LoadMesh(fileName, cooked)))
+            return;
+
+        axec::MD5Loader::ParseMD5Mesh(fileName, parsed);
+        if (!IsSameModel(parsed, cooked))
+            ++differentCount;
+    }
+
+    for (std::wstring const& fileName : animationNames)
+    {
+        axec::md5_anim_t parsed, cooked;
+        if (!TEST_CHECK(context, axec::MD5Loader::CookMD5Anim(fileName) && axec::MD5Cooker::LoadAnim(fileName, cooked)))
+            return;
+
+        axec::MD5Loader::ParseMD5Anim(fileName, parsed);
+        if (!IsSameAnimation(parsed, cooked))
+            ++differentCount;
+    }
+
+    TEST_CHECK(context, differentCount == 0);
+
+    // All files from the text and all of them from the cooked files, the best of the rounds with the files in the file cache.
+    float bestTextTime = 0.0f, bestCookedTime = 0.0f;
+
+    for (int round = 0; round < BENCHMARK_ROUNDS; ++round)
+    {
+        auto startTime = std::chrono::steady_clock::now();
+        for (std::wstring const& fileName : meshNames)
+        {
+            axec::md5_model_t model;
+            axec::MD5Loader::ParseMD5Mesh(fileName, model);
+        }
+        for (std::wstring const& fileName : animationNames)
+        {
+            axec::md5_anim_t animation;
+            axec::MD5Loader::ParseMD5Anim(fileName, animation);
+        }
+        float const textTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+        startTime = std::chrono::steady_clock::now();
+        for (std::wstring const& fileName : meshNames)
+        {
+            axec::md5_model_t model;
+            axec::MD5Cooker::LoadMesh(fileName, model);
+        }
+        for (std::wstring const& fileName : animationNames)
+        {
+            axec::md5_anim_t animation;
+            axec::MD5Cooker::LoadAnim(fileName, animation);
+        }
+        float const cookedTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+        bestTextTime = round == 0 ? textTime : std::min(bestTextTime, textTime);
+        bestCookedTime = round == 0 ? cookedTime : std::min(bestCookedTime, cookedTime);
+    }
+
+    Logger::Get()->info("Loaded {} MD5 meshes and {} animations in {:.2f} ms from the text files, {:.2f} ms from the cooked files.",
+        meshNames.size(), animationNames.size(), bestTextTime, bestCookedTime);
+}
\ No newline at end of file
@@ -0,0 +1,177 @@
+//
+// MD5ModelTests.cpp
+//
+
+#include "pch.h"
+#include "TestRunner.h"
+#include "MD5Model.h"
+#include "MD5Cache.h"
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#endif
+
+namespace
+{
+    constexpr wchar_t const* MESH_FILE = L"Data/Models/Reptile/reptile.md5mesh";
+    constexpr wchar_t const* ANIM_FILES[] = { L"Data/Models/Reptile/idle.md5anim", L"Data/Models/Reptile/walk.md5anim", L"Data/Models/Reptile/run.md5anim" };
+    constexpr int ANIM_COUNT = static_cast<int>(std::size(ANIM_FILES));
+
+    constexpr float FRAME_TIME = 1.0f / 60.0f;
+
+    // Frames played before counting, the task pool starts its threads and its queues reach their size on the first ones.
+    constexpr int WARMUP_FRAMES = 30;
+    constexpr int COUNTED_FRAMES = 300;
+
+    constexpr int BENCHMARK_CHARACTERS = 16;
+    constexpr int BENCHMARK_FRAMES = 200;
+
+#ifdef _DEBUG
+    // Counts the allocations of the debug heap on every thread, the workers of the task pool included.
+    std::atomic<long> allocationCount;
+
+    int __cdecl CountAllocation(int allocType, void*, size_t, int, long, unsigned char const*, int)
+    {
+        if (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC)
+            ++allocationCount;
+
+        return TRUE;
+    }
+#endif
+
+    bool LoadCharacter(ID3D11DeviceContext* deviceContext, MD5SkinningMode skinningMode, MD5Model& model)
+    {
+        if (!model.LoadMesh(deviceContext, MESH_FILE, skinningMode))
+            return false;
+
+        for (wchar_t const* fileName : ANIM_FILES)
+        {
+            if (!model.LoadAnim(fileName))
+                return false;
+        }
+
+        return true;
+    }
+
+    // Switches the animation every 50 frames, so the counted frames include the crossfades.
+    int GetAnimIndex(int frame)
+    {
+        return (frame / 50) % ANIM_COUNT;
+    }
+
+    char const* GetModeName(MD5SkinningMode skinningMode)
+    {
+        return skinningMode == MD5SkinningMode::GPU ? "GPU" : "CPU";
+    }
+}
+
+void Tests::MD5ModelUpdateAllocations(TestContext& context)
+{
+#ifdef _DEBUG
+    for (MD5SkinningMode skinningMode : { MD5SkinningMode::CPU, MD5SkinningMode::GPU })
+    {
+        MD5Model model;
+        if (!TEST_CHECK(context, LoadCharacter(context.GetDeviceContext(), skinningMode, model)))
+            continue;
+
+        for (int frame = 0; frame < WARMUP_FRAMES; ++frame)
+            model.Update(context.GetDeviceContext(), FRAME_TIME, GetAnimIndex(frame * 10));
+
+        allocationCount = 0;
+        _CRT_ALLOC_HOOK const previousHook = _CrtSetAllocHook(CountAllocation);
+
+        for (int frame = 0; frame < COUNTED_FRAMES; ++frame)
+            model.Update(context.GetDeviceContext(), FRAME_TIME, GetAnimIndex(frame));
+
+        _CrtSetAllocHook(previousHook);
+
+        Logger::Get()->info("{} skinned MD5Model::Update made {} allocations in {} frames.", GetModeName(skinningMode), allocationCount.load(), COUNTED_FRAMES);
+        TEST_CHECK(context, allocationCount == 0);
+    }
+
+    axec::MD5Cache::Clear();
+#else
+    Logger::Get()->warn("The allocations are counted with the debug heap, run the tests of a debug build to check them.");
+#endif
+}
+
+void Tests::MD5CacheSharing(TestContext& context)
+{
+    // Nothing of the reptile may be left in the cache from other tests, or the weak pointers below would see it.
+    axec::MD5Cache::Clear();
+
+    std::weak_ptr<axec::md5_model_t const> cachedModel;
+    std::vector<std::weak_ptr<axec::md5_anim_t const>> cachedAnimations;
+
+    {
+        MD5Model first, second;
+        if (!TEST_CHECK(context, LoadCharacter(context.GetDeviceContext(), MD5SkinningMode::CPU, first)) ||
+            !TEST_CHECK(context, LoadCharacter(context.GetDeviceContext(), MD5SkinningMode::CPU, second)))
+            return;
+
+        // Both instances use the one mesh and the same clips.
+        cachedModel = axec::MD5Cache::ResolveMesh(context.GetDeviceContext(), MESH_FILE, MD5SkinningMode::CPU);
+        TEST_CHECK(context, first.GetMesh() == cachedModel.lock().get() && second.GetMesh() == first.GetMesh());
+
+        for (int i = 0; i < ANIM_COUNT; ++i)
+        {
+            cachedAnimations.push_back(axec::MD5Cache::ResolveAnim(ANIM_FILES[i]));
+            TEST_CHECK(context, first.GetAnimation(i) == cachedAnimations[i].lock().get() && second.GetAnimation(i) == first.GetAnimation(i));
+        }
+
+        // Clear keeps what the instances still use.
+        axec::MD5Cache::Clear();
+        TEST_CHECK(context, !cachedModel.expired());
+
+        for (std::weak_ptr<axec::md5_anim_t const> const& animation : cachedAnimations)
+            TEST_CHECK(context, !animation.expired());
+    }
+
+    // Once the instances are gone the cache holds the last reference until it is cleared.
+    TEST_CHECK(context, !cachedModel.expired());
+    axec::MD5Cache::Clear();
+    TEST_CHECK(context, cachedModel.expired());
+
+    for (std::weak_ptr<axec::md5_anim_t const> const& animation : cachedAnimations)
+        TEST_CHECK(context, animation.expired());
+}
+
+void Tests::MD5ModelUpdateBenchmark(TestContext& context)
+{
+    for (MD5SkinningMode skinningMode : { MD5SkinningMode::CPU, MD5SkinningMode::GPU })
+    {
+        std::vector<std::unique_ptr<MD5Model>> characters(BENCHMARK_CHARACTERS);
+        bool loaded = true;
+
+        for (std::unique_ptr<MD5Model>& character : characters)
+        {
+            character = std::make_unique<MD5Model>();
+            loaded = loaded && LoadCharacter(context.GetDeviceContext(), skinningMode, *character);
+        }
+
+        if (!TEST_CHECK(context, loaded))
+            continue;
+
+        // Every character plays its own phase of the animations, like a crowd would.
+        for (int frame = 0; frame < WARMUP_FRAMES; ++frame)
+        {
+            for (int i = 0; i < BENCHMARK_CHARACTERS; ++i)
+                characters[i]->Update(context.GetDeviceContext(), FRAME_TIME * (1 + i), GetAnimIndex(frame + i * 50));
+        }
+
+        auto const startTime = std::chrono::steady_clock::now();
+
+        for (int frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+        {
+            for (int i = 0; i < BENCHMARK_CHARACTERS; ++i)
+                characters[i]->Update(context.GetDeviceContext(), FRAME_TIME, GetAnimIndex(frame + i * 50));
+        }
+
+        float const totalTime = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+        float const characterTime = totalTime / (BENCHMARK_FRAMES * BENCHMARK_CHARACTERS);
+
+        Logger::Get()->info("{} skinned MD5Model::Update: {:.2f} us per character, {} characters over {} frames.", GetModeName(skinningMode), characterTime, BENCHMARK_CHARACTERS, BENCHMARK_FRAMES);
+    }
+
+    axec::MD5Cache::Clear();
+}
\ No newline at end of file
@@ -0,0 +1,314 @@
+//
+// MD5SkinningTests.cpp
+//
+
+#include "pch.h"
+#include "TestRunner.h"
+#include "MD5Skinning.h"
+#include "MD5Cache.h"
+#include <random>
+
+namespace
+{
+    constexpr wchar_t const* MESH_FILE = L"Data/Models/Reptile/reptile.md5mesh";
+    constexpr wchar_t const* ANIM_FILE = L"Data/Models/Reptile/walk.md5anim";
+    constexpr int COMPARED_FRAMES[] = { 0, 7, 19, 33 };
+
+    constexpr int RANDOM_WEIGHT_ROUNDS = 500;
+    constexpr int MAX_RANDOM_WEIGHTS = 8;
+    constexpr float MAX_BIAS_ERROR = 1e-6f;
+
+    // The old skinning biased the joint position and the rotated weight, the matrices scale the weight by the bias
+    // before they transform it. That rounds a little differently.
+    constexpr float MAX_QUATERNION_POSITION_ERROR = 1e-4f;
+    constexpr float MAX_QUATERNION_NORMAL_ERROR = 1e-5f;
+
+    // The reptile is about two units tall. The renormalized biases and the 16 bit weight normals of the shader
+    // vertices round a little differently from the CPU weights.
+    constexpr float MAX_POSITION_ERROR = 1e-4f;
+    constexpr float MAX_NORMAL_ERROR = 2e-4f;
+
+    std::vector<axec::Weight> MakeWeights(std::initializer_list<float> biases)
+    {
+        std::vector<axec::Weight> weights;
+        for (float bias : biases)
+        {
+            axec::Weight weight = {};
+            weight.jointId = static_cast<int>(weights.size());
+            weight.bias = bias;
+            weights.push_back(weight);
+        }
+
+        return weights;
+    }
+
+    // The strongest weights by a stable sort, ties go to the weight that comes first like in ReduceWeights.
+    bool IsReducedCorrectly(std::vector<axec::Weight> const& weights, int count, int const* selectedWeights, float const* biases)
+    {
+        std::vector<int> order(weights.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = static_cast<int>(i);
+
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return weights[a].bias > weights[b].bias; });
+
+        int const expectedCount = std::min(static_cast<int>(weights.size()), axec::MD5Skinning::MAX_JOINT_INFLUENCES);
+        if (count != expectedCount)
+            return false;
+
+        float sum = 0.0f;
+        for (int i = 0; i < count; ++i)
+            sum += weights[order[i]].bias;
+
+        for (int i = 0; i < count; ++i)
+        {
+            float const expectedBias = sum > 0.0f ? weights[order[i]].bias / sum : 0.0f;
+            if (selectedWeights[i] != order[i] || !std::isfinite(biases[i]) || fabsf(biases[i] - expectedBias) > MAX_BIAS_ERROR)
+                return false;
+        }
+
+        return true;
+    }
+
+    bool CheckReduce(std::vector<axec::Weight> const& weights)
+    {
+        int selectedWeights[axec::MD5Skinning::MAX_JOINT_INFLUENCES];
+        float biases[axec::MD5Skinning::MAX_JOINT_INFLUENCES];
+
+        int const count = axec::MD5Skinning::ReduceWeights(weights.data(), static_cast<int>(weights.size()), selectedWeights, biases);
+        return IsReducedCorrectly(weights, count, selectedWeights, biases);
+    }
+
+    // What MD5SkinnedVertexShader.hlsl computes for a vertex. The palette is uploaded as column major matrices, so the
+    // shader sees the transpose of every palette entry and multiplies the row vectors of the weights with it.
+    void ShadeVertex(MD5SkinnedVertex const& vertex, DirectX::XMFLOAT4X4 const* palette, DirectX::XMFLOAT3& position, DirectX::XMFLOAT3& normal)
+    {
+        using namespace DirectX;
+
+        XMVECTOR skinnedPosition = XMVectorZero();
+        XMVECTOR skinnedNormal = XMVectorZero();
+
+        for (int i = 0; i < 4; ++i)
+        {
+            XMMATRIX const joint = XMMatrixTranspose(XMLoadFloat4x4(&palette[vertex.jointIndices[i]]));
+
+            // The input layout reads the normals as SNORM, -32768 clamps to -1.
+            XMVECTOR const weightNormal = XMVectorMax(XMVectorSet(vertex.weightNormals[i][0] / 32767.0f, vertex.weightNormals[i][1] / 32767.0f,
+                vertex.weightNormals[i][2] / 32767.0f, 0.0f), XMVectorReplicate(-1.0f));
+
+            skinnedPosition = XMVectorAdd(skinnedPosition, XMVector4Transform(XMLoadFloat4(&vertex.weightPositions[i]), joint));
+            skinnedNormal = XMVectorAdd(skinnedNormal, XMVectorScale(XMVector3TransformNormal(weightNormal, joint), vertex.weightPositions[i].w));
+        }
+
+        XMStoreFloat3(&position, skinnedPosition);
+        XMStoreFloat3(&normal, XMVector3Normalize(skinnedNormal));
+    }
+
+    // The skinning MD5Model::Update did before the joint matrices, a q * p * q^-1 product per weight. The normals are
+    // subtracted, that is the sign SkinningWeights::normals has folded in.
+    void SkinWithQuaternions(axec::md5_mesh_t const& mesh, axec::JointPose const* pose, std::vector<MD5Vertex>& vertices)
+    {
+        using namespace DirectX;
+
+        vertices = mesh.vertices;
+
+        for (MD5Vertex& vertex : vertices)
+        {
+            XMFLOAT3 position(0.0f, 0.0f, 0.0f), normal(0.0f, 0.0f, 0.0f);
+
+            for (int j = 0; j < vertex.WeightCount; ++j)
+            {
+                axec::Weight const& weight = mesh.weights[vertex.StartWeight + j];
+                axec::JointPose const& joint = pose[weight.jointId];
+
+                XMVECTOR const orientation = XMLoadFloat4(&joint.orientation);
+                XMVECTOR const orientationConjugate = XMQuaternionInverse(orientation);
+
+                XMFLOAT3 rotatedPoint;
+                XMStoreFloat3(&rotatedPoint, XMQuaternionMultiply(XMQuaternionMultiply(orientation,
+                    XMVectorSet(weight.position.x, weight.position.y, weight.position.z, 0.0f)), orientationConjugate));
+
+                position.x += (joint.position.x + rotatedPoint.x) * weight.bias;
+                position.y += (joint.position.y + rotatedPoint.y) * weight.bias;
+                position.z += (joint.position.z + rotatedPoint.z) * weight.bias;
+
+                XMStoreFloat3(&rotatedPoint, XMQuaternionMultiply(XMQuaternionMultiply(orientation,
+                    XMVectorSet(weight.normal.x, weight.normal.y, weight.normal.z, 0.0f)), orientationConjugate));
+
+                normal.x -= rotatedPoint.x * weight.bias;
+                normal.y -= rotatedPoint.y * weight.bias;
+                normal.z -= rotatedPoint.z * weight.bias;
+            }
+
+            vertex.position = position;
+            XMStoreFloat3(&vertex.normal, XMVector3Normalize(XMLoadFloat3(&normal)));
+        }
+    }
+
+    float GetDistance(DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b)
+    {
+        using namespace DirectX;
+        return XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&a), XMLoadFloat3(&b))));
+    }
+}
+
+void Tests::MD5SkinningReduceWeights(TestContext& context)
+{
+    int selectedWeights[axec::MD5Skinning::MAX_JOINT_INFLUENCES];
+    float biases[axec::MD5Skinning::MAX_JOINT_INFLUENCES];
+
+    // No weights, fewer than four and exactly four are all kept.
+    TEST_CHECK(context, axec::MD5Skinning::ReduceWeights(nullptr, 0, selectedWeights, biases) == 0);
+    TEST_CHECK(context, CheckReduce(MakeWeights({ 1.0f })));
+    TEST_CHECK(context, CheckReduce(MakeWeights({ 0.25f, 0.5f, 0.25f })));
+    TEST_CHECK(context, CheckReduce(MakeWeights({ 0.1f, 0.2f, 0.3f, 0.4f })));
+
+    // More than four, the weakest are dropped and the others scaled up to one.
+    TEST_CHECK(context, CheckReduce(MakeWeights({ 0.05f, 0.3f, 0.1f, 0.25f, 0.02f, 0.28f })));
+
+    std::vector<axec::Weight> const weights = MakeWeights({ 0.05f, 0.3f, 0.1f, 0.25f, 0.02f, 0.28f });
+    int const count = axec::MD5Skinning::ReduceWeights(weights.data(), static_cast<int>(weights.size()), selectedWeights, biases);
+    TEST_CHECK(context, count == 4 && selectedWeights[0] == 1 && selectedWeights[1] == 5 && selectedWeights[2] == 3 && selectedWeights[3] == 2);
+    TEST_CHECK(context, fabsf(biases[0] + biases[1] + biases[2] + biases[3] - 1.0f) <= MAX_BIAS_ERROR);
+
+    // Ties never pick a weight twice, and an all zero vertex keeps zero biases instead of dividing by zero.
+    TEST_CHECK(context, CheckReduce(MakeWeights({ 0.2f, 0.2f, 0.2f, 0.2f, 0.2f })));
+    TEST_CHECK(context, CheckReduce(MakeWeights({ 0.1f, 0.3f, 0.1f, 0.3f, 0.1f, 0.1f })));
+    TEST_CHECK(context, CheckReduce(MakeWeights({ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f })));
+    TEST_CHECK(context, CheckReduce(MakeWeights({ 0.0f, 0.0f })));
+
+    // Random biases from a few values, so ties are frequent.
+    std::mt19937 random(19);
+    std::uniform_int_distribution<int> randomCount(1, MAX_RANDOM_WEIGHTS);
+    std::uniform_int_distribution<int> randomBias(0, 4);
+
+    int wrongCount = 0;
+    for (int round = 0; round < RANDOM_WEIGHT_ROUNDS; ++round)
+    {
+        std::vector<axec::Weight> randomWeights(randomCount(random), axec::Weight());
+
+        for (size_t i = 0; i < randomWeights.size(); ++i)
+        {
+            randomWeights[i].jointId = static_cast<int>(i);
+            randomWeights[i].bias = randomBias(random) * 0.125f;
+        }
+
+        if (!CheckReduce(randomWeights))
+            ++wrongCount;
+    }
+
+    TEST_CHECK(context, wrongCount == 0);
+}
+
+void Tests::MD5SkinningMatchesQuaternions(TestContext& context)
+{
+    std::shared_ptr<axec::md5_model_t const> model = axec::MD5Cache::ResolveMesh(context.GetDeviceContext(), MESH_FILE, MD5SkinningMode::CPU);
+    std::shared_ptr<axec::md5_anim_t const> animation = axec::MD5Cache::ResolveAnim(ANIM_FILE);
+
+    if (!TEST_CHECK(context, model && animation))
+        return;
+
+    std::vector<DirectX::XMFLOAT4X4A> jointMatrices(model->numJoints);
+    std::vector<MD5Vertex> vertices, expectedVertices;
+
+    float maxPositionError = 0.0f, maxNormalError = 0.0f;
+    int comparedCount = 0;
+
+    for (int frame : COMPARED_FRAMES)
+    {
+        axec::JointPose const* pose = &animation->frameSkeleton[(frame % animation->numFrames) * animation->numJoints];
+        axec::MD5Skinning::BuildJointMatrices(pose, model->numJoints, jointMatrices.data());
+
+        for (axec::md5_mesh_t const& mesh : model->meshes)
+        {
+            SkinWithQuaternions(mesh, pose, expectedVertices);
+
+            // Skinned in two ranges like the task pool splits a mesh.
+            uint32 const vertexCount = static_cast<uint32>(mesh.vertices.size());
+            vertices = mesh.vertices;
+            axec::MD5Skinning::SkinVertices(mesh, jointMatrices.data(), 0, vertexCount / 3, vertices.data());
+            axec::MD5Skinning::SkinVertices(mesh, jointMatrices.data(), vertexCount / 3, vertexCount, vertices.data());
+
+            for (uint32 i = 0; i < vertexCount; ++i)
+            {
+                maxPositionError = std::max(maxPositionError, GetDistance(vertices[i].position, expectedVertices[i].position));
+                maxNormalError = std::max(maxNormalError, GetDistance(vertices[i].normal, expectedVertices[i].normal));
+                ++comparedCount;
+            }
+        }
+    }
+
+    TEST_CHECK(context, comparedCount > 0);
+    TEST_CHECK(context, maxPositionError <= MAX_QUATERNION_POSITION_ERROR);
+    TEST_CHECK(context, maxNormalError <= MAX_QUATERNION_NORMAL_ERROR);
+
+    Logger::Get()->info("Matrix skinning of {} vertices is {:.6f} off in position and {:.6f} in the normal from the quaternions.",
+        comparedCount, maxPositionError, maxNormalError);
+
+    model.reset();
+    animation.reset();
+    axec::MD5Cache::Clear();
+}
+
+void Tests::MD5SkinnedVertexShaderMatchesCPU(TestContext& context)
+{
+    std::shared_ptr<axec::md5_model_t const> model = axec::MD5Cache::ResolveMesh(context.GetDeviceContext(), MESH_FILE, MD5SkinningMode::CPU);
+    std::shared_ptr<axec::md5_anim_t const> animation = axec::MD5Cache::ResolveAnim(ANIM_FILE);
+
+    if (!TEST_CHECK(context, model && animation) || !TEST_CHECK(context, model->numJoints <= axec::MD5Skinning::MAX_PALETTE_JOINTS))
+        return;
+
+    std::vector<DirectX::XMFLOAT4X4A> jointMatrices(model->numJoints);
+    std::vector<DirectX::XMFLOAT4X4> palette(model->numJoints);
+    std::vector<MD5SkinnedVertex> skinnedVertices;
+    std::vector<MD5Vertex> vertices;
+
+    float maxPositionError = 0.0f, maxNormalError = 0.0f, maxReducedError = 0.0f;
+    int comparedCount = 0, reducedCount = 0;
+
+    // A few frames of the walk, every vertex skinned on the CPU and by the shader math.
+    for (int frame : COMPARED_FRAMES)
+    {
+        axec::JointPose const* pose = &animation->frameSkeleton[(frame % animation->numFrames) * animation->numJoints];
+
+        axec::MD5Skinning::BuildJointMatrices(pose, model->numJoints, jointMatrices.data());
+        axec::MD5Skinning::BuildJointPalette(jointMatrices.data(), model->numJoints, palette.data());
+
+        for (axec::md5_mesh_t const& mesh : model->meshes)
+        {
+            vertices = mesh.vertices;
+            axec::MD5Skinning::SkinVertices(mesh, jointMatrices.data(), 0, static_cast<uint32>(vertices.size()), vertices.data());
+            axec::MD5Skinning::BuildSkinnedVertices(mesh, skinnedVertices);
+
+            for (size_t i = 0; i < vertices.size(); ++i)
+            {
+                DirectX::XMFLOAT3 position, normal;
+                ShadeVertex(skinnedVertices[i], palette.data(), position, normal);
+
+                float const positionError = GetDistance(position, vertices[i].position);
+
+                // The vertices with more weights than the shader takes only get close, they are logged and not checked.
+                if (mesh.vertices[i].WeightCount > axec::MD5Skinning::MAX_JOINT_INFLUENCES)
+                {
+                    maxReducedError = std::max(maxReducedError, positionError);
+                    ++reducedCount;
+                    continue;
+                }
+
+                maxPositionError = std::max(maxPositionError, positionError);
+                maxNormalError = std::max(maxNormalError, GetDistance(normal, vertices[i].normal));
+                ++comparedCount;
+            }
+        }
+    }
+
+    TEST_CHECK(context, comparedCount > 0);
+    TEST_CHECK(context, maxPositionError <= MAX_POSITION_ERROR);
+    TEST_CHECK(context, maxNormalError <= MAX_NORMAL_ERROR);
+
+    Logger::Get()->info("Shader skinning of {} vertices is {:.6f} off in position and {:.6f} in the normal, {} vertices with more than {} weights are {:.4f} off.",
+        comparedCount, maxPositionError, maxNormalError, reducedCount, axec::MD5Skinning::MAX_JOINT_INFLUENCES, maxReducedError);
+
+    model.reset();
+    animation.reset();
+    axec::MD5Cache::Clear();
+}
\ No newline at end of file
@@ -0,0 +1,872 @@
+//
+// OctreeTests.cpp
+//
+
+#include "pch.h"
+#include "TestRunner.h"
+#include "Octree.h"
+#include "TriangleCollision.h"
+#include <random>
+
+namespace
+{
+    // Samples per side of the synthetic terrain, big enough to be split into leaves above and below the middle height.
+    constexpr int GRID_SIZE = 161;
+    constexpr int RANDOM_LOD_ROUNDS = 8;
+
+    // Points the player walks through the level, from the spawn point past the well and the bridge to the houses and
+    // back. The camera follows it like the third person camera of the game.
+    constexpr float CAMERA_PATH[][2] = { { 205.0f, 215.0f }, { 168.0f, 220.0f }, { 150.0f, 300.0f }, { 257.0f, 381.0f },
+        { 330.0f, 440.0f }, { 430.0f, 360.0f }, { 380.0f, 200.0f }, { 205.0f, 215.0f } };
+    constexpr int FRAMES_PER_PATH_SEGMENT = 120;
+    constexpr float CAMERA_DISTANCE = 20.0f;
+    constexpr float CAMERA_HEIGHT = 10.0f;
+
+    // Workers of the pool the parallel builds run on, more than one even on a machine with a single core.
+    constexpr uint32 PARALLEL_BUILD_WORKERS = 4;
+
+    // The collision queries are checked on a smaller grid, every query is also answered by testing every triangle. One
+    // tree has a single leaf, the other small leaves that share many triangles on their borders.
+    constexpr int COLLISION_GRID_SIZE = 65;
+    constexpr int COLLISION_LEAF_TRIANGLES[] = { 10000, 30 };
+    constexpr int COLLISION_QUERIES = 150;
+    constexpr int SWEEP_PATH_STEPS = 10;
+    constexpr float MAX_SWEEP_DISTANCE = 30.0f;
+
+    // The direction of a sweep is normalized a little differently by the octree, which moves its contacts by a few ulps.
+    constexpr float MAX_SWEEP_DISTANCE_ERROR = 1e-4f;
+
+    // A capsule moved to the first contact is within this of the radius from the ground.
+    constexpr float MAX_CONTACT_ERROR = 1e-3f;
+
+    // Leaf sizes that split the terrain into about a thousand, ten thousand and a hundred thousand nodes.
+    constexpr int TRAVERSAL_LEAF_TRIANGLES[] = { 2000, 165, 30 };
+
+    // The projection and frustum depth of PlayScene.
+    constexpr float FIELD_OF_VIEW = 90.0f;
+    constexpr float SCREEN_WIDTH = 800.0f;
+    constexpr float SCREEN_HEIGHT = 600.0f;
+    constexpr float SCREEN_DEPTH = 500.0f;
+
+    // Octree::MAX_TRIANGLES, a node with more triangles is split.
+    constexpr int MAX_LEAF_TRIANGLES = 10000;
+
+    // Samples per side of the grids the build is timed on, from about 33 thousand to a million triangles.
+    constexpr int BUILD_GRID_SIZES[] = { 129, 257, 513, 725 };
+
+    struct CameraFrame
+    {
+        DirectX::XMFLOAT3 position;
+        DirectX::XMMATRIX view;
+    };
+
+    // A height map grid with hills in it, laid out like the terrain vertices and indices.
+    void BuildGrid(int size, std::vector<DirectX::VertexPositionNormalColorDualTexture>& vertices, std::vector<uint32>& indices)
+    {
+        vertices.resize(size * size);
+        for (int j = 0; j < size; ++j)
+        {
+            for (int i = 0; i < size; ++i)
+            {
+                float const height = (8.0f * sinf(i * 0.11f) * cosf(j * 0.07f)) + (3.0f * sinf((i + j) * 0.31f));
+
+                vertices[(size * j) + i] = {};
+                vertices[(size * j) + i].position = DirectX::XMFLOAT3(static_cast<float>(i), height, static_cast<float>(size - 1 - j));
+            }
+        }
+
+        indices.clear();
+        for (int j = 0; j < size - 1; ++j)
+        {
+            for (int i = 0; i < size - 1; ++i)
+            {
+                uint32 const upperLeft = (size * (j + 1)) + i;
+                uint32 const upperRight = (size * (j + 1)) + (i + 1);
+                uint32 const bottomLeft = (size * j) + i;
+                uint32 const bottomRight = (size * j) + (i + 1);
+
+                indices.insert(indices.end(), { upperLeft, upperRight, bottomLeft, bottomLeft, upperRight, bottomRight });
+            }
+        }
+    }
+
+    // Twice the signed area of a triangle on the sample grid, the terrain triangles all have a negative one.
+    int64 GetDoubleArea(int size, uint32 index0, uint32 index1, uint32 index2)
+    {
+        int64 const x0 = index0 % size, z0 = index0 / size;
+        int64 const x1 = index1 % size, z1 = index1 / size;
+        int64 const x2 = index2 % size, z2 = index2 / size;
+
+        return ((x1 - x0) * (z2 - z0)) - ((x2 - x0) * (z1 - z0));
+    }
+
+    bool IsBorderEdge(int size, uint32 from, uint32 to)
+    {
+        int const x0 = from % size, z0 = from / size;
+        int const x1 = to % size, z1 = to / size;
+
+        return (x0 == x1 && (x0 == 0 || x0 == size - 1)) || (z0 == z1 && (z0 == 0 || z0 == size - 1));
+    }
+
+    // Checks that the leaves drawn at the given levels cover the grid once, without cracks or T-junctions. Every inner
+    // edge has to be used once in each direction, an edge that is only used once is a crack or a T-junction.
+    void CheckCoverage(TestContext& context, Octree const& octree, std::vector<int> const& leafLods)
+    {
+        std::vector<uint32> triangles;
+        std::vector<uint64> edges;
+        int64 area = 0;
+        int flippedCount = 0;
+
+        for (int leaf = 0; leaf < octree.GetLeafCount(); ++leaf)
+        {
+            octree.GetLeafTriangles(leaf, leafLods[leaf], triangles);
+
+            for (size_t i = 0; i + 2 < triangles.size(); i += 3)
+            {
+                int64 const triangleArea = GetDoubleArea(GRID_SIZE, triangles[i], triangles[i + 1], triangles[i + 2]);
+                if (triangleArea >= 0)
+                    ++flippedCount;
+
+                area += triangleArea;
+
+                for (int k = 0; k < 3; ++k)
+                    edges.push_back((static_cast<uint64>(triangles[i + k]) << 32) | triangles[i + ((k + 1) % 3)]);
+            }
+        }
+
+        std::sort(edges.begin(), edges.end());
+
+        int duplicateCount = 0;
+        int openCount = 0;
+        for (size_t i = 0; i < edges.size(); ++i)
+        {
+            uint32 const from = static_cast<uint32>(edges[i] >> 32);
+            uint32 const to = static_cast<uint32>(edges[i]);
+
+            if (i + 1 < edges.size() && edges[i] == edges[i + 1])
+                ++duplicateCount;
+
+            if (!std::binary_search(edges.begin(), edges.end(), (static_cast<uint64>(to) << 32) | from) && !IsBorderEdge(GRID_SIZE, from, to))
+                ++openCount;
+        }
+
+        TEST_CHECK(context, area == -2 * static_cast<int64>(GRID_SIZE - 1) * (GRID_SIZE - 1));
+        TEST_CHECK(context, flippedCount == 0);
+        TEST_CHECK(context, duplicateCount == 0);
+        TEST_CHECK(context, openCount == 0);
+    }
+
+    // The mesh the tree is built from, for the build that scans all of it for every node.
+    struct ScanMesh
+    {
+        DirectX::VertexPositionNormalColorDualTexture const* vertices;
+        int vertexCount;
+        uint32 const* indices;
+        int triangleCount;
+    };
+
+    // The root cube of the tree, around the bounds of all vertices.
+    void GetRootCube(ScanMesh const& mesh, float& centerX, float& centerY, float& centerZ, float& width)
+    {
+        DirectX::XMFLOAT3 minimum = mesh.vertices[0].position, maximum = mesh.vertices[0].position;
+        for (int i = 1; i < mesh.vertexCount; ++i)
+        {
+            DirectX::XMFLOAT3 const& position = mesh.vertices[i].position;
+            minimum = DirectX::XMFLOAT3(std::min(minimum.x, position.x), std::min(minimum.y, position.y), std::min(minimum.z, position.z));
+            maximum = DirectX::XMFLOAT3(std::max(maximum.x, position.x), std::max(maximum.y, position.y), std::max(maximum.z, position.z));
+        }
+
+        centerX = (minimum.x + maximum.x) * 0.5f;
+        centerY = (minimum.y + maximum.y) * 0.5f;
+        centerZ = (minimum.z + maximum.z) * 0.5f;
+        width = std::max(maximum.x - minimum.x, std::max(maximum.y - minimum.y, maximum.z - minimum.z));
+    }
+
+    // The triangle test of the octree, with the bounds of the triangle taken from its vertices every time.
+    bool IsTriangleInCube(ScanMesh const& mesh, int index, float x, float y, float z, float width)
+    {
+        DirectX::XMFLOAT3 const& v1 = mesh.vertices[mesh.indices[(index * 3)]].position;
+        DirectX::XMFLOAT3 const& v2 = mesh.vertices[mesh.indices[(index * 3) + 1]].position;
+        DirectX::XMFLOAT3 const& v3 = mesh.vertices[mesh.indices[(index * 3) + 2]].position;
+        float const radius = width / 2.0f;
+
+        return std::min(v1.x, std::min(v2.x, v3.x)) <= x + radius && std::max(v1.x, std::max(v2.x, v3.x)) >= x - radius &&
+            std::min(v1.y, std::min(v2.y, v3.y)) <= y + radius && std::max(v1.y, std::max(v2.y, v3.y)) >= y - radius &&
+            std::min(v1.z, std::min(v2.z, v3.z)) <= z + radius && std::max(v1.z, std::max(v2.z, v3.z)) >= z - radius;
+    }
+
+    int CountTriangles(ScanMesh const& mesh, float x, float y, float z, float width)
+    {
+        int count = 0;
+        for (int i = 0; i < mesh.triangleCount; ++i)
+        {
+            if (IsTriangleInCube(mesh, i, x, y, z, width))
+                ++count;
+        }
+
+        return count;
+    }
+
+    // A leaf of the scanning build with the cube the tree split off for it.
+    struct ScanLeaf
+    {
+        float x, y, z, width;
+        std::vector<uint32> triangles;
+    };
+
+    // The tree build before every node got the triangles its parent gathered. A node counts its triangles by scanning the
+    // whole mesh, a split node scans it again for every child and a leaf once more to collect its triangles. The leaves
+    // come out depth first like the leaves of the octree.
+    void BuildScanNode(ScanMesh const& mesh, float x, float y, float z, float width, std::vector<ScanLeaf>& leaves)
+    {
+        int const count = CountTriangles(mesh, x, y, z, width);
+        if (count == 0)
+            return;
+
+        if (count > MAX_LEAF_TRIANGLES)
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                float const offsetX = (((i & 2) ? -1.0f : 1.0f) * (width * 0.25f));
+                float const offsetY = (((i & 4) ? 1.0f : -1.0f) * (width * 0.25f));
+                float const offsetZ = (((i & 1) ? 1.0f : -1.0f) * (width * 0.25f));
+
+                if (CountTriangles(mesh, x + offsetX, y + offsetY, z + offsetZ, width * 0.5f) > 0)
+                    BuildScanNode(mesh, x + offsetX, y + offsetY, z + offsetZ, width * 0.5f, leaves);
+            }
+
+            return;
+        }
+
+        leaves.push_back({ x, y, z, width });
+        for (int i = 0; i < mesh.triangleCount; ++i)
+        {
+            if (IsTriangleInCube(mesh, i, x, y, z, width))
+                leaves.back().triangles.push_back(static_cast<uint32>(i));
+        }
+    }
+
+    void BuildScanLeaves(ScanMesh const& mesh, std::vector<ScanLeaf>& leaves)
+    {
+        float centerX, centerY, centerZ, width;
+        GetRootCube(mesh, centerX, centerY, centerZ, width);
+
+        leaves.clear();
+        BuildScanNode(mesh, centerX, centerY, centerZ, width, leaves);
+    }
+
+    // Counts the leaves of the octree whose triangles differ from the leaf of the scanning build at the same place.
+    int CompareLeaves(TestContext& context, ScanMesh const& mesh, Octree const& octree)
+    {
+        std::vector<ScanLeaf> leaves;
+        BuildScanLeaves(mesh, leaves);
+
+        if (!TEST_CHECK(context, octree.GetLeafCount() == static_cast<int>(leaves.size())))
+            return octree.GetLeafCount();
+
+        int differentCount = 0;
+        for (int leaf = 0; leaf < octree.GetLeafCount(); ++leaf)
+        {
+            if (octree.GetLeafTriangleIds(leaf) != leaves[leaf].triangles)
+                ++differentCount;
+        }
+
+        return differentCount;
+    }
+
+    // Two trees are the same if their leaves hold the same triangles and draw the same ones at every level of detail.
+    int CompareTrees(Octree const& a, Octree const& b)
+    {
+        std::vector<uint32> trianglesA, trianglesB;
+        int differentCount = 0;
+
+        for (int leaf = 0; leaf < a.GetLeafCount(); ++leaf)
+        {
+            bool same = a.GetLeafTriangleIds(leaf) == b.GetLeafTriangleIds(leaf);
+            for (int lod = 0; lod < Octree::LOD_COUNT; ++lod)
+            {
+                a.GetLeafTriangles(leaf, lod, trianglesA);
+                b.GetLeafTriangles(leaf, lod, trianglesB);
+                same = same && trianglesA == trianglesB;
+            }
+
+            if (!same)
+                ++differentCount;
+        }
+
+        return differentCount;
+    }
+
+    std::vector<Octree::Triangle> GetGridTriangles(std::vector<DirectX::VertexPositionNormalColorDualTexture> const& vertices, std::vector<uint32> const& indices)
+    {
+        std::vector<Octree::Triangle> triangles(indices.size() / 3);
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            triangles[i] = { vertices[indices[(i * 3)]].position, vertices[indices[(i * 3) + 1]].position, vertices[indices[(i * 3) + 2]].position,
+                static_cast<uint32>(i) };
+        }
+
+        return triangles;
+    }
+
+    // The same triangles with the same corners, in the order of their ids.
+    bool IsSameTriangles(std::vector<Octree::Triangle> const& triangles, std::vector<Octree::Triangle> const& expected)
+    {
+        if (triangles.size() != expected.size())
+            return false;
+
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            if (triangles[i].id != expected[i].id || std::memcmp(&triangles[i], &expected[i], sizeof(DirectX::XMFLOAT3) * 3) != 0)
+                return false;
+        }
+
+        return true;
+    }
+
+    // Squared distance of the capsule segment from the nearest triangle.
+    float GetNearestDistance(std::vector<Octree::Triangle> const& triangles, DirectX::XMFLOAT3 const& p, DirectX::XMFLOAT3 const& q)
+    {
+        DirectX::XMFLOAT3 onSegment, onTriangle;
+        float nearest = FLT_MAX;
+
+        for (Octree::Triangle const& triangle : triangles)
+            nearest = std::min(nearest, TriangleCollision::ClosestPointsOfSegmentTriangle(p, q, &triangle.v0, onSegment, onTriangle));
+
+        return nearest;
+    }
+
+    float GetComponent(DirectX::XMFLOAT3 const& value, int axis)
+    {
+        return axis == 0 ? value.x : (axis == 1 ? value.y : value.z);
+    }
+
+    float Dot(DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b)
+    {
+        return (a.x * b.x) + (a.y * b.y) + (a.z * b.z);
+    }
+
+    DirectX::XMFLOAT3 MoveAlong(DirectX::XMFLOAT3 const& point, DirectX::XMFLOAT3 const& direction, float distance)
+    {
+        return DirectX::XMFLOAT3(point.x + (direction.x * distance), point.y + (direction.y * distance), point.z + (direction.z * distance));
+    }
+
+    bool LoadTerrainTree(ID3D11DeviceContext* deviceContext, Terrain& terrain, Octree& octree)
+    {
+        terrain.Initialize(deviceContext);
+        if (terrain.GetVertices() == nullptr)
+            return false;
+
+        std::vector<uint32> indices(terrain.GetIndexCount());
+        terrain.CopyIndexArray(indices.data());
+
+        return octree.Build(terrain.GetVertices(), terrain.GetVertexCount(), indices.data(), terrain.GetIndexCount(), terrain.GetTerrainWidth());
+    }
+
+    // The camera looks at the player from behind and above while it walks the path, it stays above the ground.
+    void BuildCameraPath(Terrain& terrain, std::vector<CameraFrame>& frames)
+    {
+        using namespace DirectX;
+
+        frames.clear();
+
+        for (size_t segment = 0; segment + 1 < std::size(CAMERA_PATH); ++segment)
+        {
+            XMVECTOR const start = XMVectorSet(CAMERA_PATH[segment][0], 0.0f, CAMERA_PATH[segment][1], 0.0f);
+            XMVECTOR const end = XMVectorSet(CAMERA_PATH[segment + 1][0], 0.0f, CAMERA_PATH[segment + 1][1], 0.0f);
+            XMVECTOR const forward = XMVector3Normalize(XMVectorSubtract(end, start));
+
+            for (int frame = 0; frame < FRAMES_PER_PATH_SEGMENT; ++frame)
+            {
+                XMFLOAT3 player, camera;
+                XMStoreFloat3(&player, XMVectorLerp(start, end, static_cast<float>(frame) / FRAMES_PER_PATH_SEGMENT));
+                XMStoreFloat3(&camera, XMVectorSubtract(XMLoadFloat3(&player), XMVectorScale(forward, CAMERA_DISTANCE)));
+
+                float playerGround = 0.0f, cameraGround = 0.0f;
+                terrain.GetHeightAtPosition(player.x, player.z, playerGround);
+                terrain.GetHeightAtPosition(camera.x, camera.z, cameraGround);
+
+                player.y = playerGround + 2.0f;
+                camera.y = std::max(playerGround + CAMERA_HEIGHT, cameraGround + 2.0f);
+
+                frames.push_back({ camera, XMMatrixLookAtLH(XMLoadFloat3(&camera), XMLoadFloat3(&player), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) });
+            }
+        }
+    }
+
+    DirectX::XMMATRIX GetProjection()
+    {
+        return DirectX::XMMatrixPerspectiveFovLH(DirectX::XMConvertToRadians(FIELD_OF_VIEW), SCREEN_WIDTH / SCREEN_HEIGHT, 0.1f, 1500.0f);
+    }
+
+    // Half the screen height over tan(fieldOfViewY / 2), like PlayScene passes it.
+    float GetLodScale()
+    {
+        return SCREEN_HEIGHT * 0.5f / tanf(DirectX::XMConvertToRadians(FIELD_OF_VIEW) * 0.5f);
+    }
+}
+
+void Tests::OctreeLodSeams(TestContext& context)
+{
+    std::vector<DirectX::VertexPositionNormalColorDualTexture> vertices;
+    std::vector<uint32> indices, triangles;
+
+    BuildGrid(GRID_SIZE, vertices, indices);
+
+    Octree octree;
+    if (!TEST_CHECK(context, octree.Build(vertices.data(), static_cast<int>(vertices.size()), indices.data(), static_cast<int>(indices.size()), GRID_SIZE)))
+        return;
+
+    TEST_CHECK(context, octree.GetLeafCount() > 1);
+
+    // Every level on its own, then random levels for every leaf.
+    int triangleCount[Octree::LOD_COUNT] = {};
+    for (int lod = 0; lod < Octree::LOD_COUNT; ++lod)
+    {
+        for (int leaf = 0; leaf < octree.GetLeafCount(); ++leaf)
+        {
+            octree.GetLeafTriangles(leaf, lod, triangles);
+            triangleCount[lod] += static_cast<int>(triangles.size() / 3);
+        }
+
+        CheckCoverage(context, octree, std::vector<int>(octree.GetLeafCount(), lod));
+    }
+
+    std::mt19937 random(8);
+    std::uniform_int_distribution<int> randomLod(0, Octree::LOD_COUNT - 1);
+    std::vector<int> leafLods(octree.GetLeafCount());
+
+    for (int round = 0; round < RANDOM_LOD_ROUNDS; ++round)
+    {
+        for (int& lod : leafLods)
+            lod = randomLod(random);
+
+        CheckCoverage(context, octree, leafLods);
+    }
+
+    // Level 0 draws every triangle of the grid once, the coarser levels have to draw fewer of them. A level can't always
+    // beat the one before it, its bigger blocks need every sample along the sides they share with smaller ones.
+    TEST_CHECK(context, triangleCount[0] == (GRID_SIZE - 1) * (GRID_SIZE - 1) * 2);
+    for (int lod = 1; lod < Octree::LOD_COUNT; ++lod)
+        TEST_CHECK(context, triangleCount[lod] < triangleCount[0]);
+
+    Logger::Get()->info("Octree levels of detail of a {}x{} grid in {} leaves: {} / {} / {} / {} triangles.", GRID_SIZE, GRID_SIZE,
+        octree.GetLeafCount(), triangleCount[0], triangleCount[1], triangleCount[2], triangleCount[3]);
+}
+
+void Tests::OctreeBuildMatchesFullScan(TestContext& context)
+{
+    std::vector<DirectX::VertexPositionNormalColorDualTexture> vertices;
+    std::vector<uint32> indices;
+
+    // The synthetic grid, where triangles lie exactly on the splits, and the terrain of the game.
+    BuildGrid(GRID_SIZE, vertices, indices);
+
+    Octree gridTree;
+    if (TEST_CHECK(context, gridTree.Build(vertices.data(), static_cast<int>(vertices.size()), indices.data(), static_cast<int>(indices.size()), GRID_SIZE)))
+    {
+        ScanMesh const mesh = { vertices.data(), static_cast<int>(vertices.size()), indices.data(), static_cast<int>(indices.size() / 3) };
+
+        TEST_CHECK(context, gridTree.GetLeafCount() > 1);
+        TEST_CHECK(context, CompareLeaves(context, mesh, gridTree) == 0);
+    }
+
+    Terrain terrain;
+    Octree terrainTree;
+    if (!TEST_CHECK(context, LoadTerrainTree(context.GetDeviceContext(), terrain, terrainTree)))
+        return;
+
+    indices.resize(terrain.GetIndexCount());
+    terrain.CopyIndexArray(indices.data());
+
+    ScanMesh const mesh = { terrain.GetVertices(), terrain.GetVertexCount(), indices.data(), terrain.GetIndexCount() / 3 };
+    TEST_CHECK(context, CompareLeaves(context, mesh, terrainTree) == 0);
+}
+
+void Tests::OctreeBuildMatchesSerial(TestContext& context)
+{
+    Terrain terrain;
+    Frustum frustum;
+    std::vector<CameraFrame> frames;
+
+    terrain.Initialize(context.GetDeviceContext());
+    if (!TEST_CHECK(context, terrain.GetVertices() != nullptr))
+        return;
+
+    std::vector<uint32> indices(terrain.GetIndexCount());
+    terrain.CopyIndexArray(indices.data());
+
+    // The same terrain built on the calling thread alone and on a pool with workers, with the default leaves and with
+    // small ones that make a deep tree with many tasks.
+    TaskPool serialPool(0), parallelPool(PARALLEL_BUILD_WORKERS);
+
+    BuildCameraPath(terrain, frames);
+    DirectX::XMMATRIX const projection = GetProjection();
+
+    for (int leafTriangles : { 10000, 165 })
+    {
+        Octree serial, parallel;
+        serial.SetTaskPool(&serialPool);
+        parallel.SetTaskPool(&parallelPool);
+
+        for (Octree* octree : { &serial, &parallel })
+        {
+            octree->SetMaxLeafTriangles(leafTriangles);
+            if (!TEST_CHECK(context, octree->Build(terrain.GetVertices(), terrain.GetVertexCount(), indices.data(), terrain.GetIndexCount(), terrain.GetTerrainWidth())))
+                return;
+        }
+
+        if (!TEST_CHECK(context, serial.GetNodeCount() == parallel.GetNodeCount() && serial.GetLeafCount() == parallel.GetLeafCount()))
+            continue;
+
+        TEST_CHECK(context, CompareTrees(serial, parallel) == 0);
+
+        // The node bounds only show in the culling, both trees have to draw the same on every frame of the camera path.
+        int differentFrames = 0;
+        for (CameraFrame const& frame : frames)
+        {
+            frustum.Construct(SCREEN_DEPTH, frame.view, projection);
+            serial.Cull(&frustum, frame.position, GetLodScale());
+            parallel.Cull(&frustum, frame.position, GetLodScale());
+
+            if (serial.GetDrawCount() != parallel.GetDrawCount() || serial.GetCullTestCount() != parallel.GetCullTestCount() ||
+                serial.GetVisibleLeafCount() != parallel.GetVisibleLeafCount())
+                ++differentFrames;
+        }
+
+        TEST_CHECK(context, differentFrames == 0);
+    }
+}
+
+void Tests::OctreeCollisionMatchesBruteForce(TestContext& context)
+{
+    std::vector<DirectX::VertexPositionNormalColorDualTexture> vertices;
+    std::vector<uint32> indices;
+
+    BuildGrid(COLLISION_GRID_SIZE, vertices, indices);
+    std::vector<Octree::Triangle> const allTriangles = GetGridTriangles(vertices, indices);
+
+    float const gridEnd = static_cast<float>(COLLISION_GRID_SIZE - 1);
+    std::uniform_real_distribution<float> randomX(-2.0f, gridEnd + 2.0f), randomY(-14.0f, 14.0f), randomSize(0.05f, 5.0f);
+    std::uniform_real_distribution<float> randomOffset(-3.0f, 3.0f), randomDirection(-1.0f, 1.0f);
+
+    for (int leafTriangles : COLLISION_LEAF_TRIANGLES)
+    {
+        Octree octree;
+        octree.SetMaxLeafTriangles(leafTriangles);
+        if (!TEST_CHECK(context, octree.Build(vertices.data(), static_cast<int>(vertices.size()), indices.data(), static_cast<int>(indices.size()), COLLISION_GRID_SIZE)))
+            return;
+
+        std::mt19937 random(16);
+        std::vector<Octree::Triangle> found, expected;
+        int wrongBoxes = 0, wrongCapsules = 0, wrongSweeps = 0, wrongContacts = 0;
+        int boxHits = 0, capsuleHits = 0, sweepHits = 0;
+
+        for (int query = 0; query < COLLISION_QUERIES; ++query)
+        {
+            // A box anywhere around the grid against the separating axis test of every triangle. A triangle whose bounds
+            // are inside the box always overlaps it, one whose bounds don't touch the box never does.
+            DirectX::XMFLOAT3 const boxMin(randomX(random), randomY(random), randomX(random));
+            DirectX::XMFLOAT3 const boxMax(boxMin.x + randomSize(random) * 2.0f, boxMin.y + randomSize(random) * 2.0f, boxMin.z + randomSize(random) * 2.0f);
+            DirectX::XMFLOAT3 const center((boxMin.x + boxMax.x) * 0.5f, (boxMin.y + boxMax.y) * 0.5f, (boxMin.z + boxMax.z) * 0.5f);
+            DirectX::XMFLOAT3 const extents((boxMax.x - boxMin.x) * 0.5f, (boxMax.y - boxMin.y) * 0.5f, (boxMax.z - boxMin.z) * 0.5f);
+
+            octree.OverlapBox(boxMin, boxMax, found);
+
+            expected.clear();
+            bool boundsAgree = true;
+            for (Octree::Triangle const& triangle : allTriangles)
+            {
+                DirectX::XMFLOAT3 const corners[3] = {
+                    DirectX::XMFLOAT3(triangle.v0.x - center.x, triangle.v0.y - center.y, triangle.v0.z - center.z),
+                    DirectX::XMFLOAT3(triangle.v1.x - center.x, triangle.v1.y - center.y, triangle.v1.z - center.z),
+                    DirectX::XMFLOAT3(triangle.v2.x - center.x, triangle.v2.y - center.y, triangle.v2.z - center.z) };
+
+                bool const overlaps = TriangleCollision::TriangleOverlapsBox(corners, extents);
+                if (overlaps)
+                    expected.push_back(triangle);
+
+                bool inside = true, apart = false;
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    float const extent = GetComponent(extents, axis);
+                    float const minimum = std::min(GetComponent(corners[0], axis), std::min(GetComponent(corners[1], axis), GetComponent(corners[2], axis)));
+                    float const maximum = std::max(GetComponent(corners[0], axis), std::max(GetComponent(corners[1], axis), GetComponent(corners[2], axis)));
+
+                    inside = inside && minimum >= -extent && maximum <= extent;
+                    apart = apart || minimum > extent || maximum < -extent;
+                }
+
+                if ((inside && !overlaps) || (apart && overlaps))
+                    boundsAgree = false;
+            }
+
+            if (!IsSameTriangles(found, expected) || !boundsAgree)
+                ++wrongBoxes;
+            boxHits += found.empty() ? 0 : 1;
+
+            // A capsule, every fourth one a sphere, against the distance of every triangle. Every triangle with a corner
+            // inside the capsule has to be found.
+            DirectX::XMFLOAT3 const start(randomX(random), randomY(random) * 0.5f, randomX(random));
+            DirectX::XMFLOAT3 const end = query % 4 == 0 ? start : DirectX::XMFLOAT3(start.x + randomOffset(random), start.y + randomOffset(random), start.z + randomOffset(random));
+            float const radius = randomSize(random) * 0.5f;
+
+            octree.OverlapCapsule(start, end, radius, found);
+
+            expected.clear();
+            bool cornersFound = true;
+            for (Octree::Triangle const& triangle : allTriangles)
+            {
+                DirectX::XMFLOAT3 onSegment, onTriangle;
+                bool const overlaps = TriangleCollision::ClosestPointsOfSegmentTriangle(start, end, &triangle.v0, onSegment, onTriangle) <= radius * radius;
+                if (overlaps)
+                    expected.push_back(triangle);
+
+                for (DirectX::XMFLOAT3 const* corner : { &triangle.v0, &triangle.v1, &triangle.v2 })
+                {
+                    DirectX::XMFLOAT3 onAxis, onCorner;
+                    if (TriangleCollision::ClosestPointsOfSegments(start, end, *corner, *corner, onAxis, onCorner) < radius * radius * 0.999f)
+                        cornersFound = cornersFound && overlaps;
+                }
+            }
+
+            if (!IsSameTriangles(found, expected) || !cornersFound)
+                ++wrongCapsules;
+            capsuleHits += found.empty() ? 0 : 1;
+
+            // A capsule above the ground moving down at an angle. The first contact is the earliest of all triangles, at
+            // that distance the capsule touches the ground and on the way there it is never inside it.
+            DirectX::XMFLOAT3 const sweepStart(start.x, 16.0f + randomOffset(random), start.z);
+            DirectX::XMFLOAT3 const sweepEnd(end.x, sweepStart.y + (end.y - start.y), end.z);
+            DirectX::XMFLOAT3 const direction(randomDirection(random), -0.2f - fabsf(randomDirection(random)), randomDirection(random));
+
+            Octree::SweepHit hit;
+            bool const hasHit = octree.SweepCapsule(sweepStart, sweepEnd, radius, direction, MAX_SWEEP_DISTANCE, hit);
+
+            float const length = sqrtf((direction.x * direction.x) + (direction.y * direction.y) + (direction.z * direction.z));
+            DirectX::XMFLOAT3 const unitDirection(direction.x / length, direction.y / length, direction.z / length);
+
+            float expectedDistance = MAX_SWEEP_DISTANCE;
+            bool expectedHit = false;
+            for (Octree::Triangle const& triangle : allTriangles)
+            {
+                DirectX::XMFLOAT3 onSegment, onTriangle;
+                float time = expectedDistance;
+
+                if (TriangleCollision::ClosestPointsOfSegmentTriangle(sweepStart, sweepEnd, &triangle.v0, onSegment, onTriangle) <= radius * radius)
+                    time = 0.0f;
+                else if (!TriangleCollision::SweepCapsuleTriangle(sweepStart, sweepEnd, radius, unitDirection, &triangle.v0, time))
+                    continue;
+
+                if (time < expectedDistance || !expectedHit)
+                {
+                    expectedHit = true;
+                    expectedDistance = time;
+                }
+            }
+
+            if (hasHit != hit.hit || hasHit != expectedHit || (hasHit && fabsf(hit.distance - expectedDistance) > MAX_SWEEP_DISTANCE_ERROR))
+                ++wrongSweeps;
+
+            float const travelled = hasHit ? hit.distance : MAX_SWEEP_DISTANCE;
+            if (hasHit)
+            {
+                float const contact = sqrtf(GetNearestDistance(allTriangles, MoveAlong(sweepStart, unitDirection, travelled), MoveAlong(sweepEnd, unitDirection, travelled)));
+                if (fabsf(contact - radius) > MAX_CONTACT_ERROR || fabsf(sqrtf(Dot(hit.normal, hit.normal)) - 1.0f) > 1e-4f || Dot(hit.normal, unitDirection) > 1e-4f)
+                    ++wrongContacts;
+
+                ++sweepHits;
+            }
+
+            for (int step = 0; step < SWEEP_PATH_STEPS; ++step)
+            {
+                float const distance = travelled * step / SWEEP_PATH_STEPS;
+                if (sqrtf(GetNearestDistance(allTriangles, MoveAlong(sweepStart, unitDirection, distance), MoveAlong(sweepEnd, unitDirection, distance))) < radius - MAX_CONTACT_ERROR)
+                    ++wrongContacts;
+            }
+        }
+
+        TEST_CHECK(context, wrongBoxes == 0);
+        TEST_CHECK(context, wrongCapsules == 0);
+        TEST_CHECK(context, wrongSweeps == 0);
+        TEST_CHECK(context, wrongContacts == 0);
+
+        // The random queries have to hit the ground often enough to mean something.
+        TEST_CHECK(context, boxHits > COLLISION_QUERIES / 4 && capsuleHits > COLLISION_QUERIES / 4 && sweepHits > COLLISION_QUERIES / 2);
+
+        Logger::Get()->info("Octree collision queries in {} leaves: {} boxes, {} capsules and {} sweeps of {} hit the ground.",
+            octree.GetLeafCount(), boxHits, capsuleHits, sweepHits, COLLISION_QUERIES);
+    }
+}
+
+void Tests::OctreeBuildBenchmark(TestContext& context)
+{
+    std::vector<DirectX::VertexPositionNormalColorDualTexture> vertices;
+    std::vector<uint32> indices;
+    std::vector<ScanLeaf> leaves;
+
+    // The scanning build only partitions the triangles, the octree build also makes the vertices and the levels of
+    // detail of its leaves.
+    for (int size : BUILD_GRID_SIZES)
+    {
+        BuildGrid(size, vertices, indices);
+        ScanMesh const mesh = { vertices.data(), static_cast<int>(vertices.size()), indices.data(), static_cast<int>(indices.size() / 3) };
+
+        auto startTime = std::chrono::steady_clock::now();
+        BuildScanLeaves(mesh, leaves);
+        float const scanTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+        Octree octree;
+        startTime = std::chrono::steady_clock::now();
+        TEST_CHECK(context, octree.Build(vertices.data(), static_cast<int>(vertices.size()), indices.data(), static_cast<int>(indices.size()), size));
+        float const buildTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+        Logger::Get()->info("Octree build of {} triangles in {} leaves: {:.2f} ms, partitioning by scans of the whole mesh {:.2f} ms.",
+            mesh.triangleCount, octree.GetLeafCount(), buildTime, scanTime);
+    }
+}
+
+void Tests::OctreeLodBenchmark(TestContext& context)
+{
+    Terrain terrain;
+    Octree octree;
+    Frustum frustum;
+    std::vector<CameraFrame> frames;
+
+    if (!TEST_CHECK(context, LoadTerrainTree(context.GetDeviceContext(), terrain, octree)))
+        return;
+
+    BuildCameraPath(terrain, frames);
+
+    DirectX::XMMATRIX const projection = GetProjection();
+
+    // Walk the path once at full resolution and once with the levels of detail the game uses.
+    for (float lodScale : { 0.0f, GetLodScale() })
+    {
+        int64 drawCount = 0;
+        int maxDrawCount = 0;
+
+        auto const startTime = std::chrono::steady_clock::now();
+
+        for (CameraFrame const& frame : frames)
+        {
+            frustum.Construct(SCREEN_DEPTH, frame.view, projection);
+            octree.Cull(&frustum, frame.position, lodScale);
+
+            drawCount += octree.GetDrawCount();
+            maxDrawCount = std::max(maxDrawCount, octree.GetDrawCount());
+        }
+
+        float const frameTime = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - startTime).count() / frames.size();
+
+        Logger::Get()->info("Octree {}: {} triangles per frame on average, {} at most, culled in {:.2f} us, over {} frames of the camera path.",
+            lodScale > 0.0f ? "with levels of detail" : "at full resolution", drawCount / static_cast<int64>(frames.size()), maxDrawCount,
+            frameTime, frames.size());
+    }
+}
+
+void Tests::OctreeTraversalBenchmark(TestContext& context)
+{
+    Terrain terrain;
+    Frustum frustum;
+    std::vector<CameraFrame> frames;
+
+    terrain.Initialize(context.GetDeviceContext());
+    if (!TEST_CHECK(context, terrain.GetVertices() != nullptr))
+        return;
+
+    std::vector<uint32> indices(terrain.GetIndexCount());
+    terrain.CopyIndexArray(indices.data());
+
+    BuildCameraPath(terrain, frames);
+
+    DirectX::XMMATRIX const projection = GetProjection();
+
+    // The same terrain and camera path with smaller and smaller leaves, the culling walks more and more nodes.
+    for (int leafTriangles : TRAVERSAL_LEAF_TRIANGLES)
+    {
+        Octree octree;
+        octree.SetMaxLeafTriangles(leafTriangles);
+        if (!TEST_CHECK(context, octree.Build(terrain.GetVertices(), terrain.GetVertexCount(), indices.data(), terrain.GetIndexCount(), terrain.GetTerrainWidth())))
+            return;
+
+        int64 cullTestCount = 0, visibleLeafCount = 0;
+
+        auto const startTime = std::chrono::steady_clock::now();
+
+        for (CameraFrame const& frame : frames)
+        {
+            frustum.Construct(SCREEN_DEPTH, frame.view, projection);
+            octree.Cull(&frustum, frame.position, GetLodScale());
+
+            cullTestCount += octree.GetCullTestCount();
+            visibleLeafCount += octree.GetVisibleLeafCount();
+        }
+
+        float const frameTime = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - startTime).count() / frames.size();
+
+        Logger::Get()->info("Octree of {} nodes and {} leaves: culled in {:.2f} us per frame with {} node tests and {} visible leaves on average.",
+            octree.GetNodeCount(), octree.GetLeafCount(), frameTime, cullTestCount / static_cast<int64>(frames.size()),
+            visibleLeafCount / static_cast<int64>(frames.size()));
+    }
+}
+
+void Tests::OctreeTightBoundsBenchmark(TestContext& context)
+{
+    Terrain terrain;
+    Octree octree;
+    Frustum frustum;
+    std::vector<CameraFrame> frames;
+    std::vector<ScanLeaf> leaves;
+    std::vector<uint32> triangles;
+
+    if (!TEST_CHECK(context, LoadTerrainTree(context.GetDeviceContext(), terrain, octree)))
+        return;
+
+    std::vector<uint32> indices(terrain.GetIndexCount());
+    terrain.CopyIndexArray(indices.data());
+
+    // The cubes the tree split the terrain into, which the leaves were culled against before their bounds were refitted.
+    ScanMesh const mesh = { terrain.GetVertices(), terrain.GetVertexCount(), indices.data(), terrain.GetIndexCount() / 3 };
+    BuildScanLeaves(mesh, leaves);
+    if (!TEST_CHECK(context, static_cast<int>(leaves.size()) == octree.GetLeafCount()))
+        return;
+
+    std::vector<int> leafTriangleCounts(leaves.size());
+    for (int leaf = 0; leaf < octree.GetLeafCount(); ++leaf)
+    {
+        octree.GetLeafTriangles(leaf, 0, triangles);
+        leafTriangleCounts[leaf] = static_cast<int>(triangles.size() / 3);
+    }
+
+    BuildCameraPath(terrain, frames);
+
+    DirectX::XMMATRIX const projection = GetProjection();
+
+    // Every frame of the camera path at full resolution, once with the refitted bounds and once with the cubes. A cube is
+    // visible whenever a child cube in it is, so testing the leaf cubes alone draws what the tree of cubes drew.
+    int64 tightCount = 0, cubeCount = 0;
+    int maxTightCount = 0, maxCubeCount = 0;
+
+    for (CameraFrame const& frame : frames)
+    {
+        frustum.Construct(SCREEN_DEPTH, frame.view, projection);
+        octree.Cull(&frustum, frame.position, 0.0f);
+
+        int frameCubeCount = 0;
+        for (size_t leaf = 0; leaf < leaves.size(); ++leaf)
+        {
+            if (frustum.CheckCube(DirectX::XMFLOAT3(leaves[leaf].x, leaves[leaf].y, leaves[leaf].z), leaves[leaf].width * 0.5f))
+                frameCubeCount += leafTriangleCounts[leaf];
+        }
+
+        tightCount += octree.GetDrawCount();
+        cubeCount += frameCubeCount;
+        maxTightCount = std::max(maxTightCount, octree.GetDrawCount());
+        maxCubeCount = std::max(maxCubeCount, frameCubeCount);
+    }
+
+    int64 const frameCount = static_cast<int64>(frames.size());
+    Logger::Get()->info("Octree triangles drawn per frame over {} frames of the camera path: {} on average and {} at most with refitted bounds, "
+        "{} on average and {} at most with the node cubes.", frameCount, tightCount / frameCount, maxTightCount, cubeCount / frameCount, maxCubeCount);
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+//
+// TerrainCellTests.cpp
+//
+
+#include "pch.h"
+#include "TestRunner.h"
+#include "TerrainCell.h"
+
+namespace
+{
+    // The terrain cells are 33 samples wide, every level of detail fits them.
+    constexpr int CELL_SIZE = 33;
+    constexpr int LOD_COUNT = 4;
+
+    // Twice the signed area of a triangle on the sample grid of a cell.
+    int GetDoubleArea(unsigned int index0, unsigned int index1, unsigned int index2)
+    {
+        int const x0 = static_cast<int>(index0) % CELL_SIZE, z0 = static_cast<int>(index0) / CELL_SIZE;
+        int const x1 = static_cast<int>(index1) % CELL_SIZE, z1 = static_cast<int>(index1) / CELL_SIZE;
+        int const x2 = static_cast<int>(index2) % CELL_SIZE, z2 = static_cast<int>(index2) / CELL_SIZE;
+
+        return ((x1 - x0) * (z2 - z0)) - ((x2 - x0) * (z1 - z0));
+    }
+}
+
+void Tests::TerrainCellLodSeams(TestContext& context)
+{
+    std::vector<unsigned int> indices[LOD_COUNT];
+
+    for (int lod = 0; lod < LOD_COUNT; ++lod)
+        TerrainCell::BuildLodIndices(CELL_SIZE, CELL_SIZE, 1 << lod, indices[lod]);
+
+    // Every level covers the whole cell with triangles that all face the same way as the full resolution ones.
+    int const expectedArea = -2 * (CELL_SIZE - 1) * (CELL_SIZE - 1);
+
+    for (int lod = 0; lod < LOD_COUNT; ++lod)
+    {
+        int area = 0;
+        int flippedCount = 0;
+
+        for (size_t i = 0; i < indices[lod].size(); i += 3)
+        {
+            int const triangleArea = GetDoubleArea(indices[lod][i], indices[lod][i + 1], indices[lod][i + 2]);
+            if (triangleArea >= 0)
+                ++flippedCount;
+
+            area += triangleArea;
+        }
+
+        TEST_CHECK(context, indices[lod].size() % 3 == 0);
+        TEST_CHECK(context, area == expectedArea);
+        TEST_CHECK(context, flippedCount == 0);
+    }
+
+    // Neighbour cells at any two levels have the same edges on the side they share, so there are no cracks or T-junctions
+    // between them. The sides of the full resolution cell have an edge between every two samples.
+    std::vector<std::pair<int, int>> fullEdges;
+    for (int i = 0; i < CELL_SIZE - 1; ++i)
+        fullEdges.emplace_back(i, i + 1);
+
+    std::vector<std::pair<int, int>> edges, neighbourEdges;
+
+    for (int lod = 0; lod < LOD_COUNT; ++lod)
+    {
+        for (TerrainCell::CellSide side : { TerrainCell::CellSide::LEFT, TerrainCell::CellSide::RIGHT, TerrainCell::CellSide::BOTTOM, TerrainCell::CellSide::TOP })
+        {
+            TerrainCell::GetBorderEdges(CELL_SIZE, CELL_SIZE, indices[lod], side, edges);
+            TEST_CHECK(context, edges == fullEdges);
+        }
+
+        for (int neighbourLod = 0; neighbourLod < LOD_COUNT; ++neighbourLod)
+        {
+            // The right side of a cell is the left side of the next cell along the rows.
+            TerrainCell::GetBorderEdges(CELL_SIZE, CELL_SIZE, indices[lod], TerrainCell::CellSide::RIGHT, edges);
+            TerrainCell::GetBorderEdges(CELL_SIZE, CELL_SIZE, indices[neighbourLod], TerrainCell::CellSide::LEFT, neighbourEdges);
+            TEST_CHECK(context, edges == neighbourEdges);
+
+            // The top side of a cell is the bottom side of the next cell along the columns.
+            TerrainCell::GetBorderEdges(CELL_SIZE, CELL_SIZE, indices[lod], TerrainCell::CellSide::TOP, edges);
+            TerrainCell::GetBorderEdges(CELL_SIZE, CELL_SIZE, indices[neighbourLod], TerrainCell::CellSide::BOTTOM, neighbourEdges);
+            TEST_CHECK(context, edges == neighbourEdges);
+        }
+    }
+}
\ No newline at end of file
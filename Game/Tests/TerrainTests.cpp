@@ -0,0 +1,740 @@
+//
+// TerrainTests.cpp
+//
+
+#include "pch.h"
+#include "TestRunner.h"
+#include "Octree.h"
+#include "TerrainVertexPacker.h"
+#include <random>
+
+namespace
+{
+    // Rectangles of samples that are raised, one in the middle of the map and one in a corner where the border is cut off.
+    struct HeightEdit
+    {
+        int firstColumn, firstRow;
+        int columnCount, rowCount;
+    };
+
+    constexpr HeightEdit HEIGHT_EDITS[] = { { 200, 300, 12, 9 }, { 0, 0, 3, 4 } };
+    constexpr float HEIGHT_EDIT_RAISE = 50.0f;
+
+    // The normals of the packed vertices have 16 bits per component, they may be a few thousandths of a degree off.
+    constexpr double MAX_NORMAL_ERROR_DEGREES = 0.01;
+    constexpr int NORMAL_SPHERE_POINTS = 20000;
+
+    // The angle from the cross and dot products in double precision, the arc cosine of a float can't tell apart angles
+    // that small.
+    double GetAngleDegrees(DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b)
+    {
+        double const crossX = (static_cast<double>(a.y) * b.z) - (static_cast<double>(a.z) * b.y);
+        double const crossY = (static_cast<double>(a.z) * b.x) - (static_cast<double>(a.x) * b.z);
+        double const crossZ = (static_cast<double>(a.x) * b.y) - (static_cast<double>(a.y) * b.x);
+        double const dot = (static_cast<double>(a.x) * b.x) + (static_cast<double>(a.y) * b.y) + (static_cast<double>(a.z) * b.z);
+
+        return atan2(sqrt((crossX * crossX) + (crossY * crossY) + (crossZ * crossZ)), dot) * 180.0 / DirectX::XM_PI;
+    }
+
+    // Normals may differ in the last bits if the compiler contracts the scalar reference into multiply-adds.
+    constexpr int32 MAX_NORMAL_ULPS = 4;
+    constexpr int BUILD_BENCHMARK_ROUNDS = 10;
+
+    // A height map sample of the scalar setup passes the vertices were built with before, with all its values in one struct.
+    struct ReferenceSample
+    {
+        float x, y, z;
+        float nx, ny, nz;
+        float u, v;
+        float u1, v1;
+    };
+
+    // The four scalar passes over the samples: grid coordinates, face and vertex normals and the two texture
+    // coordinate sets. The vertex array is copied from the samples afterwards.
+    void BuildReferenceVertices(std::vector<float> const& heights, int width, int depth, int textureRepeat,
+        std::vector<DirectX::VertexPositionNormalColorDualTexture>& vertices)
+    {
+        std::vector<ReferenceSample> samples(width * depth);
+
+        for (int j = 0; j < depth; ++j)
+        {
+            for (int i = 0; i < width; ++i)
+            {
+                ReferenceSample& sample = samples[(width * j) + i];
+                sample.x = static_cast<float>(i);
+                sample.y = heights[(width * j) + i];
+                sample.z = -static_cast<float>(j) + static_cast<float>(depth - 1);
+            }
+        }
+
+        std::vector<DirectX::XMFLOAT3> faceNormals((depth - 1) * (width - 1));
+
+        for (int j = 0; j < depth - 1; ++j)
+        {
+            for (int i = 0; i < width - 1; ++i)
+            {
+                ReferenceSample const& vertex1 = samples[(j * width) + i];
+                ReferenceSample const& vertex2 = samples[(j * width) + i + 1];
+                ReferenceSample const& vertex3 = samples[((j + 1) * width) + i];
+
+                float const vector1[3] = { vertex1.x - vertex3.x, vertex1.y - vertex3.y, vertex1.z - vertex3.z };
+                float const vector2[3] = { vertex3.x - vertex2.x, vertex3.y - vertex2.y, vertex3.z - vertex2.z };
+
+                DirectX::XMFLOAT3& normal = faceNormals[(j * (width - 1)) + i];
+                normal.x = (vector1[1] * vector2[2]) - (vector1[2] * vector2[1]);
+                normal.y = (vector1[2] * vector2[0]) - (vector1[0] * vector2[2]);
+                normal.z = (vector1[0] * vector2[1]) - (vector1[1] * vector2[0]);
+            }
+        }
+
+        for (int j = 0; j < depth; ++j)
+        {
+            for (int i = 0; i < width; ++i)
+            {
+                float sum[3] = { 0.0f, 0.0f, 0.0f };
+                int count = 0;
+
+                // Bottom left, bottom right, upper left and upper right face.
+                int const faces[4][2] = { { i - 1, j - 1 }, { i, j - 1 }, { i - 1, j }, { i, j } };
+                for (auto const& face : faces)
+                {
+                    if (face[0] < 0 || face[1] < 0 || face[0] >= width - 1 || face[1] >= depth - 1)
+                        continue;
+
+                    DirectX::XMFLOAT3 const& normal = faceNormals[(face[1] * (width - 1)) + face[0]];
+                    sum[0] += normal.x;
+                    sum[1] += normal.y;
+                    sum[2] += normal.z;
+                    count++;
+                }
+
+                sum[0] = sum[0] / static_cast<float>(count);
+                sum[1] = sum[1] / static_cast<float>(count);
+                sum[2] = sum[2] / static_cast<float>(count);
+
+                float const length = sqrt((sum[0] * sum[0]) + (sum[1] * sum[1]) + (sum[2] * sum[2]));
+
+                ReferenceSample& sample = samples[(j * width) + i];
+                sample.nx = sum[0] / length;
+                sample.ny = sum[1] / length;
+                sample.nz = sum[2] / length;
+            }
+        }
+
+        float const increment = static_cast<float>(textureRepeat) / static_cast<float>(width);
+        for (int j = 0; j < depth; ++j)
+        {
+            for (int i = 0; i < width; ++i)
+            {
+                samples[(width * j) + i].u = increment * static_cast<float>(i);
+                samples[(width * j) + i].v = 1.0f - (increment * static_cast<float>(j));
+            }
+        }
+
+        // Every quad writes its alpha map coordinates to its four corners, the last quad to write a corner wins.
+        for (int j = 0; j < depth - 1; ++j)
+        {
+            for (int i = 0; i < width - 1; ++i)
+            {
+                for (int corner : { (width * (j + 1)) + i, (width * (j + 1)) + (i + 1), (width * j) + i, (width * j) + (i + 1) })
+                {
+                    samples[corner].u1 = 1.0f / width * i;
+                    samples[corner].v1 = 1.0f / depth * j;
+                }
+            }
+        }
+
+        vertices.resize(samples.size());
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            vertices[i].position = DirectX::XMFLOAT3(samples[i].x, samples[i].y, samples[i].z);
+            vertices[i].normal = DirectX::XMFLOAT3(samples[i].nx, samples[i].ny, samples[i].nz);
+            vertices[i].color = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+            vertices[i].textureCoordinate0 = DirectX::XMFLOAT2(samples[i].u, samples[i].v);
+            vertices[i].textureCoordinate1 = DirectX::XMFLOAT2(samples[i].u1, samples[i].v1);
+        }
+    }
+
+    // Distance of two floats in units in the last place, both have the same sign for the normals compared here.
+    int32 GetUlpDistance(float a, float b)
+    {
+        int32 bitsA, bitsB;
+        memcpy(&bitsA, &a, sizeof(a));
+        memcpy(&bitsB, &b, sizeof(b));
+
+        if ((bitsA < 0) != (bitsB < 0))
+            return a == b ? 0 : INT32_MAX;
+
+        return std::abs(bitsA - bitsB);
+    }
+
+    bool LoadTerrainHeights(ID3D11DeviceContext* deviceContext, Terrain& terrain, std::vector<float>& heights)
+    {
+        terrain.Initialize(deviceContext);
+        if (terrain.GetVertices() == nullptr)
+            return false;
+
+        heights.resize(terrain.GetVertexCount());
+        return terrain.GetHeights(0, 0, terrain.GetTerrainWidth(), terrain.GetTerrainHeight(), heights.data());
+    }
+
+    constexpr int RANDOM_RAYS = 300;
+    constexpr float RAY_MARCH_STEP = 0.01f;
+    constexpr float MAX_RAY_DISTANCE = 300.0f;
+
+    // A hit has to be on the surface GetHeightAtPosition reports, up to the rounding of the plane intersection.
+    constexpr float MAX_HIT_HEIGHT_ERROR = 1e-3f;
+
+    constexpr int BENCHMARK_RAYS = 100000;
+    constexpr int BENCHMARK_RAY_ROUNDS = 5;
+
+    // Terrain::HEIGHT_MAP_CACHE_FILE, removing it makes the next load build the vertices and write it again.
+    constexpr char const* TERRAIN_CACHE_FILE = "Data/terrain.raw.cache";
+    constexpr int LOAD_BENCHMARK_ROUNDS = 5;
+
+    struct TestRay
+    {
+        DirectX::XMFLOAT3 origin;
+        DirectX::XMFLOAT3 direction;
+    };
+
+    // Rays from above the terrain in random directions that point down, from steep to grazing ones.
+    void BuildRandomRays(Terrain& terrain, std::mt19937& random, float minSlope, float maxSlope, int count, std::vector<TestRay>& rays)
+    {
+        float const maxX = static_cast<float>(terrain.GetTerrainWidth() - 1);
+        float const maxZ = static_cast<float>(terrain.GetTerrainHeight() - 1);
+
+        std::uniform_real_distribution<float> randomX(0.0f, maxX), randomZ(0.0f, maxZ);
+        std::uniform_real_distribution<float> randomAngle(0.0f, DirectX::XM_2PI), randomSlope(minSlope, maxSlope);
+        std::uniform_real_distribution<float> randomHeight(0.1f, 20.0f);
+
+        rays.clear();
+        while (static_cast<int>(rays.size()) < count)
+        {
+            TestRay ray;
+            ray.origin = DirectX::XMFLOAT3(randomX(random), 0.0f, randomZ(random));
+            terrain.GetHeightAtPosition(ray.origin.x, ray.origin.z, ray.origin.y);
+            ray.origin.y += randomHeight(random);
+
+            float const angle = randomAngle(random);
+            ray.direction = DirectX::XMFLOAT3(cosf(angle), -randomSlope(random), sinf(angle));
+            rays.push_back(ray);
+        }
+    }
+
+    // The first distance at which a point on the ray is below the terrain, found in small steps. Thin crossings
+    // between two steps are missed, so a ray cast may find an earlier hit, but never a later one.
+    bool MarchRay(Terrain& terrain, TestRay const& ray, float maxDistance, float& distance)
+    {
+        float const length = sqrtf((ray.direction.x * ray.direction.x) + (ray.direction.y * ray.direction.y) + (ray.direction.z * ray.direction.z));
+
+        for (float t = 0.0f; t <= maxDistance; t += RAY_MARCH_STEP)
+        {
+            float height;
+            float const x = ray.origin.x + (ray.direction.x / length) * t;
+            float const z = ray.origin.z + (ray.direction.z / length) * t;
+
+            if (terrain.GetHeightAtPosition(x, z, height) && ray.origin.y + (ray.direction.y / length) * t <= height)
+            {
+                distance = t;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool IsOnSurface(Terrain& terrain, Terrain::RayHit const& hit)
+    {
+        float height;
+        return terrain.GetHeightAtPosition(hit.position.x, hit.position.z, height) && fabsf(hit.position.y - height) <= MAX_HIT_HEIGHT_ERROR &&
+            hit.normal.y > 0.0f && fabsf((hit.normal.x * hit.normal.x) + (hit.normal.y * hit.normal.y) + (hit.normal.z * hit.normal.z) - 1.0f) <= 1e-4f;
+    }
+
+    // Counts the rays whose hit isn't on the surface or comes after the first point the march finds below it.
+    int CheckRays(Terrain& terrain, std::vector<TestRay> const& rays, int& hitCount)
+    {
+        int wrongCount = 0;
+
+        for (TestRay const& ray : rays)
+        {
+            Terrain::RayHit hit;
+            bool const hasHit = terrain.Raycast(ray.origin, ray.direction, MAX_RAY_DISTANCE, hit);
+
+            float marchDistance;
+            bool const hasMarchHit = MarchRay(terrain, ray, MAX_RAY_DISTANCE, marchDistance);
+
+            if (hasHit != hit.hit || (hasMarchHit && !hasHit))
+                ++wrongCount;
+            else if (hasHit && (!IsOnSurface(terrain, hit) || (hasMarchHit && hit.distance > marchDistance + 1e-3f)))
+                ++wrongCount;
+
+            if (hasHit)
+                ++hitCount;
+        }
+
+        return wrongCount;
+    }
+
+    bool IsSameVertex(DirectX::VertexPositionNormalColorDualTexture const& a, DirectX::VertexPositionNormalColorDualTexture const& b)
+    {
+        return memcmp(&a, &b, sizeof(a)) == 0;
+    }
+}
+
+void Tests::TerrainHeightEdits(TestContext& context)
+{
+    Terrain terrain;
+    Octree octree;
+    std::vector<Octree::Triangle> triangles;
+
+    // Nothing can be edited before the height map is loaded.
+    float height = 0.0f;
+    TEST_CHECK(context, !terrain.GetHeights(0, 0, 1, 1, &height));
+    TEST_CHECK(context, !octree.SetHeights(context.GetDeviceContext(), &terrain, 0, 0, 1, 1, &height));
+    TEST_CHECK(context, !terrain.GetHeightAtPosition(0.0f, 0.0f, height));
+
+    terrain.Initialize(context.GetDeviceContext());
+    if (!TEST_CHECK(context, terrain.GetVertices() != nullptr) || !TEST_CHECK(context, octree.Initialize(&terrain, context.GetDeviceContext())))
+        return;
+
+    int const width = terrain.GetTerrainWidth();
+    int const depth = terrain.GetTerrainHeight();
+
+    // Rectangles that don't fit the height map are rejected.
+    TEST_CHECK(context, !octree.SetHeights(context.GetDeviceContext(), &terrain, width - 1, 0, 2, 1, &height));
+    TEST_CHECK(context, !octree.SetHeights(context.GetDeviceContext(), &terrain, 0, -1, 1, 1, &height));
+    TEST_CHECK(context, !octree.SetHeights(context.GetDeviceContext(), &terrain, 0, 0, 0, 1, &height));
+
+    for (HeightEdit const& edit : HEIGHT_EDITS)
+    {
+        std::vector<DirectX::VertexPositionNormalColorDualTexture> before(terrain.GetVertices(), terrain.GetVertices() + terrain.GetVertexCount());
+        std::vector<float> heights(edit.columnCount * edit.rowCount), result(heights.size());
+
+        TEST_CHECK(context, terrain.GetHeights(edit.firstColumn, edit.firstRow, edit.columnCount, edit.rowCount, heights.data()));
+
+        // The rectangle is raised above everything around it.
+        float highest = -FLT_MAX;
+        for (float& sample : heights)
+        {
+            highest = std::max(highest, sample);
+            sample += HEIGHT_EDIT_RAISE;
+        }
+
+        // In world space the columns run along x and the rows along negative z, the box covers the inner quads of the
+        // rectangle above its old heights.
+        DirectX::XMFLOAT3 const boxMin(static_cast<float>(edit.firstColumn) + 0.25f, highest + 1.0f,
+            static_cast<float>(depth - edit.firstRow - edit.rowCount) + 0.75f);
+        DirectX::XMFLOAT3 const boxMax(static_cast<float>(edit.firstColumn + edit.columnCount) - 1.25f, highest + HEIGHT_EDIT_RAISE,
+            static_cast<float>(depth - 1 - edit.firstRow) - 0.25f);
+
+        TEST_CHECK(context, octree.OverlapBox(boxMin, boxMax, triangles) == 0);
+        TEST_CHECK(context, octree.SetHeights(context.GetDeviceContext(), &terrain, edit.firstColumn, edit.firstRow, edit.columnCount, edit.rowCount, heights.data()));
+
+        TEST_CHECK(context, terrain.GetHeights(edit.firstColumn, edit.firstRow, edit.columnCount, edit.rowCount, result.data()));
+        TEST_CHECK(context, result == heights);
+
+        // Only the rectangle and the ring of samples around it change. The ring keeps its positions, only its normals
+        // see the new faces.
+        int changedOutside = 0, movedRing = 0, wrongHeights = 0;
+        for (int row = 0; row < depth; ++row)
+        {
+            for (int column = 0; column < width; ++column)
+            {
+                int const index = (row * width) + column;
+                DirectX::VertexPositionNormalColorDualTexture const& vertex = terrain.GetVertices()[index];
+
+                bool const inRectangle = column >= edit.firstColumn && column < edit.firstColumn + edit.columnCount &&
+                    row >= edit.firstRow && row < edit.firstRow + edit.rowCount;
+                bool const inRegion = column >= edit.firstColumn - 1 && column <= edit.firstColumn + edit.columnCount &&
+                    row >= edit.firstRow - 1 && row <= edit.firstRow + edit.rowCount;
+
+                if (inRectangle)
+                {
+                    if (vertex.position.y != heights[((row - edit.firstRow) * edit.columnCount) + (column - edit.firstColumn)])
+                        ++wrongHeights;
+                }
+                else if (inRegion)
+                {
+                    if (memcmp(&vertex.position, &before[index].position, sizeof(vertex.position)) != 0)
+                        ++movedRing;
+                }
+                else if (!IsSameVertex(vertex, before[index]))
+                {
+                    ++changedOutside;
+                }
+            }
+        }
+
+        TEST_CHECK(context, wrongHeights == 0);
+        TEST_CHECK(context, movedRing == 0);
+        TEST_CHECK(context, changedOutside == 0);
+
+        // The octree refits its bounds and collision triangles, the raised quads are found above the old heights now.
+        int const found = octree.OverlapBox(boxMin, boxMax, triangles);
+        TEST_CHECK(context, found > 0);
+
+        int outsideRegion = 0;
+        for (Octree::Triangle const& triangle : triangles)
+        {
+            for (DirectX::XMFLOAT3 const& corner : { triangle.v0, triangle.v1, triangle.v2 })
+            {
+                int const column = static_cast<int>(corner.x);
+                int const row = depth - 1 - static_cast<int>(corner.z);
+
+                if (column < edit.firstColumn - 1 || column > edit.firstColumn + edit.columnCount ||
+                    row < edit.firstRow - 1 || row > edit.firstRow + edit.rowCount)
+                    ++outsideRegion;
+            }
+        }
+
+        TEST_CHECK(context, outsideRegion == 0);
+    }
+}
+
+void Tests::TerrainVertexPackerRoundTrip(TestContext& context)
+{
+    Terrain terrain;
+    terrain.Initialize(context.GetDeviceContext());
+    if (!TEST_CHECK(context, terrain.GetVertices() != nullptr))
+        return;
+
+    TerrainVertexPacker const packer(terrain.GetPackingParameters());
+    int const width = terrain.GetTerrainWidth();
+    int const depth = terrain.GetTerrainHeight();
+
+    // Every vertex of the terrain, the last column and row included. The grid position, the height and the texture
+    // coordinates come back exactly as Terrain::BuildVertexArray made them, the normal within a small angle.
+    int wrongPositions = 0, wrongTextureCoordinates = 0, wrongColors = 0;
+    double maxNormalError = 0.0;
+
+    for (int j = 0; j < depth; ++j)
+    {
+        for (int i = 0; i < width; ++i)
+        {
+            DirectX::VertexPositionNormalColorDualTexture const& vertex = terrain.GetVertices()[(j * width) + i];
+            DirectX::VertexTerrainPacked const packed = packer.Pack(vertex);
+            DirectX::VertexPositionNormalColorDualTexture const unpacked = packer.Unpack(packed);
+
+            if (packed.gridX != i || packed.gridZ != j || memcmp(&unpacked.position, &vertex.position, sizeof(vertex.position)) != 0)
+                ++wrongPositions;
+
+            if (memcmp(&unpacked.textureCoordinate0, &vertex.textureCoordinate0, sizeof(vertex.textureCoordinate0)) != 0 ||
+                memcmp(&unpacked.textureCoordinate1, &vertex.textureCoordinate1, sizeof(vertex.textureCoordinate1)) != 0)
+                ++wrongTextureCoordinates;
+
+            if (memcmp(&unpacked.color, &vertex.color, sizeof(vertex.color)) != 0)
+                ++wrongColors;
+
+            maxNormalError = std::max(maxNormalError, GetAngleDegrees(unpacked.normal, vertex.normal));
+        }
+    }
+
+    TEST_CHECK(context, wrongPositions == 0);
+    TEST_CHECK(context, wrongTextureCoordinates == 0);
+    TEST_CHECK(context, wrongColors == 0);
+    TEST_CHECK(context, maxNormalError <= MAX_NORMAL_ERROR_DEGREES);
+
+    // The far corner of the map, where the texture coordinates of the alpha map stop growing.
+    DirectX::VertexPositionNormalColorDualTexture const corner = packer.Unpack(packer.Pack(terrain.GetVertices()[terrain.GetVertexCount() - 1]));
+    TEST_CHECK(context, corner.position.x == static_cast<float>(width - 1) && corner.position.z == 0.0f);
+
+    // Normals all over the sphere, half of them have a negative z and are folded over the corners of the octahedron.
+    // The axes and the diagonals are on the creases of the fold.
+    std::vector<DirectX::XMFLOAT3> normals = { { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f },
+        { 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.7071068f, 0.0f, -0.7071068f }, { 0.0f, -0.7071068f, -0.7071068f },
+        { 0.5773503f, -0.5773503f, -0.5773503f }, { -0.5773503f, 0.5773503f, -0.5773503f } };
+
+    for (int k = 0; k < NORMAL_SPHERE_POINTS; ++k)
+    {
+        // A Fibonacci sphere spreads the points evenly.
+        float const z = 1.0f - ((2.0f * k + 1.0f) / NORMAL_SPHERE_POINTS);
+        float const radius = sqrtf(std::max(1.0f - (z * z), 0.0f));
+        float const angle = 2.399963f * static_cast<float>(k);
+
+        normals.emplace_back(radius * cosf(angle), radius * sinf(angle), z);
+    }
+
+    double maxSphereError = 0.0, maxFoldedError = 0.0;
+    for (DirectX::XMFLOAT3 const& normal : normals)
+    {
+        int16 x, y;
+        TerrainVertexPacker::EncodeNormal(normal, x, y);
+
+        double const error = GetAngleDegrees(TerrainVertexPacker::DecodeNormal(x, y), normal);
+        maxSphereError = std::max(maxSphereError, error);
+
+        if (normal.z < 0.0f)
+            maxFoldedError = std::max(maxFoldedError, error);
+    }
+
+    TEST_CHECK(context, maxSphereError <= MAX_NORMAL_ERROR_DEGREES);
+    TEST_CHECK(context, maxFoldedError <= MAX_NORMAL_ERROR_DEGREES);
+
+    Logger::Get()->info("Packed terrain normals are at most {:.4f} degrees off on the terrain and {:.4f} degrees on the sphere.",
+        maxNormalError, maxSphereError);
+}
+
+void Tests::TerrainNormalsMatchScalar(TestContext& context)
+{
+    Terrain terrain;
+    std::vector<float> heights;
+
+    if (!TEST_CHECK(context, LoadTerrainHeights(context.GetDeviceContext(), terrain, heights)))
+        return;
+
+    // The vertices may come from the cache, build them from the heights with the current code.
+    TEST_CHECK(context, terrain.RebuildVertexArray());
+
+    std::vector<DirectX::VertexPositionNormalColorDualTexture> reference;
+    BuildReferenceVertices(heights, terrain.GetTerrainWidth(), terrain.GetTerrainHeight(), terrain.GetPackingParameters().textureRepeat, reference);
+
+    // Everything but the normals is the same to the bit, the normals may only be a few bits off.
+    int wrongVertices = 0, differentNormals = 0;
+    int32 maxUlps = 0;
+
+    for (int i = 0; i < terrain.GetVertexCount(); ++i)
+    {
+        DirectX::VertexPositionNormalColorDualTexture const& vertex = terrain.GetVertices()[i];
+
+        if (memcmp(&vertex.position, &reference[i].position, sizeof(vertex.position)) != 0 ||
+            memcmp(&vertex.color, &reference[i].color, sizeof(vertex.color)) != 0 ||
+            memcmp(&vertex.textureCoordinate0, &reference[i].textureCoordinate0, sizeof(vertex.textureCoordinate0)) != 0 ||
+            memcmp(&vertex.textureCoordinate1, &reference[i].textureCoordinate1, sizeof(vertex.textureCoordinate1)) != 0)
+            ++wrongVertices;
+
+        int32 const ulps = std::max({ GetUlpDistance(vertex.normal.x, reference[i].normal.x), GetUlpDistance(vertex.normal.y, reference[i].normal.y),
+            GetUlpDistance(vertex.normal.z, reference[i].normal.z) });
+
+        maxUlps = std::max(maxUlps, ulps);
+        if (ulps > 0)
+            ++differentNormals;
+    }
+
+    TEST_CHECK(context, wrongVertices == 0);
+    TEST_CHECK(context, maxUlps <= MAX_NORMAL_ULPS);
+
+    Logger::Get()->info("Terrain normals: {} of {} differ from the scalar passes, by at most {} units in the last place.",
+        differentNormals, terrain.GetVertexCount(), maxUlps);
+}
+
+void Tests::TerrainVertexBuildBenchmark(TestContext& context)
+{
+    Terrain terrain;
+    std::vector<float> heights;
+    std::vector<DirectX::VertexPositionNormalColorDualTexture> reference;
+
+    if (!TEST_CHECK(context, LoadTerrainHeights(context.GetDeviceContext(), terrain, heights)))
+        return;
+
+    int const textureRepeat = terrain.GetPackingParameters().textureRepeat;
+
+    auto startTime = std::chrono::steady_clock::now();
+    for (int round = 0; round < BUILD_BENCHMARK_ROUNDS; ++round)
+        BuildReferenceVertices(heights, terrain.GetTerrainWidth(), terrain.GetTerrainHeight(), textureRepeat, reference);
+    float const referenceTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    startTime = std::chrono::steady_clock::now();
+    for (int round = 0; round < BUILD_BENCHMARK_ROUNDS; ++round)
+        terrain.RebuildVertexArray();
+    float const buildTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    Logger::Get()->info("Terrain vertices of a {}x{} height map: scalar passes {:.2f} ms, parallel pass {:.2f} ms with {} task pool workers.",
+        terrain.GetTerrainWidth(), terrain.GetTerrainHeight(), referenceTime / BUILD_BENCHMARK_ROUNDS, buildTime / BUILD_BENCHMARK_ROUNDS,
+        TaskPool::Get().GetWorkerCount());
+}
+
+void Tests::TerrainRaycast(TestContext& context)
+{
+    Terrain terrain;
+    Terrain::RayHit hit;
+
+    // Nothing is hit before the height map is loaded.
+    TEST_CHECK(context, !terrain.Raycast(DirectX::XMFLOAT3(10.0f, 100.0f, 10.0f), DirectX::XMFLOAT3(0.0f, -1.0f, 0.0f), 1000.0f, hit));
+
+    terrain.Initialize(context.GetDeviceContext());
+    if (!TEST_CHECK(context, terrain.GetVertices() != nullptr))
+        return;
+
+    std::mt19937 random(15);
+    std::vector<TestRay> rays;
+    int hitCount = 0;
+
+    // Steep rays, then grazing ones that run almost flat over the ground.
+    BuildRandomRays(terrain, random, 0.2f, 3.0f, RANDOM_RAYS, rays);
+    TEST_CHECK(context, CheckRays(terrain, rays, hitCount) == 0);
+    TEST_CHECK(context, hitCount > RANDOM_RAYS / 2);
+
+    hitCount = 0;
+    BuildRandomRays(terrain, random, 0.0005f, 0.01f, RANDOM_RAYS, rays);
+    TEST_CHECK(context, CheckRays(terrain, rays, hitCount) == 0);
+    TEST_CHECK(context, hitCount > 0);
+
+    // Vertical rays hit right below their origin, also on the sample grid and on the diagonals of the quads. They
+    // only reach the ground if it is within their distance.
+    std::uniform_real_distribution<float> randomPosition(0.0f, static_cast<float>(terrain.GetTerrainWidth() - 1));
+    int wrongVertical = 0;
+
+    for (int i = 0; i < RANDOM_RAYS; ++i)
+    {
+        float x = randomPosition(random), z = randomPosition(random);
+        if (i % 3 == 1)
+        {
+            x = floorf(x);
+            z = floorf(z);
+        }
+        else if (i % 3 == 2)
+        {
+            z = floorf(z) + (x - floorf(x));
+        }
+
+        float height;
+        terrain.GetHeightAtPosition(x, z, height);
+
+        DirectX::XMFLOAT3 const origin(x, height + 10.0f, z);
+        DirectX::XMFLOAT3 const down(0.0f, -1.0f, 0.0f);
+
+        if (!terrain.Raycast(origin, down, 10.01f, hit) || fabsf(hit.distance - 10.0f) > MAX_HIT_HEIGHT_ERROR ||
+            hit.position.x != x || hit.position.z != z || !IsOnSurface(terrain, hit))
+            ++wrongVertical;
+
+        if (terrain.Raycast(origin, down, 9.99f, hit) || terrain.Raycast(origin, down, 0.0f, hit))
+            ++wrongVertical;
+
+        // From below the ground a ray going up hits it where it comes out, one going down doesn't hit anything.
+        DirectX::XMFLOAT3 const below(x, height - 2.0f, z);
+        if (!terrain.Raycast(below, DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f), MAX_RAY_DISTANCE, hit) || fabsf(hit.distance - 2.0f) > MAX_HIT_HEIGHT_ERROR)
+            ++wrongVertical;
+
+        if (terrain.Raycast(below, down, MAX_RAY_DISTANCE, hit))
+            ++wrongVertical;
+    }
+
+    TEST_CHECK(context, wrongVertical == 0);
+
+    // Rays that miss the grid, point away from it or have no direction at all.
+    TEST_CHECK(context, !terrain.Raycast(DirectX::XMFLOAT3(-10.0f, 50.0f, 10.0f), DirectX::XMFLOAT3(0.0f, -1.0f, 0.0f), MAX_RAY_DISTANCE, hit));
+    TEST_CHECK(context, !terrain.Raycast(DirectX::XMFLOAT3(-10.0f, 500.0f, 10.0f), DirectX::XMFLOAT3(-1.0f, -0.1f, 0.0f), MAX_RAY_DISTANCE, hit));
+    TEST_CHECK(context, !terrain.Raycast(DirectX::XMFLOAT3(100.0f, 500.0f, 100.0f), DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f), MAX_RAY_DISTANCE, hit));
+    TEST_CHECK(context, !hit.hit);
+
+    // The batched ray casts find the same hits as the single ones.
+    BuildRandomRays(terrain, random, 0.01f, 1.0f, RANDOM_RAYS, rays);
+
+    std::vector<DirectX::XMFLOAT3> origins, directions;
+    std::vector<float> maxDistances;
+    for (TestRay const& ray : rays)
+    {
+        origins.push_back(ray.origin);
+        directions.push_back(ray.direction);
+        maxDistances.push_back(MAX_RAY_DISTANCE);
+    }
+
+    std::vector<Terrain::RayHit> hits(rays.size());
+    int const batchHitCount = terrain.Raycast(origins.data(), directions.data(), maxDistances.data(), RANDOM_RAYS, hits.data());
+
+    int singleHitCount = 0, differentHits = 0;
+    for (int i = 0; i < RANDOM_RAYS; ++i)
+    {
+        bool const hasHit = terrain.Raycast(origins[i], directions[i], maxDistances[i], hit);
+        singleHitCount += hasHit ? 1 : 0;
+
+        if (hasHit != hits[i].hit || (hasHit && hit.distance != hits[i].distance))
+            ++differentHits;
+    }
+
+    TEST_CHECK(context, batchHitCount == singleHitCount);
+    TEST_CHECK(context, differentHits == 0);
+}
+
+void Tests::TerrainRaycastBenchmark(TestContext& context)
+{
+    Terrain terrain;
+    terrain.Initialize(context.GetDeviceContext());
+    if (!TEST_CHECK(context, terrain.GetVertices() != nullptr))
+        return;
+
+    // Rays like the picking and line of sight queries of a frame, most of them reach the ground within the distance.
+    std::mt19937 random(15);
+    std::vector<TestRay> rays;
+    BuildRandomRays(terrain, random, 0.05f, 2.0f, BENCHMARK_RAYS, rays);
+
+    std::vector<DirectX::XMFLOAT3> origins, directions;
+    std::vector<float> maxDistances(BENCHMARK_RAYS, MAX_RAY_DISTANCE);
+    std::vector<Terrain::RayHit> hits(BENCHMARK_RAYS);
+
+    for (TestRay const& ray : rays)
+    {
+        origins.push_back(ray.origin);
+        directions.push_back(ray.direction);
+    }
+
+    int hitCount = 0;
+
+    auto startTime = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCHMARK_RAY_ROUNDS; ++round)
+    {
+        for (int i = 0; i < BENCHMARK_RAYS; ++i)
+            hitCount += terrain.Raycast(origins[i], directions[i], maxDistances[i], hits[i]) ? 1 : 0;
+    }
+    float const singleTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+
+    startTime = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCHMARK_RAY_ROUNDS; ++round)
+        hitCount += terrain.Raycast(origins.data(), directions.data(), maxDistances.data(), BENCHMARK_RAYS, hits.data());
+    float const batchTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+
+    float const rayCount = static_cast<float>(BENCHMARK_RAYS) * BENCHMARK_RAY_ROUNDS;
+    Logger::Get()->info("Terrain ray casts: {:.2f} million rays/s one by one, {:.2f} million rays/s batched with {} task pool workers, {:.1f}% hit.",
+        rayCount / singleTime / 1e6f, rayCount / batchTime / 1e6f, TaskPool::Get().GetWorkerCount(), 50.0f * hitCount / rayCount);
+}
+
+void Tests::TerrainLoadBenchmark(TestContext& context)
+{
+    std::vector<DirectX::VertexPositionNormalColorDualTexture> coldVertices;
+    float coldTime = 0.0f, cachedTime = 0.0f;
+    int differentCount = 0;
+
+    // Every round loads the terrain once without the cache, which writes it again, and once from it.
+    for (int round = 0; round < LOAD_BENCHMARK_ROUNDS; ++round)
+    {
+        std::remove(TERRAIN_CACHE_FILE);
+
+        auto startTime = std::chrono::steady_clock::now();
+        {
+            Terrain terrain;
+            terrain.Initialize(context.GetDeviceContext());
+            coldTime += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+            if (!TEST_CHECK(context, terrain.GetVertices() != nullptr))
+                return;
+
+            coldVertices.assign(terrain.GetVertices(), terrain.GetVertices() + terrain.GetVertexCount());
+        }
+
+        if (!TEST_CHECK(context, std::ifstream(TERRAIN_CACHE_FILE, std::ios::binary).good()))
+            return;
+
+        startTime = std::chrono::steady_clock::now();
+        {
+            Terrain terrain;
+            terrain.Initialize(context.GetDeviceContext());
+            cachedTime += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+            // The cache holds the finished vertices, a cached load has to give the same ones bit for bit.
+            if (!TEST_CHECK(context, terrain.GetVertexCount() == static_cast<int>(coldVertices.size())))
+                return;
+
+            for (int i = 0; i < terrain.GetVertexCount(); ++i)
+            {
+                if (!IsSameVertex(terrain.GetVertices()[i], coldVertices[i]))
+                    ++differentCount;
+            }
+        }
+    }
+
+    TEST_CHECK(context, differentCount == 0);
+
+    Logger::Get()->info("Terrain load of {} vertices: {:.2f} ms without the cache, {:.2f} ms from the cache.",
+        coldVertices.size(), coldTime / LOAD_BENCHMARK_ROUNDS, cachedTime / LOAD_BENCHMARK_ROUNDS);
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+//
+// TestRunner.cpp
+//
+
+#include "pch.h"
+#include "TestRunner.h"
+
+namespace
+{
+    struct TestCase
+    {
+        char const* name;
+        void (*function)(TestContext& context);
+    };
+
+    TestCase const TEST_CASES[] =
+    {
+        { "TerrainCellLodSeams", Tests::TerrainCellLodSeams },
+        { "MD5ModelUpdateAllocations", Tests::MD5ModelUpdateAllocations },
+        { "MD5CacheSharing", Tests::MD5CacheSharing },
+        { "MD5ParseReference", Tests::MD5ParseReference },
+        { "MD5PrepareNormals", Tests::MD5PrepareNormals },
+        { "OctreeLodSeams", Tests::OctreeLodSeams },
+        { "FrustumBatchMatchesScalar", Tests::FrustumBatchMatchesScalar },
+        { "TerrainHeightEdits", Tests::TerrainHeightEdits },
+        { "TerrainVertexPackerRoundTrip", Tests::TerrainVertexPackerRoundTrip },
+        { "TerrainNormalsMatchScalar", Tests::TerrainNormalsMatchScalar },
+        { "TerrainRaycast", Tests::TerrainRaycast },
+        { "OctreeBuildMatchesFullScan", Tests::OctreeBuildMatchesFullScan },
+        { "OctreeBuildMatchesSerial", Tests::OctreeBuildMatchesSerial },
+        { "OctreeCollisionMatchesBruteForce", Tests::OctreeCollisionMatchesBruteForce },
+        { "DrawRangeMergerRanges", Tests::DrawRangeMergerRanges },
+        { "MD5AnimatorCrossfade", Tests::MD5AnimatorCrossfade },
+        { "MD5AnimatorLayers", Tests::MD5AnimatorLayers },
+        { "MD5SkinningReduceWeights", Tests::MD5SkinningReduceWeights },
+        { "MD5SkinningMatchesQuaternions", Tests::MD5SkinningMatchesQuaternions },
+        { "MD5SkinnedVertexShaderMatchesCPU", Tests::MD5SkinnedVertexShaderMatchesCPU },
+    };
+
+    TestCase const BENCHMARK_CASES[] =
+    {
+        { "MD5ModelUpdateBenchmark", Tests::MD5ModelUpdateBenchmark },
+        { "MD5ParseBenchmark", Tests::MD5ParseBenchmark },
+        { "MD5PrepareNormalsBenchmark", Tests::MD5PrepareNormalsBenchmark },
+        { "OctreeLodBenchmark", Tests::OctreeLodBenchmark },
+        { "FrustumBatchBenchmark", Tests::FrustumBatchBenchmark },
+        { "MD5AnimatorBenchmark", Tests::MD5AnimatorBenchmark },
+        { "TerrainVertexBuildBenchmark", Tests::TerrainVertexBuildBenchmark },
+        { "TerrainRaycastBenchmark", Tests::TerrainRaycastBenchmark },
+        { "OctreeBuildBenchmark", Tests::OctreeBuildBenchmark },
+        { "OctreeTraversalBenchmark", Tests::OctreeTraversalBenchmark },
+        { "OctreeTightBoundsBenchmark", Tests::OctreeTightBoundsBenchmark },
+        { "TerrainLoadBenchmark", Tests::TerrainLoadBenchmark },
+        { "MD5CookedLoadBenchmark", Tests::MD5CookedLoadBenchmark },
+    };
+
+    int RunCases(TestCase const* cases, size_t caseCount, ID3D11DeviceContext* deviceContext)
+    {
+        int failedCount = 0;
+
+        for (size_t i = 0; i < caseCount; ++i)
+        {
+            Logger::Get()->info("Running {}", cases[i].name);
+
+            TestContext context(deviceContext);
+            cases[i].function(context);
+
+            if (context.GetFailureCount() > 0)
+            {
+                Logger::Get()->error("{} failed with {} failed checks.", cases[i].name, context.GetFailureCount());
+                ++failedCount;
+            }
+        }
+
+        return failedCount;
+    }
+}
+
+bool TestContext::Check(bool condition, char const* expression, char const* file, int line)
+{
+    if (!condition)
+    {
+        Logger::Get()->error("Check failed: {} ({}:{})", expression, file, line);
+        ++m_failureCount;
+    }
+
+    return condition;
+}
+
+int Tests::RunAll(bool runBenchmarks)
+{
+    Microsoft::WRL::ComPtr<ID3D11Device> device;
+    Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext;
+
+    HRESULT const result = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_WARP, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION,
+        device.GetAddressOf(), nullptr, deviceContext.GetAddressOf());
+
+    if (FAILED(result))
+    {
+        Logger::Get()->error("Failed to create the WARP device for the tests.");
+        return 1;
+    }
+
+    int failedCount = RunCases(TEST_CASES, std::size(TEST_CASES), deviceContext.Get());
+    Logger::Get()->info("{} of {} tests passed.", std::size(TEST_CASES) - failedCount, std::size(TEST_CASES));
+
+    // The benchmarks share the device, the caches may hold resources of it.
+    if (runBenchmarks)
+        failedCount += RunCases(BENCHMARK_CASES, std::size(BENCHMARK_CASES), deviceContext.Get());
+
+    return failedCount;
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+//
+// TestRunner.h
+//
+
+#pragma once
+
+// Headless checks of the engine code, run with "Game.exe --run-tests" instead of the game from the Game directory, like
+// the game itself. The results go to the log and the process exits with the number of failed tests, so a build script
+// can run them after the build. "--run-benchmarks" runs the timings after the tests, they only log what they measure.
+class TestContext
+{
+    public:
+        explicit TestContext(ID3D11DeviceContext* deviceContext) : m_deviceContext(deviceContext), m_failureCount(0) {}
+
+        // A device on the WARP software rasterizer for the code that creates buffers, nothing is presented.
+        ID3D11DeviceContext* GetDeviceContext() const { return m_deviceContext; }
+
+        bool Check(bool condition, char const* expression, char const* file, int line);
+        int GetFailureCount() const { return m_failureCount; }
+
+    private:
+        ID3D11DeviceContext* m_deviceContext;
+        int m_failureCount;
+};
+
+#define TEST_CHECK(context, condition) (context).Check((condition), #condition, __FILE__, __LINE__)
+
+namespace Tests
+{
+    int RunAll(bool runBenchmarks);
+
+    // The tests and benchmarks, every one is added to its list in TestRunner.cpp.
+    void TerrainCellLodSeams(TestContext& context);
+    void MD5ModelUpdateAllocations(TestContext& context);
+    void MD5CacheSharing(TestContext& context);
+    void MD5ParseReference(TestContext& context);
+    void MD5PrepareNormals(TestContext& context);
+    void OctreeLodSeams(TestContext& context);
+    void FrustumBatchMatchesScalar(TestContext& context);
+    void TerrainHeightEdits(TestContext& context);
+    void TerrainVertexPackerRoundTrip(TestContext& context);
+    void TerrainNormalsMatchScalar(TestContext& context);
+    void TerrainRaycast(TestContext& context);
+    void OctreeBuildMatchesFullScan(TestContext& context);
+    void OctreeBuildMatchesSerial(TestContext& context);
+    void OctreeCollisionMatchesBruteForce(TestContext& context);
+    void DrawRangeMergerRanges(TestContext& context);
+    void MD5AnimatorCrossfade(TestContext& context);
+    void MD5AnimatorLayers(TestContext& context);
+    void MD5SkinningReduceWeights(TestContext& context);
+    void MD5SkinningMatchesQuaternions(TestContext& context);
+    void MD5SkinnedVertexShaderMatchesCPU(TestContext& context);
+
+    void MD5ModelUpdateBenchmark(TestContext& context);
+    void MD5ParseBenchmark(TestContext& context);
+    void MD5PrepareNormalsBenchmark(TestContext& context);
+    void OctreeLodBenchmark(TestContext& context);
+    void FrustumBatchBenchmark(TestContext& context);
+    void MD5AnimatorBenchmark(TestContext& context);
+    void TerrainVertexBuildBenchmark(TestContext& context);
+    void TerrainRaycastBenchmark(TestContext& context);
+    void OctreeBuildBenchmark(TestContext& context);
+    void OctreeTraversalBenchmark(TestContext& context);
+    void OctreeTightBoundsBenchmark(TestContext& context);
+    void TerrainLoadBenchmark(TestContext& context);
+    void MD5CookedLoadBenchmark(TestContext& context);
+}
\ No newline at end of file
@@ -0,0 +1,368 @@
+//
+// TriangleCollision.cpp
+//
+
+#include "pch.h"
+#include "TriangleCollision.h"
+
+namespace
+{
+    DirectX::XMFLOAT3 Add(DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b) { return DirectX::XMFLOAT3(a.x + b.x, a.y + b.y, a.z + b.z); }
+    DirectX::XMFLOAT3 Subtract(DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b) { return DirectX::XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z); }
+    DirectX::XMFLOAT3 Scale(DirectX::XMFLOAT3 const& a, float s) { return DirectX::XMFLOAT3(a.x * s, a.y * s, a.z * s); }
+    float Dot(DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b) { return (a.x * b.x) + (a.y * b.y) + (a.z * b.z); }
+
+    DirectX::XMFLOAT3 Cross(DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b)
+    {
+        return DirectX::XMFLOAT3((a.y * b.z) - (a.z * b.y), (a.z * b.x) - (a.x * b.z), (a.x * b.y) - (a.y * b.x));
+    }
+
+    float Clamp01(float value) { return std::min(std::max(value, 0.0f), 1.0f); }
+}
+
+DirectX::XMFLOAT3 TriangleCollision::ClosestPointOnTriangle(DirectX::XMFLOAT3 const& p, DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b, DirectX::XMFLOAT3 const& c)
+{
+    DirectX::XMFLOAT3 const ab = Subtract(b, a);
+    DirectX::XMFLOAT3 const ac = Subtract(c, a);
+    DirectX::XMFLOAT3 const ap = Subtract(p, a);
+
+    float const d1 = Dot(ab, ap);
+    float const d2 = Dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+
+    DirectX::XMFLOAT3 const bp = Subtract(p, b);
+    float const d3 = Dot(ab, bp);
+    float const d4 = Dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return b;
+
+    float const vc = (d1 * d4) - (d3 * d2);
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return Add(a, Scale(ab, d1 / (d1 - d3)));
+
+    DirectX::XMFLOAT3 const cp = Subtract(p, c);
+    float const d5 = Dot(ab, cp);
+    float const d6 = Dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return c;
+
+    float const vb = (d5 * d2) - (d1 * d6);
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return Add(a, Scale(ac, d2 / (d2 - d6)));
+
+    float const va = (d3 * d6) - (d5 * d4);
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return Add(b, Scale(Subtract(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+
+    // Inside the face, use the barycentric coordinates.
+    float const denominator = 1.0f / (va + vb + vc);
+    return Add(a, Add(Scale(ab, vb * denominator), Scale(ac, vc * denominator)));
+}
+
+float TriangleCollision::ClosestPointsOfSegments(DirectX::XMFLOAT3 const& p1, DirectX::XMFLOAT3 const& q1, DirectX::XMFLOAT3 const& p2, DirectX::XMFLOAT3 const& q2,
+    DirectX::XMFLOAT3& c1, DirectX::XMFLOAT3& c2)
+{
+    float const epsilon = 1.0e-8f;
+    float s, t;
+
+    DirectX::XMFLOAT3 const d1 = Subtract(q1, p1);
+    DirectX::XMFLOAT3 const d2 = Subtract(q2, p2);
+    DirectX::XMFLOAT3 const r = Subtract(p1, p2);
+    float const a = Dot(d1, d1);
+    float const e = Dot(d2, d2);
+    float const f = Dot(d2, r);
+
+    if (a <= epsilon && e <= epsilon)
+    {
+        s = t = 0.0f;
+    }
+    else if (a <= epsilon)
+    {
+        s = 0.0f;
+        t = Clamp01(f / e);
+    }
+    else
+    {
+        float const c = Dot(d1, r);
+        if (e <= epsilon)
+        {
+            t = 0.0f;
+            s = Clamp01(-c / a);
+        }
+        else
+        {
+            // Closest points of the lines, clamped to the first segment and then fixed up for the second one.
+            float const b = Dot(d1, d2);
+            float const denominator = (a * e) - (b * b);
+            s = denominator != 0.0f ? Clamp01(((b * f) - (c * e)) / denominator) : 0.0f;
+            t = ((b * s) + f) / e;
+
+            if (t < 0.0f)
+            {
+                t = 0.0f;
+                s = Clamp01(-c / a);
+            }
+            else if (t > 1.0f)
+            {
+                t = 1.0f;
+                s = Clamp01((b - c) / a);
+            }
+        }
+    }
+
+    c1 = Add(p1, Scale(d1, s));
+    c2 = Add(p2, Scale(d2, t));
+
+    DirectX::XMFLOAT3 const difference = Subtract(c1, c2);
+    return Dot(difference, difference);
+}
+
+bool TriangleCollision::IntersectSegmentTriangle(DirectX::XMFLOAT3 const& p, DirectX::XMFLOAT3 const& q, DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b, DirectX::XMFLOAT3 const& c,
+    DirectX::XMFLOAT3& point)
+{
+    DirectX::XMFLOAT3 const direction = Subtract(q, p);
+    DirectX::XMFLOAT3 const ab = Subtract(b, a);
+    DirectX::XMFLOAT3 const ac = Subtract(c, a);
+    DirectX::XMFLOAT3 const h = Cross(direction, ac);
+
+    float const determinant = Dot(ab, h);
+    if (determinant == 0.0f)
+        return false;
+
+    float const inverse = 1.0f / determinant;
+    DirectX::XMFLOAT3 const s = Subtract(p, a);
+    float const u = Dot(s, h) * inverse;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    DirectX::XMFLOAT3 const k = Cross(s, ab);
+    float const v = Dot(direction, k) * inverse;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    float const t = Dot(ac, k) * inverse;
+    if (t < 0.0f || t > 1.0f)
+        return false;
+
+    point = Add(p, Scale(direction, t));
+    return true;
+}
+
+float TriangleCollision::ClosestPointsOfSegmentTriangle(DirectX::XMFLOAT3 const& p, DirectX::XMFLOAT3 const& q, DirectX::XMFLOAT3 const* triangle,
+    DirectX::XMFLOAT3& onSegment, DirectX::XMFLOAT3& onTriangle)
+{
+    DirectX::XMFLOAT3 candidateSegment, candidateTriangle, difference;
+    float distance, nearest;
+
+    if (IntersectSegmentTriangle(p, q, triangle[0], triangle[1], triangle[2], onSegment))
+    {
+        onTriangle = onSegment;
+        return 0.0f;
+    }
+
+    // Otherwise the closest points are on an end of the segment or on an edge of the triangle.
+    onSegment = p;
+    onTriangle = ClosestPointOnTriangle(p, triangle[0], triangle[1], triangle[2]);
+    difference = Subtract(onSegment, onTriangle);
+    nearest = Dot(difference, difference);
+
+    candidateTriangle = ClosestPointOnTriangle(q, triangle[0], triangle[1], triangle[2]);
+    difference = Subtract(q, candidateTriangle);
+    distance = Dot(difference, difference);
+    if (distance < nearest)
+    {
+        nearest = distance;
+        onSegment = q;
+        onTriangle = candidateTriangle;
+    }
+
+    for (int edge = 0; edge < 3; ++edge)
+    {
+        distance = ClosestPointsOfSegments(p, q, triangle[edge], triangle[(edge + 1) % 3], candidateSegment, candidateTriangle);
+        if (distance < nearest)
+        {
+            nearest = distance;
+            onSegment = candidateSegment;
+            onTriangle = candidateTriangle;
+        }
+    }
+
+    return nearest;
+}
+
+bool TriangleCollision::TriangleOverlapsBox(DirectX::XMFLOAT3 const* triangle, DirectX::XMFLOAT3 const& extents)
+{
+    DirectX::XMFLOAT3 const edges[3] = { Subtract(triangle[1], triangle[0]), Subtract(triangle[2], triangle[1]), Subtract(triangle[0], triangle[2]) };
+    DirectX::XMFLOAT3 const boxAxes[3] = { DirectX::XMFLOAT3(1.0f, 0.0f, 0.0f), DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f), DirectX::XMFLOAT3(0.0f, 0.0f, 1.0f) };
+    DirectX::XMFLOAT3 axes[13];
+    int axisCount = 0;
+
+    // The axes of the box, the normal of the triangle and the cross products of their edges.
+    for (int i = 0; i < 3; ++i)
+        axes[axisCount++] = boxAxes[i];
+
+    axes[axisCount++] = Cross(edges[0], edges[1]);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+            axes[axisCount++] = Cross(boxAxes[i], edges[j]);
+    }
+
+    for (int i = 0; i < axisCount; ++i)
+    {
+        DirectX::XMFLOAT3 const& axis = axes[i];
+
+        float const p0 = Dot(triangle[0], axis);
+        float const p1 = Dot(triangle[1], axis);
+        float const p2 = Dot(triangle[2], axis);
+        float const radius = (extents.x * fabs(axis.x)) + (extents.y * fabs(axis.y)) + (extents.z * fabs(axis.z));
+
+        if (std::min(p0, std::min(p1, p2)) > radius || std::max(p0, std::max(p1, p2)) < -radius)
+            return false;
+    }
+
+    return true;
+}
+
+bool TriangleCollision::SweepPointSphere(DirectX::XMFLOAT3 const& o, DirectX::XMFLOAT3 const& d, DirectX::XMFLOAT3 const& center, float radius, float& time)
+{
+    DirectX::XMFLOAT3 const m = Subtract(o, center);
+    float const b = Dot(m, d);
+    float const c = Dot(m, m) - (radius * radius);
+
+    // Moving away or already inside, the overlap at the start is handled separately.
+    if (c <= 0.0f || b > 0.0f)
+        return false;
+
+    float const discriminant = (b * b) - c;
+    if (discriminant < 0.0f)
+        return false;
+
+    time = -b - sqrt(discriminant);
+    return true;
+}
+
+bool TriangleCollision::SweepPointCylinder(DirectX::XMFLOAT3 const& o, DirectX::XMFLOAT3 const& d, DirectX::XMFLOAT3 const& p, DirectX::XMFLOAT3 const& q, float radius, float& time)
+{
+    DirectX::XMFLOAT3 const axis = Subtract(q, p);
+    float const axisLength = Dot(axis, axis);
+    if (axisLength <= 0.0f)
+        return false;
+
+    // Remove the parts along the axis, what is left is a moving point against a circle.
+    DirectX::XMFLOAT3 const m = Subtract(o, p);
+    DirectX::XMFLOAT3 const mr = Subtract(m, Scale(axis, Dot(m, axis) / axisLength));
+    DirectX::XMFLOAT3 const dr = Subtract(d, Scale(axis, Dot(d, axis) / axisLength));
+
+    float const a = Dot(dr, dr);
+    float const b = Dot(mr, dr);
+    float const c = Dot(mr, mr) - (radius * radius);
+    if (a <= 1.0e-12f || c <= 0.0f || b > 0.0f)
+        return false;
+
+    float const discriminant = (b * b) - (a * c);
+    if (discriminant < 0.0f)
+        return false;
+
+    time = (-b - sqrt(discriminant)) / a;
+
+    // The contact has to be on the side of the segment, the ends are the spheres.
+    float const along = Dot(Add(m, Scale(d, time)), axis) / axisLength;
+    return along >= 0.0f && along <= 1.0f;
+}
+
+bool TriangleCollision::SweepCapsuleTriangle(DirectX::XMFLOAT3 const& p, DirectX::XMFLOAT3 const& q, float radius, DirectX::XMFLOAT3 const& d,
+    DirectX::XMFLOAT3 const* triangle, float& time)
+{
+    float candidate;
+    bool found = false;
+
+    auto const keep = [&](float t)
+    {
+        if (t >= 0.0f && t < time)
+        {
+            time = t;
+            found = true;
+        }
+    };
+
+    DirectX::XMFLOAT3 normal = Cross(Subtract(triangle[1], triangle[0]), Subtract(triangle[2], triangle[0]));
+    float const normalLength = sqrt(Dot(normal, normal));
+    if (normalLength > 0.0f)
+        normal = Scale(normal, 1.0f / normalLength);
+
+    DirectX::XMFLOAT3 const ends[2] = { p, q };
+    int const endCount = (p.x == q.x && p.y == q.y && p.z == q.z) ? 1 : 2;
+
+    // The ends of the capsule against the face, the edges and the corners of the triangle grown by the radius.
+    for (int i = 0; i < endCount; ++i)
+    {
+        DirectX::XMFLOAT3 const& o = ends[i];
+
+        float const distance = Dot(Subtract(o, triangle[0]), normal);
+        float const approach = Dot(d, normal);
+        if (normalLength > 0.0f && approach != 0.0f && distance * approach < 0.0f)
+        {
+            float const side = distance > 0.0f ? 1.0f : -1.0f;
+            float const t = (side * radius - distance) / approach;
+            DirectX::XMFLOAT3 const contact = Subtract(Add(o, Scale(d, t)), Scale(normal, side * radius));
+            DirectX::XMFLOAT3 const closest = ClosestPointOnTriangle(contact, triangle[0], triangle[1], triangle[2]);
+            DirectX::XMFLOAT3 const offset = Subtract(contact, closest);
+
+            if (Dot(offset, offset) <= 1.0e-8f)
+                keep(t);
+        }
+
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            if (SweepPointCylinder(o, d, triangle[corner], triangle[(corner + 1) % 3], radius, candidate))
+                keep(candidate);
+            if (SweepPointSphere(o, d, triangle[corner], radius, candidate))
+                keep(candidate);
+        }
+    }
+
+    // The corners of the triangle moving the other way against the side of the capsule.
+    DirectX::XMFLOAT3 const reverse = Scale(d, -1.0f);
+    for (int corner = 0; corner < 3; ++corner)
+    {
+        if (SweepPointCylinder(triangle[corner], reverse, p, q, radius, candidate))
+            keep(candidate);
+    }
+
+    // The side of the capsule against the edges of the triangle, the distance of two lines changes linearly when one moves.
+    DirectX::XMFLOAT3 const axis = Subtract(q, p);
+    for (int edge = 0; edge < 3; ++edge)
+    {
+        DirectX::XMFLOAT3 const& e0 = triangle[edge];
+        DirectX::XMFLOAT3 const& e1 = triangle[(edge + 1) % 3];
+
+        DirectX::XMFLOAT3 lineNormal = Cross(axis, Subtract(e1, e0));
+        float const lineNormalLength = sqrt(Dot(lineNormal, lineNormal));
+        if (lineNormalLength <= 1.0e-6f)
+            continue;
+
+        lineNormal = Scale(lineNormal, 1.0f / lineNormalLength);
+
+        float const distance = Dot(Subtract(p, e0), lineNormal);
+        float const approach = Dot(d, lineNormal);
+        if (approach == 0.0f || distance * approach >= 0.0f)
+            continue;
+
+        float const t = ((distance > 0.0f ? radius : -radius) - distance) / approach;
+        if (!(t >= 0.0f && t < time))
+            continue;
+
+        // The closest points of the lines at that time have to be inside both segments.
+        DirectX::XMFLOAT3 onCapsule, onEdge;
+        DirectX::XMFLOAT3 const moved = Scale(d, t);
+        float const distanceSquared = ClosestPointsOfSegments(Add(p, moved), Add(q, moved), e0, e1, onCapsule, onEdge);
+
+        if (distanceSquared <= radius * radius * 1.0001f + 1.0e-8f)
+            keep(t);
+    }
+
+    return found;
+}
\ No newline at end of file
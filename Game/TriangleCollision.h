@@ -0,0 +1,42 @@
+//
+// TriangleCollision.h
+//
+
+#pragma once
+
+// Distance, overlap and sweep tests of triangles against points, segments, boxes and capsules, the geometry of the
+// collision queries of the octree. The triangles are three corners in an array.
+class TriangleCollision
+{
+    public:
+        // Closest point of the triangle abc to p, by the Voronoi region of the triangle p is in.
+        static DirectX::XMFLOAT3 ClosestPointOnTriangle(DirectX::XMFLOAT3 const& p, DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b, DirectX::XMFLOAT3 const& c);
+
+        // Closest points of the segments p1q1 and p2q2, returns their squared distance.
+        static float ClosestPointsOfSegments(DirectX::XMFLOAT3 const& p1, DirectX::XMFLOAT3 const& q1, DirectX::XMFLOAT3 const& p2, DirectX::XMFLOAT3 const& q2,
+            DirectX::XMFLOAT3& c1, DirectX::XMFLOAT3& c2);
+
+        // Closest points of the segment pq and the triangle, returns their squared distance.
+        static float ClosestPointsOfSegmentTriangle(DirectX::XMFLOAT3 const& p, DirectX::XMFLOAT3 const& q, DirectX::XMFLOAT3 const* triangle,
+            DirectX::XMFLOAT3& onSegment, DirectX::XMFLOAT3& onTriangle);
+
+        // Separating axis test of a triangle and a box, the triangle is given relative to the center of the box.
+        static bool TriangleOverlapsBox(DirectX::XMFLOAT3 const* triangle, DirectX::XMFLOAT3 const& extents);
+
+        // Earliest time the capsule pq moving along the unit direction d touches the triangle, without an overlap at the start.
+        // Only times before the time passed in are found.
+        static bool SweepCapsuleTriangle(DirectX::XMFLOAT3 const& p, DirectX::XMFLOAT3 const& q, float radius, DirectX::XMFLOAT3 const& d,
+            DirectX::XMFLOAT3 const* triangle, float& time);
+
+    private:
+        // Finds where the segment pq passes through the triangle abc, from either side.
+        static bool IntersectSegmentTriangle(DirectX::XMFLOAT3 const& p, DirectX::XMFLOAT3 const& q, DirectX::XMFLOAT3 const& a, DirectX::XMFLOAT3 const& b,
+            DirectX::XMFLOAT3 const& c, DirectX::XMFLOAT3& point);
+
+        // Earliest time the point o moving along the unit direction d gets within radius of center.
+        static bool SweepPointSphere(DirectX::XMFLOAT3 const& o, DirectX::XMFLOAT3 const& d, DirectX::XMFLOAT3 const& center, float radius, float& time);
+
+        // Earliest time the point o moving along the unit direction d gets within radius of the side of the segment pq.
+        static bool SweepPointCylinder(DirectX::XMFLOAT3 const& o, DirectX::XMFLOAT3 const& d, DirectX::XMFLOAT3 const& p, DirectX::XMFLOAT3 const& q,
+            float radius, float& time);
+};
\ No newline at end of file
@@ -16,4 +16,12 @@ const D3D11_INPUT_ELEMENT_DESC VertexPositionNormalColorDualTexture::InputElemen
     { "TEXCOORD",    1, DXGI_FORMAT_R32G32_FLOAT,       0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 };
 
-static_assert(sizeof(VertexPositionNormalColorDualTexture) == 56, "Vertex struct/layout mismatch");
\ No newline at end of file
+static_assert(sizeof(VertexPositionNormalColorDualTexture) == 56, "Vertex struct/layout mismatch");
+
+const D3D11_INPUT_ELEMENT_DESC VertexTerrainPacked::InputElements[] =
+{
+    { "POSITION",    0, DXGI_FORMAT_R16G16B16A16_UINT,  0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    { "NORMAL",      0, DXGI_FORMAT_R16G16_SNORM,       0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+};
+
+static_assert(sizeof(VertexTerrainPacked) == 12, "Vertex struct/layout mismatch");
\ No newline at end of file
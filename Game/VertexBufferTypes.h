@@ -43,4 +43,19 @@ namespace DirectX
         static const int InputElementCount = 5;
         static const D3D11_INPUT_ELEMENT_DESC InputElements[InputElementCount];
     };
+
+    // Terrain vertex with the position as a grid index and a 16 bit height, and the normal octahedral encoded.
+    // The color is always white and the texture coordinates follow from the grid index, the shader derives them.
+    struct VertexTerrainPacked
+    {
+        uint16 gridX;
+        uint16 gridZ;
+        uint16 height;
+        uint16 padding;
+        int16 normalX;
+        int16 normalY;
+
+        static const int InputElementCount = 2;
+        static const D3D11_INPUT_ELEMENT_DESC InputElements[InputElementCount];
+    };
 }
\ No newline at end of file